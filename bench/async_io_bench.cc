@@ -0,0 +1,150 @@
+#include "bench.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "async_io.h"
+#include "job_system.h"
+
+static const int kRuns = 5;
+static const uint32_t kFileCount = 64;
+static const uint32_t kFileSize = 256 * 1024;
+
+static std::string fileName(uint32_t index)
+{
+  char name[64];
+  snprintf(name, sizeof(name), "async_io_bench_%u.bin", index);
+  return name;
+}
+
+static void readDone(const IoRead& read, int64_t result, void* user_data)
+{
+  if (result != (int64_t) read.size)
+  {
+    *(std::atomic<int>*) user_data = 1;
+  }
+}
+
+// One fopen and fread per file, what loose assets cost before AsyncIo
+static double benchSync(std::vector<uint8_t>* data)
+{
+  double best = 1e30;
+  for (int run = 0; run < kRuns; run++)
+  {
+    BenchTimer timer;
+    for (uint32_t i = 0; i < kFileCount; i++)
+    {
+      FILE* file = fopen(fileName(i).c_str(), "rb");
+      if (file == nullptr || fread(data->data() + (size_t) i * kFileSize, 1, kFileSize, file) != kFileSize)
+      {
+        printf("  synchronous read failed\n");
+        return 0.0;
+      }
+      fclose(file);
+    }
+
+    double elapsed = timer.elapsedMs();
+    best = elapsed < best ? elapsed : best;
+  }
+
+  return best;
+}
+
+// Every file opened, then all reads in one submission, as Assets::loadMany
+static double benchAsync(std::vector<uint8_t>* data)
+{
+  double best = 1e30;
+  for (int run = 0; run < kRuns; run++)
+  {
+    std::atomic<int> failed(0);
+    std::vector<IoFile> files(kFileCount);
+    std::vector<IoRead> reads(kFileCount);
+
+    BenchTimer timer;
+    for (uint32_t i = 0; i < kFileCount; i++)
+    {
+      if (!AsyncIo::openFile(fileName(i), &files[i]))
+      {
+        printf("  asynchronous open failed\n");
+        return 0.0;
+      }
+
+      reads[i].file = files[i];
+      reads[i].offset = 0;
+      reads[i].size = kFileSize;
+      reads[i].destination = data->data() + (size_t) i * kFileSize;
+      reads[i].callback = readDone;
+      reads[i].user_data = &failed;
+    }
+
+    AsyncIo::submit(reads.data(), kFileCount);
+    AsyncIo::waitIdle();
+
+    for (uint32_t i = 0; i < kFileCount; i++)
+    {
+      AsyncIo::closeFile(&files[i]);
+    }
+
+    double elapsed = timer.elapsedMs();
+    best = elapsed < best ? elapsed : best;
+
+    if (failed)
+    {
+      printf("  asynchronous read failed\n");
+      return 0.0;
+    }
+  }
+
+  return best;
+}
+
+// Files are written first so both sides read from the page cache, this
+// compares syscall and completion overhead, not the disk
+void benchAsyncIo()
+{
+  std::vector<uint8_t> expected((size_t) kFileCount * kFileSize);
+  for (size_t i = 0; i < expected.size(); i++)
+  {
+    expected[i] = (uint8_t) (i * 2654435761u >> 24);
+  }
+
+  for (uint32_t i = 0; i < kFileCount; i++)
+  {
+    FILE* file = fopen(fileName(i).c_str(), "wb");
+    if (file == nullptr)
+    {
+      printf("  failed creating %s\n", fileName(i).c_str());
+      return;
+    }
+    fwrite(expected.data() + (size_t) i * kFileSize, 1, kFileSize, file);
+    fclose(file);
+  }
+
+  JobSystem::init();
+  AsyncIo::init();
+  printf("  %s backend, %u files of %u KB\n", AsyncIo::backendName(), kFileCount, kFileSize / 1024);
+
+  double megabytes = (double) expected.size() / (1024.0 * 1024.0);
+  std::vector<uint8_t> data(expected.size());
+
+  double sync = benchSync(&data);
+  bool sync_valid = data == expected;
+
+  data.assign(data.size(), 0);
+  double async = benchAsync(&data);
+  bool async_valid = data == expected;
+
+  printf("  synchronous: %7.2f ms, %7.1f MB/s%s\n", sync, megabytes * 1000.0 / sync,
+    sync_valid ? "" : ", WRONG DATA");
+  printf("  AsyncIo:     %7.2f ms, %7.1f MB/s%s\n", async, megabytes * 1000.0 / async,
+    async_valid ? "" : ", WRONG DATA");
+
+  AsyncIo::shutdown();
+  JobSystem::shutdown();
+
+  for (uint32_t i = 0; i < kFileCount; i++)
+  {
+    remove(fileName(i).c_str());
+  }
+}
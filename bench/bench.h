@@ -0,0 +1,29 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__ 1
+
+#include <stdio.h>
+
+#include <chrono>
+
+// Micro-benchmarks, run with the Bench project. Every suite prints its own
+// results, times are the best of a few runs to reduce noise.
+class BenchTimer
+{
+public:
+  BenchTimer() : _start(std::chrono::steady_clock::now()) { }
+
+  double elapsedMs() const
+  {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _start).count();
+  }
+
+private:
+  std::chrono::steady_clock::time_point _start;
+};
+
+void benchJobSystem();
+void benchSimd();
+void benchOcclusion();
+void benchAsyncIo();
+
+#endif // __BENCH_H__
@@ -0,0 +1,37 @@
+#include "bench.h"
+
+#include <string.h>
+
+struct BenchSuite
+{
+  const char* name;
+  void (*function)();
+};
+
+static const BenchSuite suites[] = {
+  { "jobs", benchJobSystem },
+  { "simd", benchSimd },
+  { "occlusion", benchOcclusion },
+  { "io", benchAsyncIo },
+};
+
+// Bench.exe [suite...], no arguments runs everything
+int main(int argc, char** argv)
+{
+  for (size_t i = 0; i < sizeof(suites) / sizeof(suites[0]); i++)
+  {
+    bool selected = argc < 2;
+    for (int j = 1; j < argc; j++)
+    {
+      selected |= strcmp(argv[j], suites[i].name) == 0;
+    }
+
+    if (selected)
+    {
+      printf("\n== %s ==\n", suites[i].name);
+      suites[i].function();
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,138 @@
+#include "bench.h"
+
+#include <math.h>
+
+#include <thread>
+#include <vector>
+
+#include "job_system.h"
+
+static const int kRuns = 5;
+
+static void emptyJob(void*) { }
+
+static void spinJob(void* data)
+{
+  volatile float* value = (volatile float*) data;
+  float x = *value;
+  for (int i = 0; i < 500; i++)
+  {
+    x = sqrtf(x * x + 1.0f);
+  }
+  *value = x;
+}
+
+// Cost of pushing, stealing and finishing jobs that do nothing
+static void benchOverhead()
+{
+  const uint32_t job_count = 4000;
+
+  double best = 1e30;
+  for (int run = 0; run < kRuns; run++)
+  {
+    BenchTimer timer;
+    for (uint32_t batch = 0; batch < 25; batch++)
+    {
+      JobCounter counter;
+      for (uint32_t i = 0; i < job_count; i++)
+      {
+        JobSystem::run(emptyJob, nullptr, &counter);
+      }
+      JobSystem::wait(&counter);
+    }
+
+    double elapsed = timer.elapsedMs();
+    best = elapsed < best ? elapsed : best;
+  }
+
+  printf("  empty jobs: %.1f ns/job\n", best * 1000000.0 / (job_count * 25.0));
+}
+
+// Chains of dependent groups, measures the release latency of counters
+static void benchDependencies()
+{
+  const uint32_t chain_length = 1000;
+
+  double best = 1e30;
+  for (int run = 0; run < kRuns; run++)
+  {
+    std::vector<JobCounter> counters(chain_length);
+
+    BenchTimer timer;
+    for (uint32_t i = 0; i < chain_length; i++)
+    {
+      JobSystem::run(emptyJob, nullptr, &counters[i], i > 0 ? &counters[i - 1] : nullptr);
+    }
+    JobSystem::wait(&counters[chain_length - 1]);
+
+    double elapsed = timer.elapsedMs();
+    best = elapsed < best ? elapsed : best;
+
+    // Earlier links may still be finishing
+    for (uint32_t i = 0; i < chain_length; i++)
+    {
+      JobSystem::wait(&counters[i]);
+    }
+  }
+
+  printf("  dependency chain: %.1f ns/link\n", best * 1000000.0 / chain_length);
+}
+
+// Same amount of work with an increasing number of workers
+static void benchScaling()
+{
+  const uint32_t item_count = 1 << 16;
+  std::vector<float> values(item_count, 1.0f);
+
+  uint32_t max_workers = std::thread::hardware_concurrency();
+  if (max_workers == 0)
+  {
+    max_workers = 1;
+  }
+
+  double single = 0.0;
+  for (uint32_t workers = 1; workers <= max_workers; workers *= 2)
+  {
+    JobSystem::init(workers);
+
+    double best = 1e30;
+    for (int run = 0; run < kRuns; run++)
+    {
+      BenchTimer timer;
+      JobSystem::parallelFor(item_count, 256, [&values](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++)
+        {
+          spinJob(&values[i]);
+        }
+      });
+
+      double elapsed = timer.elapsedMs();
+      best = elapsed < best ? elapsed : best;
+    }
+
+    JobSystem::shutdown();
+
+    if (workers == 1)
+    {
+      single = best;
+    }
+
+    printf("  parallelFor %2u workers: %8.2f ms, speedup %.2fx\n", workers, best, single / best);
+
+    if (workers < max_workers && workers * 2 > max_workers)
+    {
+      workers = max_workers / 2;
+    }
+  }
+}
+
+void benchJobSystem()
+{
+  JobSystem::init();
+  printf("  %u workers\n", JobSystem::workerCount());
+  benchOverhead();
+  benchDependencies();
+  JobSystem::shutdown();
+
+  benchScaling();
+}
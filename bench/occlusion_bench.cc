@@ -0,0 +1,154 @@
+#include "bench.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "glm/gtc/matrix_transform.hpp"
+
+#include "occlusion.h"
+#include "simd.h"
+
+static const int kRuns = 20;
+static const uint32_t kBufferWidth = 320;
+static const uint32_t kBufferHeight = 192;
+static const uint32_t kBuildingRows = 16;
+static const uint32_t kObjectCount = 10000;
+
+static const glm::vec3 cube_positions[8] = {
+  { 0.0f, 0.0f, 0.0f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 1.0f, 1.0f, 0.0f },
+  { 0.0f, 0.0f, 1.0f }, { 1.0f, 0.0f, 1.0f }, { 0.0f, 1.0f, 1.0f }, { 1.0f, 1.0f, 1.0f },
+};
+
+static const uint32_t cube_indices[36] = {
+  0, 2, 1, 1, 2, 3,
+  4, 5, 6, 5, 7, 6,
+  0, 1, 4, 1, 5, 4,
+  2, 6, 3, 3, 6, 7,
+  0, 4, 2, 2, 4, 6,
+  1, 3, 5, 3, 7, 5,
+};
+
+static float randomFloat(float low, float high)
+{
+  return low + (high - low) * (float) rand() / (float) RAND_MAX;
+}
+
+// A city block grid in front of the camera, small objects scattered
+// between and behind the buildings
+struct OcclusionBenchScene
+{
+  std::vector<glm::mat4> buildings;
+  std::vector<glm::vec3> bounds_min;
+  std::vector<glm::vec3> bounds_max;
+  glm::mat4 view_projection;
+};
+
+static void createScene(OcclusionBenchScene* scene)
+{
+  srand(1);
+
+  for (uint32_t row = 0; row < kBuildingRows; row++)
+  {
+    for (uint32_t column = 0; column < kBuildingRows; column++)
+    {
+      glm::vec3 position(-200.0f + column * 25.0f, 20.0f + row * 25.0f, 0.0f);
+      glm::vec3 size(randomFloat(12.0f, 20.0f), randomFloat(12.0f, 20.0f), randomFloat(15.0f, 40.0f));
+      scene->buildings.push_back(glm::scale(glm::translate(glm::mat4(1.0f), position), size));
+    }
+  }
+
+  glm::mat4 projection = glm::perspective(glm::radians(60.0f), kBufferWidth / (float) kBufferHeight, 0.1f, 1000.0f);
+  glm::mat4 view = glm::lookAt(glm::vec3(0.0f, -20.0f, 5.0f), glm::vec3(0.0f, 100.0f, 5.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+  scene->view_projection = projection * view;
+
+  // Only objects in the view, the frustum cull already removed the rest
+  while (scene->bounds_min.size() < kObjectCount)
+  {
+    glm::vec3 position(randomFloat(-200.0f, 200.0f), randomFloat(0.0f, 420.0f), randomFloat(0.0f, 10.0f));
+    glm::vec4 clip = scene->view_projection * glm::vec4(position, 1.0f);
+    if (clip.w <= 0.0f || fabsf(clip.x) > clip.w || fabsf(clip.y) > clip.w)
+    {
+      continue;
+    }
+
+    glm::vec3 extent(randomFloat(0.5f, 2.0f));
+    scene->bounds_min.push_back(position - extent);
+    scene->bounds_max.push_back(position + extent);
+  }
+}
+
+static void runLevel(const OcclusionBenchScene& scene, OcclusionBuffer* buffer, std::vector<uint8_t>* results)
+{
+  std::vector<uint32_t> objects;
+  double best_raster = 1e30, best_test = 1e30;
+  for (int run = 0; run < kRuns; run++)
+  {
+    BenchTimer raster_timer;
+    buffer->clear(scene.view_projection);
+    for (const glm::mat4& building : scene.buildings)
+    {
+      buffer->renderOccluder(building, cube_positions, 8, cube_indices, 36);
+    }
+    double raster = raster_timer.elapsedMs();
+
+    objects.resize(kObjectCount);
+    for (uint32_t i = 0; i < kObjectCount; i++)
+    {
+      objects[i] = i;
+    }
+
+    // Batched the way the renderer tests its visible list
+    BenchTimer test_timer;
+    buffer->filter(scene.bounds_min.data(), scene.bounds_max.data(), &objects);
+    double test = test_timer.elapsedMs();
+
+    best_raster = raster < best_raster ? raster : best_raster;
+    best_test = test < best_test ? test : best_test;
+  }
+
+  std::fill(results->begin(), results->end(), 0);
+  for (uint32_t object : objects)
+  {
+    (*results)[object] = 1;
+  }
+
+  const OcclusionStats& stats = buffer->stats();
+  printf("  %-6s %u triangles %.3f ms, %u boxes %.3f ms (%.1f ns/box), %u occluded\n",
+    Simd::levelName(Simd::level()), stats.triangles, best_raster, stats.objects_tested, best_test,
+    best_test * 1000000.0 / stats.objects_tested, stats.objects_occluded);
+}
+
+void benchOcclusion()
+{
+  OcclusionBenchScene scene;
+  createScene(&scene);
+
+  OcclusionBuffer buffer;
+  buffer.init(kBufferWidth, kBufferHeight);
+  printf("  %ux%u buffer, %u occluders\n", buffer.width(), buffer.height(), (uint32_t) scene.buildings.size());
+
+  std::vector<uint8_t> reference(kObjectCount), results(kObjectCount);
+
+  Simd::setLevel(kSimdLevel_Scalar);
+  runLevel(scene, &buffer, &reference);
+
+  if (Simd::setLevel(kSimdLevel_AVX2))
+  {
+    runLevel(scene, &buffer, &results);
+
+    uint32_t differences = 0;
+    for (uint32_t i = 0; i < kObjectCount; i++)
+    {
+      differences += results[i] != reference[i] ? 1 : 0;
+    }
+    if (differences > 0)
+    {
+      printf("  AVX2 differs from scalar on %u boxes\n", differences);
+    }
+  }
+
+  Simd::setFastest();
+}
@@ -0,0 +1,263 @@
+#include "bench.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "glm/gtc/matrix_transform.hpp"
+
+#include "simd.h"
+
+static const int kRuns = 5;
+static const uint32_t kObjectCount = 1 << 20;
+
+// Few objects many times stays in cache and measures the arithmetic, all
+// of them once measures what memory bandwidth leaves of it
+struct SimdBenchSize
+{
+  uint32_t count;
+  uint32_t repeats;
+};
+
+static const SimdBenchSize sizes[] = {
+  { 4096, 256 },
+  { kObjectCount, 1 },
+};
+
+struct SimdBenchData
+{
+  std::vector<glm::vec3> positions;
+  std::vector<glm::quat> rotations;
+  std::vector<glm::vec3> scales;
+  std::vector<glm::vec4> spheres;
+
+  std::vector<glm::mat4> worlds;
+  std::vector<glm::mat4> clips;
+  std::vector<glm::vec4> world_spheres;
+
+  glm::mat4 view_projection;
+};
+
+static float randomFloat(float low, float high)
+{
+  return low + (high - low) * (float) rand() / (float) RAND_MAX;
+}
+
+static void fillData(SimdBenchData* data)
+{
+  srand(1);
+
+  data->positions.resize(kObjectCount);
+  data->rotations.resize(kObjectCount);
+  data->scales.resize(kObjectCount);
+  data->spheres.resize(kObjectCount);
+
+  for (uint32_t i = 0; i < kObjectCount; i++)
+  {
+    data->positions[i] = glm::vec3(randomFloat(-100.0f, 100.0f), randomFloat(-100.0f, 100.0f), randomFloat(-100.0f, 100.0f));
+    glm::vec3 axis = glm::normalize(glm::vec3(randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f), 1.0f));
+    data->rotations[i] = glm::angleAxis(randomFloat(0.0f, 6.28f), axis);
+    data->scales[i] = glm::vec3(randomFloat(0.5f, 2.0f), randomFloat(0.5f, 2.0f), randomFloat(0.5f, 2.0f));
+    data->spheres[i] = glm::vec4(randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f), randomFloat(0.5f, 2.0f));
+  }
+
+  data->worlds.resize(kObjectCount);
+  data->clips.resize(kObjectCount);
+  data->world_spheres.resize(kObjectCount);
+
+  glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+  glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 50.0f, 200.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  data->view_projection = projection * view;
+}
+
+// What the scene did before the kernels, one object at a time with glm
+static void runScalar(SimdBenchData* data, const SimdBenchSize& size, double* times)
+{
+  {
+    BenchTimer timer;
+    for (uint32_t repeat = 0; repeat < size.repeats; repeat++)
+    {
+      for (uint32_t i = 0; i < size.count; i++)
+      {
+        glm::mat3 rotation = glm::mat3_cast(data->rotations[i]);
+        const glm::vec3& scale = data->scales[i];
+        data->worlds[i] = glm::mat4(
+          glm::vec4(rotation[0] * scale.x, 0.0f),
+          glm::vec4(rotation[1] * scale.y, 0.0f),
+          glm::vec4(rotation[2] * scale.z, 0.0f),
+          glm::vec4(data->positions[i], 1.0f));
+      }
+    }
+    times[0] = timer.elapsedMs();
+  }
+
+  {
+    BenchTimer timer;
+    for (uint32_t repeat = 0; repeat < size.repeats; repeat++)
+    {
+      for (uint32_t i = 0; i < size.count; i++)
+      {
+        data->clips[i] = data->view_projection * data->worlds[i];
+      }
+    }
+    times[1] = timer.elapsedMs();
+  }
+
+  {
+    BenchTimer timer;
+    for (uint32_t repeat = 0; repeat < size.repeats; repeat++)
+    {
+      for (uint32_t i = 0; i < size.count; i++)
+      {
+        const glm::mat4& world = data->worlds[i];
+        const glm::vec4& sphere = data->spheres[i];
+        glm::vec3 x(world[0]), y(world[1]), z(world[2]);
+        float scale = glm::max(glm::dot(x, x), glm::max(glm::dot(y, y), glm::dot(z, z)));
+        data->world_spheres[i] = glm::vec4(glm::vec3(world * glm::vec4(glm::vec3(sphere), 1.0f)), sphere.w * sqrtf(scale));
+      }
+    }
+    times[2] = timer.elapsedMs();
+  }
+}
+
+static void runKernels(SimdBenchData* data, const SimdBenchSize& size, double* times)
+{
+  {
+    BenchTimer timer;
+    for (uint32_t repeat = 0; repeat < size.repeats; repeat++)
+    {
+      Simd::composeTransforms(data->positions.data(), data->rotations.data(), data->scales.data(), size.count, data->worlds.data());
+    }
+    times[0] = timer.elapsedMs();
+  }
+
+  {
+    BenchTimer timer;
+    for (uint32_t repeat = 0; repeat < size.repeats; repeat++)
+    {
+      Simd::multiplyMatrices(data->view_projection, data->worlds.data(), size.count, data->clips.data());
+    }
+    times[1] = timer.elapsedMs();
+  }
+
+  {
+    BenchTimer timer;
+    for (uint32_t repeat = 0; repeat < size.repeats; repeat++)
+    {
+      Simd::transformSpheres(data->worlds.data(), data->spheres.data(), size.count, data->world_spheres.data());
+    }
+    times[2] = timer.elapsedMs();
+  }
+}
+
+// Largest difference against the glm results, relative to the magnitude
+template<typename T>
+static float maxError(const T* values, const T* reference, uint32_t count)
+{
+  const uint32_t components = sizeof(T) / sizeof(float);
+
+  float error = 0.0f;
+  for (uint32_t i = 0; i < count; i++)
+  {
+    const float* value = (const float*) &values[i];
+    const float* expected = (const float*) &reference[i];
+    for (uint32_t j = 0; j < components; j++)
+    {
+      float difference = fabsf(value[j] - expected[j]) / glm::max(1.0f, fabsf(expected[j]));
+      error = difference > error ? difference : error;
+    }
+  }
+  return error;
+}
+
+static void printTimes(const char* name, const SimdBenchSize& size, const double* times, const double* baseline)
+{
+  double objects = (double) size.count * size.repeats;
+  printf("    %-6s compose %5.2f ns, multiply %5.2f ns, spheres %5.2f ns",
+    name,
+    times[0] * 1000000.0 / objects,
+    times[1] * 1000000.0 / objects,
+    times[2] * 1000000.0 / objects);
+
+  if (baseline)
+  {
+    printf("  (%.1fx, %.1fx, %.1fx)", baseline[0] / times[0], baseline[1] / times[1], baseline[2] / times[2]);
+  }
+  printf("\n");
+}
+
+static void benchSize(SimdBenchData* data, const SimdBenchSize& size)
+{
+  printf("  %u objects x %u, ns/object\n", size.count, size.repeats);
+
+  double scalar[3] = { 1e30, 1e30, 1e30 };
+  for (int run = 0; run < kRuns; run++)
+  {
+    double times[3];
+    runScalar(data, size, times);
+    for (int j = 0; j < 3; j++)
+    {
+      scalar[j] = times[j] < scalar[j] ? times[j] : scalar[j];
+    }
+  }
+  printTimes("glm", size, scalar, nullptr);
+
+  std::vector<glm::mat4> reference_worlds(data->worlds.begin(), data->worlds.begin() + size.count);
+  std::vector<glm::mat4> reference_clips(data->clips.begin(), data->clips.begin() + size.count);
+  std::vector<glm::vec4> reference_spheres(data->world_spheres.begin(), data->world_spheres.begin() + size.count);
+
+  // Every level forced in turn, then the fastest one per kernel
+  const SimdLevel levels[] = { kSimdLevel_Scalar, kSimdLevel_SSE2, kSimdLevel_AVX2 };
+  for (uint32_t i = 0; i <= sizeof(levels) / sizeof(levels[0]); i++)
+  {
+    bool fastest = i == sizeof(levels) / sizeof(levels[0]);
+    if (fastest)
+    {
+      Simd::setFastest();
+    }
+    else if (!Simd::setLevel(levels[i]))
+    {
+      continue;
+    }
+    const char* name = fastest ? "auto" : Simd::levelName(levels[i]);
+
+    double best[3] = { 1e30, 1e30, 1e30 };
+    for (int run = 0; run < kRuns; run++)
+    {
+      double times[3];
+      runKernels(data, size, times);
+      for (int j = 0; j < 3; j++)
+      {
+        best[j] = times[j] < best[j] ? times[j] : best[j];
+      }
+    }
+    printTimes(name, size, best, scalar);
+
+    float error = glm::max(maxError(data->worlds.data(), reference_worlds.data(), size.count),
+      glm::max(maxError(data->clips.data(), reference_clips.data(), size.count),
+        maxError(data->world_spheres.data(), reference_spheres.data(), size.count)));
+    if (error > 1e-4f)
+    {
+      printf("    %s differs from glm by %g\n", name, error);
+    }
+  }
+}
+
+void benchSimd()
+{
+  SimdBenchData data;
+  fillData(&data);
+
+  printf("  detected %s, fastest", Simd::levelName(Simd::level()));
+  for (uint32_t kernel = 0; kernel < kSimdKernel_Count; kernel++)
+  {
+    printf(" %s %s", Simd::kernelName((SimdKernel) kernel), Simd::levelName(Simd::kernelLevel((SimdKernel) kernel)));
+  }
+  printf("\n");
+
+  for (const SimdBenchSize& size : sizes)
+  {
+    benchSize(&data, size);
+  }
+}
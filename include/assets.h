@@ -0,0 +1,65 @@
+#ifndef __ASSETS_H__
+#define __ASSETS_H__ 1
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// Read only asset contents. Points into the mounted pack when the entry is
+// stored uncompressed, otherwise owns the decompressed bytes or the bytes
+// read from the loose file.
+class Asset
+{
+public:
+  Asset();
+
+  Asset(Asset&& other);
+  Asset& operator=(Asset&& other);
+
+  bool valid() const { return _data != nullptr; }
+  const uint8_t* data() const { return _data; }
+  size_t size() const { return _size; }
+
+private:
+  friend class Assets;
+
+  Asset(const Asset&);
+  Asset& operator=(const Asset&);
+
+  const uint8_t* _data = nullptr;
+  size_t _size = 0;
+  std::vector<uint64_t> _storage;
+};
+
+// Asset lookup by name, e.g. "shaders/vert.spv". Names are searched in the
+// mounted pack first and then as loose files under the root, so a missing
+// or stale pack never breaks development builds.
+class Assets
+{
+public:
+  // Maps the pack built by tools/packer, startup I/O is this single open
+  static int mount(const std::string& pack_file);
+  static void unmount();
+
+  // Prefix for loose files, "../../" by default
+  static void setRoot(const std::string& root);
+  static const std::string& root();
+
+  // Loose files that changed while running, e.g. reported by a file
+  // watcher, take precedence over the pack from then on
+  static void markChanged(const std::string& name);
+
+  static int load(const std::string& name, Asset* asset);
+  // Reads every loose file in one AsyncIo batch, then decompresses the
+  // pack entries in parallel on the job system
+  static int loadMany(const char* const* names, uint32_t count, Asset* assets);
+
+private:
+  Assets();
+
+  // Of names[indices[i]] into assets[indices[i]], waits for the reads
+  static int readLoose(const char* const* names, const uint32_t* indices, uint32_t count, Asset* assets);
+};
+
+#endif // __ASSETS_H__
@@ -0,0 +1,59 @@
+#ifndef __ASYNC_IO_H__
+#define __ASYNC_IO_H__ 1
+
+#include <stdint.h>
+
+#include <string>
+
+struct IoFile
+{
+  // fd on Linux, HANDLE on Windows, -1 when not open
+  intptr_t handle = -1;
+  uint64_t size = 0;
+};
+
+struct IoRead;
+
+// result is the number of bytes read, short only at the end of the file,
+// or negative on failure
+typedef void (*IoCallback)(const IoRead& read, int64_t result, void* user_data);
+
+struct IoRead
+{
+  IoFile file;
+  uint64_t offset;
+  uint32_t size;
+  // Any memory that stays valid until the callback, mapped staging
+  // buffers included, so data lands where the GPU copies it from
+  void* destination;
+  IoCallback callback;
+  void* user_data;
+};
+
+// Asynchronous file reads. On Linux reads go through io_uring, batches are
+// queued in the submission ring and sent with a single syscall, a reaper
+// thread collects completions. Elsewhere, or when io_uring is missing, a
+// small thread pool issues positional reads. Either way callbacks run on
+// job system workers, never on the thread that submitted.
+class AsyncIo
+{
+public:
+  // queue_depth caps reads in flight, the rest wait in a queue
+  static int init(uint32_t queue_depth = 64);
+  static void shutdown();
+
+  static const char* backendName();
+
+  static int openFile(const std::string& file_name, IoFile* file);
+  static void closeFile(IoFile* file);
+
+  // Never blocks on the disk
+  static void submit(const IoRead* reads, uint32_t count);
+  // Waits until every read submitted so far has run its callback
+  static void waitIdle();
+
+private:
+  AsyncIo();
+};
+
+#endif // __ASYNC_IO_H__
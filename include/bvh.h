@@ -0,0 +1,129 @@
+#ifndef __BVH_H__
+#define __BVH_H__ 1
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "simd.h"
+
+class Scene;
+
+// Planes with their normals pointing inside, taken from a clip matrix
+struct Frustum
+{
+  glm::vec4 planes[6];
+
+  void setMatrix(const glm::mat4& clip);
+};
+
+struct BvhStats
+{
+  // Nodes whose children were tested against the frustum
+  uint32_t nodes_visited = 0;
+  // Leaves whose objects were tested one by one
+  uint32_t leaves_visited = 0;
+  uint32_t objects_visible = 0;
+  uint32_t objects_culled = 0;
+  bool rebuilt = false;
+};
+
+// Bounding volume hierarchy over the scene world bounds, four children per
+// node so one node is tested with a single SIMD frustum test.
+//
+// Moving objects only refit the boxes, which keeps the topology but lets
+// the boxes grow and overlap. The tree is rebuilt with the surface area
+// heuristic when its cost grew too much, or periodically when it grew at
+// all, and whenever the scene dense indices changed.
+class Bvh
+{
+public:
+  // Call after Scene::updateTransforms
+  void update(const Scene& scene);
+  // Dense indices of the objects in the frustum, the top of the tree is
+  // split in subtrees that are traversed on the job system
+  void cull(const Frustum& frustum, std::vector<uint32_t>* visible);
+
+  // Of the last update and cull
+  const BvhStats& stats() const { return _stats; }
+  uint32_t nodeCount() const { return (uint32_t) _nodes.size(); }
+  uint32_t leafCount() const { return (uint32_t) _leaves.size(); }
+  // Surface area cost relative to the root, lower is better
+  float cost() const { return _cost; }
+
+private:
+  static const uint32_t kLeafSize = 4;
+  static const uint32_t kLeafFlag = 0x80000000;
+  static const uint32_t kEmptyChild = UINT32_MAX;
+
+  struct Node
+  {
+    BoxLanes bounds;
+    // Node index, leaf index with kLeafFlag or kEmptyChild
+    uint32_t children[4];
+  };
+
+  struct Leaf
+  {
+    BoxLanes bounds;
+    uint32_t objects[kLeafSize];
+    uint32_t count;
+  };
+
+  // Subtree to traverse, inside ones are accepted without tests
+  struct Task
+  {
+    uint32_t child;
+    bool inside;
+  };
+
+  struct Range
+  {
+    uint32_t begin;
+    uint32_t end;
+  };
+
+  // Everything a split reads, so the build streams one array
+  struct BuildItem
+  {
+    glm::vec3 center;
+    uint32_t object;
+    glm::vec3 bounds_min;
+    glm::vec3 bounds_max;
+  };
+
+  void build(const Scene& scene);
+  uint32_t buildNode(uint32_t begin, uint32_t end);
+  // Partitions the range around its best surface area split
+  uint32_t split(uint32_t begin, uint32_t end);
+  void refit(const Scene& scene);
+  void refitLeaf(Leaf* leaf, const glm::vec3* bounds_min, const glm::vec3* bounds_max);
+  float surfaceCost() const;
+
+  void traverse(const Frustum& frustum, Task task, std::vector<uint32_t>* visible, BvhStats* stats) const;
+  void accept(uint32_t child, std::vector<uint32_t>* visible) const;
+  // Classifies the children of an intersecting node and queues them
+  void expand(const Frustum& frustum, uint32_t node, std::vector<Task>* tasks, BvhStats* stats) const;
+
+  std::vector<Node> _nodes;
+  std::vector<Leaf> _leaves;
+
+  // Permuted in place by the splits
+  std::vector<BuildItem> _items;
+
+  uint32_t _object_count = 0;
+  uint32_t _layout_version = 0;
+  float _built_cost = 0.0f;
+  float _cost = 0.0f;
+  uint32_t _refits = 0;
+
+  std::vector<Task> _tasks;
+  std::vector<std::vector<uint32_t>> _task_visible;
+  std::vector<BvhStats> _task_stats;
+
+  BvhStats _stats;
+};
+
+#endif // __BVH_H__
@@ -0,0 +1,64 @@
+#ifndef __CLOCK_H__
+#define __CLOCK_H__ 1
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+enum ClockMode {
+  kClockMode_RealTime = 0,
+  kClockMode_FixedStep,
+  kClockMode_Replay
+};
+
+// Simulation time source. Real time follows the wall clock, fixed step
+// advances a constant delta per tick and replay feeds back the times and
+// deltas recorded from a previous real time run, so frame N always sees
+// the same simulation time, bit for bit.
+class Clock
+{
+public:
+  Clock();
+  ~Clock();
+
+  void initRealTime();
+  void initFixedStep(double step_seconds);
+  int initReplay(const std::string& file_name);
+
+  // Stores the time and delta of every frame so the run can be replayed
+  int startRecording(const std::string& file_name);
+
+  // Frames per second as "60", "29.97" or "30000/1001", reduced to a
+  // fraction. Fails on anything that is not a positive rate.
+  static int parseRate(const char* text, uint32_t* numerator, uint32_t* denominator);
+
+  void tick();
+
+  ClockMode mode() const { return _mode; }
+  double time() const { return _time; }
+  double delta() const { return _delta; }
+  uint64_t frame() const { return _frame; }
+
+private:
+  typedef std::chrono::steady_clock SteadyClock;
+
+  ClockMode _mode = kClockMode_RealTime;
+
+  double _time = 0.0;
+  double _delta = 0.0;
+  uint64_t _frame = 0;
+
+  double _step = 0.0;
+  bool _started = false;
+  SteadyClock::time_point _start;
+  SteadyClock::time_point _last;
+
+  std::vector<double> _replay_times;
+  std::vector<double> _replay_deltas;
+  FILE* _record_file = nullptr;
+};
+
+#endif // __CLOCK_H__
@@ -0,0 +1,141 @@
+#ifndef __CLUSTER_CULLER_H__
+#define __CLUSTER_CULLER_H__ 1
+
+#include <stdint.h>
+
+#include "vulkan/vulkan.h"
+#include "glm/glm.hpp"
+
+#include "bvh.h"
+
+class GeometryArena;
+class LayoutCache;
+class OcclusionBuffer;
+struct GeometryRange;
+
+struct ClusterStats
+{
+  // Objects drawn through their clusters
+  uint32_t objects = 0;
+  uint32_t clusters = 0;
+  uint32_t clusters_visible = 0;
+  // Rasterized after cluster culling, and what drawing the same objects
+  // whole would have rasterized
+  uint64_t triangles = 0;
+  uint64_t whole_triangles = 0;
+};
+
+// GPU culling of the clusters of dense meshes (see MeshCluster). Objects
+// whose finest level has clusters are added every frame, a compute pass
+// tests every cluster against the frustum, its backface cone and the tile
+// depths of the occlusion buffer, and writes the triangles of the visible
+// ones into a shared index buffer. Each object then has an indexed
+// indirect draw over its part of that buffer, using the vertex streams of
+// the geometry arena, so no vertex is fetched for a culled cluster.
+//
+// The pass needs shaders/cluster_cull.spv, without it the culler stays
+// disabled and objects are drawn whole. Buffers are not double buffered,
+// one frame may be in flight.
+class ClusterCuller
+{
+public:
+  static const uint32_t kMaxObjects = 4096;
+  static const uint32_t kMaxIndices = 1 << 22;
+  static const uint32_t kMaxTiles = 4096;
+
+  // Only fails on Vulkan errors, a missing shader just leaves it disabled
+  int init(VkPhysicalDevice physical_device, VkDevice device, LayoutCache& layouts, const GeometryArena& geometry);
+  void release();
+  bool enabled() const { return _pipeline != VK_NULL_HANDLE; }
+
+  // Reads the results of the previous frame, which must have completed,
+  // and starts a new object list
+  void begin(const glm::mat4& view_projection, const glm::vec3& view_position);
+  // Index of the draw of the object, UINT32_MAX when the lists are full
+  uint32_t add(const glm::mat4& model, const GeometryRange& range, uint32_t triangle_count);
+  // Optional, clusters behind the covered depth of every tile they touch
+  // are culled
+  void setOcclusion(const OcclusionBuffer& occlusion);
+
+  // Outside of a render pass, before the draws
+  void record(VkCommandBuffer command_buffer);
+  // Expects indexBuffer() bound with 32 bit indices
+  void draw(VkCommandBuffer command_buffer, uint32_t draw) const;
+  VkBuffer indexBuffer() const { return _index_buffer; }
+
+  // Of the last completed frame
+  const ClusterStats& stats() const { return _stats; }
+
+private:
+  // Layouts as cluster_cull.comp reads them
+  struct Params
+  {
+    glm::mat4 view_projection;
+    glm::vec4 planes[6];
+    glm::vec4 view_position;
+    uint32_t object_count;
+    uint32_t occlusion_width;
+    uint32_t occlusion_height;
+    uint32_t tiles_x;
+    uint32_t tiles_y;
+    uint32_t reserved[3];
+  };
+
+  struct Object
+  {
+    glm::mat4 model;
+    uint32_t cluster_offset;
+    uint32_t cluster_count;
+    uint32_t index_offset;
+    // Negative when the scale is not uniform, which skips the cone test
+    float scale;
+  };
+
+  struct DrawHeader
+  {
+    uint32_t clusters_visible;
+    uint32_t reserved[3];
+  };
+
+  int createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+    VkBuffer* buffer, VkDeviceMemory* memory, void** mapped);
+  int createDescriptors(const GeometryArena& geometry);
+
+  VkPhysicalDevice _physical_device = VK_NULL_HANDLE;
+  VkDevice _device = VK_NULL_HANDLE;
+
+  // Owned by the layout cache, built from the reflected shader
+  VkDescriptorSetLayout _descriptor_layout = VK_NULL_HANDLE;
+  VkPipelineLayout _pipeline_layout = VK_NULL_HANDLE;
+  VkPipeline _pipeline = VK_NULL_HANDLE;
+  VkDescriptorPool _descriptor_pool = VK_NULL_HANDLE;
+  VkDescriptorSet _descriptor_set = VK_NULL_HANDLE;
+
+  // Host visible and mapped, except the indices which only the GPU uses
+  VkBuffer _params_buffer = VK_NULL_HANDLE;
+  VkBuffer _object_buffer = VK_NULL_HANDLE;
+  VkBuffer _draw_buffer = VK_NULL_HANDLE;
+  VkBuffer _tile_buffer = VK_NULL_HANDLE;
+  VkBuffer _index_buffer = VK_NULL_HANDLE;
+  VkDeviceMemory _params_memory = VK_NULL_HANDLE;
+  VkDeviceMemory _object_memory = VK_NULL_HANDLE;
+  VkDeviceMemory _draw_memory = VK_NULL_HANDLE;
+  VkDeviceMemory _tile_memory = VK_NULL_HANDLE;
+  VkDeviceMemory _index_memory = VK_NULL_HANDLE;
+  Params* _params = nullptr;
+  Object* _objects = nullptr;
+  DrawHeader* _draw_header = nullptr;
+  VkDrawIndexedIndirectCommand* _draws = nullptr;
+  float* _tile_depths = nullptr;
+
+  // Of the frame being built, read back by the next begin once recorded
+  uint32_t _object_count = 0;
+  uint32_t _index_count = 0;
+  uint32_t _max_clusters = 0;
+  uint32_t _cluster_count = 0;
+  uint64_t _whole_triangles = 0;
+  bool _recorded = false;
+  ClusterStats _stats;
+};
+
+#endif // __CLUSTER_CULLER_H__
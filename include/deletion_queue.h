@@ -0,0 +1,64 @@
+#ifndef __DELETION_QUEUE_H__
+#define __DELETION_QUEUE_H__ 1
+
+#include <stdint.h>
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "gpu_timeline.h"
+
+// Defers destroying Vulkan objects until the GPU is done with them. Every
+// object is released with the timeline value of the last submission that
+// used it and destroyed by collect() once the timeline passes that value,
+// so replacing resources never needs the device idle.
+//
+// Entries are destroyed in release order, an entry released with an older
+// value than the ones before it waits for them, it is never destroyed early.
+class DeletionQueue
+{
+public:
+  void init(VkDevice device, GpuTimeline* timeline);
+
+  void destroyBuffer(VkBuffer buffer, uint64_t value);
+  void destroyImage(VkImage image, uint64_t value);
+  void destroyImageView(VkImageView image_view, uint64_t value);
+  void destroyFramebuffer(VkFramebuffer framebuffer, uint64_t value);
+  void destroyPipeline(VkPipeline pipeline, uint64_t value);
+  void destroyPipelineLayout(VkPipelineLayout pipeline_layout, uint64_t value);
+  void destroyRenderPass(VkRenderPass render_pass, uint64_t value);
+  void destroyShaderModule(VkShaderModule shader_module, uint64_t value);
+  void destroySwapchain(VkSwapchainKHR swapchain, uint64_t value);
+  void freeMemory(VkDeviceMemory memory, uint64_t value);
+  void freeCommandBuffers(VkCommandPool pool, const std::vector<VkCommandBuffer>& command_buffers, uint64_t value);
+
+  // Destroys everything the GPU has finished with, cheap when nothing is due
+  void collect();
+  // Waits for every pending value and destroys everything
+  void flush();
+
+  size_t pending();
+
+private:
+  struct Entry
+  {
+    VkObjectType type;
+    uint64_t handle;
+    // Command pool of command buffers
+    uint64_t owner;
+    uint64_t value;
+  };
+
+  void push(VkObjectType type, uint64_t handle, uint64_t owner, uint64_t value);
+  void destroy(const Entry& entry);
+
+  VkDevice _device = VK_NULL_HANDLE;
+  GpuTimeline* _timeline = nullptr;
+
+  std::mutex _mutex;
+  std::deque<Entry> _entries;
+};
+
+#endif // __DELETION_QUEUE_H__
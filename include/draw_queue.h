@@ -0,0 +1,95 @@
+#ifndef __DRAW_QUEUE_H__
+#define __DRAW_QUEUE_H__ 1
+
+#include <stdint.h>
+
+#include <vector>
+
+enum DrawPass
+{
+  kDrawPass_Opaque = 0,
+  kDrawPass_Transparent,
+};
+
+// One draw, everything the recorder binds is encoded in the key
+struct DrawPacket
+{
+  uint64_t key;
+  // Dense scene index of the object
+  uint32_t object;
+  // Level of detail of the mesh
+  uint32_t lod;
+  // Index buffer and index type the draw reads, an id the recorder maps to
+  // them. It binds them again when the id changes.
+  uint32_t index_binding;
+};
+
+// Bound state changes over a sequence of draws
+struct DrawStateStats
+{
+  uint32_t draws = 0;
+  uint32_t pipeline_binds = 0;
+  uint32_t descriptor_binds = 0;
+  // Meshes share the vertex streams of the geometry arena, which are bound
+  // once per pass
+  uint32_t vertex_binds = 0;
+  uint32_t index_binds = 0;
+};
+
+// Sort key layout, most significant first:
+//
+//   pass 4 | pipeline 12 | material 16 | mesh 16 | depth 16
+//
+// Sorting groups draws by the state that is most expensive to change, and
+// mesh comes before depth so draws of one mesh share their index buffer.
+// Opaque draws go front to back, transparent ones back to front.
+class DrawKey
+{
+public:
+  static const uint32_t kPipelineBits = 12;
+  static const uint32_t kMaterialBits = 16;
+  static const uint32_t kMeshBits = 16;
+  static const uint32_t kDepthBits = 16;
+
+  // Depth is the view distance over the far plane, clamped to [0, 1]
+  static uint64_t make(DrawPass pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth);
+
+  static DrawPass pass(uint64_t key) { return (DrawPass) (key >> 60); }
+  static uint32_t pipeline(uint64_t key) { return (uint32_t) (key >> 48) & 0xfff; }
+  static uint32_t material(uint64_t key) { return (uint32_t) (key >> 32) & 0xffff; }
+  static uint32_t mesh(uint64_t key) { return (uint32_t) (key >> 16) & 0xffff; }
+
+private:
+  DrawKey();
+};
+
+// Draw packets of one frame. Packets are added in visibility order and
+// sorted by key with an LSD radix sort, eight passes of one byte each.
+// Passes where every key has the same byte are skipped, which is most of
+// them since the high fields take few distinct values.
+class DrawQueue
+{
+public:
+  void clear();
+  void add(uint64_t key, uint32_t object, uint32_t lod, uint32_t index_binding);
+  // Also counts the state changes before and after sorting
+  void sort();
+
+  const DrawPacket* packets() const { return _packets.data(); }
+  uint32_t count() const { return (uint32_t) _packets.size(); }
+
+  // Of the last sort, in submission order and in sorted order
+  const DrawStateStats& unsortedStats() const { return _unsorted_stats; }
+  const DrawStateStats& sortedStats() const { return _sorted_stats; }
+
+  // Binds a recorder issues for the packets when it skips redundant ones
+  static DrawStateStats countStateChanges(const DrawPacket* packets, uint32_t count);
+
+private:
+  std::vector<DrawPacket> _packets;
+  std::vector<DrawPacket> _scratch;
+  DrawStateStats _unsorted_stats;
+  DrawStateStats _sorted_stats;
+};
+
+#endif // __DRAW_QUEUE_H__
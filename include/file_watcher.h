@@ -0,0 +1,49 @@
+#ifndef __FILE_WATCHER_H__
+#define __FILE_WATCHER_H__ 1
+
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+
+// Watches a directory for written files on a background thread, with
+// ReadDirectoryChangesW on Windows and inotify elsewhere. Tools usually
+// write a file in several steps, so a change is only reported once the
+// file has been left alone for kSettleMs.
+class FileWatcher
+{
+public:
+  FileWatcher();
+  ~FileWatcher();
+
+  static const uint32_t kSettleMs = 100;
+
+  // Windows watches subdirectories too, inotify only the directory itself
+  int start(const std::string& directory);
+  void stop();
+
+  // Appends the names, relative to the directory with forward slashes, of
+  // the files that settled since the last poll. Never blocks.
+  void poll(std::vector<std::string>* changed);
+
+private:
+  void watchLoop();
+  void recordChange(const std::string& name);
+
+  std::string _directory;
+  std::thread _thread;
+  std::atomic<bool> _running;
+
+  std::mutex _mutex;
+  std::unordered_map<std::string, std::chrono::steady_clock::time_point> _changes;
+
+  // Directory handle on Windows, inotify descriptor elsewhere
+  intptr_t _handle = -1;
+};
+
+#endif // __FILE_WATCHER_H__
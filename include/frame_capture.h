@@ -0,0 +1,144 @@
+#ifndef __FRAME_CAPTURE_H__
+#define __FRAME_CAPTURE_H__ 1
+
+#include <stdio.h>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <condition_variable>
+
+#include "vulkan/vulkan.h"
+
+class LayoutCache;
+
+enum CaptureFormat {
+  kCaptureFormat_None = 0,
+  // One file per frame
+  kCaptureFormat_PPM,
+  kCaptureFormat_PNG,
+  // Every frame appended as tightly packed RGBA to a single stream
+  kCaptureFormat_Raw,
+  // YUV 4:2:0 stream, converted on the GPU, ready to pipe into an encoder
+  kCaptureFormat_Y4M
+};
+
+// Copies presented images into a ring of host visible buffers. The copy is
+// recorded after the main pass, the slot is handed to a worker thread once
+// the GPU has retired it and the worker writes it out, so neither side ever
+// waits for the other. If the worker falls behind, frames are dropped.
+// Streams (raw and Y4M) go to a file, stdout ("-"), a fifo, or on Windows a
+// named pipe (\\.\pipe\name) that the encoder connects to.
+class FrameCapture
+{
+public:
+  FrameCapture();
+  ~FrameCapture();
+
+  static const uint32_t kSlotCount = 3;
+
+  void configure(CaptureFormat format, const std::string& path);
+  // Frames per second as a fraction, 30000/1001 for 29.97
+  void setFrameRate(uint32_t numerator, uint32_t denominator)
+  {
+    _frame_rate_numerator = numerator;
+    _frame_rate_denominator = denominator;
+  }
+  bool enabled() const { return _format != kCaptureFormat_None; }
+
+  int init(VkPhysicalDevice physical_device, VkDevice device, LayoutCache& layouts);
+  // Every submission that recorded a copy must have completed
+  int resize(VkExtent2D extent, VkFormat format);
+  void release();
+
+  // Records the copy of a presentable image, which must be in PRESENT_SRC
+  // layout. timeline_value is the value signaled by the submission.
+  bool recordCopy(VkCommandBuffer command_buffer, VkImage image, uint64_t frame, uint64_t timeline_value);
+
+  // Hands every copy whose submission reached completed_value to the worker
+  void retire(uint64_t completed_value);
+
+  uint64_t capturedFrames() const { return _captured; }
+  uint64_t droppedFrames() const { return _dropped; }
+
+private:
+  enum SlotState {
+    kSlotState_Free = 0,
+    kSlotState_Pending,
+    kSlotState_Queued
+  };
+
+  struct Slot
+  {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    void* data = nullptr;
+    VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+    uint64_t frame = 0;
+    uint64_t timeline_value = 0;
+    // Size the frame was copied at, the worker never reads _extent
+    VkExtent2D extent = {};
+    std::atomic<int> state;
+  };
+
+  int createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+    VkBuffer* buffer, VkDeviceMemory* memory);
+  int createConverter(LayoutCache& layouts);
+  void releaseConverter();
+  void recordConversion(VkCommandBuffer command_buffer, Slot& slot);
+
+  int openStream();
+  void writeStream(const void* data, size_t size);
+
+  void releaseSlots();
+  void workerLoop();
+  void writeSlot(Slot& slot);
+  void writePPM(const char* file_name, const uint8_t* pixels, VkExtent2D extent);
+  void writePNG(const char* file_name, const uint8_t* pixels, VkExtent2D extent);
+
+  CaptureFormat _format = kCaptureFormat_None;
+  std::string _path;
+  uint32_t _frame_rate_numerator = 60;
+  uint32_t _frame_rate_denominator = 1;
+
+  VkPhysicalDevice _physical_device = VK_NULL_HANDLE;
+  VkDevice _device = VK_NULL_HANDLE;
+  VkExtent2D _extent = {};
+  bool _bgra = false;
+  bool _coherent = true;
+  VkDeviceSize _slot_size = 0;
+
+  // Y4M conversion, planes are padded so the shader writes whole words
+  // Owned by the layout cache, built from the reflected shader
+  VkDescriptorSetLayout _converter_descriptor_layout = VK_NULL_HANDLE;
+  VkPipelineLayout _converter_pipeline_layout = VK_NULL_HANDLE;
+  VkPipeline _converter_pipeline = VK_NULL_HANDLE;
+  VkDescriptorPool _converter_descriptor_pool = VK_NULL_HANDLE;
+  VkBuffer _scratch_buffer = VK_NULL_HANDLE;
+  VkDeviceMemory _scratch_memory = VK_NULL_HANDLE;
+  uint32_t _luma_stride = 0;
+  uint32_t _chroma_stride = 0;
+  uint32_t _padded_height = 0;
+
+  Slot _slots[kSlotCount];
+  uint32_t _next_slot = 0;
+
+  std::thread _worker;
+  std::mutex _mutex;
+  std::condition_variable _condition;
+  std::deque<uint32_t> _queue;
+  bool _running = false;
+
+  FILE* _stream = nullptr;
+  void* _pipe = nullptr;
+  // Only touched by the worker: the size in the Y4M header and the size
+  // of the last frame written
+  VkExtent2D _stream_extent = {};
+  VkExtent2D _last_extent = {};
+  std::atomic<uint64_t> _captured;
+  uint64_t _dropped = 0;
+};
+
+#endif // __FRAME_CAPTURE_H__
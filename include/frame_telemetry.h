@@ -0,0 +1,100 @@
+#ifndef __FRAME_TELEMETRY_H__
+#define __FRAME_TELEMETRY_H__ 1
+
+#include <stdint.h>
+#include <chrono>
+
+enum FramePhase {
+  kFramePhase_GpuWait = 0,
+  kFramePhase_Acquire,
+  kFramePhase_Update,
+  kFramePhase_Cull,
+  kFramePhase_Record,
+  kFramePhase_Submit,
+  kFramePhase_Present,
+  // Time spent outside of drawFrame (message pump, etc.)
+  kFramePhase_External,
+  kFramePhase_Count
+};
+
+// Log-linear histogram in the spirit of HdrHistogram. Values are stored in
+// microseconds, exactly below 128us and then with 7 bits of precision, 64
+// sub-buckets per power of two (< 1.6% error), up to ~134s. Larger values
+// land in the last bucket.
+class HdrHistogram
+{
+public:
+  HdrHistogram();
+
+  void record(uint64_t value_us);
+  void reset();
+
+  uint64_t count() const { return _count; }
+  uint64_t min() const { return _count != 0 ? _min : 0; }
+  uint64_t max() const { return _max; }
+  double mean() const;
+  uint64_t percentile(double percentile) const;
+  uint64_t countAbove(uint64_t value_us) const;
+
+private:
+  static const uint32_t kSubBucketBits = 7;
+  static const uint32_t kHalfSubBuckets = 1 << (kSubBucketBits - 1);
+  static const uint32_t kMaxExponent = 20;
+  static const uint32_t kBucketCount = (kMaxExponent + 2) * kHalfSubBuckets;
+
+  static uint32_t indexOf(uint64_t value);
+  static uint64_t lowestOf(uint32_t index);
+  static uint64_t highestOf(uint32_t index);
+
+  uint32_t _counts[kBucketCount];
+  uint64_t _count = 0;
+  uint64_t _sum = 0;
+  uint64_t _min = UINT64_MAX;
+  uint64_t _max = 0;
+};
+
+// Splits every frame in phases, feeds one histogram per phase and blames
+// the phase that ran furthest above its median when a frame misses budget.
+class FrameTelemetry
+{
+public:
+  FrameTelemetry();
+
+  void setBudget(double budget_ms);
+  double budget() const { return _budget_us / 1000.0; }
+
+  void beginFrame();
+  // Closes the given phase, measured from the previous mark
+  void mark(FramePhase phase);
+  void endFrame();
+
+  const HdrHistogram& phase(FramePhase phase) const { return _phases[phase]; }
+  const HdrHistogram& frame() const { return _frame; }
+  uint64_t framesOverBudget() const { return _frames_over_budget; }
+  uint64_t stalls(FramePhase phase) const { return _stalls[phase]; }
+
+  void report() const;
+
+  static const char* phaseName(FramePhase phase);
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  uint64_t _budget_us = 16667;
+  bool _in_frame = false;
+
+  Clock::time_point _frame_start;
+  Clock::time_point _last_mark;
+  Clock::time_point _last_frame_end;
+  bool _has_last_frame = false;
+
+  uint64_t _current[kFramePhase_Count] = {};
+
+  HdrHistogram _phases[kFramePhase_Count];
+  HdrHistogram _frame;
+  uint64_t _frames = 0;
+  uint64_t _frames_over_budget = 0;
+  uint64_t _stalls[kFramePhase_Count] = {};
+};
+
+#endif // __FRAME_TELEMETRY_H__
@@ -0,0 +1,155 @@
+#ifndef __GEOMETRY_ARENA_H__
+#define __GEOMETRY_ARENA_H__ 1
+
+#include <stdint.h>
+
+#include <deque>
+#include <map>
+
+#include "vulkan/vulkan.h"
+#include "vertex_layout.h"
+#include "gpu_timeline.h"
+
+class MeshFile;
+
+// First fit allocator of ranges in a heap of fixed size, free ranges are
+// merged with their neighbours. Units are up to the caller, alignment does
+// not have to be a power of two.
+class RangeAllocator
+{
+public:
+  static const uint64_t kInvalidOffset = UINT64_MAX;
+
+  void init(uint64_t size);
+
+  // kInvalidOffset when no free range is large enough
+  uint64_t allocate(uint64_t size, uint64_t alignment = 1);
+  void free(uint64_t offset);
+
+  uint64_t size() const { return _size; }
+  uint64_t used() const { return _used; }
+  uint32_t freeRangeCount() const { return (uint32_t) _free.size(); }
+
+private:
+  struct Allocation
+  {
+    // Includes the alignment padding
+    uint64_t start;
+    uint64_t end;
+  };
+
+  uint64_t _size = 0;
+  uint64_t _used = 0;
+  // Start to end of every free range, and aligned offset to range of every
+  // allocation
+  std::map<uint64_t, uint64_t> _free;
+  std::map<uint64_t, Allocation> _allocations;
+};
+
+// Where a mesh lives in the arena, the arguments of its indexed draws
+struct GeometryRange
+{
+  // Added to every index, in vertices of every stream
+  int32_t vertex_offset = 0;
+  uint32_t vertex_count = 0;
+  // In indices of index_type, LOD offsets are relative to it
+  uint32_t first_index = 0;
+  uint32_t index_count = 0;
+  VkIndexType index_type = VK_INDEX_TYPE_UINT16;
+  // Byte offset of the indices, to free them
+  uint64_t index_allocation = RangeAllocator::kInvalidOffset;
+  // Clusters of the finest level in the cluster buffer, their vertex and
+  // triangle offsets already point into the shared cluster buffers
+  uint32_t cluster_offset = 0;
+  uint32_t cluster_count = 0;
+  uint64_t cluster_vertex_allocation = RangeAllocator::kInvalidOffset;
+  uint64_t cluster_triangle_allocation = RangeAllocator::kInvalidOffset;
+};
+
+// Shared vertex and index buffers that every mesh of a vertex layout is
+// sub-allocated from, so draws of different meshes only differ in their
+// first index and vertex offset and the buffers are bound once per pass.
+//
+// There is one buffer per stream, holding the same vertex slots, and one
+// index buffer. Meshes pick 16 bit indices when they have at most 65535
+// vertices, the index type is part of the range and the index buffer is
+// rebound when it changes. Index ranges are 4 byte aligned so their first
+// index is whole in either width.
+//
+// Clusters (see MeshCluster) go into three storage buffers for the culling
+// pass: the clusters, their vertex indices, and their triangles as bytes.
+//
+// Memory is host visible and stays mapped, meshes are copied in directly.
+// Freed ranges are reused once the timeline passes their value.
+class GeometryArena
+{
+public:
+  // Cluster vertex and triangle storage is sized for full clusters
+  int init(VkPhysicalDevice physical_device, VkDevice device, GpuTimeline* timeline, const VertexLayout& layout,
+    uint32_t vertex_capacity, uint64_t index_capacity, uint32_t cluster_capacity);
+  void release();
+  bool valid() const { return _device != VK_NULL_HANDLE; }
+
+  // Fails when the mesh has another layout or the arena is full
+  int add(const MeshFile& mesh, GeometryRange* range);
+  // The range is reused once the timeline reaches value
+  void free(const GeometryRange& range, uint64_t value);
+  // Reuses every freed range the GPU has finished with, in free order
+  void collect();
+
+  // The vertex streams hold every mesh. The index buffer is bound with
+  // the index type of the range drawn, again when the next one differs.
+  void bindVertexBuffers(VkCommandBuffer command_buffer) const;
+  VkBuffer indexBuffer() const { return _index_buffer; }
+
+  // Storage buffers of MeshCluster, uint32_t vertex indices and uint8_t
+  // triangle corners
+  VkBuffer clusterBuffer() const { return _cluster_buffers[0]; }
+  VkBuffer clusterVertexBuffer() const { return _cluster_buffers[1]; }
+  VkBuffer clusterTriangleBuffer() const { return _cluster_buffers[2]; }
+
+  const VertexLayout& layout() const { return _layout; }
+  uint32_t vertexCapacity() const { return (uint32_t) _vertices.size(); }
+  uint32_t verticesUsed() const { return (uint32_t) _vertices.used(); }
+  uint64_t indexCapacity() const { return _indices.size(); }
+  uint64_t indexBytesUsed() const { return _indices.used(); }
+  uint32_t clusterCapacity() const { return (uint32_t) _clusters.size(); }
+  uint32_t clustersUsed() const { return (uint32_t) _clusters.used(); }
+
+private:
+  struct Pending
+  {
+    GeometryRange range;
+    uint64_t value;
+  };
+
+  int createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer* buffer, VkDeviceMemory* memory,
+    uint8_t** mapped);
+
+  VkPhysicalDevice _physical_device = VK_NULL_HANDLE;
+  VkDevice _device = VK_NULL_HANDLE;
+  GpuTimeline* _timeline = nullptr;
+  VertexLayout _layout;
+
+  // Null for streams the layout does not have
+  VkBuffer _vertex_buffers[kVertexStream_Count] = {};
+  VkDeviceMemory _vertex_memory[kVertexStream_Count] = {};
+  uint8_t* _vertex_data[kVertexStream_Count] = {};
+  VkBuffer _index_buffer = VK_NULL_HANDLE;
+  VkDeviceMemory _index_memory = VK_NULL_HANDLE;
+  uint8_t* _index_data = nullptr;
+  VkBuffer _cluster_buffers[3] = {};
+  VkDeviceMemory _cluster_memory[3] = {};
+  uint8_t* _cluster_data[3] = {};
+
+  // Vertex slots, index bytes, clusters, cluster vertex entries and
+  // cluster triangles
+  RangeAllocator _vertices;
+  RangeAllocator _indices;
+  RangeAllocator _clusters;
+  RangeAllocator _cluster_vertices;
+  RangeAllocator _cluster_triangles;
+  std::deque<Pending> _pending;
+};
+
+#endif // __GEOMETRY_ARENA_H__
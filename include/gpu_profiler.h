@@ -0,0 +1,68 @@
+#ifndef __GPU_PROFILER_H__
+#define __GPU_PROFILER_H__ 1
+
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+// Results of a single profiled pass, filled once the GPU is done with it
+struct GpuPassStats
+{
+  const char* name = nullptr;
+
+  double time_ms = 0.0;
+  uint64_t samples_passed = 0;
+
+  // Only valid when has_statistics is true
+  bool has_statistics = false;
+  uint64_t input_vertices = 0;
+  uint64_t input_primitives = 0;
+  uint64_t vertex_invocations = 0;
+  uint64_t clipping_invocations = 0;
+  uint64_t clipping_primitives = 0;
+  uint64_t fragment_invocations = 0;
+};
+
+// Wraps timestamp, occlusion and pipeline statistics queries around passes.
+// Every frame slot owns its own range of queries, results are read back
+// without waiting once the slot's submission is known to be finished.
+class GpuProfiler
+{
+public:
+  GpuProfiler();
+  ~GpuProfiler();
+
+  static const uint32_t kMaxFrames = 8;
+  static const uint32_t kMaxPasses = 8;
+
+  int init(VkPhysicalDevice physical_device, VkDevice device, uint32_t queue_family, bool statistics_enabled);
+  void release();
+
+  // Must be recorded outside of any render pass, before the first beginPass
+  void resetFrame(VkCommandBuffer command_buffer, uint32_t frame);
+  uint32_t beginPass(VkCommandBuffer command_buffer, uint32_t frame, const char* name);
+  void endPass(VkCommandBuffer command_buffer, uint32_t frame, uint32_t pass);
+
+  // Reads the results of a frame slot, never blocks
+  void collect(uint32_t frame);
+
+  const std::vector<GpuPassStats>& passes() const { return _passes; }
+  bool timestampsSupported() const { return _timestamp_pool != VK_NULL_HANDLE; }
+  bool statisticsSupported() const { return _statistics_pool != VK_NULL_HANDLE; }
+
+private:
+  VkDevice _device = VK_NULL_HANDLE;
+  VkQueryPool _timestamp_pool = VK_NULL_HANDLE;
+  VkQueryPool _occlusion_pool = VK_NULL_HANDLE;
+  VkQueryPool _statistics_pool = VK_NULL_HANDLE;
+
+  float _timestamp_period = 1.0f;
+  uint64_t _timestamp_mask = UINT64_MAX;
+
+  uint32_t _frame_pass_count[kMaxFrames] = {};
+  const char* _frame_pass_names[kMaxFrames][kMaxPasses] = {};
+
+  std::vector<GpuPassStats> _passes;
+};
+
+#endif // __GPU_PROFILER_H__
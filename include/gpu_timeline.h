@@ -0,0 +1,48 @@
+#ifndef __GPU_TIMELINE_H__
+#define __GPU_TIMELINE_H__ 1
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include "vulkan/vulkan.h"
+
+// Single timeline semaphore shared by every submission. Each submit signals
+// the next value, so anything used by a submission is free to reuse once
+// the timeline reaches that value. Resources track a value instead of
+// owning fences, and retiring them is an integer compare.
+class GpuTimeline
+{
+public:
+  GpuTimeline();
+
+  int init(VkDevice device);
+  void release();
+
+  // Value the next submit will signal, for resources recorded before it
+  uint64_t pendingValue() const { return _submitted + 1; }
+  uint64_t submittedValue() const { return _submitted; }
+
+  // Submits with the timeline signal appended to the signal semaphores,
+  // optionally returns the value the submission signals
+  int submit(VkQueue queue, const VkSubmitInfo& submit_info, uint64_t* value = nullptr);
+
+  // Polls the semaphore, cached so checks on old values are free
+  uint64_t completedValue();
+  bool isComplete(uint64_t value);
+  int wait(uint64_t value, uint64_t timeout = UINT64_MAX);
+
+  VkSemaphore semaphore() const { return _semaphore; }
+
+private:
+  void advance(uint64_t value);
+
+  static const uint32_t kMaxSignalSemaphores = 8;
+
+  VkDevice _device = VK_NULL_HANDLE;
+  VkSemaphore _semaphore = VK_NULL_HANDLE;
+  uint64_t _submitted = 0;
+  std::atomic<uint64_t> _completed;
+};
+
+#endif // __GPU_TIMELINE_H__
@@ -0,0 +1,72 @@
+#ifndef __JOB_SYSTEM_H__
+#define __JOB_SYSTEM_H__ 1
+
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+typedef void (*JobFunction)(void* data);
+typedef void (*ParallelForFunction)(uint32_t begin, uint32_t end, void* data);
+
+struct Job;
+
+// Counts the jobs still running for a group, jobs that depend on the group
+// are held by the counter and released when it reaches zero
+class JobCounter
+{
+public:
+  JobCounter();
+
+  int32_t value() const { return _value.load(std::memory_order_acquire); }
+
+private:
+  friend class JobSystem;
+
+  std::atomic<int32_t> _value;
+  std::atomic<int32_t> _busy;
+  std::mutex _mutex;
+  std::vector<Job*> _waiters;
+};
+
+// Work stealing scheduler. Every worker owns a Chase-Lev deque: the owner
+// pushes and pops at the bottom, idle workers steal from the top. Threads
+// that are not workers submit through a shared queue. Waiting on a counter
+// runs pending jobs instead of sleeping.
+class JobSystem
+{
+public:
+  // 0 workers picks one per hardware thread, the calling thread is worker 0
+  static int init(uint32_t worker_count = 0);
+  static void shutdown();
+
+  static void run(JobFunction function, void* data, JobCounter* counter, JobCounter* dependency = nullptr);
+  static void wait(JobCounter* counter);
+
+  // Splits [0, count) in batches, runs them across workers and waits
+  static void parallelFor(uint32_t count, uint32_t batch_size, ParallelForFunction function, void* data);
+
+  template<typename Function>
+  static void parallelFor(uint32_t count, uint32_t batch_size, const Function& function)
+  {
+    parallelFor(count, batch_size, [](uint32_t begin, uint32_t end, void* data) {
+      (*(const Function*) data)(begin, end);
+    }, (void*) &function);
+  }
+
+  static uint32_t workerCount();
+  // UINT32_MAX when called from a thread that is not a worker
+  static uint32_t workerIndex();
+
+private:
+  JobSystem();
+
+  static void submit(Job* job);
+  static void execute(Job* job);
+  static void finish(JobCounter* counter);
+  static Job* findJob(uint32_t worker_index);
+  static void workerLoop(uint32_t worker_index);
+};
+
+#endif // __JOB_SYSTEM_H__
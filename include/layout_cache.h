@@ -0,0 +1,57 @@
+#ifndef __LAYOUT_CACHE_H__
+#define __LAYOUT_CACHE_H__ 1
+
+#include <stdint.h>
+
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+
+#include "vulkan/vulkan.h"
+#include "shader_reflection.h"
+
+// Owns every descriptor set and pipeline layout, deduplicated by content.
+// Pipelines whose shaders declare the same interface get the same handles,
+// so they stay compatible for descriptor binding and a pipeline rebuild
+// never recreates its layouts. Everything lives until release().
+class LayoutCache
+{
+public:
+  void init(VkDevice device);
+  void release();
+
+  // Bindings may come in any order, immutable samplers are not supported
+  VkDescriptorSetLayout descriptorSetLayout(const VkDescriptorSetLayoutBinding* bindings, uint32_t count);
+  VkPipelineLayout pipelineLayout(const VkDescriptorSetLayout* set_layouts, uint32_t set_count,
+    const VkPushConstantRange* push_constants, uint32_t push_constant_count);
+
+  // Layouts for a merged reflection, set_layouts gets one layout per set
+  // index, empty sets included
+  VkPipelineLayout pipelineLayout(const ShaderReflection& reflection,
+    std::vector<VkDescriptorSetLayout>* set_layouts = nullptr);
+
+  size_t descriptorSetLayoutCount() const { return _set_layouts.size(); }
+  size_t pipelineLayoutCount() const { return _pipeline_layouts.size(); }
+
+private:
+  struct SetLayoutEntry
+  {
+    std::vector<VkDescriptorSetLayoutBinding> bindings;
+    VkDescriptorSetLayout layout;
+  };
+
+  struct PipelineLayoutEntry
+  {
+    std::vector<VkDescriptorSetLayout> set_layouts;
+    std::vector<VkPushConstantRange> push_constants;
+    VkPipelineLayout layout;
+  };
+
+  VkDevice _device = VK_NULL_HANDLE;
+
+  std::mutex _mutex;
+  std::unordered_multimap<uint64_t, SetLayoutEntry> _set_layouts;
+  std::unordered_multimap<uint64_t, PipelineLayoutEntry> _pipeline_layouts;
+};
+
+#endif // __LAYOUT_CACHE_H__
@@ -0,0 +1,99 @@
+#ifndef __LOCK_FREE_H__
+#define __LOCK_FREE_H__ 1
+
+#include <stdint.h>
+
+#include <atomic>
+
+// Single writer, single reader triple buffer. The writer always has a slot
+// to fill and the reader always has a complete one to read, publishing and
+// consuming just swap slot indices, so neither side ever blocks. The reader
+// only sees the latest published value, older ones are overwritten.
+template<typename T>
+class TripleBuffer
+{
+public:
+  TripleBuffer() : _middle(1) { }
+
+  // Writer side
+  T& back() { return _slots[_back]; }
+
+  void publish()
+  {
+    _back = _middle.exchange(_back | kFresh, std::memory_order_acq_rel) & kIndexMask;
+  }
+
+  // True until the reader takes the last published value
+  bool pending() const { return (_middle.load(std::memory_order_acquire) & kFresh) != 0; }
+
+  // Reader side, returns false and keeps the current front when nothing new
+  // was published
+  bool consume()
+  {
+    if (!pending())
+    {
+      return false;
+    }
+
+    _front = _middle.exchange(_front, std::memory_order_acq_rel) & kIndexMask;
+    return true;
+  }
+
+  const T& front() const { return _slots[_front]; }
+
+private:
+  static const uint32_t kIndexMask = 3;
+  static const uint32_t kFresh = 4;
+
+  T _slots[3] = {};
+  uint32_t _back = 0;
+  uint32_t _front = 2;
+  std::atomic<uint32_t> _middle;
+};
+
+// Bounded single producer, single consumer ring. Capacity must be a power
+// of two.
+template<typename T, uint32_t Capacity>
+class SpscQueue
+{
+public:
+  SpscQueue() : _head(0), _tail(0) { }
+
+  // Producer side, false when full
+  bool push(const T& value)
+  {
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail - _head.load(std::memory_order_acquire) == Capacity)
+    {
+      return false;
+    }
+
+    _items[tail & (Capacity - 1)] = value;
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side, false when empty
+  bool pop(T* value)
+  {
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    if (head == _tail.load(std::memory_order_acquire))
+    {
+      return false;
+    }
+
+    *value = _items[head & (Capacity - 1)];
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+  T _items[Capacity];
+  // Separate cache lines so producer and consumer do not false share
+  alignas(64) std::atomic<uint32_t> _head;
+  alignas(64) std::atomic<uint32_t> _tail;
+};
+
+#endif // __LOCK_FREE_H__
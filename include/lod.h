@@ -0,0 +1,68 @@
+#ifndef __LOD_H__
+#define __LOD_H__ 1
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "mesh_format.h"
+
+class Scene;
+
+// Levels of one mesh as stored in its file, finest first
+struct LodChain
+{
+  const MeshLod* lods = nullptr;
+  uint32_t count = 0;
+};
+
+struct LodStats
+{
+  uint32_t objects = 0;
+  uint32_t triangles = 0;
+  uint32_t level_counts[kMeshMaxLods] = {};
+  // Multiplier the triangle budget applied to the pixel error
+  float error_scale = 1.0f;
+};
+
+// Picks a level of detail per object from the screen space error: the
+// mesh error scaled by the object, projected at its distance. The coarsest
+// level under the pixel threshold wins.
+//
+// A level only changes once its error is past the threshold by the
+// hysteresis fraction, so objects near the switch distance do not pop back
+// and forth. With a triangle budget the threshold also grows while the
+// selection is over budget and shrinks back once it is well under, which
+// keeps the triangle count roughly flat as objects are added.
+class LodSelector
+{
+public:
+  void setPixelError(float pixels) { _pixel_error = pixels; }
+  void setHysteresis(float fraction) { _hysteresis = fraction; }
+  // 0 disables the budget
+  void setTriangleBudget(uint32_t triangles) { _triangle_budget = triangles; }
+
+  // chains is indexed by mesh id, objects without one use level 0.
+  // projection_scale turns a size over a distance into pixels, viewport
+  // height / (2 * tan(fov / 2)).
+  void select(const Scene& scene, const glm::vec3& eye, float projection_scale,
+    const LodChain* chains, uint32_t chain_count, const uint32_t* objects, uint32_t count, uint32_t* levels);
+
+  // Of the last selection
+  const LodStats& stats() const { return _stats; }
+
+private:
+  float _pixel_error = 1.0f;
+  float _hysteresis = 0.25f;
+  uint32_t _triangle_budget = 0;
+  float _error_scale = 1.0f;
+
+  // Previous level by dense index, reset when the scene layout changes
+  std::vector<uint8_t> _levels;
+  uint32_t _layout_version = UINT32_MAX;
+  LodStats _stats;
+};
+
+#endif // __LOD_H__
@@ -0,0 +1,25 @@
+#ifndef __LZ4_H__
+#define __LZ4_H__ 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+// LZ4 block format codec, no frame. Output of compress() can be read by any
+// LZ4 block decoder and the other way around. Fast greedy matcher, meant
+// for offline packing, decompression is the part that runs at load time.
+class Lz4
+{
+public:
+  static size_t compressBound(size_t size) { return size + size / 255 + 16; }
+
+  // Returns the compressed size, 0 when it does not fit in capacity
+  static size_t compress(const uint8_t* source, size_t source_size, uint8_t* destination, size_t capacity);
+
+  // Bounds checked, fails unless exactly destination_size bytes come out
+  static int decompress(const uint8_t* source, size_t source_size, uint8_t* destination, size_t destination_size);
+
+private:
+  Lz4();
+};
+
+#endif // __LZ4_H__
@@ -0,0 +1,40 @@
+#ifndef __MESH_H__
+#define __MESH_H__ 1
+
+#include <stdint.h>
+
+#include <string>
+
+#include "mesh_format.h"
+#include "assets.h"
+
+// Read only view of a mesh asset. Sections point straight into the mapped
+// pack or file and can be copied into GPU memory as is.
+class MeshFile
+{
+public:
+  // Loads and validates the asset
+  int open(const std::string& name);
+  void close() { _asset = Asset(); }
+
+  const MeshHeader& header() const { return *(const MeshHeader*) _asset.data(); }
+  const void* section(MeshSection section) const;
+  uint64_t sectionSize(MeshSection section) const;
+  uint64_t fileSize() const { return _asset.size(); }
+  // Finest first, at least one
+  const MeshLod* lods() const { return (const MeshLod*) section(kMeshSection_Lods); }
+  uint32_t lodCount() const { return header().lod_count; }
+  // Of the finest level, none when the file has no clusters
+  const MeshCluster* clusters() const { return (const MeshCluster*) section(kMeshSection_Clusters); }
+  uint32_t clusterCount() const { return header().cluster_count; }
+  // Encodings of the vertex streams, already validated
+  const VertexLayout& vertexLayout() const { return _layout; }
+
+private:
+  int validate(const std::string& file_name);
+
+  Asset _asset;
+  VertexLayout _layout;
+};
+
+#endif // __MESH_H__
@@ -0,0 +1,111 @@
+#ifndef __MESH_FORMAT_H__
+#define __MESH_FORMAT_H__ 1
+
+#include <stdint.h>
+
+#include "vertex_layout.h"
+
+// Binary mesh layout written by tools/meshconv. A fixed header followed by
+// sections aligned to kMeshSectionAlignment, each one already laid out as
+// the vertex/index buffer expects it, so loading is a map and a memcpy.
+//
+// Version history:
+//   1: float3 positions, float3 colors, 16 or 32 bit indices
+//   2: levels of detail, index ranges into one index section
+//   3: vertex streams in the encodings of the header, optional normals
+//   4: clusters of the finest level with bounds for GPU culling
+
+static const uint32_t kMeshMagic = 0x48534D56; // "VMSH"
+static const uint32_t kMeshVersion = 4;
+static const uint32_t kMeshSectionAlignment = 256;
+static const uint32_t kMeshMaxLods = 8;
+// Limits of one cluster, 124 triangles keep the local indices of a
+// cluster within 372 bytes
+static const uint32_t kMeshClusterMaxVertices = 64;
+static const uint32_t kMeshClusterMaxTriangles = 124;
+
+static_assert(kVertexStream_Count <= 4, "MeshHeader::encodings is too small");
+
+// Vertex streams first, in VertexStream order
+enum MeshSection {
+  kMeshSection_Positions = 0,
+  kMeshSection_Colors,
+  kMeshSection_Normals,
+  kMeshSection_Indices,
+  kMeshSection_Lods,
+  kMeshSection_Clusters,
+  kMeshSection_ClusterVertices,
+  kMeshSection_ClusterTriangles,
+  kMeshSection_Count
+};
+
+struct MeshSectionEntry
+{
+  uint64_t offset;
+  uint64_t size;
+};
+
+// One level of detail, finest first. All levels index the same vertices,
+// the index section holds their ranges back to back.
+struct MeshLod
+{
+  uint32_t index_offset;
+  uint32_t index_count;
+  // Largest distance the surface moved from the full mesh, object space
+  float error;
+  uint32_t reserved;
+};
+
+// Meshlet of the finest level. Its triangles are three bytes each, local
+// indices into its vertices, which are indices into the vertex streams.
+// Bounds are in object space, before quantization.
+struct MeshCluster
+{
+  float center[3];
+  float radius;
+  // Every triangle faces away from a view point v when
+  // dot(center - v, cone_axis) >= cone_cutoff * length(center - v) + radius,
+  // a cutoff of 1 never culls
+  float cone_axis[3];
+  float cone_cutoff;
+  // Into the cluster vertex section, in entries
+  uint32_t vertex_offset;
+  // Into the cluster triangle section, in triangles
+  uint32_t triangle_offset;
+  uint32_t vertex_count;
+  uint32_t triangle_count;
+};
+
+static_assert(sizeof(MeshCluster) == 48, "MeshCluster is read by cluster_cull.comp");
+
+struct MeshHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t vertex_count;
+  // Of every level together
+  uint32_t index_count;
+  // 2 or 4
+  uint32_t index_size;
+  uint32_t flags;
+  float bounds_min[3];
+  float bounds_max[3];
+  uint32_t lod_count;
+  // VertexEncoding of every stream, kVertexEncoding_None when left out
+  uint8_t encodings[4];
+  // Object space position = stored position * scale + offset
+  float position_scale[3];
+  float position_offset[3];
+  // Clusters cover the first level of detail
+  uint32_t cluster_count;
+  // Entries of 4 bytes
+  uint32_t cluster_vertex_count;
+  // Entries of 3 bytes
+  uint32_t cluster_triangle_count;
+  uint32_t reserved;
+  MeshSectionEntry sections[kMeshSection_Count];
+};
+
+static_assert(sizeof(MeshHeader) == 224, "MeshHeader layout changed, bump kMeshVersion");
+
+#endif // __MESH_FORMAT_H__
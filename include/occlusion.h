@@ -0,0 +1,137 @@
+#ifndef __OCCLUSION_H__
+#define __OCCLUSION_H__ 1
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "glm/glm.hpp"
+
+struct OcclusionStats
+{
+  uint32_t triangles = 0;
+  uint32_t objects_tested = 0;
+  uint32_t objects_occluded = 0;
+};
+
+// Low resolution software depth buffer in the style of masked occlusion
+// culling. Occluder triangles are rasterized on the CPU and object boxes
+// are tested against them before anything is submitted.
+//
+// The buffer is split in tiles of 32x8 pixels. Every tile keeps a
+// coverage bit per pixel and two depths instead of a depth per pixel: the
+// depth the whole tile is known to be covered at, and the depth of a
+// working layer that only covers the masked pixels. A triangle is merged
+// into the working layer, and once its mask is full it becomes the new
+// tile depth. Depths are 1 / w, larger is nearer, and every depth is the
+// farthest one of its layer, so tests only ever err towards visible.
+//
+// One row of a tile is a 32 bit mask, so the AVX2 path handles a whole
+// tile per instruction. It is used when Simd picked the AVX2 kernels.
+class OcclusionBuffer
+{
+public:
+  static const uint32_t kTileWidth = 32;
+  static const uint32_t kTileHeight = 8;
+  // Boxes are projected this many at a time, one per AVX2 lane
+  static const uint32_t kBoxBatch = 8;
+
+  // The size is rounded up to whole tiles
+  int init(uint32_t width, uint32_t height);
+  uint32_t width() const { return _width; }
+  uint32_t height() const { return _height; }
+
+  // Resets the depths and sets the world to clip matrix used by both
+  // occluders and tests
+  void clear(const glm::mat4& view_projection);
+
+  // Triangle list in object space, both windings are rasterized
+  void renderOccluder(const glm::mat4& model, const glm::vec3* positions, uint32_t vertex_count,
+    const uint32_t* indices, uint32_t index_count);
+
+  // World space box, false when every pixel it covers is hidden
+  bool testBox(const glm::vec3& bounds_min, const glm::vec3& bounds_max);
+  // Removes the occluded objects from a list of dense indices, cheaper
+  // per box than testBox
+  void filter(const glm::vec3* bounds_min, const glm::vec3* bounds_max, std::vector<uint32_t>* objects);
+
+  // Since the last clear
+  const OcclusionStats& stats() const { return _stats; }
+
+  // Depth every pixel of a tile is known to be covered at, 0 when the
+  // tile is not fully covered. Row major, tilesX() by tilesY(), for tests
+  // that run elsewhere, e.g. on the GPU.
+  uint32_t tilesX() const { return _tiles_x; }
+  uint32_t tilesY() const { return _tiles_y; }
+  void tileDepths(float* depths) const;
+
+private:
+  // Clip space w below which geometry is clipped, boxes reaching it are
+  // always visible
+  static const float kNearW;
+
+  struct Tile
+  {
+    // Bit 31 - x of row y is pixel (x, y)
+    uint32_t mask[kTileHeight];
+    float z0;
+    float z1;
+  };
+
+  // Screen space setup of one triangle. Every row is bounded by the
+  // largest of the left edges and the smallest of the right ones, unused
+  // edges are pushed to infinity.
+  struct Triangle
+  {
+    float left_slope[2];
+    float left_offset[2];
+    float right_slope[2];
+    float right_offset[2];
+    float y_min;
+    float y_max;
+    // depth = a * x + b * y + c
+    float depth_a;
+    float depth_b;
+    float depth_c;
+    float depth_min;
+    uint32_t tile_x0, tile_x1;
+    uint32_t tile_y0, tile_y1;
+  };
+
+  void rasterize(const glm::vec4* clip);
+  int setupTriangle(const glm::vec4* clip, Triangle* triangle) const;
+  void rasterizeScalar(const Triangle& triangle);
+  void rasterizeAVX2(const Triangle& triangle);
+  // Farthest depth of the triangle inside a tile
+  float tileDepth(const Triangle& triangle, uint32_t tile_x, uint32_t tile_y) const;
+  void mergeTile(Tile* tile, const uint32_t* coverage, float depth);
+
+  // Pixels a box touches and its nearest depth
+  struct BoxRect
+  {
+    uint32_t x0, x1;
+    uint32_t y0, y1;
+    float depth;
+    // The box reaches the near plane and is always visible
+    bool clipped;
+  };
+
+  void projectBoxes(const glm::vec3* bounds_min, const glm::vec3* bounds_max, uint32_t count, BoxRect* rects) const;
+  void projectBoxesScalar(const glm::vec3* bounds_min, const glm::vec3* bounds_max, uint32_t count, BoxRect* rects) const;
+  void projectBoxesAVX2(const glm::vec3* bounds_min, const glm::vec3* bounds_max, uint32_t count, BoxRect* rects) const;
+  bool testRect(const BoxRect& rect);
+  bool testTilesScalar(uint32_t x0, uint32_t x1, uint32_t y0, uint32_t y1, float depth) const;
+  bool testTilesAVX2(uint32_t x0, uint32_t x1, uint32_t y0, uint32_t y1, float depth) const;
+
+  uint32_t _width = 0;
+  uint32_t _height = 0;
+  uint32_t _tiles_x = 0;
+  uint32_t _tiles_y = 0;
+  std::vector<Tile> _tiles;
+
+  glm::mat4 _view_projection = glm::mat4(1.0f);
+  std::vector<glm::vec4> _clip;
+  OcclusionStats _stats;
+};
+
+#endif // __OCCLUSION_H__
@@ -0,0 +1,40 @@
+#ifndef __PACK_FILE_H__
+#define __PACK_FILE_H__ 1
+
+#include <stdint.h>
+
+#include <string>
+
+#include "pack_format.h"
+#include "utils.h"
+
+// Reader for packs built by tools/packer. The whole pack is mapped once,
+// lookups hash the name into the table and uncompressed entries are used
+// straight from the mapping.
+class PackFile
+{
+public:
+  int open(const std::string& file_name);
+  void close();
+
+  bool isOpen() const { return _header != nullptr; }
+  uint32_t entryCount() const { return _header->entry_count; }
+
+  // nullptr when the pack has no such entry
+  const PackEntry* find(const std::string& name) const;
+  const uint8_t* entryData(const PackEntry& entry) const { return _file.data() + entry.offset; }
+  std::string entryName(const PackEntry& entry) const;
+
+  // Fills entry.size bytes, blocks are spread over the job system
+  int decompress(const PackEntry& entry, uint8_t* destination) const;
+
+private:
+  int validate(const std::string& file_name) const;
+
+  MappedFile _file;
+  const PackHeader* _header = nullptr;
+  const PackEntry* _table = nullptr;
+  const char* _names = nullptr;
+};
+
+#endif // __PACK_FILE_H__
@@ -0,0 +1,72 @@
+#ifndef __PACK_FORMAT_H__
+#define __PACK_FORMAT_H__ 1
+
+#include <stdint.h>
+
+// Asset pack written by tools/packer. Layout:
+//   PackHeader
+//   PackEntry table[table_size], open addressing on the name hash
+//   names, not terminated
+//   entries, every one aligned to kPackAlignment
+//
+// Compressed entries start with a uint32_t per block holding its stored
+// size, kPackBlockRaw marks blocks kept uncompressed. Blocks are
+// independent LZ4 blocks of kPackBlockSize bytes (the last one shorter), so
+// they can be decompressed in parallel.
+//
+// Version history:
+//   1: initial layout
+
+static const uint32_t kPackMagic = 0x4B415056; // "VPAK"
+static const uint32_t kPackVersion = 1;
+static const uint32_t kPackAlignment = 4096;
+static const uint32_t kPackBlockSize = 64 * 1024;
+static const uint32_t kPackBlockRaw = 0x80000000u;
+
+enum PackCompression {
+  kPackCompression_None = 0,
+  kPackCompression_Lz4
+};
+
+struct PackHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t entry_count;
+  // Power of two, slots with hash 0 are empty
+  uint32_t table_size;
+  uint64_t table_offset;
+  uint64_t names_offset;
+  uint64_t names_size;
+};
+
+struct PackEntry
+{
+  uint64_t hash;
+  uint64_t offset;
+  uint64_t stored_size;
+  uint64_t size;
+  uint32_t compression;
+  uint32_t block_count;
+  uint32_t name_offset;
+  uint32_t name_length;
+};
+
+static_assert(sizeof(PackHeader) == 40, "PackHeader layout changed, bump kPackVersion");
+static_assert(sizeof(PackEntry) == 48, "PackEntry layout changed, bump kPackVersion");
+
+// FNV-1a, never 0 so empty slots stay distinguishable. Names use forward
+// slashes and are relative to the packed root, e.g. "shaders/vert.spv".
+static inline uint64_t packHash(const char* name, uint32_t length)
+{
+  uint64_t hash = 14695981039346656037ull;
+  for (uint32_t i = 0; i < length; i++)
+  {
+    hash ^= (uint8_t) name[i];
+    hash *= 1099511628211ull;
+  }
+
+  return hash != 0 ? hash : 1;
+}
+
+#endif // __PACK_FORMAT_H__
@@ -4,6 +4,8 @@
 #include <Windows.h>
 
 #include <set>
+#include <atomic>
+#include <thread>
 #include <vector>
 #include <string>
 #include <iostream>
@@ -11,6 +13,22 @@
 #define VK_USE_PLATFORM_WIN32_KHR
 #include "vulkan/vulkan.h"
 
+#include "gpu_profiler.h"
+#include "gpu_timeline.h"
+#include "deletion_queue.h"
+#include "layout_cache.h"
+#include "frame_telemetry.h"
+#include "frame_capture.h"
+#include "file_watcher.h"
+#include "scene.h"
+#include "bvh.h"
+#include "occlusion.h"
+#include "draw_queue.h"
+#include "lod.h"
+#include "vertex_layout.h"
+#include "geometry_arena.h"
+#include "cluster_culler.h"
+
 struct QueueFamilyIndices
 {
 	int32_t graphics_family = -1;
@@ -21,6 +39,13 @@ struct QueueFamilyIndices
 	}
 };
 
+// Simulation output consumed by a frame
+struct FrameState
+{
+	double time;
+	uint64_t frame;
+};
+
 class Render
 {
 public:
@@ -28,7 +53,34 @@ public:
 	~Render();
 
 	int init(HWND window, HINSTANCE instance);
-	void drawFrame();
+	// Frames that repeat the previous state are not captured
+	void drawFrame(const FrameState& state);
+
+	const GpuProfiler& profiler() const { return _profiler; }
+	const FrameTelemetry& telemetry() const { return _telemetry; }
+	GpuTimeline& timeline() { return _timeline; }
+	DeletionQueue& deletionQueue() { return _deletion_queue; }
+	LayoutCache& layoutCache() { return _layout_cache; }
+	// Of the last frame
+	const BvhStats& cullStats() const { return _bvh.stats(); }
+	const OcclusionStats& occlusionStats() const { return _occlusion.stats(); }
+	// State changes of the last frame before and after sorting
+	const DrawStateStats& unsortedDrawStats() const { return _draw_queue.unsortedStats(); }
+	const DrawStateStats& sortedDrawStats() const { return _draw_queue.sortedStats(); }
+	const LodStats& lodStats() const { return _lod_selector.stats(); }
+	// Of the last completed frame
+	const ClusterStats& clusterStats() const { return _clusters.stats(); }
+	// Object space triangle list drawn into the occlusion buffer with the
+	// world matrix of the object. Occluders should be large and simple,
+	// their triangles must lie inside the visible surface of the object.
+	void addOccluder(SceneHandle object, const glm::vec3* positions, uint32_t vertex_count,
+		const uint32_t* indices, uint32_t index_count);
+	// Copies a mesh into the geometry arena, objects refer to it by mesh_id.
+	// Every mesh must have the vertex layout of the first one.
+	int loadMesh(const std::string& name, uint32_t* mesh_id);
+	const GeometryArena& geometry() const { return _geometry; }
+	// Configure before init
+	FrameCapture& capture() { return _capture; }
 
 	bool _resize = false;
 	VkDevice _device = VK_NULL_HANDLE;
@@ -40,14 +92,39 @@ private:
 	int createSwapChain(int width, int height);
 	int createRenderPass();
 	int createGraphicsPipeline();
-	int createVertexBuffers();
+
+	struct PipelineBuild
+	{
+		VkPipeline pipeline;
+		VkPipelineLayout layout;
+		VkDescriptorSetLayout uniform_layout;
+	};
+
+	int buildGraphicsPipeline(VkRenderPass render_pass, VkExtent2D extent, PipelineBuild* build);
+	// Rebuilds the pipeline on a background thread when its shaders change
+	// and swaps it in at the start of a later frame
+	void reloadShaders();
+	void cancelPipelineBuild();
+	// Loads the meshes, before the pipeline since their layout decides the
+	// vertex input
+	int createGeometry();
+	int createDescriptors();
+	int createHostBuffer(VkBufferUsageFlags usage, const void* data, VkDeviceSize size,
+		VkBuffer* buffer, VkDeviceMemory* memory);
 	int createCommandBuffer();
+	int createSyncObjects();
+	int recordCommandBuffer(uint32_t image_index, const FrameState& state);
 
 	int recreateSwapChain();
-	void update();
+	void update(double time);
+	// Fills the visible list from the view projection of the last update
+	void cull();
+	// Picks a level of detail and adds one packet per visible object,
+	// sorted by key
+	void sortDraws();
 
 	uint32_t findMemoryType(uint32_t filter, VkMemoryPropertyFlags properties);
-	VkShaderModule createShaderModule(const std::vector<char>& code) const;
+	VkShaderModule createShaderModule(const void* code, size_t size) const;
 	void cleanup();
 
 	VkInstance _instance = VK_NULL_HANDLE;
@@ -71,27 +148,77 @@ private:
 	VkPhysicalDevice _physical_device = VK_NULL_HANDLE;
 	
 	VkPipeline _graphics_pipeline = VK_NULL_HANDLE;
+	// Both owned by the layout cache
 	VkPipelineLayout _pipeline_layout = VK_NULL_HANDLE;
 	VkDescriptorSetLayout _uniform_descriptor_layout = VK_NULL_HANDLE;
+	LayoutCache _layout_cache;
+
+	FileWatcher _shader_watcher;
+	std::thread _pipeline_builder;
+	std::atomic<bool> _pipeline_built{ false };
+	PipelineBuild _pipeline_build = {};
+	int _pipeline_build_result = 0;
+	bool _shaders_changed = false;
 	VkRenderPass _render_pass = VK_NULL_HANDLE;
 
 	VkSemaphore _image_ready_semaphore;
 	VkSemaphore _render_finished_semaphore;
-	VkFence _frame_fence;
+	GpuTimeline _timeline;
+	DeletionQueue _deletion_queue;
+	// Timeline value signaled by the last frame submit
+	uint64_t _frame_value = 0;
 
-	VkBuffer _positions_vertex_buffer;
-	VkBuffer _colors_vertex_buffer;
-	VkBuffer _indices_buffer;
 	VkBuffer _uniform_buffer;
-	VkDeviceMemory _positions_buffer_memory;
-	VkDeviceMemory _colors_buffer_memory;
-	VkDeviceMemory _indices_buffer_memory;
 	VkDeviceMemory _uniform_buffer_memory;
 
+	struct RenderMesh
+	{
+		GeometryRange geometry;
+		// Levels of detail, index ranges relative to geometry.first_index
+		std::vector<MeshLod> lods;
+		glm::vec3 bounds_min;
+		glm::vec3 bounds_max;
+		// Stored positions to object space, applied with the model matrix
+		glm::mat4 dequantize;
+	};
+	GeometryArena _geometry;
+	// Indexed by mesh id
+	std::vector<RenderMesh> _meshes;
+	std::vector<LodChain> _lod_chains;
+	ClusterCuller _clusters;
+	// Cluster culler draw by dense scene index, UINT32_MAX when drawn whole
+	std::vector<uint32_t> _cluster_draws;
+
+	Scene _scene;
+	SceneHandle _cube;
+	Bvh _bvh;
+	std::vector<uint32_t> _visible;
+	glm::mat4 _view_projection = glm::mat4(1.0f);
+	glm::vec3 _view_position = glm::vec3(0.0f);
+
+	struct Occluder
+	{
+		SceneHandle object;
+		std::vector<glm::vec3> positions;
+		std::vector<uint32_t> indices;
+	};
+	std::vector<Occluder> _occluders;
+	OcclusionBuffer _occlusion;
+	DrawQueue _draw_queue;
+	LodSelector _lod_selector;
+	std::vector<uint32_t> _draw_levels;
+
 	VkDebugUtilsMessengerEXT _debug_messenger = VK_NULL_HANDLE;
 
 	QueueFamilyIndices _queue_indices = {};
 
+	GpuProfiler _profiler;
+	FrameTelemetry _telemetry;
+	FrameCapture _capture;
+	bool _statistics_supported = false;
+	uint32_t _last_image_index = UINT32_MAX;
+	uint64_t _last_frame = UINT64_MAX;
+
 	HWND _window;
 };
 
@@ -0,0 +1,68 @@
+#ifndef __RENDER_THREAD_H__
+#define __RENDER_THREAD_H__ 1
+
+#include <Windows.h>
+
+#include <atomic>
+#include <thread>
+
+#include "lock_free.h"
+#include "render.h"
+
+enum RenderEventType {
+  kRenderEventType_Resize = 0
+};
+
+struct RenderEvent
+{
+  RenderEventType type;
+  uint32_t width;
+  uint32_t height;
+};
+
+// Runs the render loop on its own thread. The simulation hands states
+// through a triple buffer and window events through a queue, so neither
+// the message pump nor swapchain waits stall each other.
+//
+// The simulation should only publish once the previous state has been
+// consumed (see canPublish/consumedEvent), which bounds input to present
+// latency to a single frame and lets every simulated frame be rendered.
+// When no new state arrives the last one is redrawn every kStaleRedrawMs,
+// e.g. while the main thread sits in a modal move or resize loop.
+class RenderThread
+{
+public:
+  RenderThread();
+  ~RenderThread();
+
+  // The render must be initialized and outlive the thread
+  int start(Render* render);
+  void stop();
+
+  // Simulation side
+  bool canPublish() const { return !_states.pending(); }
+  FrameState& state() { return _states.back(); }
+  void publish();
+  // Auto reset, signaled every time the render thread takes a state
+  HANDLE consumedEvent() const { return _consumed_event; }
+
+  // Window thread side, safe before start
+  void postEvent(const RenderEvent& event);
+
+private:
+  static const DWORD kStaleRedrawMs = 100;
+
+  void loop();
+
+  Render* _render = nullptr;
+  std::thread _thread;
+  std::atomic<bool> _running;
+
+  TripleBuffer<FrameState> _states;
+  SpscQueue<RenderEvent, 64> _events;
+
+  HANDLE _wake_event = NULL;
+  HANDLE _consumed_event = NULL;
+};
+
+#endif // __RENDER_THREAD_H__
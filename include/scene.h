@@ -0,0 +1,106 @@
+#ifndef __SCENE_H__
+#define __SCENE_H__ 1
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+
+// Stable reference to a scene object. The generation changes when the slot
+// is reused, so handles to destroyed objects are detected instead of
+// silently pointing at whatever took their place.
+struct SceneHandle
+{
+  uint32_t slot = UINT32_MAX;
+  uint32_t generation = 0;
+};
+
+// Scene objects in structure of arrays form. Every component lives in its
+// own contiguous array indexed by the object's dense index, so passes only
+// stream the data they use.
+//
+// Objects are kept sorted by hierarchy depth: roots first, then their
+// children, and so on. Parents always precede their children, so world
+// matrices are computed in one linear pass, and every depth level is a
+// contiguous range whose objects only read the previous level, so each
+// level is updated in parallel.
+//
+// Everything but create and valid expects a valid handle.
+class Scene
+{
+public:
+  static const uint32_t kNoParent = UINT32_MAX;
+
+  // Objects start at the origin with no rotation and unit scale
+  SceneHandle create(SceneHandle parent = SceneHandle(), uint32_t mesh_id = 0, uint32_t material_id = 0);
+  // Destroys the children too
+  void destroy(SceneHandle handle);
+  bool valid(SceneHandle handle) const;
+  // Fails when the new parent is the object itself or one of its children
+  int setParent(SceneHandle handle, SceneHandle parent);
+
+  void setPosition(SceneHandle handle, const glm::vec3& position) { _positions[index(handle)] = position; }
+  void setRotation(SceneHandle handle, const glm::quat& rotation) { _rotations[index(handle)] = rotation; }
+  void setScale(SceneHandle handle, const glm::vec3& scale) { _scales[index(handle)] = scale; }
+  // Object space bounds, usually the ones of its mesh
+  void setBounds(SceneHandle handle, const glm::vec3& bounds_min, const glm::vec3& bounds_max);
+
+  // Sorts the hierarchy if it changed, then computes every world matrix
+  // and world bounds on the job system
+  void updateTransforms();
+
+  const glm::mat4& worldMatrix(SceneHandle handle) const { return _world_matrices[index(handle)]; }
+
+  // Dense arrays, valid until the next create, destroy or setParent
+  uint32_t count() const { return (uint32_t) _positions.size(); }
+  uint32_t index(SceneHandle handle) const { return _slots[handle.slot].index; }
+  const uint32_t* parents() const { return _parents.data(); }
+  const glm::mat4* worldMatrices() const { return _world_matrices.data(); }
+  const glm::vec3* worldBoundsMin() const { return _world_bounds_min.data(); }
+  const glm::vec3* worldBoundsMax() const { return _world_bounds_max.data(); }
+  const uint32_t* meshIds() const { return _mesh_ids.data(); }
+  const uint32_t* materialIds() const { return _material_ids.data(); }
+  // Changes whenever dense indices do, for structures that store them
+  uint32_t layoutVersion() const { return _layout_version; }
+
+private:
+  struct Slot
+  {
+    // Dense index while alive, next free slot otherwise
+    uint32_t index;
+    uint32_t generation;
+  };
+
+  void sortByDepth();
+  // order[new] = old, dropped objects are left out
+  void reorder(const std::vector<uint32_t>& order);
+  void updateRange(uint32_t begin, uint32_t end);
+
+  // Sparse handle table
+  std::vector<Slot> _slots;
+  uint32_t _free_slot = UINT32_MAX;
+
+  // Dense components
+  std::vector<uint32_t> _handles;
+  std::vector<uint32_t> _parents;
+  std::vector<uint32_t> _depths;
+  std::vector<glm::vec3> _positions;
+  std::vector<glm::quat> _rotations;
+  std::vector<glm::vec3> _scales;
+  std::vector<glm::mat4> _world_matrices;
+  std::vector<glm::vec3> _bounds_min;
+  std::vector<glm::vec3> _bounds_max;
+  std::vector<glm::vec3> _world_bounds_min;
+  std::vector<glm::vec3> _world_bounds_max;
+  std::vector<uint32_t> _mesh_ids;
+  std::vector<uint32_t> _material_ids;
+
+  // Start of every depth level, plus the end of the last one
+  std::vector<uint32_t> _levels;
+  bool _sorted = true;
+  uint32_t _layout_version = 0;
+};
+
+#endif // __SCENE_H__
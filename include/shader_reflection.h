@@ -0,0 +1,74 @@
+#ifndef __SHADER_REFLECTION_H__
+#define __SHADER_REFLECTION_H__ 1
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+#include "vertex_layout.h"
+
+struct ShaderInput
+{
+  uint32_t location;
+  VkFormat format;
+};
+
+struct ShaderBinding
+{
+  uint32_t set;
+  uint32_t binding;
+  VkDescriptorType type;
+  // Array size, 1 for single descriptors
+  uint32_t count;
+  VkShaderStageFlags stages;
+  // Declared size of buffer blocks, 0 for everything else
+  uint32_t size;
+};
+
+// Interface of a SPIR-V module, read straight from its words so the C++
+// side never restates what the shader declares. Reflections of the stages
+// of a pipeline are merged into one before building its layouts.
+class ShaderReflection
+{
+public:
+  // Fails on malformed modules and on interfaces it cannot express
+  int parse(const void* code, size_t size);
+  // Adds the interface of another stage, fails when both declare the same
+  // binding with different types
+  int merge(const ShaderReflection& other);
+
+  VkShaderStageFlags stages() const { return _stages; }
+  // Vertex stage inputs by location, built-ins are left out
+  const std::vector<ShaderInput>& inputs() const { return _inputs; }
+  // Sorted by set then binding
+  const std::vector<ShaderBinding>& bindings() const { return _bindings; }
+  const ShaderBinding* findBinding(uint32_t set, uint32_t binding) const;
+
+  bool hasPushConstants() const { return _push_constants.size > 0; }
+  const VkPushConstantRange& pushConstants() const { return _push_constants; }
+
+  // Highest set index plus one
+  uint32_t setCount() const;
+
+  // One binding per input location, as the demo keeps every attribute in
+  // its own tightly packed stream. Formats and strides are the ones the
+  // mesh stores, fails when an input has no stream, is not read as floats
+  // or reads more components than the stream has.
+  int vertexInput(const VertexLayout& layout, std::vector<VkVertexInputBindingDescription>* bindings,
+    std::vector<VkVertexInputAttributeDescription>* attributes) const;
+
+  static uint32_t formatSize(VkFormat format);
+  static VkFormat encodingFormat(VertexEncoding encoding);
+
+private:
+  void addBinding(const ShaderBinding& binding);
+
+  VkShaderStageFlags _stages = 0;
+  std::vector<ShaderInput> _inputs;
+  std::vector<ShaderBinding> _bindings;
+  VkPushConstantRange _push_constants = {};
+};
+
+#endif // __SHADER_REFLECTION_H__
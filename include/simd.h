@@ -0,0 +1,73 @@
+#ifndef __SIMD_H__
+#define __SIMD_H__ 1
+
+#include <stdint.h>
+
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define SIMD_X86 1
+#endif
+
+enum SimdLevel {
+  kSimdLevel_Scalar = 0,
+  // Four objects per iteration
+  kSimdLevel_SSE2,
+  // Eight objects per iteration
+  kSimdLevel_AVX2
+};
+
+enum SimdKernel {
+  kSimdKernel_Compose = 0,
+  kSimdKernel_Multiply,
+  kSimdKernel_Spheres,
+  kSimdKernel_Boxes,
+  kSimdKernel_Count
+};
+
+// Bounds of four boxes, one per lane. Unused lanes are inverted, min above
+// max, and classify as outside.
+struct BoxLanes
+{
+  float min_x[4], min_y[4], min_z[4];
+  float max_x[4], max_y[4], max_z[4];
+};
+
+// Batch math kernels over component arrays, the layout the scene keeps.
+// Inputs are transposed in registers so every lane works on a different
+// object, results are identical to the glm scalar path up to rounding.
+// At startup every level the CPU supports is timed on a small batch and
+// each kernel uses the fastest one, which is not always the widest.
+class Simd
+{
+public:
+  // Widest level of the CPU, or the one forced with setLevel
+  static SimdLevel level();
+  static bool supported(SimdLevel level);
+  // Forces every kernel to a supported level, for comparing kernels
+  static int setLevel(SimdLevel level);
+  // Back to the fastest level of each kernel
+  static void setFastest();
+  static SimdLevel kernelLevel(SimdKernel kernel);
+  static const char* levelName(SimdLevel level);
+  static const char* kernelName(SimdKernel kernel);
+
+  // Translation * rotation * scale, rotations must be normalized
+  static void composeTransforms(const glm::vec3* positions, const glm::quat* rotations, const glm::vec3* scales,
+    uint32_t count, glm::mat4* matrices);
+  // result[i] = left * right[i], e.g. view projection times world
+  static void multiplyMatrices(const glm::mat4& left, const glm::mat4* right, uint32_t count, glm::mat4* result);
+  // Spheres are center and radius, the radius grows with the largest scale
+  static void transformSpheres(const glm::mat4* matrices, const glm::vec4* spheres, uint32_t count, glm::vec4* result);
+  // Tests every group of four boxes against planes with normals pointing
+  // inside. Bits 0-3 of masks[i] are the lanes outside some plane, bits 4-7
+  // the lanes inside all of them.
+  static void classifyBoxes(const glm::vec4* planes, uint32_t plane_count, const BoxLanes* boxes, uint32_t count,
+    uint32_t* masks);
+
+private:
+  Simd();
+};
+
+#endif // __SIMD_H__
@@ -0,0 +1,138 @@
+#ifndef __SIMD_LANES_H__
+#define __SIMD_LANES_H__ 1
+
+// Kernel bodies shared by every instruction set. V is a lane type with the
+// arithmetic operators, splat, sqrt, min and max, one object per lane. Included
+// by the kernel sources only, each one with its own target options.
+
+#include "simd.h"
+
+// Scalar kernels, also the tails of the wider ones
+void composeTransformsScalar(const glm::vec3* positions, const glm::quat* rotations, const glm::vec3* scales,
+  uint32_t count, glm::mat4* matrices);
+void multiplyMatricesScalar(const glm::mat4& left, const glm::mat4* right, uint32_t count, glm::mat4* result);
+void transformSpheresScalar(const glm::mat4* matrices, const glm::vec4* spheres, uint32_t count, glm::vec4* result);
+void classifyBoxesScalar(const glm::vec4* planes, uint32_t plane_count, const BoxLanes* boxes, uint32_t count,
+  uint32_t* masks);
+
+#ifdef SIMD_X86
+// Defined in simd_avx2.cc
+void composeTransformsAVX2(const glm::vec3* positions, const glm::quat* rotations, const glm::vec3* scales,
+  uint32_t count, glm::mat4* matrices);
+void multiplyMatricesAVX2(const glm::mat4& left, const glm::mat4* right, uint32_t count, glm::mat4* result);
+void transformSpheresAVX2(const glm::mat4* matrices, const glm::vec4* spheres, uint32_t count, glm::vec4* result);
+void classifyBoxesAVX2(const glm::vec4* planes, uint32_t plane_count, const BoxLanes* boxes, uint32_t count,
+  uint32_t* masks);
+#endif
+
+// Column major, m[column * 4 + row]
+template<typename V>
+static inline void composeLanes(const V* position, const V* rotation, const V* scale, V* m)
+{
+  V one = V::splat(1.0f);
+  V two = V::splat(2.0f);
+  V zero = V::splat(0.0f);
+
+  V x = rotation[0], y = rotation[1], z = rotation[2], w = rotation[3];
+  V xx = x * x, yy = y * y, zz = z * z;
+  V xy = x * y, xz = x * z, yz = y * z;
+  V wx = w * x, wy = w * y, wz = w * z;
+
+  m[0] = (one - two * (yy + zz)) * scale[0];
+  m[1] = two * (xy + wz) * scale[0];
+  m[2] = two * (xz - wy) * scale[0];
+  m[3] = zero;
+
+  m[4] = two * (xy - wz) * scale[1];
+  m[5] = (one - two * (xx + zz)) * scale[1];
+  m[6] = two * (yz + wx) * scale[1];
+  m[7] = zero;
+
+  m[8] = two * (xz + wy) * scale[2];
+  m[9] = two * (yz - wx) * scale[2];
+  m[10] = (one - two * (xx + yy)) * scale[2];
+  m[11] = zero;
+
+  m[12] = position[0];
+  m[13] = position[1];
+  m[14] = position[2];
+  m[15] = one;
+}
+
+template<typename V>
+static inline void sphereLanes(const V* m, const V* sphere, V* result)
+{
+  result[0] = m[0] * sphere[0] + m[4] * sphere[1] + m[8] * sphere[2] + m[12];
+  result[1] = m[1] * sphere[0] + m[5] * sphere[1] + m[9] * sphere[2] + m[13];
+  result[2] = m[2] * sphere[0] + m[6] * sphere[1] + m[10] * sphere[2] + m[14];
+
+  V scale_x = m[0] * m[0] + m[1] * m[1] + m[2] * m[2];
+  V scale_y = m[4] * m[4] + m[5] * m[5] + m[6] * m[6];
+  V scale_z = m[8] * m[8] + m[9] * m[9] + m[10] * m[10];
+  result[3] = sphere[3] * V::sqrt(V::max(scale_x, V::max(scale_y, scale_z)));
+}
+
+// Smallest distance over the planes of the farthest corner along each plane
+// normal, negative when outside, and of the nearest one, not negative when
+// inside. The corner is picked per plane, so there is no per lane select.
+template<typename V>
+static inline void boxLanes(const glm::vec4* planes, uint32_t plane_count, const V* min, const V* max,
+  V* far_distance, V* near_distance)
+{
+  for (uint32_t p = 0; p < plane_count; p++)
+  {
+    const glm::vec4& plane = planes[p];
+    V nx = V::splat(plane.x), ny = V::splat(plane.y), nz = V::splat(plane.z), d = V::splat(plane.w);
+
+    V far_corner = (plane.x > 0.0f ? max[0] : min[0]) * nx + (plane.y > 0.0f ? max[1] : min[1]) * ny +
+      (plane.z > 0.0f ? max[2] : min[2]) * nz + d;
+    V near_corner = (plane.x > 0.0f ? min[0] : max[0]) * nx + (plane.y > 0.0f ? min[1] : max[1]) * ny +
+      (plane.z > 0.0f ? min[2] : max[2]) * nz + d;
+
+    *far_distance = p == 0 ? far_corner : V::min(*far_distance, far_corner);
+    *near_distance = p == 0 ? near_corner : V::min(*near_distance, near_corner);
+  }
+}
+
+#ifdef SIMD_X86
+#include <emmintrin.h>
+
+// Three unaligned loads of four packed vec3 into x, y and z lanes
+static inline void loadVec3x4(const glm::vec3* source, __m128* lanes)
+{
+  const float* data = (const float*) source;
+  __m128 a = _mm_loadu_ps(data);
+  __m128 b = _mm_loadu_ps(data + 4);
+  __m128 c = _mm_loadu_ps(data + 8);
+
+  __m128 x_high = _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2));
+  __m128 y_low = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1));
+  __m128 y_high = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3));
+  __m128 z_low = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2));
+
+  lanes[0] = _mm_shuffle_ps(a, x_high, _MM_SHUFFLE(2, 0, 3, 0));
+  lanes[1] = _mm_shuffle_ps(y_low, y_high, _MM_SHUFFLE(2, 0, 2, 0));
+  lanes[2] = _mm_shuffle_ps(z_low, c, _MM_SHUFFLE(3, 0, 2, 0));
+}
+
+// Four vec4 at stride floats apart into x, y, z and w lanes, and back
+static inline void loadVec4x4(const float* source, uint32_t stride, __m128* lanes)
+{
+  lanes[0] = _mm_loadu_ps(source);
+  lanes[1] = _mm_loadu_ps(source + stride);
+  lanes[2] = _mm_loadu_ps(source + stride * 2);
+  lanes[3] = _mm_loadu_ps(source + stride * 3);
+  _MM_TRANSPOSE4_PS(lanes[0], lanes[1], lanes[2], lanes[3]);
+}
+
+static inline void storeVec4x4(float* destination, uint32_t stride, __m128 x, __m128 y, __m128 z, __m128 w)
+{
+  _MM_TRANSPOSE4_PS(x, y, z, w);
+  _mm_storeu_ps(destination, x);
+  _mm_storeu_ps(destination + stride, y);
+  _mm_storeu_ps(destination + stride * 2, z);
+  _mm_storeu_ps(destination + stride * 3, w);
+}
+#endif // SIMD_X86
+
+#endif // __SIMD_LANES_H__
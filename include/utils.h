@@ -1,13 +1,52 @@
 #ifndef __UTILS_H__
 #define __UTILS_H__ 1
 
+#include <stdint.h>
+
 #include <vector>
 #include <string>
 
+// Read only view of a whole file, unmapped when it goes out of scope.
+// Files up to kSmallFileSize are read into an owned buffer instead, a map
+// costs more than reading a few pages. Data is 8 byte aligned either way,
+// so SPIR-V and binary assets can be used in place.
+class MappedFile
+{
+public:
+  static const size_t kSmallFileSize = 16 * 1024;
+
+  MappedFile();
+  ~MappedFile();
+
+  MappedFile(MappedFile&& other);
+  MappedFile& operator=(MappedFile&& other);
+
+  int open(const std::string& file_name, bool small_file_read = true);
+  void close();
+
+  bool isOpen() const { return _data != nullptr; }
+  bool mapped() const { return _mapped; }
+  const uint8_t* data() const { return _data; }
+  size_t size() const { return _size; }
+
+private:
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+
+  const uint8_t* _data = nullptr;
+  size_t _size = 0;
+  bool _mapped = false;
+
+  std::vector<uint64_t> _buffer;
+  void* _file = nullptr;
+  void* _mapping = nullptr;
+};
+
 class Utils
 {
 public:
-  static std::vector<char> readFile(const std::string& file_name);
+  // Empty when the file can not be opened
+  static MappedFile mapFile(const std::string& file_name);
 };
 
 #endif // __UTILS_H__
@@ -0,0 +1,73 @@
+#ifndef __VERTEX_LAYOUT_H__
+#define __VERTEX_LAYOUT_H__ 1
+
+#include <stdint.h>
+
+#include <string>
+
+// Every stream has its own binding, at the location of the same index
+enum VertexStream
+{
+  kVertexStream_Position = 0,
+  kVertexStream_Color,
+  kVertexStream_Normal,
+  kVertexStream_Count
+};
+
+enum VertexEncoding
+{
+  kVertexEncoding_None = 0,
+  // 12 bytes
+  kVertexEncoding_Float3,
+  // 8 bytes, w unused since three component 16 bit formats are rarely
+  // supported for vertex input
+  kVertexEncoding_Half4,
+  // 8 bytes, positions are normalized to their bounds first
+  kVertexEncoding_Snorm16x4,
+  // 4 bytes, alpha is always 1
+  kVertexEncoding_Unorm8x4,
+  // 4 bytes, unit vectors folded onto an octahedron, two snorm16
+  kVertexEncoding_Octahedral16,
+  kVertexEncoding_Count
+};
+
+// Encoding of every vertex stream of a mesh. Meshconv uses it to encode
+// the streams and to write the matching GLSL declarations, the renderer
+// to build the vertex input of the pipeline (see ShaderReflection).
+//
+// Positions are stored relative to an offset and divided by a scale, so
+// 16 bit encodings spend their precision on the mesh bounds. The shader
+// reads them as is and the renderer folds the dequantization into the
+// model matrix.
+class VertexLayout
+{
+public:
+  // Fails when the stream cannot use the encoding, e.g. octahedral
+  // positions, or when the position stream is left out
+  int setEncoding(VertexStream stream, VertexEncoding encoding);
+  VertexEncoding encoding(VertexStream stream) const { return _encodings[stream]; }
+  uint32_t stride(VertexStream stream) const { return encodingSize(_encodings[stream]); }
+  uint32_t vertexSize() const;
+
+  // Offset and scale the position encoding wants for these bounds
+  void positionQuantization(const float* bounds_min, const float* bounds_max, float* offset, float* scale) const;
+  // Encodes count float3 values of a stream into stride(stream) bytes
+  // each. offset and scale only apply to positions.
+  void encode(VertexStream stream, const float* values, uint32_t count, const float* offset, const float* scale,
+    void* result) const;
+
+  // Inputs at the location of their stream, named as the shaders expect,
+  // and a decodePosition/decodeColor/decodeNormal function per stream
+  std::string glsl() const;
+
+  static uint32_t encodingSize(VertexEncoding encoding);
+  static const char* encodingName(VertexEncoding encoding);
+  static int parseEncoding(const char* name, VertexEncoding* encoding);
+
+private:
+  VertexEncoding _encodings[kVertexStream_Count] = {
+    kVertexEncoding_Float3, kVertexEncoding_Float3, kVertexEncoding_None
+  };
+};
+
+#endif // __VERTEX_LAYOUT_H__
@@ -77,4 +77,87 @@ solution "VulkanDemo"
 
         configuration "Shipping"
             targetdir "../bin/Demo/Shipping"
-            kind "WindowedApp"
\ No newline at end of file
+            kind "WindowedApp"
+
+    project "Bench"
+        location "../build/Bench"
+        kind "ConsoleApp"
+        objdir "../build/Bench/obj"
+
+        files {
+            "../bench/**.h",
+            "../bench/**.cc",
+            "../src/async_io.cc",
+            "../src/job_system.cc",
+            "../src/logger.cc",
+            "../src/simd.cc",
+            "../src/simd_avx2.cc",
+            "../src/occlusion.cc",
+            "../src/occlusion_avx2.cc",
+        }
+
+        includedirs {
+            "../include",
+            "../bench",
+            "../deps/vulkan/Include",
+            "../deps/glm/",
+        }
+
+        configuration "Debug"
+            targetdir "../bin/Bench/Debug"
+
+        configuration "Release"
+            targetdir "../bin/Bench/Release"
+
+        configuration "Shipping"
+            targetdir "../bin/Bench/Shipping"
+
+    project "MeshConv"
+        location "../build/MeshConv"
+        kind "ConsoleApp"
+        objdir "../build/MeshConv/obj"
+
+        files {
+            "../tools/meshconv/**.cc",
+            "../src/vertex_layout.cc",
+            "../include/mesh_format.h",
+            "../include/vertex_layout.h",
+        }
+
+        includedirs {
+            "../include",
+        }
+
+        configuration "Debug"
+            targetdir "../bin/Tools/Debug"
+
+        configuration "Release"
+            targetdir "../bin/Tools/Release"
+
+        configuration "Shipping"
+            targetdir "../bin/Tools/Shipping"
+
+    project "Packer"
+        location "../build/Packer"
+        kind "ConsoleApp"
+        objdir "../build/Packer/obj"
+
+        files {
+            "../tools/packer/**.cc",
+            "../include/pack_format.h",
+            "../include/lz4.h",
+            "../src/lz4.cc",
+        }
+
+        includedirs {
+            "../include",
+        }
+
+        configuration "Debug"
+            targetdir "../bin/Tools/Debug"
+
+        configuration "Release"
+            targetdir "../bin/Tools/Release"
+
+        configuration "Shipping"
+            targetdir "../bin/Tools/Shipping"
@@ -1,3 +1,5 @@
 call ..\tools\glslc\glslc.exe shader.vert -o vert.spv
 call ..\tools\glslc\glslc.exe shader.frag -o frag.spv
+call ..\tools\glslc\glslc.exe yuv420.comp -o yuv420.spv
+call ..\tools\glslc\glslc.exe cluster_cull.comp -o cluster_cull.spv
 PAUSE
\ No newline at end of file
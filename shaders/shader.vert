@@ -1,4 +1,5 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
 
 layout(binding = 0) uniform UniformBufferObject {
     mat4 model;
@@ -6,12 +7,12 @@ layout(binding = 0) uniform UniformBufferObject {
     mat4 projection;
 } ubo;
 
-layout(location = 0) in vec3 position;
-layout(location = 1) in vec3 color;
+// Written by meshconv --glsl for the layout of data/cube.mesh
+#include "vertex_input.glsl"
 
 layout(location = 0) out vec3 vertexColor; 
 
 void main() {
-    vertexColor = color;
-    gl_Position = ubo.projection * ubo.view * ubo.model * vec4(position, 1.0);
-}
\ No newline at end of file
+    vertexColor = decodeColor();
+    gl_Position = ubo.projection * ubo.view * ubo.model * vec4(decodePosition(), 1.0);
+}
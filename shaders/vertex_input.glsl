@@ -0,0 +1,8 @@
+// Generated by meshconv for the vertex layout: position snorm16 color unorm8 normal none
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 color;
+
+// Object space once multiplied by the model matrix, which holds the dequantization
+vec3 decodePosition() { return position; }
+vec3 decodeColor() { return color; }
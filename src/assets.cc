@@ -0,0 +1,221 @@
+#include "assets.h"
+
+#include <set>
+#include <mutex>
+#include <atomic>
+
+#include "job_system.h"
+#include "async_io.h"
+#include "logger.h"
+#include "pack_file.h"
+
+// Larger loose files are split so their reads overlap
+static const uint32_t kLooseReadSize = 4 * 1024 * 1024;
+
+static PackFile pack;
+static std::string loose_root = "../../";
+
+static std::mutex changed_mutex;
+static std::set<std::string> changed_names;
+
+Asset::Asset() { }
+
+Asset::Asset(Asset&& other)
+{
+  *this = static_cast<Asset&&>(other);
+}
+
+Asset& Asset::operator=(Asset&& other)
+{
+  if (this != &other)
+  {
+    _data = other._data;
+    _size = other._size;
+    _storage.swap(other._storage);
+
+    other._data = nullptr;
+    other._size = 0;
+    other._storage.clear();
+  }
+
+  return *this;
+}
+
+int Assets::mount(const std::string& pack_file)
+{
+  if (!pack.open(pack_file))
+  {
+    LOG_WARNING("Assets", "No pack at %s, using loose files", pack_file.c_str());
+    return 0;
+  }
+
+  return 1;
+}
+
+void Assets::unmount()
+{
+  pack.close();
+}
+
+void Assets::setRoot(const std::string& new_root)
+{
+  loose_root = new_root;
+}
+
+const std::string& Assets::root()
+{
+  return loose_root;
+}
+
+void Assets::markChanged(const std::string& name)
+{
+  std::lock_guard<std::mutex> lock(changed_mutex);
+  changed_names.insert(name);
+}
+
+static bool changed(const std::string& name)
+{
+  std::lock_guard<std::mutex> lock(changed_mutex);
+  return !changed_names.empty() && changed_names.count(name) != 0;
+}
+
+int Assets::load(const std::string& name, Asset* asset)
+{
+  *asset = Asset();
+
+  const PackEntry* entry = changed(name) ? nullptr : pack.find(name);
+  if (entry == nullptr)
+  {
+    const char* names[] = { name.c_str() };
+    uint32_t index = 0;
+    return readLoose(names, &index, 1, asset);
+  }
+
+  if (entry->compression == kPackCompression_None)
+  {
+    asset->_data = pack.entryData(*entry);
+    asset->_size = (size_t) entry->size;
+    return 1;
+  }
+
+  // At least one element so empty entries still get a valid pointer
+  asset->_storage.resize((size_t) (entry->size + sizeof(uint64_t) - 1) / sizeof(uint64_t) + 1);
+  if (!pack.decompress(*entry, (uint8_t*) asset->_storage.data()))
+  {
+    asset->_storage.clear();
+    return 0;
+  }
+
+  asset->_data = (const uint8_t*) asset->_storage.data();
+  asset->_size = (size_t) entry->size;
+  return 1;
+}
+
+int Assets::loadMany(const char* const* names, uint32_t count, Asset* assets)
+{
+  std::vector<uint32_t> loose;
+  std::vector<uint32_t> packed;
+  for (uint32_t i = 0; i < count; i++)
+  {
+    assets[i] = Asset();
+    bool in_pack = !changed(names[i]) && pack.find(names[i]) != nullptr;
+    (in_pack ? packed : loose).push_back(i);
+  }
+
+  std::atomic<int> failed(0);
+  if (!loose.empty() && !readLoose(names, loose.data(), (uint32_t) loose.size(), assets))
+  {
+    failed = 1;
+  }
+
+  // Each asset spreads its own blocks too, waiting on those runs other jobs
+  JobSystem::parallelFor((uint32_t) packed.size(), 1, [names, assets, &packed, &failed](uint32_t begin, uint32_t end) {
+    for (uint32_t i = begin; i < end; i++)
+    {
+      if (!load(names[packed[i]], &assets[packed[i]]))
+      {
+        failed = 1;
+      }
+    }
+  });
+
+  return failed ? 0 : 1;
+}
+
+struct LooseFile
+{
+  const char* name;
+  IoFile file;
+  std::atomic<int>* failed;
+};
+
+static void looseReadDone(const IoRead& read, int64_t result, void* user_data)
+{
+  LooseFile* loose_file = (LooseFile*) user_data;
+  if (result != (int64_t) read.size)
+  {
+    LOG_ERROR("Assets", "Failed reading asset: %s", loose_file->name);
+    *loose_file->failed = 1;
+  }
+}
+
+int Assets::readLoose(const char* const* names, const uint32_t* indices, uint32_t count, Asset* assets)
+{
+  std::atomic<int> failed(0);
+  std::vector<LooseFile> files(count);
+  std::vector<IoRead> reads;
+
+  for (uint32_t i = 0; i < count; i++)
+  {
+    LooseFile& loose_file = files[i];
+    loose_file.name = names[indices[i]];
+    loose_file.failed = &failed;
+    if (!AsyncIo::openFile(loose_root + loose_file.name, &loose_file.file))
+    {
+      LOG_ERROR("Assets", "Missing asset: %s", loose_file.name);
+      failed = 1;
+      continue;
+    }
+
+    // At least one element so empty files still get a valid pointer
+    Asset* asset = &assets[indices[i]];
+    asset->_storage.resize((size_t) (loose_file.file.size + sizeof(uint64_t) - 1) / sizeof(uint64_t) + 1);
+    asset->_data = (const uint8_t*) asset->_storage.data();
+    asset->_size = (size_t) loose_file.file.size;
+
+    for (uint64_t offset = 0; offset < loose_file.file.size; offset += kLooseReadSize)
+    {
+      uint64_t left = loose_file.file.size - offset;
+
+      IoRead read = {};
+      read.file = loose_file.file;
+      read.offset = offset;
+      read.size = left < kLooseReadSize ? (uint32_t) left : kLooseReadSize;
+      read.destination = (uint8_t*) asset->_storage.data() + offset;
+      read.callback = looseReadDone;
+      read.user_data = &loose_file;
+      reads.push_back(read);
+    }
+  }
+
+  // One submission for the whole batch. Waiting covers reads other threads
+  // submitted too, only assets read through AsyncIo so that stays short.
+  AsyncIo::submit(reads.data(), (uint32_t) reads.size());
+  AsyncIo::waitIdle();
+
+  for (uint32_t i = 0; i < count; i++)
+  {
+    AsyncIo::closeFile(&files[i].file);
+  }
+
+  if (failed)
+  {
+    for (uint32_t i = 0; i < count; i++)
+    {
+      assets[indices[i]] = Asset();
+    }
+    return 0;
+  }
+
+  return 1;
+}
@@ -0,0 +1,551 @@
+#include "async_io.h"
+
+#include <string.h>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+#include "job_system.h"
+#include "logger.h"
+
+struct IoSlot
+{
+  IoRead read;
+  int64_t result;
+};
+
+static const uint32_t kPoolThreads = 4;
+static const uint32_t kMaxQueueDepth = 1024;
+static const uint64_t kWakeUpData = UINT64_MAX;
+
+static bool initialized = false;
+static bool use_uring = false;
+
+// Slots bound the reads in flight, the rest wait in pending_reads
+static std::mutex mutex;
+static std::vector<IoSlot> slots;
+static std::vector<uint32_t> free_slots;
+static std::deque<IoRead> pending_reads;
+
+// Submitted reads whose callback has not been queued yet
+static std::atomic<uint32_t> in_flight(0);
+static JobCounter* callbacks = nullptr;
+
+// Thread pool backend
+static std::vector<std::thread> pool_threads;
+static std::deque<uint32_t> pool_queue;
+static std::condition_variable pool_condition;
+static bool pool_running = false;
+
+#ifdef __linux__
+// io_uring backend, through raw syscalls so there is no liburing dependency
+struct Uring
+{
+  int fd = -1;
+  void* sq_ring = nullptr;
+  void* cq_ring = nullptr;
+  size_t sq_ring_size = 0;
+  size_t cq_ring_size = 0;
+  io_uring_sqe* sqes = nullptr;
+  size_t sqes_size = 0;
+
+  uint32_t* sq_tail = nullptr;
+  uint32_t* sq_mask = nullptr;
+  uint32_t* sq_array = nullptr;
+  uint32_t* cq_head = nullptr;
+  uint32_t* cq_tail = nullptr;
+  uint32_t* cq_mask = nullptr;
+  io_uring_cqe* cqes = nullptr;
+
+  std::thread reaper;
+};
+
+static Uring uring;
+#endif
+
+static void completeRead(void* data);
+static void flushPending();
+
+// Called by the backends once the kernel is done with a slot
+static void finishRead(uint32_t index, int64_t result)
+{
+  slots[index].result = result;
+
+  // Counted before in_flight drops so waitIdle never misses it
+  JobSystem::run(completeRead, &slots[index], callbacks);
+  in_flight.fetch_sub(1);
+}
+
+static void completeRead(void* data)
+{
+  IoSlot* slot = (IoSlot*) data;
+  IoRead read = slot->read;
+  int64_t result = slot->result;
+
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    free_slots.push_back((uint32_t) (slot - slots.data()));
+    flushPending();
+  }
+
+  read.callback(read, result, read.user_data);
+}
+
+static int64_t readAt(const IoRead& read)
+{
+#ifdef _WIN32
+  OVERLAPPED overlapped = {};
+  overlapped.Offset = (DWORD) (read.offset & 0xFFFFFFFF);
+  overlapped.OffsetHigh = (DWORD) (read.offset >> 32);
+
+  DWORD bytes = 0;
+  if (!ReadFile((HANDLE) read.file.handle, read.destination, read.size, &bytes, &overlapped) &&
+      GetLastError() != ERROR_HANDLE_EOF)
+  {
+    return -1;
+  }
+
+  return bytes;
+#else
+  ssize_t bytes = pread((int) read.file.handle, read.destination, read.size, (off_t) read.offset);
+  return bytes < 0 ? -errno : bytes;
+#endif
+}
+
+static void poolWorker()
+{
+  while (true)
+  {
+    uint32_t index;
+
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      pool_condition.wait(lock, []() { return !pool_queue.empty() || !pool_running; });
+
+      if (pool_queue.empty())
+      {
+        return;
+      }
+
+      index = pool_queue.front();
+      pool_queue.pop_front();
+    }
+
+    finishRead(index, readAt(slots[index].read));
+  }
+}
+
+#ifdef __linux__
+static int uringSetup(uint32_t entries)
+{
+  io_uring_params params = {};
+  int fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+  if (fd < 0)
+  {
+    return 0;
+  }
+
+  // IORING_OP_READ came in 5.6, fast poll in 5.7, so this rules out
+  // kernels that would fail every read
+  if (!(params.features & IORING_FEAT_FAST_POLL))
+  {
+    close(fd);
+    return 0;
+  }
+
+  uring.fd = fd;
+  uring.sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+  uring.cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+  bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single_mmap)
+  {
+    size_t size = uring.sq_ring_size > uring.cq_ring_size ? uring.sq_ring_size : uring.cq_ring_size;
+    uring.sq_ring_size = uring.cq_ring_size = size;
+  }
+
+  uring.sq_ring = mmap(nullptr, uring.sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  uring.cq_ring = single_mmap ? uring.sq_ring :
+    mmap(nullptr, uring.cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+  uring.sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  void* sqes = mmap(nullptr, uring.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+
+  if (uring.sq_ring == MAP_FAILED || uring.cq_ring == MAP_FAILED || sqes == MAP_FAILED)
+  {
+    LOG_WARNING("AsyncIo", "Failed mapping io_uring rings");
+    close(fd);
+    uring.fd = -1;
+    return 0;
+  }
+
+  uint8_t* sq = (uint8_t*) uring.sq_ring;
+  uint8_t* cq = (uint8_t*) uring.cq_ring;
+  uring.sqes = (io_uring_sqe*) sqes;
+  uring.sq_tail = (uint32_t*) (sq + params.sq_off.tail);
+  uring.sq_mask = (uint32_t*) (sq + params.sq_off.ring_mask);
+  uring.sq_array = (uint32_t*) (sq + params.sq_off.array);
+  uring.cq_head = (uint32_t*) (cq + params.cq_off.head);
+  uring.cq_tail = (uint32_t*) (cq + params.cq_off.tail);
+  uring.cq_mask = (uint32_t*) (cq + params.cq_off.ring_mask);
+  uring.cqes = (io_uring_cqe*) (cq + params.cq_off.cqes);
+
+  return 1;
+}
+
+static void uringRelease()
+{
+  if (uring.fd < 0)
+  {
+    return;
+  }
+
+  munmap(uring.sqes, uring.sqes_size);
+  if (uring.cq_ring != uring.sq_ring)
+  {
+    munmap(uring.cq_ring, uring.cq_ring_size);
+  }
+  munmap(uring.sq_ring, uring.sq_ring_size);
+  close(uring.fd);
+
+  uring = Uring();
+}
+
+// Callers hold the mutex, slots never outnumber ring entries so there is
+// always room
+static void uringQueue(uint8_t opcode, const IoRead* read, uint64_t user_data)
+{
+  uint32_t tail = *uring.sq_tail;
+  uint32_t index = tail & *uring.sq_mask;
+
+  io_uring_sqe* sqe = &uring.sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = opcode;
+  sqe->user_data = user_data;
+  sqe->fd = -1;
+
+  if (read != nullptr)
+  {
+    sqe->fd = (int) read->file.handle;
+    sqe->off = read->offset;
+    sqe->addr = (uint64_t) (uintptr_t) read->destination;
+    sqe->len = read->size;
+  }
+
+  uring.sq_array[index] = index;
+  __atomic_store_n(uring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static void uringSubmit(uint32_t count)
+{
+  while (count > 0)
+  {
+    int submitted = (int) syscall(__NR_io_uring_enter, uring.fd, count, 0, 0, nullptr, 0);
+    if (submitted < 0)
+    {
+      if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+      {
+        continue;
+      }
+
+      LOG_ERROR("AsyncIo", "io_uring_enter failed: %d", errno);
+      return;
+    }
+    count -= (uint32_t) submitted;
+  }
+}
+
+static void uringReaper()
+{
+  while (true)
+  {
+    uint32_t head = *uring.cq_head;
+    uint32_t tail = __atomic_load_n(uring.cq_tail, __ATOMIC_ACQUIRE);
+
+    if (head == tail)
+    {
+      syscall(__NR_io_uring_enter, uring.fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+      continue;
+    }
+
+    bool stop = false;
+    for (; head != tail; head++)
+    {
+      const io_uring_cqe& cqe = uring.cqes[head & *uring.cq_mask];
+      if (cqe.user_data == kWakeUpData)
+      {
+        stop = true;
+        continue;
+      }
+
+      finishRead((uint32_t) cqe.user_data, cqe.res);
+    }
+
+    __atomic_store_n(uring.cq_head, head, __ATOMIC_RELEASE);
+
+    if (stop)
+    {
+      return;
+    }
+  }
+}
+#endif
+
+// Moves pending reads into free slots and hands them to the backend, the
+// caller holds the mutex
+static void flushPending()
+{
+  uint32_t queued = 0;
+
+  while (!pending_reads.empty() && !free_slots.empty())
+  {
+    uint32_t index = free_slots.back();
+    free_slots.pop_back();
+
+    slots[index].read = pending_reads.front();
+    pending_reads.pop_front();
+
+#ifdef __linux__
+    if (use_uring)
+    {
+      uringQueue(IORING_OP_READ, &slots[index].read, index);
+      queued++;
+      continue;
+    }
+#endif
+
+    pool_queue.push_back(index);
+    queued++;
+  }
+
+  if (queued == 0)
+  {
+    return;
+  }
+
+#ifdef __linux__
+  if (use_uring)
+  {
+    // One syscall for the whole batch
+    uringSubmit(queued);
+    return;
+  }
+#endif
+
+  if (queued == 1)
+  {
+    pool_condition.notify_one();
+  }
+  else
+  {
+    pool_condition.notify_all();
+  }
+}
+
+int AsyncIo::init(uint32_t queue_depth)
+{
+  if (initialized)
+  {
+    LOG_WARNING("AsyncIo", "Async IO already initialized");
+    return 1;
+  }
+
+  // Completions are queued as jobs from a single thread, whose job ring
+  // must not wrap around
+  if (queue_depth == 0)
+  {
+    queue_depth = 1;
+  }
+  if (queue_depth > kMaxQueueDepth)
+  {
+    queue_depth = kMaxQueueDepth;
+  }
+
+  slots.resize(queue_depth);
+  free_slots.clear();
+  for (uint32_t i = queue_depth; i > 0; i--)
+  {
+    free_slots.push_back(i - 1);
+  }
+
+  callbacks = new JobCounter();
+  in_flight = 0;
+
+#ifdef __linux__
+  use_uring = uringSetup(queue_depth) != 0;
+  if (use_uring)
+  {
+    uring.reaper = std::thread(uringReaper);
+  }
+#endif
+
+  if (!use_uring)
+  {
+    pool_running = true;
+    for (uint32_t i = 0; i < kPoolThreads; i++)
+    {
+      pool_threads.push_back(std::thread(poolWorker));
+    }
+  }
+
+  initialized = true;
+  LOG_DEBUG("AsyncIo", "Running on %s, %d reads in flight", backendName(), queue_depth);
+  return 1;
+}
+
+void AsyncIo::shutdown()
+{
+  if (!initialized)
+  {
+    return;
+  }
+
+  waitIdle();
+
+#ifdef __linux__
+  if (use_uring)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      uringQueue(IORING_OP_NOP, nullptr, kWakeUpData);
+      uringSubmit(1);
+    }
+
+    uring.reaper.join();
+    uringRelease();
+  }
+#endif
+
+  if (!use_uring)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      pool_running = false;
+    }
+    pool_condition.notify_all();
+
+    for (size_t i = 0; i < pool_threads.size(); i++)
+    {
+      pool_threads[i].join();
+    }
+    pool_threads.clear();
+  }
+
+  delete callbacks;
+  callbacks = nullptr;
+  slots.clear();
+  free_slots.clear();
+  use_uring = false;
+  initialized = false;
+}
+
+const char* AsyncIo::backendName()
+{
+  return use_uring ? "io_uring" : "thread pool";
+}
+
+int AsyncIo::openFile(const std::string& file_name, IoFile* file)
+{
+#ifdef _WIN32
+  HANDLE handle = CreateFile(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (handle == INVALID_HANDLE_VALUE)
+  {
+    LOG_WARNING("AsyncIo", "Failed opening file: %s", file_name.c_str());
+    return 0;
+  }
+
+  LARGE_INTEGER size;
+  GetFileSizeEx(handle, &size);
+
+  file->handle = (intptr_t) handle;
+  file->size = (uint64_t) size.QuadPart;
+#else
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    LOG_WARNING("AsyncIo", "Failed opening file: %s", file_name.c_str());
+    return 0;
+  }
+
+  struct stat info;
+  fstat(fd, &info);
+
+  file->handle = fd;
+  file->size = (uint64_t) info.st_size;
+#endif
+
+  return 1;
+}
+
+void AsyncIo::closeFile(IoFile* file)
+{
+  if (file->handle == -1)
+  {
+    return;
+  }
+
+#ifdef _WIN32
+  CloseHandle((HANDLE) file->handle);
+#else
+  close((int) file->handle);
+#endif
+
+  file->handle = -1;
+  file->size = 0;
+}
+
+void AsyncIo::submit(const IoRead* reads, uint32_t count)
+{
+  if (!initialized)
+  {
+    // Keep working before init, synchronously
+    for (uint32_t i = 0; i < count; i++)
+    {
+      reads[i].callback(reads[i], readAt(reads[i]), reads[i].user_data);
+    }
+    return;
+  }
+
+  in_flight.fetch_add(count);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  pending_reads.insert(pending_reads.end(), reads, reads + count);
+  flushPending();
+}
+
+void AsyncIo::waitIdle()
+{
+  if (!initialized)
+  {
+    return;
+  }
+
+  // Pending reads only start when a callback frees their slot, so run
+  // queued callbacks on this thread too instead of just spinning
+  while (in_flight.load() > 0)
+  {
+    JobSystem::wait(callbacks);
+    std::this_thread::yield();
+  }
+
+  JobSystem::wait(callbacks);
+}
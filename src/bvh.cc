@@ -0,0 +1,512 @@
+#include "bvh.h"
+
+#include <float.h>
+
+#include <algorithm>
+
+#include "job_system.h"
+#include "scene.h"
+
+// Candidate split positions per axis
+static const uint32_t kBinCount = 16;
+// Leaves per refit job
+static const uint32_t kRefitBatch = 1024;
+// Rebuilds as soon as refitting made the tree this much worse
+static const float kRebuildGrowth = 1.5f;
+// Or after this many refits if it got worse at all
+static const uint32_t kRebuildInterval = 600;
+static const float kRebuildDrift = 1.05f;
+// Subtrees handed to every worker, to even out their sizes
+static const uint32_t kTasksPerWorker = 4;
+
+static float surfaceArea(const glm::vec3& bounds_min, const glm::vec3& bounds_max)
+{
+  glm::vec3 extent = bounds_max - bounds_min;
+  if (extent.x < 0.0f || extent.y < 0.0f || extent.z < 0.0f)
+  {
+    return 0.0f;
+  }
+  return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+static void setLane(BoxLanes* box, uint32_t lane, const glm::vec3& bounds_min, const glm::vec3& bounds_max)
+{
+  box->min_x[lane] = bounds_min.x;
+  box->min_y[lane] = bounds_min.y;
+  box->min_z[lane] = bounds_min.z;
+  box->max_x[lane] = bounds_max.x;
+  box->max_y[lane] = bounds_max.y;
+  box->max_z[lane] = bounds_max.z;
+}
+
+static void clearLane(BoxLanes* box, uint32_t lane)
+{
+  setLane(box, lane, glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX));
+}
+
+// Box around all four lanes, cleared lanes do not grow it
+static void laneBounds(const BoxLanes& box, glm::vec3* bounds_min, glm::vec3* bounds_max)
+{
+  *bounds_min = glm::vec3(FLT_MAX);
+  *bounds_max = glm::vec3(-FLT_MAX);
+  for (uint32_t lane = 0; lane < 4; lane++)
+  {
+    *bounds_min = glm::min(*bounds_min, glm::vec3(box.min_x[lane], box.min_y[lane], box.min_z[lane]));
+    *bounds_max = glm::max(*bounds_max, glm::vec3(box.max_x[lane], box.max_y[lane], box.max_z[lane]));
+  }
+}
+
+void Frustum::setMatrix(const glm::mat4& clip)
+{
+  glm::vec4 rows[4];
+  for (uint32_t i = 0; i < 4; i++)
+  {
+    rows[i] = glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+  }
+
+  planes[0] = rows[3] + rows[0];
+  planes[1] = rows[3] - rows[0];
+  planes[2] = rows[3] + rows[1];
+  planes[3] = rows[3] - rows[1];
+#ifdef GLM_FORCE_DEPTH_ZERO_TO_ONE
+  planes[4] = rows[2];
+#else
+  planes[4] = rows[3] + rows[2];
+#endif
+  planes[5] = rows[3] - rows[2];
+
+  // Normalized so distances are in world units
+  for (uint32_t i = 0; i < 6; i++)
+  {
+    planes[i] /= glm::length(glm::vec3(planes[i]));
+  }
+}
+
+void Bvh::update(const Scene& scene)
+{
+  _stats.rebuilt = false;
+
+  if (scene.count() != _object_count || scene.layoutVersion() != _layout_version)
+  {
+    build(scene);
+    return;
+  }
+
+  if (_nodes.empty())
+  {
+    return;
+  }
+
+  refit(scene);
+  _refits++;
+
+  if (_cost > _built_cost * kRebuildGrowth || (_refits >= kRebuildInterval && _cost > _built_cost * kRebuildDrift))
+  {
+    build(scene);
+  }
+  else if (_refits >= kRebuildInterval)
+  {
+    _refits = 0;
+  }
+}
+
+void Bvh::build(const Scene& scene)
+{
+  _object_count = scene.count();
+  _layout_version = scene.layoutVersion();
+  _nodes.clear();
+  _leaves.clear();
+  _refits = 0;
+  _stats.rebuilt = true;
+
+  if (_object_count == 0)
+  {
+    _cost = _built_cost = 0.0f;
+    return;
+  }
+
+  const glm::vec3* bounds_min = scene.worldBoundsMin();
+  const glm::vec3* bounds_max = scene.worldBoundsMax();
+
+  _items.resize(_object_count);
+  for (uint32_t i = 0; i < _object_count; i++)
+  {
+    BuildItem& item = _items[i];
+    item.center = (bounds_min[i] + bounds_max[i]) * 0.5f;
+    item.object = i;
+    item.bounds_min = bounds_min[i];
+    item.bounds_max = bounds_max[i];
+  }
+
+  _nodes.reserve(_object_count / kLeafSize);
+  _leaves.reserve(_object_count / 2);
+  buildNode(0, _object_count);
+
+  // Boxes are filled the same way a moving scene refits them
+  refit(scene);
+  _built_cost = _cost;
+}
+
+uint32_t Bvh::buildNode(uint32_t begin, uint32_t end)
+{
+  uint32_t node = (uint32_t) _nodes.size();
+  _nodes.push_back(Node());
+
+  // Splits the largest range until there is one per child
+  Range ranges[4] = { { begin, end } };
+  uint32_t range_count = 1;
+  while (range_count < 4)
+  {
+    uint32_t largest = 0;
+    for (uint32_t i = 1; i < range_count; i++)
+    {
+      largest = ranges[i].end - ranges[i].begin > ranges[largest].end - ranges[largest].begin ? i : largest;
+    }
+
+    Range range = ranges[largest];
+    if (range.end - range.begin <= kLeafSize)
+    {
+      break;
+    }
+
+    uint32_t middle = split(range.begin, range.end);
+    ranges[largest].end = middle;
+    ranges[range_count].begin = middle;
+    ranges[range_count].end = range.end;
+    range_count++;
+  }
+
+  for (uint32_t i = 0; i < 4; i++)
+  {
+    uint32_t child = kEmptyChild;
+    if (i < range_count && ranges[i].end - ranges[i].begin <= kLeafSize)
+    {
+      Leaf leaf = {};
+      leaf.count = ranges[i].end - ranges[i].begin;
+      for (uint32_t j = 0; j < leaf.count; j++)
+      {
+        leaf.objects[j] = _items[ranges[i].begin + j].object;
+      }
+
+      child = kLeafFlag | (uint32_t) _leaves.size();
+      _leaves.push_back(leaf);
+    }
+    else if (i < range_count)
+    {
+      child = buildNode(ranges[i].begin, ranges[i].end);
+    }
+
+    // Not a reference, the recursion grows the array
+    _nodes[node].children[i] = child;
+  }
+
+  return node;
+}
+
+uint32_t Bvh::split(uint32_t begin, uint32_t end)
+{
+  glm::vec3 center_min(FLT_MAX), center_max(-FLT_MAX);
+  for (uint32_t i = begin; i < end; i++)
+  {
+    center_min = glm::min(center_min, _items[i].center);
+    center_max = glm::max(center_max, _items[i].center);
+  }
+
+  // Binned surface area heuristic, every object goes to the bin of its
+  // center on each axis and the split is placed between two bins
+  glm::vec3 scale(0.0f);
+  for (int32_t axis = 0; axis < 3; axis++)
+  {
+    float extent = center_max[axis] - center_min[axis];
+    scale[axis] = extent > 0.0f ? kBinCount / extent : 0.0f;
+  }
+
+  uint32_t counts[3][kBinCount] = {};
+  glm::vec3 bins_min[3][kBinCount], bins_max[3][kBinCount];
+  for (int32_t axis = 0; axis < 3; axis++)
+  {
+    std::fill(bins_min[axis], bins_min[axis] + kBinCount, glm::vec3(FLT_MAX));
+    std::fill(bins_max[axis], bins_max[axis] + kBinCount, glm::vec3(-FLT_MAX));
+  }
+
+  for (uint32_t i = begin; i < end; i++)
+  {
+    const BuildItem& item = _items[i];
+    glm::vec3 position = (item.center - center_min) * scale;
+    for (int32_t axis = 0; axis < 3; axis++)
+    {
+      uint32_t bin = std::min((uint32_t) position[axis], kBinCount - 1);
+      counts[axis][bin]++;
+      bins_min[axis][bin] = glm::min(bins_min[axis][bin], item.bounds_min);
+      bins_max[axis][bin] = glm::max(bins_max[axis][bin], item.bounds_max);
+    }
+  }
+
+  float best_cost = FLT_MAX;
+  int32_t best_axis = -1;
+  uint32_t best_bin = 0;
+
+  for (int32_t axis = 0; axis < 3; axis++)
+  {
+    if (scale[axis] == 0.0f)
+    {
+      continue;
+    }
+
+    // Right side costs first, then the left side sweeps towards them
+    float right_costs[kBinCount];
+    glm::vec3 side_min(FLT_MAX), side_max(-FLT_MAX);
+    uint32_t side_count = 0;
+    for (uint32_t bin = kBinCount - 1; bin > 0; bin--)
+    {
+      side_min = glm::min(side_min, bins_min[axis][bin]);
+      side_max = glm::max(side_max, bins_max[axis][bin]);
+      side_count += counts[axis][bin];
+      right_costs[bin - 1] = surfaceArea(side_min, side_max) * side_count;
+    }
+
+    side_min = glm::vec3(FLT_MAX);
+    side_max = glm::vec3(-FLT_MAX);
+    side_count = 0;
+    for (uint32_t bin = 0; bin + 1 < kBinCount; bin++)
+    {
+      side_min = glm::min(side_min, bins_min[axis][bin]);
+      side_max = glm::max(side_max, bins_max[axis][bin]);
+      side_count += counts[axis][bin];
+
+      float cost = surfaceArea(side_min, side_max) * side_count + right_costs[bin];
+      if (side_count > 0 && side_count < end - begin && cost < best_cost)
+      {
+        best_cost = cost;
+        best_axis = axis;
+        best_bin = bin;
+      }
+    }
+  }
+
+  // All centers in one place, any split is as good as another
+  if (best_axis < 0)
+  {
+    return begin + (end - begin) / 2;
+  }
+
+  // Same arithmetic as the binning, so every object lands on its bin side
+  BuildItem* middle = std::partition(&_items[0] + begin, &_items[0] + end, [&](const BuildItem& item) {
+    glm::vec3 position = (item.center - center_min) * scale;
+    return std::min((uint32_t) position[best_axis], kBinCount - 1) <= best_bin;
+  });
+
+  return (uint32_t) (middle - &_items[0]);
+}
+
+void Bvh::refit(const Scene& scene)
+{
+  const glm::vec3* bounds_min = scene.worldBoundsMin();
+  const glm::vec3* bounds_max = scene.worldBoundsMax();
+
+  JobSystem::parallelFor((uint32_t) _leaves.size(), kRefitBatch, [this, bounds_min, bounds_max](uint32_t first, uint32_t last) {
+    for (uint32_t i = first; i < last; i++)
+    {
+      refitLeaf(&_leaves[i], bounds_min, bounds_max);
+    }
+  });
+
+  // Children are always created after their parent, so a reverse pass
+  // sees every child before the node that encloses it
+  for (size_t i = _nodes.size(); i-- > 0;)
+  {
+    Node& node = _nodes[i];
+    for (uint32_t lane = 0; lane < 4; lane++)
+    {
+      uint32_t child = node.children[lane];
+      if (child == kEmptyChild)
+      {
+        clearLane(&node.bounds, lane);
+        continue;
+      }
+
+      glm::vec3 child_min, child_max;
+      laneBounds((child & kLeafFlag) ? _leaves[child & ~kLeafFlag].bounds : _nodes[child].bounds, &child_min, &child_max);
+      setLane(&node.bounds, lane, child_min, child_max);
+    }
+  }
+
+  _cost = surfaceCost();
+}
+
+void Bvh::refitLeaf(Leaf* leaf, const glm::vec3* bounds_min, const glm::vec3* bounds_max)
+{
+  for (uint32_t lane = 0; lane < 4; lane++)
+  {
+    if (lane < leaf->count)
+    {
+      setLane(&leaf->bounds, lane, bounds_min[leaf->objects[lane]], bounds_max[leaf->objects[lane]]);
+    }
+    else
+    {
+      clearLane(&leaf->bounds, lane);
+    }
+  }
+}
+
+// Expected number of node tests for a random ray or box, up to a constant
+float Bvh::surfaceCost() const
+{
+  glm::vec3 root_min, root_max;
+  laneBounds(_nodes[0].bounds, &root_min, &root_max);
+  float root_area = surfaceArea(root_min, root_max);
+  if (root_area <= 0.0f)
+  {
+    return 0.0f;
+  }
+
+  float area = 0.0f;
+  for (const Node& node : _nodes)
+  {
+    for (uint32_t lane = 0; lane < 4; lane++)
+    {
+      area += surfaceArea(
+        glm::vec3(node.bounds.min_x[lane], node.bounds.min_y[lane], node.bounds.min_z[lane]),
+        glm::vec3(node.bounds.max_x[lane], node.bounds.max_y[lane], node.bounds.max_z[lane]));
+    }
+  }
+
+  return area / root_area;
+}
+
+void Bvh::cull(const Frustum& frustum, std::vector<uint32_t>* visible)
+{
+  visible->clear();
+
+  bool rebuilt = _stats.rebuilt;
+  _stats = BvhStats();
+  _stats.rebuilt = rebuilt;
+
+  if (_nodes.empty())
+  {
+    return;
+  }
+
+  // Breadth first, one level at a time, until there are enough subtrees
+  uint32_t target = std::max(JobSystem::workerCount(), 1u) * kTasksPerWorker;
+
+  _tasks.clear();
+  _tasks.push_back({ 0, false });
+
+  std::vector<Task> next;
+  bool expanded = true;
+  while (expanded && _tasks.size() < target)
+  {
+    expanded = false;
+    next.clear();
+    for (const Task& task : _tasks)
+    {
+      if (task.inside || (task.child & kLeafFlag))
+      {
+        next.push_back(task);
+      }
+      else
+      {
+        expand(frustum, task.child, &next, &_stats);
+        expanded = true;
+      }
+    }
+    _tasks.swap(next);
+  }
+
+  uint32_t task_count = (uint32_t) _tasks.size();
+  _task_visible.resize(task_count);
+  _task_stats.assign(task_count, BvhStats());
+
+  JobSystem::parallelFor(task_count, 1, [this, &frustum](uint32_t first, uint32_t last) {
+    for (uint32_t i = first; i < last; i++)
+    {
+      _task_visible[i].clear();
+      traverse(frustum, _tasks[i], &_task_visible[i], &_task_stats[i]);
+    }
+  });
+
+  for (uint32_t i = 0; i < task_count; i++)
+  {
+    visible->insert(visible->end(), _task_visible[i].begin(), _task_visible[i].end());
+    _stats.nodes_visited += _task_stats[i].nodes_visited;
+    _stats.leaves_visited += _task_stats[i].leaves_visited;
+  }
+
+  _stats.objects_visible = (uint32_t) visible->size();
+  _stats.objects_culled = _object_count - _stats.objects_visible;
+}
+
+void Bvh::traverse(const Frustum& frustum, Task task, std::vector<uint32_t>* visible, BvhStats* stats) const
+{
+  std::vector<Task> stack;
+  stack.push_back(task);
+
+  while (!stack.empty())
+  {
+    Task current = stack.back();
+    stack.pop_back();
+
+    if (current.inside)
+    {
+      accept(current.child, visible);
+    }
+    else if (current.child & kLeafFlag)
+    {
+      const Leaf& leaf = _leaves[current.child & ~kLeafFlag];
+      stats->leaves_visited++;
+
+      uint32_t mask;
+      Simd::classifyBoxes(frustum.planes, 6, &leaf.bounds, 1, &mask);
+      for (uint32_t lane = 0; lane < leaf.count; lane++)
+      {
+        if (!(mask & (1 << lane)))
+        {
+          visible->push_back(leaf.objects[lane]);
+        }
+      }
+    }
+    else
+    {
+      expand(frustum, current.child, &stack, stats);
+    }
+  }
+}
+
+void Bvh::accept(uint32_t child, std::vector<uint32_t>* visible) const
+{
+  if (child & kLeafFlag)
+  {
+    const Leaf& leaf = _leaves[child & ~kLeafFlag];
+    visible->insert(visible->end(), leaf.objects, leaf.objects + leaf.count);
+    return;
+  }
+
+  for (uint32_t lane = 0; lane < 4; lane++)
+  {
+    if (_nodes[child].children[lane] != kEmptyChild)
+    {
+      accept(_nodes[child].children[lane], visible);
+    }
+  }
+}
+
+void Bvh::expand(const Frustum& frustum, uint32_t node, std::vector<Task>* tasks, BvhStats* stats) const
+{
+  const Node& current = _nodes[node];
+  stats->nodes_visited++;
+
+  uint32_t mask;
+  Simd::classifyBoxes(frustum.planes, 6, &current.bounds, 1, &mask);
+
+  for (uint32_t lane = 0; lane < 4; lane++)
+  {
+    uint32_t child = current.children[lane];
+    if (child == kEmptyChild || (mask & (1 << lane)))
+    {
+      continue;
+    }
+
+    tasks->push_back({ child, (mask & (0x10 << lane)) != 0 });
+  }
+}
@@ -0,0 +1,203 @@
+#include "clock.h"
+
+#include <math.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "logger.h"
+
+// Rates above this are typos, it also keeps decimal rates in 32 bits
+static const double kMaxRate = 1000000.0;
+
+Clock::Clock() { }
+
+Clock::~Clock()
+{
+  if (_record_file != nullptr)
+  {
+    fclose(_record_file);
+  }
+}
+
+void Clock::initRealTime()
+{
+  _mode = kClockMode_RealTime;
+  _time = 0.0;
+  _delta = 0.0;
+  _frame = 0;
+  _started = false;
+}
+
+void Clock::initFixedStep(double step_seconds)
+{
+  _mode = kClockMode_FixedStep;
+  _step = step_seconds;
+  _time = 0.0;
+  _delta = 0.0;
+  _frame = 0;
+}
+
+int Clock::initReplay(const std::string& file_name)
+{
+  FILE* file = fopen(file_name.c_str(), "r");
+  if (file == nullptr)
+  {
+    LOG_ERROR("Clock", "Failed opening replay file: %s", file_name.c_str());
+    return 0;
+  }
+
+  _replay_times.clear();
+  _replay_deltas.clear();
+
+  // One "time delta" line per frame
+  char line[128];
+  while (fgets(line, sizeof(line), file) != nullptr)
+  {
+    double time;
+    double delta;
+    if (sscanf(line, "%lf %lf", &time, &delta) != 2)
+    {
+      fclose(file);
+      LOG_ERROR("Clock", "Invalid line %d in replay file %s, record it again",
+        (int) _replay_times.size() + 1, file_name.c_str());
+      return 0;
+    }
+
+    _replay_times.push_back(time);
+    _replay_deltas.push_back(delta);
+  }
+  fclose(file);
+
+  if (_replay_times.empty())
+  {
+    LOG_ERROR("Clock", "Replay file is empty: %s", file_name.c_str());
+    return 0;
+  }
+
+  _mode = kClockMode_Replay;
+  _time = 0.0;
+  _delta = 0.0;
+  _frame = 0;
+
+  LOG_DEBUG("Clock", "Replaying %d frames from %s", (int) _replay_deltas.size(), file_name.c_str());
+  return 1;
+}
+
+int Clock::startRecording(const std::string& file_name)
+{
+  if (_record_file != nullptr)
+  {
+    fclose(_record_file);
+  }
+
+  _record_file = fopen(file_name.c_str(), "w");
+  if (_record_file == nullptr)
+  {
+    LOG_ERROR("Clock", "Failed opening record file: %s", file_name.c_str());
+    return 0;
+  }
+
+  return 1;
+}
+
+void Clock::tick()
+{
+  switch (_mode)
+  {
+  case kClockMode_RealTime: {
+    SteadyClock::time_point now = SteadyClock::now();
+    if (!_started)
+    {
+      _start = now;
+      _last = now;
+      _started = true;
+    }
+
+    _delta = std::chrono::duration<double>(now - _last).count();
+    _time = std::chrono::duration<double>(now - _start).count();
+    _last = now;
+    break;
+  }
+  case kClockMode_FixedStep: {
+    // Derived from the frame index so there is no accumulated rounding
+    _delta = _frame == 0 ? 0.0 : _step;
+    _time = (double) _frame * _step;
+    break;
+  }
+  case kClockMode_Replay: {
+    // The recorded times, not a sum of the deltas, which would drift from
+    // the now - start the recording run computed
+    if (_frame < _replay_times.size())
+    {
+      _time = _replay_times[_frame];
+      _delta = _replay_deltas[_frame];
+    }
+    else
+    {
+      if (_frame == _replay_times.size())
+      {
+        LOG_WARNING("Clock", "Replay finished, repeating last delta");
+      }
+      _time += _delta;
+    }
+    break;
+  }
+  }
+
+  // 17 significant digits read back to the same double
+  if (_record_file != nullptr)
+  {
+    fprintf(_record_file, "%.17g %.17g\n", _time, _delta);
+  }
+
+  _frame++;
+}
+
+int Clock::parseRate(const char* text, uint32_t* numerator, uint32_t* denominator)
+{
+  // strtoul and strtod accept signs and spaces, rates start with a digit
+  if (!isdigit((unsigned char) text[0]))
+  {
+    return 0;
+  }
+
+  char* end = nullptr;
+  double num;
+  double den;
+  const char* slash = strchr(text, '/');
+  if (slash != nullptr)
+  {
+    num = strtod(text, &end);
+    if (end != slash || !isdigit((unsigned char) slash[1]))
+    {
+      return 0;
+    }
+    den = strtod(slash + 1, &end);
+  }
+  else
+  {
+    // Up to three decimals, 29.97 is 2997/100
+    num = floor(strtod(text, &end) * 1000.0 + 0.5);
+    den = 1000.0;
+  }
+
+  if (*end != '\0' || !(num > 0.0) || !(den > 0.0) || num / den > kMaxRate || num > kMaxRate * 1000.0 ||
+      den > kMaxRate * 1000.0 || num != floor(num) || den != floor(den))
+  {
+    return 0;
+  }
+
+  uint32_t a = (uint32_t) num;
+  uint32_t b = (uint32_t) den;
+  while (b != 0)
+  {
+    uint32_t r = a % b;
+    a = b;
+    b = r;
+  }
+
+  *numerator = (uint32_t) num / a;
+  *denominator = (uint32_t) den / a;
+  return 1;
+}
@@ -0,0 +1,415 @@
+#include "cluster_culler.h"
+
+#include <string.h>
+
+#include <vector>
+
+#include "logger.h"
+#include "assets.h"
+#include "layout_cache.h"
+#include "shader_reflection.h"
+#include "geometry_arena.h"
+#include "occlusion.h"
+
+static const uint32_t kGroupSize = 64;
+static const uint32_t kBindingCount = 8;
+
+// In binding order, see cluster_cull.comp
+static const VkDescriptorType kBindingTypes[kBindingCount] = {
+  VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+  VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+  VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+};
+
+static uint32_t findMemoryType(VkPhysicalDevice physical_device, uint32_t filter, VkMemoryPropertyFlags properties)
+{
+  VkPhysicalDeviceMemoryProperties memory_properties;
+  vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+
+  for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+    if ((filter & (1 << i)) && (memory_properties.memoryTypes[i].propertyFlags & properties) == properties) {
+      return i;
+    }
+  }
+
+  return UINT32_MAX;
+}
+
+int ClusterCuller::init(VkPhysicalDevice physical_device, VkDevice device, LayoutCache& layouts,
+  const GeometryArena& geometry)
+{
+  _physical_device = physical_device;
+  _device = device;
+
+  Asset code;
+  if (!Assets::load("shaders/cluster_cull.spv", &code))
+  {
+    LOG_WARNING("Clusters", "Missing cluster_cull.spv, run shaders/compile.bat, meshes are drawn whole");
+    return 1;
+  }
+
+  // The descriptors below are written for this interface, so the shader
+  // has to declare exactly it
+  ShaderReflection reflection;
+  if (!reflection.parse(code.data(), code.size()) || reflection.stages() != VK_SHADER_STAGE_COMPUTE_BIT)
+  {
+    LOG_ERROR("Clusters", "Failed reflecting cluster_cull.spv");
+    return 0;
+  }
+
+  bool matches = reflection.setCount() == 1 && reflection.bindings().size() == kBindingCount &&
+    !reflection.hasPushConstants();
+  for (uint32_t i = 0; matches && i < kBindingCount; i++)
+  {
+    const ShaderBinding* binding = reflection.findBinding(0, i);
+    matches = binding != nullptr && binding->type == kBindingTypes[i] && binding->count == 1;
+  }
+
+  const ShaderBinding* params_binding = reflection.findBinding(0, 0);
+  if (!matches || params_binding->size > sizeof(Params))
+  {
+    LOG_ERROR("Clusters", "cluster_cull.spv does not declare the bindings the culler writes");
+    return 0;
+  }
+
+  const VkMemoryPropertyFlags host = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  void* draws = nullptr;
+  if (!createBuffer(sizeof(Params), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, host, &_params_buffer, &_params_memory,
+        (void**) &_params) ||
+      !createBuffer(kMaxObjects * sizeof(Object), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, host, &_object_buffer,
+        &_object_memory, (void**) &_objects) ||
+      !createBuffer(sizeof(DrawHeader) + kMaxObjects * sizeof(VkDrawIndexedIndirectCommand),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, host, &_draw_buffer, &_draw_memory,
+        &draws) ||
+      !createBuffer(kMaxTiles * sizeof(float), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, host, &_tile_buffer, &_tile_memory,
+        (void**) &_tile_depths) ||
+      !createBuffer((VkDeviceSize) kMaxIndices * sizeof(uint32_t),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        &_index_buffer, &_index_memory, nullptr))
+  {
+    return 0;
+  }
+
+  // The commands follow the header, 20 byte VkDrawIndexedIndirectCommand
+  // is the stride the shader's std430 array has too
+  _draw_header = (DrawHeader*) draws;
+  _draws = (VkDrawIndexedIndirectCommand*) (_draw_header + 1);
+
+  VkShaderModuleCreateInfo module_info = {};
+  module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  module_info.codeSize = code.size();
+  module_info.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+  VkShaderModule shader_module;
+  if (vkCreateShaderModule(_device, &module_info, nullptr, &shader_module) != VK_SUCCESS)
+  {
+    LOG_ERROR("Clusters", "Failed creating cluster culling shader module");
+    return 0;
+  }
+
+  // Cached and owned by the layout cache
+  std::vector<VkDescriptorSetLayout> set_layouts;
+  _pipeline_layout = layouts.pipelineLayout(reflection, &set_layouts);
+  if (_pipeline_layout == VK_NULL_HANDLE)
+  {
+    vkDestroyShaderModule(_device, shader_module, nullptr);
+    return 0;
+  }
+  _descriptor_layout = set_layouts[0];
+
+  VkComputePipelineCreateInfo pipeline_info = {};
+  pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipeline_info.stage.module = shader_module;
+  pipeline_info.stage.pName = "main";
+  pipeline_info.layout = _pipeline_layout;
+
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  VkResult result = vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &pipeline);
+  vkDestroyShaderModule(_device, shader_module, nullptr);
+  if (result != VK_SUCCESS)
+  {
+    LOG_ERROR("Clusters", "Failed creating cluster culling pipeline");
+    return 0;
+  }
+
+  if (!createDescriptors(geometry))
+  {
+    vkDestroyPipeline(_device, pipeline, nullptr);
+    return 0;
+  }
+
+  // Enabled from here on
+  _pipeline = pipeline;
+  LOG_DEBUG("Clusters", "Cluster culling ready, up to %u objects and %u indices a frame", kMaxObjects, kMaxIndices);
+  return 1;
+}
+
+int ClusterCuller::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+  VkBuffer* buffer, VkDeviceMemory* memory, void** mapped)
+{
+  VkBufferCreateInfo create_info = {};
+  create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  create_info.size = size;
+  create_info.usage = usage;
+  create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  VkResult result = vkCreateBuffer(_device, &create_info, nullptr, buffer);
+  if (result != VK_SUCCESS)
+  {
+    LOG_ERROR("Clusters", "Failed creating cluster culling buffer");
+    return 0;
+  }
+
+  VkMemoryRequirements memory_requirements;
+  vkGetBufferMemoryRequirements(_device, *buffer, &memory_requirements);
+
+  uint32_t memory_type = findMemoryType(_physical_device, memory_requirements.memoryTypeBits, properties);
+  if (memory_type == UINT32_MAX)
+  {
+    LOG_ERROR("Clusters", "Unable to find cluster culling memory type");
+    return 0;
+  }
+
+  VkMemoryAllocateInfo allocate_info = {};
+  allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocate_info.allocationSize = memory_requirements.size;
+  allocate_info.memoryTypeIndex = memory_type;
+
+  result = vkAllocateMemory(_device, &allocate_info, nullptr, memory);
+  if (result != VK_SUCCESS)
+  {
+    LOG_ERROR("Clusters", "Failed allocating cluster culling memory");
+    return 0;
+  }
+
+  vkBindBufferMemory(_device, *buffer, *memory, 0);
+
+  if (mapped != nullptr && vkMapMemory(_device, *memory, 0, size, 0, mapped) != VK_SUCCESS)
+  {
+    LOG_ERROR("Clusters", "Failed mapping cluster culling memory");
+    return 0;
+  }
+
+  return 1;
+}
+
+int ClusterCuller::createDescriptors(const GeometryArena& geometry)
+{
+  VkDescriptorPoolSize pool_sizes[2] = {};
+  pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  pool_sizes[0].descriptorCount = 1;
+  pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  pool_sizes[1].descriptorCount = kBindingCount - 1;
+
+  VkDescriptorPoolCreateInfo pool_info = {};
+  pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  pool_info.poolSizeCount = 2;
+  pool_info.pPoolSizes = pool_sizes;
+  pool_info.maxSets = 1;
+
+  VkResult result = vkCreateDescriptorPool(_device, &pool_info, nullptr, &_descriptor_pool);
+  if (result != VK_SUCCESS)
+  {
+    LOG_ERROR("Clusters", "Failed creating cluster culling descriptor pool");
+    return 0;
+  }
+
+  VkDescriptorSetAllocateInfo allocate_info = {};
+  allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocate_info.descriptorPool = _descriptor_pool;
+  allocate_info.descriptorSetCount = 1;
+  allocate_info.pSetLayouts = &_descriptor_layout;
+
+  result = vkAllocateDescriptorSets(_device, &allocate_info, &_descriptor_set);
+  if (result != VK_SUCCESS)
+  {
+    LOG_ERROR("Clusters", "Failed allocating cluster culling descriptor set");
+    return 0;
+  }
+
+  VkBuffer buffers[kBindingCount] = {
+    _params_buffer, geometry.clusterBuffer(), geometry.clusterVertexBuffer(), geometry.clusterTriangleBuffer(),
+    _object_buffer, _draw_buffer, _index_buffer, _tile_buffer
+  };
+
+  VkDescriptorBufferInfo buffer_infos[kBindingCount] = {};
+  VkWriteDescriptorSet writes[kBindingCount] = {};
+  for (uint32_t i = 0; i < kBindingCount; i++)
+  {
+    buffer_infos[i].buffer = buffers[i];
+    buffer_infos[i].offset = 0;
+    buffer_infos[i].range = VK_WHOLE_SIZE;
+
+    writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[i].dstSet = _descriptor_set;
+    writes[i].dstBinding = i;
+    writes[i].descriptorCount = 1;
+    writes[i].descriptorType = kBindingTypes[i];
+    writes[i].pBufferInfo = &buffer_infos[i];
+  }
+
+  vkUpdateDescriptorSets(_device, kBindingCount, writes, 0, nullptr);
+  return 1;
+}
+
+void ClusterCuller::release()
+{
+  if (_device == VK_NULL_HANDLE)
+  {
+    return;
+  }
+
+  vkDestroyPipeline(_device, _pipeline, nullptr);
+  vkDestroyDescriptorPool(_device, _descriptor_pool, nullptr);
+
+  VkBuffer buffers[] = { _params_buffer, _object_buffer, _draw_buffer, _tile_buffer, _index_buffer };
+  VkDeviceMemory memories[] = { _params_memory, _object_memory, _draw_memory, _tile_memory, _index_memory };
+  for (uint32_t i = 0; i < 5; i++)
+  {
+    vkDestroyBuffer(_device, buffers[i], nullptr);
+    vkFreeMemory(_device, memories[i], nullptr);
+  }
+
+  *this = ClusterCuller();
+}
+
+void ClusterCuller::begin(const glm::mat4& view_projection, const glm::vec3& view_position)
+{
+  if (!enabled())
+  {
+    return;
+  }
+
+  // Index counts are what the previous frame appended
+  if (_recorded)
+  {
+    _stats = ClusterStats();
+    _stats.objects = _object_count;
+    _stats.clusters = _cluster_count;
+    _stats.clusters_visible = _draw_header->clusters_visible;
+    _stats.whole_triangles = _whole_triangles;
+    for (uint32_t i = 0; i < _object_count; i++)
+    {
+      _stats.triangles += _draws[i].indexCount / 3;
+    }
+    _recorded = false;
+  }
+
+  _object_count = 0;
+  _index_count = 0;
+  _max_clusters = 0;
+  _cluster_count = 0;
+  _whole_triangles = 0;
+
+  Frustum frustum;
+  frustum.setMatrix(view_projection);
+  _params->view_projection = view_projection;
+  for (uint32_t i = 0; i < 6; i++)
+  {
+    _params->planes[i] = frustum.planes[i];
+  }
+  _params->view_position = glm::vec4(view_position, 1.0f);
+  _params->tiles_x = 0;
+  _params->tiles_y = 0;
+}
+
+uint32_t ClusterCuller::add(const glm::mat4& model, const GeometryRange& range, uint32_t triangle_count)
+{
+  // Every cluster may survive, so the object reserves all of its triangles
+  uint32_t index_count = triangle_count * 3;
+  if (!enabled() || range.cluster_count == 0 || _object_count == kMaxObjects ||
+      index_count > kMaxIndices - _index_count)
+  {
+    return UINT32_MAX;
+  }
+
+  float scales[3] = {
+    glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))
+  };
+  float scale = scales[0] > scales[1] ? scales[0] : scales[1];
+  scale = scale > scales[2] ? scale : scales[2];
+  float smallest = scales[0] < scales[1] ? scales[0] : scales[1];
+  smallest = smallest < scales[2] ? smallest : scales[2];
+
+  uint32_t draw = _object_count++;
+  Object& object = _objects[draw];
+  object.model = model;
+  object.cluster_offset = range.cluster_offset;
+  object.cluster_count = range.cluster_count;
+  object.index_offset = _index_count;
+  object.scale = smallest < scale * 0.999f ? -scale : scale;
+
+  VkDrawIndexedIndirectCommand& command = _draws[draw];
+  command.indexCount = 0;
+  command.instanceCount = 1;
+  command.firstIndex = _index_count;
+  command.vertexOffset = range.vertex_offset;
+  command.firstInstance = 0;
+
+  _index_count += index_count;
+  _max_clusters = range.cluster_count > _max_clusters ? range.cluster_count : _max_clusters;
+  _cluster_count += range.cluster_count;
+  _whole_triangles += triangle_count;
+  return draw;
+}
+
+void ClusterCuller::setOcclusion(const OcclusionBuffer& occlusion)
+{
+  uint32_t tile_count = occlusion.tilesX() * occlusion.tilesY();
+  if (!enabled() || tile_count == 0 || tile_count > kMaxTiles)
+  {
+    return;
+  }
+
+  occlusion.tileDepths(_tile_depths);
+  _params->occlusion_width = occlusion.width();
+  _params->occlusion_height = occlusion.height();
+  _params->tiles_x = occlusion.tilesX();
+  _params->tiles_y = occlusion.tilesY();
+}
+
+void ClusterCuller::record(VkCommandBuffer command_buffer)
+{
+  if (!enabled() || _object_count == 0)
+  {
+    return;
+  }
+
+  _params->object_count = _object_count;
+  _draw_header->clusters_visible = 0;
+
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline);
+  vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline_layout,
+    0, 1, &_descriptor_set, 0, nullptr);
+  vkCmdDispatch(command_buffer, (_max_clusters + kGroupSize - 1) / kGroupSize, _object_count, 1);
+
+  // The draws read the counts and the indices, the host the counts once
+  // the frame is done
+  VkBufferMemoryBarrier barriers[2] = {};
+  for (uint32_t i = 0; i < 2; i++)
+  {
+    barriers[i].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barriers[i].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barriers[i].size = VK_WHOLE_SIZE;
+  }
+  barriers[0].buffer = _draw_buffer;
+  barriers[0].dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+  barriers[1].buffer = _index_buffer;
+  barriers[1].dstAccessMask = VK_ACCESS_INDEX_READ_BIT;
+
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+    VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+    0, 0, nullptr, 2, barriers, 0, nullptr);
+
+  _recorded = true;
+}
+
+void ClusterCuller::draw(VkCommandBuffer command_buffer, uint32_t draw) const
+{
+  vkCmdDrawIndexedIndirect(command_buffer, _draw_buffer, sizeof(DrawHeader) + draw * sizeof(VkDrawIndexedIndirectCommand),
+    1, sizeof(VkDrawIndexedIndirectCommand));
+}
@@ -0,0 +1,182 @@
+#include "deletion_queue.h"
+
+#include "logger.h"
+
+void DeletionQueue::init(VkDevice device, GpuTimeline* timeline)
+{
+  _device = device;
+  _timeline = timeline;
+}
+
+void DeletionQueue::destroyBuffer(VkBuffer buffer, uint64_t value)
+{
+  push(VK_OBJECT_TYPE_BUFFER, (uint64_t) buffer, 0, value);
+}
+
+void DeletionQueue::destroyImage(VkImage image, uint64_t value)
+{
+  push(VK_OBJECT_TYPE_IMAGE, (uint64_t) image, 0, value);
+}
+
+void DeletionQueue::destroyImageView(VkImageView image_view, uint64_t value)
+{
+  push(VK_OBJECT_TYPE_IMAGE_VIEW, (uint64_t) image_view, 0, value);
+}
+
+void DeletionQueue::destroyFramebuffer(VkFramebuffer framebuffer, uint64_t value)
+{
+  push(VK_OBJECT_TYPE_FRAMEBUFFER, (uint64_t) framebuffer, 0, value);
+}
+
+void DeletionQueue::destroyPipeline(VkPipeline pipeline, uint64_t value)
+{
+  push(VK_OBJECT_TYPE_PIPELINE, (uint64_t) pipeline, 0, value);
+}
+
+void DeletionQueue::destroyPipelineLayout(VkPipelineLayout pipeline_layout, uint64_t value)
+{
+  push(VK_OBJECT_TYPE_PIPELINE_LAYOUT, (uint64_t) pipeline_layout, 0, value);
+}
+
+void DeletionQueue::destroyRenderPass(VkRenderPass render_pass, uint64_t value)
+{
+  push(VK_OBJECT_TYPE_RENDER_PASS, (uint64_t) render_pass, 0, value);
+}
+
+void DeletionQueue::destroyShaderModule(VkShaderModule shader_module, uint64_t value)
+{
+  push(VK_OBJECT_TYPE_SHADER_MODULE, (uint64_t) shader_module, 0, value);
+}
+
+void DeletionQueue::destroySwapchain(VkSwapchainKHR swapchain, uint64_t value)
+{
+  push(VK_OBJECT_TYPE_SWAPCHAIN_KHR, (uint64_t) swapchain, 0, value);
+}
+
+void DeletionQueue::freeMemory(VkDeviceMemory memory, uint64_t value)
+{
+  push(VK_OBJECT_TYPE_DEVICE_MEMORY, (uint64_t) memory, 0, value);
+}
+
+void DeletionQueue::freeCommandBuffers(VkCommandPool pool, const std::vector<VkCommandBuffer>& command_buffers, uint64_t value)
+{
+  for (size_t i = 0; i < command_buffers.size(); i++)
+  {
+    push(VK_OBJECT_TYPE_COMMAND_BUFFER, (uint64_t) (uintptr_t) command_buffers[i], (uint64_t) pool, value);
+  }
+}
+
+void DeletionQueue::push(VkObjectType type, uint64_t handle, uint64_t owner, uint64_t value)
+{
+  if (handle == 0)
+  {
+    return;
+  }
+
+  Entry entry = { type, handle, owner, value };
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _entries.push_back(entry);
+}
+
+void DeletionQueue::collect()
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_entries.empty() || !_timeline->isComplete(_entries.front().value))
+  {
+    return;
+  }
+
+  uint64_t completed = _timeline->completedValue();
+  while (!_entries.empty() && _entries.front().value <= completed)
+  {
+    destroy(_entries.front());
+    _entries.pop_front();
+  }
+}
+
+void DeletionQueue::flush()
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  uint64_t last_value = 0;
+  for (size_t i = 0; i < _entries.size(); i++)
+  {
+    last_value = _entries[i].value > last_value ? _entries[i].value : last_value;
+  }
+
+  if (!_entries.empty() && !_timeline->wait(last_value))
+  {
+    LOG_ERROR("DeletionQueue", "Failed waiting for the GPU, leaking %d objects", (int) _entries.size());
+    _entries.clear();
+    return;
+  }
+
+  for (size_t i = 0; i < _entries.size(); i++)
+  {
+    destroy(_entries[i]);
+  }
+  _entries.clear();
+}
+
+size_t DeletionQueue::pending()
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _entries.size();
+}
+
+void DeletionQueue::destroy(const Entry& entry)
+{
+  switch (entry.type)
+  {
+  case VK_OBJECT_TYPE_BUFFER: {
+    vkDestroyBuffer(_device, (VkBuffer) entry.handle, nullptr);
+    break;
+  }
+  case VK_OBJECT_TYPE_IMAGE: {
+    vkDestroyImage(_device, (VkImage) entry.handle, nullptr);
+    break;
+  }
+  case VK_OBJECT_TYPE_IMAGE_VIEW: {
+    vkDestroyImageView(_device, (VkImageView) entry.handle, nullptr);
+    break;
+  }
+  case VK_OBJECT_TYPE_FRAMEBUFFER: {
+    vkDestroyFramebuffer(_device, (VkFramebuffer) entry.handle, nullptr);
+    break;
+  }
+  case VK_OBJECT_TYPE_PIPELINE: {
+    vkDestroyPipeline(_device, (VkPipeline) entry.handle, nullptr);
+    break;
+  }
+  case VK_OBJECT_TYPE_PIPELINE_LAYOUT: {
+    vkDestroyPipelineLayout(_device, (VkPipelineLayout) entry.handle, nullptr);
+    break;
+  }
+  case VK_OBJECT_TYPE_RENDER_PASS: {
+    vkDestroyRenderPass(_device, (VkRenderPass) entry.handle, nullptr);
+    break;
+  }
+  case VK_OBJECT_TYPE_SHADER_MODULE: {
+    vkDestroyShaderModule(_device, (VkShaderModule) entry.handle, nullptr);
+    break;
+  }
+  case VK_OBJECT_TYPE_SWAPCHAIN_KHR: {
+    vkDestroySwapchainKHR(_device, (VkSwapchainKHR) entry.handle, nullptr);
+    break;
+  }
+  case VK_OBJECT_TYPE_DEVICE_MEMORY: {
+    vkFreeMemory(_device, (VkDeviceMemory) entry.handle, nullptr);
+    break;
+  }
+  case VK_OBJECT_TYPE_COMMAND_BUFFER: {
+    VkCommandBuffer command_buffer = (VkCommandBuffer) (uintptr_t) entry.handle;
+    vkFreeCommandBuffers(_device, (VkCommandPool) entry.owner, 1, &command_buffer);
+    break;
+  }
+  default: {
+    LOG_ERROR("DeletionQueue", "Unknown object type %d", (int) entry.type);
+    break;
+  }
+  }
+}
@@ -0,0 +1,127 @@
+#include "draw_queue.h"
+
+#include <string.h>
+
+static const uint32_t kRadixBits = 8;
+static const uint32_t kRadixSize = 1 << kRadixBits;
+static const uint32_t kRadixPasses = 64 / kRadixBits;
+
+static uint64_t field(uint32_t value, uint32_t bits)
+{
+  return value & ((1u << bits) - 1);
+}
+
+uint64_t DrawKey::make(DrawPass pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth)
+{
+  depth = depth < 0.0f ? 0.0f : (depth > 1.0f ? 1.0f : depth);
+  uint32_t bucket = (uint32_t) (depth * ((1 << kDepthBits) - 1) + 0.5f);
+  if (pass == kDrawPass_Transparent)
+  {
+    bucket = ((1 << kDepthBits) - 1) - bucket;
+  }
+
+  return ((uint64_t) pass << 60) |
+    (field(pipeline, kPipelineBits) << 48) |
+    (field(material, kMaterialBits) << 32) |
+    (field(mesh, kMeshBits) << 16) |
+    field(bucket, kDepthBits);
+}
+
+void DrawQueue::clear()
+{
+  _packets.clear();
+}
+
+void DrawQueue::add(uint64_t key, uint32_t object, uint32_t lod, uint32_t index_binding)
+{
+  DrawPacket packet = {};
+  packet.key = key;
+  packet.object = object;
+  packet.lod = lod;
+  packet.index_binding = index_binding;
+  _packets.push_back(packet);
+}
+
+void DrawQueue::sort()
+{
+  uint32_t count = (uint32_t) _packets.size();
+  _unsorted_stats = countStateChanges(_packets.data(), count);
+
+  // Every histogram in one read of the keys
+  uint32_t histograms[kRadixPasses][kRadixSize];
+  memset(histograms, 0, sizeof(histograms));
+  for (uint32_t i = 0; i < count; i++)
+  {
+    uint64_t key = _packets[i].key;
+    for (uint32_t pass = 0; pass < kRadixPasses; pass++)
+    {
+      histograms[pass][(key >> (pass * kRadixBits)) & (kRadixSize - 1)]++;
+    }
+  }
+
+  _scratch.resize(count);
+  DrawPacket* source = _packets.data();
+  DrawPacket* destination = _scratch.data();
+  for (uint32_t pass = 0; pass < kRadixPasses; pass++)
+  {
+    uint32_t shift = pass * kRadixBits;
+    uint32_t* histogram = histograms[pass];
+
+    // Same byte in every key, the order would not change
+    if (count == 0 || histogram[(source[0].key >> shift) & (kRadixSize - 1)] == count)
+    {
+      continue;
+    }
+
+    uint32_t offset = 0;
+    for (uint32_t digit = 0; digit < kRadixSize; digit++)
+    {
+      uint32_t digit_count = histogram[digit];
+      histogram[digit] = offset;
+      offset += digit_count;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+      destination[histogram[(source[i].key >> shift) & (kRadixSize - 1)]++] = source[i];
+    }
+
+    DrawPacket* swap = source;
+    source = destination;
+    destination = swap;
+  }
+
+  // An odd number of passes left the result in the scratch buffer
+  if (source != _packets.data())
+  {
+    _packets.swap(_scratch);
+  }
+
+  _sorted_stats = countStateChanges(_packets.data(), count);
+}
+
+DrawStateStats DrawQueue::countStateChanges(const DrawPacket* packets, uint32_t count)
+{
+  DrawStateStats stats;
+  stats.draws = count;
+  stats.vertex_binds = count > 0 ? 1 : 0;
+
+  for (uint32_t i = 0; i < count; i++)
+  {
+    uint64_t key = packets[i].key;
+    if (i == 0 || DrawKey::pipeline(key) != DrawKey::pipeline(packets[i - 1].key))
+    {
+      stats.pipeline_binds++;
+    }
+    if (i == 0 || DrawKey::material(key) != DrawKey::material(packets[i - 1].key))
+    {
+      stats.descriptor_binds++;
+    }
+    if (i == 0 || packets[i].index_binding != packets[i - 1].index_binding)
+    {
+      stats.index_binds++;
+    }
+  }
+
+  return stats;
+}
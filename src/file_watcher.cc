@@ -0,0 +1,204 @@
+#include "file_watcher.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+#include "logger.h"
+
+// How often the watch thread checks for stop
+static const int kStopPollMs = 100;
+
+FileWatcher::FileWatcher() : _running(false) { }
+
+FileWatcher::~FileWatcher()
+{
+  stop();
+}
+
+int FileWatcher::start(const std::string& directory)
+{
+  stop();
+  _directory = directory;
+
+#ifdef _WIN32
+  HANDLE handle = CreateFile(directory.c_str(), FILE_LIST_DIRECTORY,
+    FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+    FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+
+  if (handle == INVALID_HANDLE_VALUE)
+  {
+    LOG_WARNING("Watcher", "Failed opening %s", directory.c_str());
+    return 0;
+  }
+
+  _handle = (intptr_t) handle;
+#else
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0 || inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+  {
+    LOG_WARNING("Watcher", "Failed watching %s", directory.c_str());
+    if (fd >= 0)
+    {
+      close(fd);
+    }
+    return 0;
+  }
+
+  _handle = fd;
+#endif
+
+  _running = true;
+  _thread = std::thread(&FileWatcher::watchLoop, this);
+
+  LOG_DEBUG("Watcher", "Watching %s", directory.c_str());
+  return 1;
+}
+
+void FileWatcher::stop()
+{
+  _running = false;
+  if (_thread.joinable())
+  {
+    _thread.join();
+  }
+
+  if (_handle != -1)
+  {
+#ifdef _WIN32
+    CloseHandle((HANDLE) _handle);
+#else
+    close((int) _handle);
+#endif
+    _handle = -1;
+  }
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _changes.clear();
+}
+
+void FileWatcher::poll(std::vector<std::string>* changed)
+{
+  std::chrono::steady_clock::time_point settled =
+    std::chrono::steady_clock::now() - std::chrono::milliseconds((int64_t) kSettleMs);
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  for (auto it = _changes.begin(); it != _changes.end();)
+  {
+    if (it->second <= settled)
+    {
+      changed->push_back(it->first);
+      it = _changes.erase(it);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+}
+
+void FileWatcher::recordChange(const std::string& name)
+{
+  std::string normalized = name;
+  for (size_t i = 0; i < normalized.size(); i++)
+  {
+    if (normalized[i] == '\\')
+    {
+      normalized[i] = '/';
+    }
+  }
+
+  // Every write pushes the settle time further
+  std::lock_guard<std::mutex> lock(_mutex);
+  _changes[normalized] = std::chrono::steady_clock::now();
+}
+
+void FileWatcher::watchLoop()
+{
+#ifdef _WIN32
+  // DWORD aligned as ReadDirectoryChangesW requires
+  DWORD buffer[16 * 1024];
+  OVERLAPPED overlapped = {};
+  overlapped.hEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+  while (_running)
+  {
+    ResetEvent(overlapped.hEvent);
+    if (!ReadDirectoryChangesW((HANDLE) _handle, buffer, sizeof(buffer), TRUE,
+          FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME, nullptr, &overlapped, nullptr))
+    {
+      LOG_ERROR("Watcher", "Failed reading changes of %s", _directory.c_str());
+      break;
+    }
+
+    DWORD wait = WAIT_TIMEOUT;
+    while (_running && (wait = WaitForSingleObject(overlapped.hEvent, kStopPollMs)) == WAIT_TIMEOUT) { }
+
+    DWORD bytes = 0;
+    if (wait != WAIT_OBJECT_0)
+    {
+      CancelIoEx((HANDLE) _handle, &overlapped);
+      GetOverlappedResult((HANDLE) _handle, &overlapped, &bytes, TRUE);
+      break;
+    }
+
+    // Zero bytes means the buffer overflowed and the changes were lost
+    if (!GetOverlappedResult((HANDLE) _handle, &overlapped, &bytes, FALSE) || bytes == 0)
+    {
+      continue;
+    }
+
+    const uint8_t* cursor = (const uint8_t*) buffer;
+    while (true)
+    {
+      const FILE_NOTIFY_INFORMATION* info = (const FILE_NOTIFY_INFORMATION*) cursor;
+
+      if (info->Action == FILE_ACTION_ADDED || info->Action == FILE_ACTION_MODIFIED ||
+          info->Action == FILE_ACTION_RENAMED_NEW_NAME)
+      {
+        int length = (int) (info->FileNameLength / sizeof(WCHAR));
+        int size = WideCharToMultiByte(CP_UTF8, 0, info->FileName, length, nullptr, 0, nullptr, nullptr);
+
+        std::string name(size, '\0');
+        WideCharToMultiByte(CP_UTF8, 0, info->FileName, length, &name[0], size, nullptr, nullptr);
+        recordChange(name);
+      }
+
+      if (info->NextEntryOffset == 0)
+      {
+        break;
+      }
+      cursor += info->NextEntryOffset;
+    }
+  }
+
+  CloseHandle(overlapped.hEvent);
+#else
+  alignas(inotify_event) char buffer[16 * 1024];
+
+  while (_running)
+  {
+    pollfd descriptor = { (int) _handle, POLLIN, 0 };
+    if (::poll(&descriptor, 1, kStopPollMs) <= 0)
+    {
+      continue;
+    }
+
+    ssize_t bytes = read((int) _handle, buffer, sizeof(buffer));
+    for (ssize_t offset = 0; offset < bytes;)
+    {
+      const inotify_event* event = (const inotify_event*) (buffer + offset);
+      if (event->len > 0 && !(event->mask & IN_ISDIR))
+      {
+        recordChange(event->name);
+      }
+
+      offset += sizeof(inotify_event) + event->len;
+    }
+  }
+#endif
+}
@@ -0,0 +1,914 @@
+#include "frame_capture.h"
+
+#include <string.h>
+
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+#include "logger.h"
+#include "assets.h"
+#include "layout_cache.h"
+#include "shader_reflection.h"
+
+// Must match the push constants in shaders/yuv420.comp
+struct ConverterParams
+{
+  uint32_t width;
+  uint32_t height;
+  uint32_t luma_stride;
+  uint32_t chroma_stride;
+  uint32_t u_offset;
+  uint32_t v_offset;
+  uint32_t bgra;
+};
+
+static uint32_t findHostMemoryType(VkPhysicalDevice physical_device, uint32_t filter, VkMemoryPropertyFlags properties)
+{
+  VkPhysicalDeviceMemoryProperties memory_properties;
+  vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+
+  for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+    if ((filter & (1 << i)) && (memory_properties.memoryTypes[i].propertyFlags & properties) == properties) {
+      return i;
+    }
+  }
+
+  return UINT32_MAX;
+}
+
+static uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size)
+{
+  static uint32_t table[256];
+  static bool table_ready = false;
+
+  if (!table_ready)
+  {
+    for (uint32_t i = 0; i < 256; i++)
+    {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++)
+      {
+        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      }
+      table[i] = c;
+    }
+    table_ready = true;
+  }
+
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++)
+  {
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+static void writeBigEndian(std::vector<uint8_t>& out, uint32_t value)
+{
+  out.push_back((uint8_t) (value >> 24));
+  out.push_back((uint8_t) (value >> 16));
+  out.push_back((uint8_t) (value >> 8));
+  out.push_back((uint8_t) value);
+}
+
+static void writeChunk(FILE* file, const char* type, const std::vector<uint8_t>& data)
+{
+  std::vector<uint8_t> chunk;
+  writeBigEndian(chunk, (uint32_t) data.size());
+  chunk.insert(chunk.end(), type, type + 4);
+  chunk.insert(chunk.end(), data.begin(), data.end());
+  writeBigEndian(chunk, crc32(0, chunk.data() + 4, chunk.size() - 4));
+  fwrite(chunk.data(), 1, chunk.size(), file);
+}
+
+FrameCapture::FrameCapture()
+{
+  _captured = 0;
+  for (uint32_t i = 0; i < kSlotCount; i++)
+  {
+    _slots[i].state = kSlotState_Free;
+  }
+}
+
+FrameCapture::~FrameCapture()
+{
+  release();
+}
+
+void FrameCapture::configure(CaptureFormat format, const std::string& path)
+{
+  _format = format;
+  _path = path;
+}
+
+int FrameCapture::init(VkPhysicalDevice physical_device, VkDevice device, LayoutCache& layouts)
+{
+  if (!enabled())
+  {
+    return 1;
+  }
+
+  _physical_device = physical_device;
+  _device = device;
+
+  if (_format == kCaptureFormat_Y4M && !createConverter(layouts))
+  {
+    return 0;
+  }
+
+  if ((_format == kCaptureFormat_Raw || _format == kCaptureFormat_Y4M) && !openStream())
+  {
+    return 0;
+  }
+
+  _running = true;
+  _worker = std::thread(&FrameCapture::workerLoop, this);
+  return 1;
+}
+
+int FrameCapture::openStream()
+{
+  if (strcmp(_path.c_str(), "-") == 0)
+  {
+#ifdef _WIN32
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    _stream = stdout;
+    return 1;
+  }
+
+#ifdef _WIN32
+  if (_path.compare(0, 9, "\\\\.\\pipe\\") == 0)
+  {
+    HANDLE pipe = CreateNamedPipe(_path.c_str(), PIPE_ACCESS_OUTBOUND, PIPE_TYPE_BYTE | PIPE_WAIT,
+      1, 1 << 20, 0, 0, nullptr);
+    if (pipe == INVALID_HANDLE_VALUE)
+    {
+      LOG_ERROR("Capture", "Failed creating named pipe: %s", _path.c_str());
+      return 0;
+    }
+
+    LOG_DEBUG("Capture", "Waiting for a reader on %s", _path.c_str());
+    if (!ConnectNamedPipe(pipe, nullptr) && GetLastError() != ERROR_PIPE_CONNECTED)
+    {
+      LOG_ERROR("Capture", "Failed connecting named pipe: %s", _path.c_str());
+      CloseHandle(pipe);
+      return 0;
+    }
+
+    _pipe = pipe;
+    return 1;
+  }
+#endif
+
+  // Also covers fifos, fopen blocks until the reader opens the other end
+  _stream = fopen(_path.c_str(), "wb");
+  if (_stream == nullptr)
+  {
+    LOG_ERROR("Capture", "Failed opening capture stream: %s", _path.c_str());
+    return 0;
+  }
+
+  return 1;
+}
+
+void FrameCapture::writeStream(const void* data, size_t size)
+{
+#ifdef _WIN32
+  if (_pipe != nullptr)
+  {
+    const uint8_t* bytes = (const uint8_t*) data;
+    while (size > 0)
+    {
+      DWORD written = 0;
+      if (!WriteFile((HANDLE) _pipe, bytes, (DWORD) size, &written, nullptr))
+      {
+        return;
+      }
+      bytes += written;
+      size -= written;
+    }
+    return;
+  }
+#endif
+
+  fwrite(data, 1, size, _stream);
+}
+
+int FrameCapture::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+  VkBuffer* buffer, VkDeviceMemory* memory)
+{
+  VkBufferCreateInfo create_info = {};
+  create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  create_info.size = size;
+  create_info.usage = usage;
+  create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  VkResult result = vkCreateBuffer(_device, &create_info, nullptr, buffer);
+  if (result != VK_SUCCESS)
+  {
+    LOG_ERROR("Capture", "Failed creating capture buffer");
+    return 0;
+  }
+
+  VkMemoryRequirements memory_requirements;
+  vkGetBufferMemoryRequirements(_device, *buffer, &memory_requirements);
+
+  uint32_t memory_type = findHostMemoryType(_physical_device, memory_requirements.memoryTypeBits, properties);
+  if (memory_type == UINT32_MAX)
+  {
+    LOG_ERROR("Capture", "Unable to find capture memory type");
+    return 0;
+  }
+
+  VkMemoryAllocateInfo allocate_info = {};
+  allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocate_info.allocationSize = memory_requirements.size;
+  allocate_info.memoryTypeIndex = memory_type;
+
+  result = vkAllocateMemory(_device, &allocate_info, nullptr, memory);
+  if (result != VK_SUCCESS)
+  {
+    LOG_ERROR("Capture", "Failed allocating capture memory");
+    return 0;
+  }
+
+  vkBindBufferMemory(_device, *buffer, *memory, 0);
+  return 1;
+}
+
+int FrameCapture::createConverter(LayoutCache& layouts)
+{
+  Asset code;
+  if (!Assets::load("shaders/yuv420.spv", &code))
+  {
+    LOG_ERROR("Capture", "Missing yuv420.spv, run shaders/compile.bat");
+    return 0;
+  }
+
+  // Slots write the two buffers and push ConverterParams, the shader has
+  // to declare exactly that
+  ShaderReflection reflection;
+  if (!reflection.parse(code.data(), code.size()) || reflection.stages() != VK_SHADER_STAGE_COMPUTE_BIT)
+  {
+    LOG_ERROR("Capture", "Failed reflecting yuv420.spv");
+    return 0;
+  }
+
+  bool matches = reflection.setCount() == 1 && reflection.bindings().size() == 2 &&
+    reflection.pushConstants().size == sizeof(ConverterParams);
+  for (uint32_t i = 0; matches && i < 2; i++)
+  {
+    const ShaderBinding* binding = reflection.findBinding(0, i);
+    matches = binding != nullptr && binding->type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER && binding->count == 1;
+  }
+
+  if (!matches)
+  {
+    LOG_ERROR("Capture", "yuv420.spv does not declare the interface the converter uses");
+    return 0;
+  }
+
+  VkShaderModuleCreateInfo module_info = {};
+  module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  module_info.codeSize = code.size();
+  module_info.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+  VkShaderModule shader_module;
+  if (vkCreateShaderModule(_device, &module_info, nullptr, &shader_module) != VK_SUCCESS)
+  {
+    LOG_ERROR("Capture", "Failed creating yuv shader module");
+    return 0;
+  }
+
+  // Cached and owned by the layout cache
+  std::vector<VkDescriptorSetLayout> set_layouts;
+  _converter_pipeline_layout = layouts.pipelineLayout(reflection, &set_layouts);
+  if (_converter_pipeline_layout == VK_NULL_HANDLE)
+  {
+    vkDestroyShaderModule(_device, shader_module, nullptr);
+    return 0;
+  }
+  _converter_descriptor_layout = set_layouts[0];
+
+  VkComputePipelineCreateInfo pipeline_info = {};
+  pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipeline_info.stage.module = shader_module;
+  pipeline_info.stage.pName = "main";
+  pipeline_info.layout = _converter_pipeline_layout;
+
+  VkResult result = vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr,
+    &_converter_pipeline);
+  vkDestroyShaderModule(_device, shader_module, nullptr);
+  if (result != VK_SUCCESS)
+  {
+    LOG_ERROR("Capture", "Failed creating yuv pipeline");
+    return 0;
+  }
+
+  VkDescriptorPoolSize pool_size = {};
+  pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  pool_size.descriptorCount = kSlotCount * 2;
+
+  VkDescriptorPoolCreateInfo pool_info = {};
+  pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  pool_info.poolSizeCount = 1;
+  pool_info.pPoolSizes = &pool_size;
+  pool_info.maxSets = kSlotCount;
+
+  result = vkCreateDescriptorPool(_device, &pool_info, nullptr, &_converter_descriptor_pool);
+  if (result != VK_SUCCESS)
+  {
+    LOG_ERROR("Capture", "Failed creating yuv descriptor pool");
+    return 0;
+  }
+
+  return 1;
+}
+
+void FrameCapture::releaseConverter()
+{
+  vkDestroyPipeline(_device, _converter_pipeline, nullptr);
+  vkDestroyDescriptorPool(_device, _converter_descriptor_pool, nullptr);
+
+  _converter_pipeline = VK_NULL_HANDLE;
+  _converter_pipeline_layout = VK_NULL_HANDLE;
+  _converter_descriptor_layout = VK_NULL_HANDLE;
+  _converter_descriptor_pool = VK_NULL_HANDLE;
+}
+
+int FrameCapture::resize(VkExtent2D extent, VkFormat format)
+{
+  if (!enabled() || _device == VK_NULL_HANDLE)
+  {
+    return 1;
+  }
+
+  // The caller made sure the timeline reached its last submitted value, so
+  // no copy into the slots is still pending on the GPU: recreateSwapChain
+  // waits for it when capturing, and nothing is submitted before the first
+  // swapchain. Let the worker drain before the buffers go away.
+  retire(UINT64_MAX);
+  for (uint32_t i = 0; i < kSlotCount; i++)
+  {
+    while (_slots[i].state != kSlotState_Free)
+    {
+      std::this_thread::yield();
+    }
+  }
+
+  releaseSlots();
+
+  switch (format)
+  {
+  case VK_FORMAT_B8G8R8A8_SRGB:
+  case VK_FORMAT_B8G8R8A8_UNORM:
+    _bgra = true;
+    break;
+  case VK_FORMAT_R8G8B8A8_SRGB:
+  case VK_FORMAT_R8G8B8A8_UNORM:
+    _bgra = false;
+    break;
+  default:
+    LOG_ERROR("Capture", "Unsupported swapchain format for capture: %d", format);
+    return 0;
+  }
+
+  _extent = extent;
+
+  VkBufferUsageFlags slot_usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  if (_format == kCaptureFormat_Y4M)
+  {
+    // 8x2 luma blocks per shader invocation
+    uint32_t padded_width = (extent.width + 7) & ~7u;
+    _padded_height = (extent.height + 1) & ~1u;
+    _luma_stride = padded_width;
+    _chroma_stride = padded_width / 2;
+    _slot_size = (VkDeviceSize) _luma_stride * _padded_height + (VkDeviceSize) _chroma_stride * _padded_height;
+    slot_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+
+    if (!createBuffer((VkDeviceSize) extent.width * extent.height * 4,
+          VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &_scratch_buffer, &_scratch_memory))
+    {
+      return 0;
+    }
+
+    vkResetDescriptorPool(_device, _converter_descriptor_pool, 0);
+  }
+  else
+  {
+    _slot_size = (VkDeviceSize) extent.width * extent.height * 4;
+  }
+
+  for (uint32_t i = 0; i < kSlotCount; i++)
+  {
+    Slot& slot = _slots[i];
+
+    // Cached memory makes the CPU reads on the worker much faster
+    _coherent = false;
+    if (!createBuffer(_slot_size, slot_usage,
+          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, &slot.buffer, &slot.memory))
+    {
+      vkDestroyBuffer(_device, slot.buffer, nullptr);
+      slot.buffer = VK_NULL_HANDLE;
+
+      _coherent = true;
+      if (!createBuffer(_slot_size, slot_usage,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &slot.buffer, &slot.memory))
+      {
+        return 0;
+      }
+    }
+
+    // Persistently mapped for the whole lifetime of the slot
+    vkMapMemory(_device, slot.memory, 0, VK_WHOLE_SIZE, 0, &slot.data);
+
+    if (_format == kCaptureFormat_Y4M)
+    {
+      VkDescriptorSetAllocateInfo allocate_info = {};
+      allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+      allocate_info.descriptorPool = _converter_descriptor_pool;
+      allocate_info.descriptorSetCount = 1;
+      allocate_info.pSetLayouts = &_converter_descriptor_layout;
+
+      if (vkAllocateDescriptorSets(_device, &allocate_info, &slot.descriptor_set) != VK_SUCCESS)
+      {
+        LOG_ERROR("Capture", "Failed allocating yuv descriptor set");
+        return 0;
+      }
+
+      VkDescriptorBufferInfo buffer_infos[2] = {};
+      buffer_infos[0].buffer = _scratch_buffer;
+      buffer_infos[0].range = VK_WHOLE_SIZE;
+      buffer_infos[1].buffer = slot.buffer;
+      buffer_infos[1].range = VK_WHOLE_SIZE;
+
+      VkWriteDescriptorSet writes[2] = {};
+      for (uint32_t j = 0; j < 2; j++)
+      {
+        writes[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[j].dstSet = slot.descriptor_set;
+        writes[j].dstBinding = j;
+        writes[j].descriptorCount = 1;
+        writes[j].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[j].pBufferInfo = &buffer_infos[j];
+      }
+
+      vkUpdateDescriptorSets(_device, 2, writes, 0, nullptr);
+    }
+  }
+
+  return 1;
+}
+
+void FrameCapture::releaseSlots()
+{
+  for (uint32_t i = 0; i < kSlotCount; i++)
+  {
+    Slot& slot = _slots[i];
+    if (slot.memory != VK_NULL_HANDLE)
+    {
+      vkUnmapMemory(_device, slot.memory);
+    }
+
+    vkDestroyBuffer(_device, slot.buffer, nullptr);
+    vkFreeMemory(_device, slot.memory, nullptr);
+
+    slot.buffer = VK_NULL_HANDLE;
+    slot.memory = VK_NULL_HANDLE;
+    slot.data = nullptr;
+    slot.descriptor_set = VK_NULL_HANDLE;
+    slot.state = kSlotState_Free;
+  }
+
+  vkDestroyBuffer(_device, _scratch_buffer, nullptr);
+  vkFreeMemory(_device, _scratch_memory, nullptr);
+  _scratch_buffer = VK_NULL_HANDLE;
+  _scratch_memory = VK_NULL_HANDLE;
+  _slot_size = 0;
+}
+
+void FrameCapture::release()
+{
+  if (_device == VK_NULL_HANDLE)
+  {
+    return;
+  }
+
+  retire(UINT64_MAX);
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _running = false;
+  }
+  _condition.notify_all();
+
+  if (_worker.joinable())
+  {
+    _worker.join();
+  }
+
+  releaseSlots();
+  releaseConverter();
+
+  if (_stream != nullptr && _stream != stdout)
+  {
+    fclose(_stream);
+  }
+  _stream = nullptr;
+
+#ifdef _WIN32
+  if (_pipe != nullptr)
+  {
+    CloseHandle((HANDLE) _pipe);
+  }
+#endif
+  _pipe = nullptr;
+
+  LOG_DEBUG("Capture", "Captured %llu frames, dropped %llu",
+    (unsigned long long) _captured.load(), (unsigned long long) _dropped);
+
+  _device = VK_NULL_HANDLE;
+}
+
+bool FrameCapture::recordCopy(VkCommandBuffer command_buffer, VkImage image, uint64_t frame, uint64_t timeline_value)
+{
+  if (!enabled() || _slot_size == 0)
+  {
+    return false;
+  }
+
+  Slot& slot = _slots[_next_slot];
+  if (slot.state != kSlotState_Free)
+  {
+    // The worker is behind, never wait for it
+    _dropped++;
+    return false;
+  }
+
+  _next_slot = (_next_slot + 1) % kSlotCount;
+  slot.frame = frame;
+  slot.timeline_value = timeline_value;
+  slot.extent = _extent;
+  slot.state = kSlotState_Pending;
+
+  bool convert = _format == kCaptureFormat_Y4M;
+  VkBuffer destination = convert ? _scratch_buffer : slot.buffer;
+
+  VkImageMemoryBarrier barrier = {};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.levelCount = 1;
+  barrier.subresourceRange.layerCount = 1;
+
+  // The scratch buffer is shared, the previous conversion must be done reading it
+  VkPipelineStageFlags source_stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  if (convert)
+  {
+    source_stages |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+  }
+
+  vkCmdPipelineBarrier(command_buffer, source_stages, VK_PIPELINE_STAGE_TRANSFER_BIT,
+    0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+  VkBufferImageCopy region = {};
+  region.bufferOffset = 0;
+  region.bufferRowLength = 0;
+  region.bufferImageHeight = 0;
+  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  region.imageSubresource.layerCount = 1;
+  region.imageExtent = { _extent.width, _extent.height, 1 };
+
+  vkCmdCopyImageToBuffer(command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, destination, 1, &region);
+
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  barrier.dstAccessMask = 0;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+  VkBufferMemoryBarrier buffer_barrier = {};
+  buffer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  buffer_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  buffer_barrier.dstAccessMask = convert ? VK_ACCESS_SHADER_READ_BIT : VK_ACCESS_HOST_READ_BIT;
+  buffer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  buffer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  buffer_barrier.buffer = destination;
+  buffer_barrier.size = VK_WHOLE_SIZE;
+
+  vkCmdPipelineBarrier(command_buffer,
+    VK_PIPELINE_STAGE_TRANSFER_BIT,
+    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT | (convert ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_HOST_BIT),
+    0, 0, nullptr, 1, &buffer_barrier, 1, &barrier);
+
+  if (convert)
+  {
+    recordConversion(command_buffer, slot);
+  }
+
+  return true;
+}
+
+void FrameCapture::recordConversion(VkCommandBuffer command_buffer, Slot& slot)
+{
+  ConverterParams params = {};
+  params.width = _extent.width;
+  params.height = _extent.height;
+  params.luma_stride = _luma_stride / 4;
+  params.chroma_stride = _chroma_stride / 4;
+  params.u_offset = _luma_stride * _padded_height / 4;
+  params.v_offset = params.u_offset + _chroma_stride * (_padded_height / 2) / 4;
+  params.bgra = _bgra ? 1 : 0;
+
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _converter_pipeline);
+  vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _converter_pipeline_layout,
+    0, 1, &slot.descriptor_set, 0, nullptr);
+  vkCmdPushConstants(command_buffer, _converter_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT,
+    0, sizeof(params), &params);
+
+  // 8x8 invocations per group, each one converting an 8x2 pixel block
+  uint32_t blocks_x = _luma_stride / 8;
+  uint32_t blocks_y = _padded_height / 2;
+  vkCmdDispatch(command_buffer, (blocks_x + 7) / 8, (blocks_y + 7) / 8, 1);
+
+  VkBufferMemoryBarrier host_barrier = {};
+  host_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  host_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  host_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  host_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  host_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  host_barrier.buffer = slot.buffer;
+  host_barrier.size = VK_WHOLE_SIZE;
+
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+    0, 0, nullptr, 1, &host_barrier, 0, nullptr);
+}
+
+void FrameCapture::retire(uint64_t completed_value)
+{
+  bool queued = false;
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (uint32_t i = 0; i < kSlotCount; i++)
+    {
+      // Keep frame order in the queue
+      uint32_t index = (_next_slot + i) % kSlotCount;
+      if (_slots[index].state == kSlotState_Pending && _slots[index].timeline_value <= completed_value)
+      {
+        _slots[index].state = kSlotState_Queued;
+        _queue.push_back(index);
+        queued = true;
+      }
+    }
+  }
+
+  if (queued)
+  {
+    _condition.notify_one();
+  }
+}
+
+void FrameCapture::workerLoop()
+{
+  while (true)
+  {
+    uint32_t index;
+
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _condition.wait(lock, [this]() { return !_queue.empty() || !_running; });
+
+      if (_queue.empty())
+      {
+        return;
+      }
+
+      index = _queue.front();
+      _queue.pop_front();
+    }
+
+    writeSlot(_slots[index]);
+    _captured++;
+    _slots[index].state = kSlotState_Free;
+  }
+}
+
+void FrameCapture::writeSlot(Slot& slot)
+{
+  if (!_coherent)
+  {
+    VkMappedMemoryRange range = {};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = slot.memory;
+    range.offset = 0;
+    range.size = VK_WHOLE_SIZE;
+    vkInvalidateMappedMemoryRanges(_device, 1, &range);
+  }
+
+  const uint8_t* pixels = (const uint8_t*) slot.data;
+  VkExtent2D extent = slot.extent;
+
+  if (_stream != nullptr && _last_extent.width != 0 &&
+      (_last_extent.width != extent.width || _last_extent.height != extent.height))
+  {
+    LOG_WARNING("Capture", "Capture stream changes size to %ux%u", extent.width, extent.height);
+  }
+  _last_extent = extent;
+
+  char file_name[512];
+  switch (_format)
+  {
+  case kCaptureFormat_PPM:
+    snprintf(file_name, sizeof(file_name), "%s_%06llu.ppm", _path.c_str(), (unsigned long long) slot.frame);
+    writePPM(file_name, pixels, extent);
+    break;
+  case kCaptureFormat_PNG:
+    snprintf(file_name, sizeof(file_name), "%s_%06llu.png", _path.c_str(), (unsigned long long) slot.frame);
+    writePNG(file_name, pixels, extent);
+    break;
+  case kCaptureFormat_Raw: {
+    if (!_bgra)
+    {
+      writeStream(pixels, (size_t) extent.width * extent.height * 4);
+      break;
+    }
+
+    std::vector<uint8_t> row(extent.width * 4);
+    for (uint32_t y = 0; y < extent.height; y++)
+    {
+      const uint8_t* src = pixels + (size_t) y * extent.width * 4;
+      for (uint32_t x = 0; x < extent.width; x++)
+      {
+        row[x * 4 + 0] = src[x * 4 + 2];
+        row[x * 4 + 1] = src[x * 4 + 1];
+        row[x * 4 + 2] = src[x * 4 + 0];
+        row[x * 4 + 3] = src[x * 4 + 3];
+      }
+      writeStream(row.data(), row.size());
+    }
+    break;
+  }
+  case kCaptureFormat_Y4M: {
+    // Y4M can not change size mid stream, frames with another size are skipped
+    if (_stream_extent.width == 0)
+    {
+      _stream_extent = extent;
+
+      char header[128];
+      int size = snprintf(header, sizeof(header), "YUV4MPEG2 W%u H%u F%u:%u Ip A1:1 C420jpeg\n",
+        extent.width, extent.height, _frame_rate_numerator, _frame_rate_denominator);
+      writeStream(header, size);
+    }
+    else if (_stream_extent.width != extent.width || _stream_extent.height != extent.height)
+    {
+      break;
+    }
+
+    writeStream("FRAME\n", 6);
+
+    uint32_t chroma_width = (extent.width + 1) / 2;
+    uint32_t chroma_height = (extent.height + 1) / 2;
+    const uint8_t* u_plane = pixels + (size_t) _luma_stride * _padded_height;
+    const uint8_t* v_plane = u_plane + (size_t) _chroma_stride * (_padded_height / 2);
+
+    for (uint32_t y = 0; y < extent.height; y++)
+    {
+      writeStream(pixels + (size_t) y * _luma_stride, extent.width);
+    }
+    for (uint32_t y = 0; y < chroma_height; y++)
+    {
+      writeStream(u_plane + (size_t) y * _chroma_stride, chroma_width);
+    }
+    for (uint32_t y = 0; y < chroma_height; y++)
+    {
+      writeStream(v_plane + (size_t) y * _chroma_stride, chroma_width);
+    }
+    break;
+  }
+  default:
+    break;
+  }
+
+  if (_stream != nullptr)
+  {
+    fflush(_stream);
+  }
+}
+
+void FrameCapture::writePPM(const char* file_name, const uint8_t* pixels, VkExtent2D extent)
+{
+  FILE* file = fopen(file_name, "wb");
+  if (file == nullptr)
+  {
+    LOG_WARNING("Capture", "Failed opening %s", file_name);
+    return;
+  }
+
+  fprintf(file, "P6\n%u %u\n255\n", extent.width, extent.height);
+
+  int r = _bgra ? 2 : 0;
+  int b = _bgra ? 0 : 2;
+  std::vector<uint8_t> row(extent.width * 3);
+  for (uint32_t y = 0; y < extent.height; y++)
+  {
+    const uint8_t* src = pixels + (size_t) y * extent.width * 4;
+    for (uint32_t x = 0; x < extent.width; x++)
+    {
+      row[x * 3 + 0] = src[x * 4 + r];
+      row[x * 3 + 1] = src[x * 4 + 1];
+      row[x * 3 + 2] = src[x * 4 + b];
+    }
+    fwrite(row.data(), 1, row.size(), file);
+  }
+
+  fclose(file);
+}
+
+void FrameCapture::writePNG(const char* file_name, const uint8_t* pixels, VkExtent2D extent)
+{
+  FILE* file = fopen(file_name, "wb");
+  if (file == nullptr)
+  {
+    LOG_WARNING("Capture", "Failed opening %s", file_name);
+    return;
+  }
+
+  static const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+  fwrite(signature, 1, sizeof(signature), file);
+
+  std::vector<uint8_t> header;
+  writeBigEndian(header, extent.width);
+  writeBigEndian(header, extent.height);
+  // 8 bit RGB, default compression, filter and no interlace
+  header.push_back(8);
+  header.push_back(2);
+  header.push_back(0);
+  header.push_back(0);
+  header.push_back(0);
+  writeChunk(file, "IHDR", header);
+
+  // Filter byte (none) + RGB for every row
+  int r = _bgra ? 2 : 0;
+  int b = _bgra ? 0 : 2;
+  size_t row_size = (size_t) extent.width * 3 + 1;
+  std::vector<uint8_t> raw(row_size * extent.height);
+  for (uint32_t y = 0; y < extent.height; y++)
+  {
+    const uint8_t* src = pixels + (size_t) y * extent.width * 4;
+    uint8_t* dst = raw.data() + y * row_size;
+    dst[0] = 0;
+    for (uint32_t x = 0; x < extent.width; x++)
+    {
+      dst[1 + x * 3 + 0] = src[x * 4 + r];
+      dst[1 + x * 3 + 1] = src[x * 4 + 1];
+      dst[1 + x * 3 + 2] = src[x * 4 + b];
+    }
+  }
+
+  // zlib stream made of stored deflate blocks, speed matters more than size here
+  std::vector<uint8_t> data;
+  data.push_back(0x78);
+  data.push_back(0x01);
+
+  uint32_t adler_a = 1;
+  uint32_t adler_b = 0;
+  for (size_t offset = 0; offset < raw.size(); offset += 65535)
+  {
+    size_t size = raw.size() - offset < 65535 ? raw.size() - offset : 65535;
+    bool last = offset + size == raw.size();
+
+    data.push_back(last ? 1 : 0);
+    data.push_back((uint8_t) size);
+    data.push_back((uint8_t) (size >> 8));
+    data.push_back((uint8_t) ~size);
+    data.push_back((uint8_t) (~size >> 8));
+    data.insert(data.end(), raw.begin() + offset, raw.begin() + offset + size);
+
+    for (size_t i = 0; i < size; i++)
+    {
+      adler_a = (adler_a + raw[offset + i]) % 65521;
+      adler_b = (adler_b + adler_a) % 65521;
+    }
+  }
+  writeBigEndian(data, (adler_b << 16) | adler_a);
+
+  writeChunk(file, "IDAT", data);
+  writeChunk(file, "IEND", std::vector<uint8_t>());
+
+  fclose(file);
+}
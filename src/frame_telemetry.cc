@@ -0,0 +1,236 @@
+#include "frame_telemetry.h"
+
+#include <string.h>
+
+#include "logger.h"
+
+static const char* phase_names[] = {
+  "gpu wait", "acquire", "update", "cull", "record", "submit", "present", "external"
+};
+
+static uint32_t highestBit(uint64_t value)
+{
+  uint32_t bit = 0;
+  while (value >>= 1)
+  {
+    bit++;
+  }
+  return bit;
+}
+
+HdrHistogram::HdrHistogram()
+{
+  reset();
+}
+
+void HdrHistogram::reset()
+{
+  memset(_counts, 0, sizeof(_counts));
+  _count = 0;
+  _sum = 0;
+  _min = UINT64_MAX;
+  _max = 0;
+}
+
+uint32_t HdrHistogram::indexOf(uint64_t value)
+{
+  if (value < (1 << kSubBucketBits))
+  {
+    return (uint32_t) value;
+  }
+
+  uint32_t exponent = highestBit(value) - (kSubBucketBits - 1);
+  if (exponent > kMaxExponent)
+  {
+    return kBucketCount - 1;
+  }
+
+  return exponent * kHalfSubBuckets + (uint32_t) (value >> exponent);
+}
+
+uint64_t HdrHistogram::lowestOf(uint32_t index)
+{
+  if (index < (1 << kSubBucketBits))
+  {
+    return index;
+  }
+
+  uint32_t exponent = index / kHalfSubBuckets - 1;
+  uint64_t mantissa = index - exponent * kHalfSubBuckets;
+  return mantissa << exponent;
+}
+
+uint64_t HdrHistogram::highestOf(uint32_t index)
+{
+  if (index < (1 << kSubBucketBits))
+  {
+    return index;
+  }
+
+  uint32_t exponent = index / kHalfSubBuckets - 1;
+  return lowestOf(index) + ((uint64_t) 1 << exponent) - 1;
+}
+
+void HdrHistogram::record(uint64_t value_us)
+{
+  _counts[indexOf(value_us)]++;
+  _count++;
+  _sum += value_us;
+
+  if (value_us < _min)
+  {
+    _min = value_us;
+  }
+
+  if (value_us > _max)
+  {
+    _max = value_us;
+  }
+}
+
+double HdrHistogram::mean() const
+{
+  return _count != 0 ? (double) _sum / (double) _count : 0.0;
+}
+
+uint64_t HdrHistogram::percentile(double percentile) const
+{
+  if (_count == 0)
+  {
+    return 0;
+  }
+
+  uint64_t target = (uint64_t) (percentile / 100.0 * (double) _count + 0.5);
+  if (target < 1)
+  {
+    target = 1;
+  }
+
+  uint64_t accumulated = 0;
+  for (uint32_t i = 0; i < kBucketCount; i++)
+  {
+    accumulated += _counts[i];
+    if (accumulated >= target)
+    {
+      uint64_t value = highestOf(i);
+      return value < _max ? value : _max;
+    }
+  }
+
+  return _max;
+}
+
+uint64_t HdrHistogram::countAbove(uint64_t value_us) const
+{
+  uint64_t result = 0;
+  for (uint32_t i = indexOf(value_us) + 1; i < kBucketCount; i++)
+  {
+    result += _counts[i];
+  }
+  return result;
+}
+
+FrameTelemetry::FrameTelemetry() { }
+
+void FrameTelemetry::setBudget(double budget_ms)
+{
+  _budget_us = (uint64_t) (budget_ms * 1000.0);
+}
+
+void FrameTelemetry::beginFrame()
+{
+  Clock::time_point now = Clock::now();
+
+  memset(_current, 0, sizeof(_current));
+  if (_has_last_frame)
+  {
+    _current[kFramePhase_External] =
+      std::chrono::duration_cast<std::chrono::microseconds>(now - _last_frame_end).count();
+    _frame_start = _last_frame_end;
+  }
+  else
+  {
+    _frame_start = now;
+  }
+
+  _last_mark = now;
+  _in_frame = true;
+}
+
+void FrameTelemetry::mark(FramePhase phase)
+{
+  if (!_in_frame)
+  {
+    return;
+  }
+
+  Clock::time_point now = Clock::now();
+  _current[phase] += std::chrono::duration_cast<std::chrono::microseconds>(now - _last_mark).count();
+  _last_mark = now;
+}
+
+void FrameTelemetry::endFrame()
+{
+  if (!_in_frame)
+  {
+    return;
+  }
+
+  Clock::time_point now = Clock::now();
+  uint64_t frame_us = std::chrono::duration_cast<std::chrono::microseconds>(now - _frame_start).count();
+
+  _in_frame = false;
+  _last_frame_end = now;
+  _has_last_frame = true;
+  _frames++;
+
+  // Blame the phase furthest above its own median, so phases that are
+  // always long (vsync GPU waits) are not blamed for every hitch
+  if (frame_us > _budget_us)
+  {
+    _frames_over_budget++;
+
+    int32_t culprit = 0;
+    int64_t worst_excess = INT64_MIN;
+    for (int32_t i = 0; i < kFramePhase_Count; i++)
+    {
+      int64_t excess = (int64_t) _current[i] - (int64_t) _phases[i].percentile(50.0);
+      if (excess > worst_excess)
+      {
+        worst_excess = excess;
+        culprit = i;
+      }
+    }
+
+    _stalls[culprit]++;
+    LOG_WARNING("Telemetry", "Frame %llu over budget: %.2f ms, stalled in %s (%.2f ms)",
+      (unsigned long long) _frames, frame_us / 1000.0,
+      phase_names[culprit], _current[culprit] / 1000.0);
+  }
+
+  for (int32_t i = 0; i < kFramePhase_Count; i++)
+  {
+    _phases[i].record(_current[i]);
+  }
+  _frame.record(frame_us);
+}
+
+void FrameTelemetry::report() const
+{
+  LOG_DEBUG("Telemetry", "%llu frames, %llu over %.2f ms budget",
+    (unsigned long long) _frames, (unsigned long long) _frames_over_budget, budget());
+  LOG_DEBUG("Telemetry", "%-10s p50 %7.2f ms p99 %7.2f ms max %7.2f ms", "frame",
+    _frame.percentile(50.0) / 1000.0, _frame.percentile(99.0) / 1000.0, _frame.max() / 1000.0);
+
+  for (int32_t i = 0; i < kFramePhase_Count; i++)
+  {
+    LOG_DEBUG("Telemetry", "%-10s p50 %7.2f ms p99 %7.2f ms max %7.2f ms stalls %llu", phase_names[i],
+      _phases[i].percentile(50.0) / 1000.0, _phases[i].percentile(99.0) / 1000.0,
+      _phases[i].max() / 1000.0, (unsigned long long) _stalls[i]);
+  }
+}
+
+const char* FrameTelemetry::phaseName(FramePhase phase)
+{
+  return phase < kFramePhase_Count ? phase_names[phase] : "unknown";
+}
@@ -0,0 +1,396 @@
+#include "geometry_arena.h"
+
+#include <string.h>
+
+#include "logger.h"
+#include "mesh.h"
+
+static uint32_t findHostMemoryType(VkPhysicalDevice physical_device, uint32_t filter, VkMemoryPropertyFlags properties)
+{
+  VkPhysicalDeviceMemoryProperties memory_properties;
+  vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+
+  for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+    if ((filter & (1 << i)) && (memory_properties.memoryTypes[i].propertyFlags & properties) == properties) {
+      return i;
+    }
+  }
+
+  return UINT32_MAX;
+}
+
+void RangeAllocator::init(uint64_t size)
+{
+  _size = size;
+  _used = 0;
+  _free.clear();
+  _allocations.clear();
+  if (size > 0)
+  {
+    _free[0] = size;
+  }
+}
+
+uint64_t RangeAllocator::allocate(uint64_t size, uint64_t alignment)
+{
+  if (size == 0 || alignment == 0)
+  {
+    return kInvalidOffset;
+  }
+
+  for (std::map<uint64_t, uint64_t>::iterator it = _free.begin(); it != _free.end(); ++it)
+  {
+    uint64_t start = it->first;
+    uint64_t end = it->second;
+    uint64_t offset = (start + alignment - 1) / alignment * alignment;
+    if (offset + size > end)
+    {
+      continue;
+    }
+
+    // The padding stays with the allocation, the tail goes back
+    _free.erase(it);
+    if (offset + size < end)
+    {
+      _free[offset + size] = end;
+    }
+
+    Allocation allocation;
+    allocation.start = start;
+    allocation.end = offset + size;
+    _allocations[offset] = allocation;
+    _used += allocation.end - allocation.start;
+    return offset;
+  }
+
+  return kInvalidOffset;
+}
+
+void RangeAllocator::free(uint64_t offset)
+{
+  std::map<uint64_t, Allocation>::iterator allocation = _allocations.find(offset);
+  if (allocation == _allocations.end())
+  {
+    return;
+  }
+
+  uint64_t start = allocation->second.start;
+  uint64_t end = allocation->second.end;
+  _used -= end - start;
+  _allocations.erase(allocation);
+
+  // Merge with the free ranges right after and right before
+  std::map<uint64_t, uint64_t>::iterator next = _free.find(end);
+  if (next != _free.end())
+  {
+    end = next->second;
+    _free.erase(next);
+  }
+
+  std::map<uint64_t, uint64_t>::iterator previous = _free.lower_bound(start);
+  if (previous != _free.begin())
+  {
+    --previous;
+    if (previous->second == start)
+    {
+      previous->second = end;
+      return;
+    }
+  }
+
+  _free[start] = end;
+}
+
+int GeometryArena::init(VkPhysicalDevice physical_device, VkDevice device, GpuTimeline* timeline,
+  const VertexLayout& layout, uint32_t vertex_capacity, uint64_t index_capacity, uint32_t cluster_capacity)
+{
+  _physical_device = physical_device;
+  _device = device;
+  _timeline = timeline;
+  _layout = layout;
+
+  for (uint32_t stream = 0; stream < kVertexStream_Count; stream++)
+  {
+    uint32_t stride = _layout.stride((VertexStream) stream);
+    if (stride > 0 && !createBuffer((VkDeviceSize) vertex_capacity * stride, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+          &_vertex_buffers[stream], &_vertex_memory[stream], &_vertex_data[stream]))
+    {
+      return 0;
+    }
+  }
+
+  if (!createBuffer(index_capacity, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, &_index_buffer, &_index_memory, &_index_data))
+  {
+    return 0;
+  }
+
+  // Triangles are read as words, the size is rounded up so the last one
+  // stays inside the buffer
+  uint64_t cluster_vertex_capacity = (uint64_t) cluster_capacity * kMeshClusterMaxVertices;
+  uint64_t cluster_triangle_capacity = (uint64_t) cluster_capacity * kMeshClusterMaxTriangles;
+  VkDeviceSize cluster_sizes[3] = {
+    (VkDeviceSize) cluster_capacity * sizeof(MeshCluster),
+    cluster_vertex_capacity * sizeof(uint32_t),
+    (cluster_triangle_capacity * 3 + 3) & ~3ull
+  };
+  for (uint32_t i = 0; i < 3; i++)
+  {
+    if (!createBuffer(cluster_sizes[i], VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &_cluster_buffers[i], &_cluster_memory[i],
+          &_cluster_data[i]))
+    {
+      return 0;
+    }
+  }
+
+  _vertices.init(vertex_capacity);
+  _indices.init(index_capacity);
+  _clusters.init(cluster_capacity);
+  _cluster_vertices.init(cluster_vertex_capacity);
+  _cluster_triangles.init(cluster_triangle_capacity);
+
+  LOG_DEBUG("Geometry", "Arena of %u vertices (%u bytes each), %.1f MB of indices and %u clusters",
+    vertex_capacity, _layout.vertexSize(), index_capacity / (1024.0 * 1024.0), cluster_capacity);
+  return 1;
+}
+
+void GeometryArena::release()
+{
+  if (_device == VK_NULL_HANDLE)
+  {
+    return;
+  }
+
+  for (uint32_t stream = 0; stream < kVertexStream_Count; stream++)
+  {
+    vkDestroyBuffer(_device, _vertex_buffers[stream], nullptr);
+    vkFreeMemory(_device, _vertex_memory[stream], nullptr);
+    _vertex_buffers[stream] = VK_NULL_HANDLE;
+    _vertex_memory[stream] = VK_NULL_HANDLE;
+    _vertex_data[stream] = nullptr;
+  }
+
+  vkDestroyBuffer(_device, _index_buffer, nullptr);
+  vkFreeMemory(_device, _index_memory, nullptr);
+  _index_buffer = VK_NULL_HANDLE;
+  _index_memory = VK_NULL_HANDLE;
+  _index_data = nullptr;
+
+  for (uint32_t i = 0; i < 3; i++)
+  {
+    vkDestroyBuffer(_device, _cluster_buffers[i], nullptr);
+    vkFreeMemory(_device, _cluster_memory[i], nullptr);
+    _cluster_buffers[i] = VK_NULL_HANDLE;
+    _cluster_memory[i] = VK_NULL_HANDLE;
+    _cluster_data[i] = nullptr;
+  }
+
+  _pending.clear();
+  _device = VK_NULL_HANDLE;
+}
+
+int GeometryArena::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer* buffer,
+  VkDeviceMemory* memory, uint8_t** mapped)
+{
+  VkBufferCreateInfo create_info = {};
+  create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  create_info.size = size;
+  create_info.usage = usage;
+  create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  VkResult result = vkCreateBuffer(_device, &create_info, nullptr, buffer);
+  if (result != VK_SUCCESS)
+  {
+    LOG_ERROR("Geometry", "Failed creating arena buffer");
+    return 0;
+  }
+
+  VkMemoryRequirements memory_requirements;
+  vkGetBufferMemoryRequirements(_device, *buffer, &memory_requirements);
+
+  uint32_t memory_type = findHostMemoryType(_physical_device, memory_requirements.memoryTypeBits,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  if (memory_type == UINT32_MAX)
+  {
+    LOG_ERROR("Geometry", "Unable to find arena memory type");
+    return 0;
+  }
+
+  VkMemoryAllocateInfo allocate_info = {};
+  allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocate_info.allocationSize = memory_requirements.size;
+  allocate_info.memoryTypeIndex = memory_type;
+
+  result = vkAllocateMemory(_device, &allocate_info, nullptr, memory);
+  if (result != VK_SUCCESS)
+  {
+    LOG_ERROR("Geometry", "Failed allocating arena memory");
+    return 0;
+  }
+
+  vkBindBufferMemory(_device, *buffer, *memory, 0);
+
+  void* data = nullptr;
+  result = vkMapMemory(_device, *memory, 0, size, 0, &data);
+  if (result != VK_SUCCESS)
+  {
+    LOG_ERROR("Geometry", "Failed mapping arena memory");
+    return 0;
+  }
+
+  *mapped = (uint8_t*) data;
+  return 1;
+}
+
+int GeometryArena::add(const MeshFile& mesh, GeometryRange* range)
+{
+  const MeshHeader& header = mesh.header();
+  const VertexLayout& layout = mesh.vertexLayout();
+  for (uint32_t stream = 0; stream < kVertexStream_Count; stream++)
+  {
+    if (layout.encoding((VertexStream) stream) != _layout.encoding((VertexStream) stream))
+    {
+      LOG_ERROR("Geometry", "Mesh vertex layout does not match the arena (%s %s instead of %s)",
+        stream == kVertexStream_Position ? "position" : (stream == kVertexStream_Color ? "color" : "normal"),
+        VertexLayout::encodingName(layout.encoding((VertexStream) stream)),
+        VertexLayout::encodingName(_layout.encoding((VertexStream) stream)));
+      return 0;
+    }
+  }
+
+  // The arena width only depends on the vertex count, the copy below
+  // converts from whichever width the file was written with. MeshFile
+  // already checked every index against vertex_count.
+  uint32_t index_size = header.vertex_count <= 0xFFFF ? 2 : 4;
+
+  uint64_t vertex_offset = _vertices.allocate(header.vertex_count);
+  uint64_t index_offset = _indices.allocate((uint64_t) header.index_count * index_size, 4);
+  bool full = vertex_offset == RangeAllocator::kInvalidOffset || index_offset == RangeAllocator::kInvalidOffset;
+
+  uint64_t cluster_offset = RangeAllocator::kInvalidOffset;
+  uint64_t cluster_vertex_offset = RangeAllocator::kInvalidOffset;
+  uint64_t cluster_triangle_offset = RangeAllocator::kInvalidOffset;
+  if (header.cluster_count > 0)
+  {
+    cluster_offset = _clusters.allocate(header.cluster_count);
+    cluster_vertex_offset = _cluster_vertices.allocate(header.cluster_vertex_count);
+    cluster_triangle_offset = _cluster_triangles.allocate(header.cluster_triangle_count);
+    full = full || cluster_offset == RangeAllocator::kInvalidOffset ||
+      cluster_vertex_offset == RangeAllocator::kInvalidOffset ||
+      cluster_triangle_offset == RangeAllocator::kInvalidOffset;
+  }
+
+  if (full)
+  {
+    _vertices.free(vertex_offset);
+    _indices.free(index_offset);
+    _clusters.free(cluster_offset);
+    _cluster_vertices.free(cluster_vertex_offset);
+    _cluster_triangles.free(cluster_triangle_offset);
+    LOG_ERROR("Geometry", "Arena full, %u of %u vertices, %llu of %llu index bytes and %u of %u clusters used",
+      verticesUsed(), vertexCapacity(), (unsigned long long) indexBytesUsed(), (unsigned long long) indexCapacity(),
+      clustersUsed(), clusterCapacity());
+    return 0;
+  }
+
+  for (uint32_t stream = 0; stream < kVertexStream_Count; stream++)
+  {
+    if (_vertex_data[stream] != nullptr)
+    {
+      MeshSection section = (MeshSection) stream;
+      memcpy(_vertex_data[stream] + vertex_offset * _layout.stride((VertexStream) stream), mesh.section(section),
+        (size_t) mesh.sectionSize(section));
+    }
+  }
+
+  uint8_t* indices = _index_data + index_offset;
+  const void* source = mesh.section(kMeshSection_Indices);
+  if (header.index_size == index_size)
+  {
+    memcpy(indices, source, (size_t) header.index_count * index_size);
+  }
+  else if (index_size == 2)
+  {
+    const uint32_t* wide = (const uint32_t*) source;
+    uint16_t* narrow = (uint16_t*) indices;
+    for (uint32_t i = 0; i < header.index_count; i++)
+    {
+      narrow[i] = (uint16_t) wide[i];
+    }
+  }
+  else
+  {
+    const uint16_t* narrow = (const uint16_t*) source;
+    uint32_t* wide = (uint32_t*) indices;
+    for (uint32_t i = 0; i < header.index_count; i++)
+    {
+      wide[i] = narrow[i];
+    }
+  }
+
+  range->vertex_offset = (int32_t) vertex_offset;
+  range->vertex_count = header.vertex_count;
+  range->first_index = (uint32_t) (index_offset / index_size);
+  range->index_count = header.index_count;
+  range->index_type = index_size == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+  range->index_allocation = index_offset;
+
+  range->cluster_offset = 0;
+  range->cluster_count = header.cluster_count;
+  range->cluster_vertex_allocation = cluster_vertex_offset;
+  range->cluster_triangle_allocation = cluster_triangle_offset;
+  if (header.cluster_count > 0)
+  {
+    // Cluster vertices stay relative to the mesh, draws add vertex_offset
+    MeshCluster* clusters = (MeshCluster*) _cluster_data[0] + cluster_offset;
+    memcpy(clusters, mesh.clusters(), (size_t) header.cluster_count * sizeof(MeshCluster));
+    for (uint32_t i = 0; i < header.cluster_count; i++)
+    {
+      clusters[i].vertex_offset += (uint32_t) cluster_vertex_offset;
+      clusters[i].triangle_offset += (uint32_t) cluster_triangle_offset;
+    }
+
+    memcpy((uint32_t*) _cluster_data[1] + cluster_vertex_offset, mesh.section(kMeshSection_ClusterVertices),
+      (size_t) mesh.sectionSize(kMeshSection_ClusterVertices));
+    memcpy(_cluster_data[2] + cluster_triangle_offset * 3, mesh.section(kMeshSection_ClusterTriangles),
+      (size_t) mesh.sectionSize(kMeshSection_ClusterTriangles));
+    range->cluster_offset = (uint32_t) cluster_offset;
+  }
+  return 1;
+}
+
+void GeometryArena::free(const GeometryRange& range, uint64_t value)
+{
+  Pending pending;
+  pending.range = range;
+  pending.value = value;
+  _pending.push_back(pending);
+}
+
+void GeometryArena::collect()
+{
+  while (!_pending.empty() && _timeline->isComplete(_pending.front().value))
+  {
+    const GeometryRange& range = _pending.front().range;
+    _vertices.free((uint64_t) range.vertex_offset);
+    _indices.free(range.index_allocation);
+    if (range.cluster_count > 0)
+    {
+      _clusters.free(range.cluster_offset);
+      _cluster_vertices.free(range.cluster_vertex_allocation);
+      _cluster_triangles.free(range.cluster_triangle_allocation);
+    }
+    _pending.pop_front();
+  }
+}
+
+void GeometryArena::bindVertexBuffers(VkCommandBuffer command_buffer) const
+{
+  for (uint32_t stream = 0; stream < kVertexStream_Count; stream++)
+  {
+    VkDeviceSize offset = 0;
+    if (_vertex_buffers[stream] != VK_NULL_HANDLE)
+    {
+      vkCmdBindVertexBuffers(command_buffer, stream, 1, &_vertex_buffers[stream], &offset);
+    }
+  }
+}
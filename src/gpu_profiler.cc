@@ -0,0 +1,238 @@
+#include "gpu_profiler.h"
+
+#include "logger.h"
+
+static const VkQueryPipelineStatisticFlags kStatisticFlags =
+  VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+  VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+  VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+  VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+  VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+  VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+// Counters in the order Vulkan writes them (ascending flag bits)
+static const uint32_t kStatisticCount = 6;
+
+GpuProfiler::GpuProfiler() { }
+
+GpuProfiler::~GpuProfiler() { }
+
+int GpuProfiler::init(VkPhysicalDevice physical_device, VkDevice device, uint32_t queue_family, bool statistics_enabled)
+{
+  _device = device;
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+  uint32_t count;
+  vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &count, nullptr);
+  std::vector<VkQueueFamilyProperties> queues(count);
+  vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &count, queues.data());
+
+  uint32_t valid_bits = queue_family < count ? queues[queue_family].timestampValidBits : 0;
+
+  VkQueryPoolCreateInfo create_info = {};
+  create_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+
+  if (valid_bits != 0)
+  {
+    _timestamp_period = properties.limits.timestampPeriod;
+    _timestamp_mask = valid_bits >= 64 ? UINT64_MAX : ((uint64_t) 1 << valid_bits) - 1;
+
+    create_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    create_info.queryCount = kMaxFrames * kMaxPasses * 2;
+    if (vkCreateQueryPool(_device, &create_info, nullptr, &_timestamp_pool) != VK_SUCCESS)
+    {
+      LOG_WARNING("GpuProfiler", "Failed creating timestamp query pool");
+      _timestamp_pool = VK_NULL_HANDLE;
+    }
+  }
+  else
+  {
+    LOG_WARNING("GpuProfiler", "Graphics queue does not support timestamps");
+  }
+
+  create_info.queryType = VK_QUERY_TYPE_OCCLUSION;
+  create_info.queryCount = kMaxFrames * kMaxPasses;
+  if (vkCreateQueryPool(_device, &create_info, nullptr, &_occlusion_pool) != VK_SUCCESS)
+  {
+    LOG_WARNING("GpuProfiler", "Failed creating occlusion query pool");
+    _occlusion_pool = VK_NULL_HANDLE;
+  }
+
+  if (statistics_enabled)
+  {
+    create_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+    create_info.queryCount = kMaxFrames * kMaxPasses;
+    create_info.pipelineStatistics = kStatisticFlags;
+    if (vkCreateQueryPool(_device, &create_info, nullptr, &_statistics_pool) != VK_SUCCESS)
+    {
+      LOG_WARNING("GpuProfiler", "Failed creating pipeline statistics query pool");
+      _statistics_pool = VK_NULL_HANDLE;
+    }
+  }
+
+  LOG_DEBUG("GpuProfiler", "Timestamps: %d, pipeline statistics: %d", timestampsSupported(), statisticsSupported());
+  return 1;
+}
+
+void GpuProfiler::release()
+{
+  if (_device == VK_NULL_HANDLE)
+  {
+    return;
+  }
+
+  vkDestroyQueryPool(_device, _timestamp_pool, nullptr);
+  vkDestroyQueryPool(_device, _occlusion_pool, nullptr);
+  vkDestroyQueryPool(_device, _statistics_pool, nullptr);
+
+  _timestamp_pool = VK_NULL_HANDLE;
+  _occlusion_pool = VK_NULL_HANDLE;
+  _statistics_pool = VK_NULL_HANDLE;
+  _device = VK_NULL_HANDLE;
+}
+
+void GpuProfiler::resetFrame(VkCommandBuffer command_buffer, uint32_t frame)
+{
+  if (frame >= kMaxFrames)
+  {
+    return;
+  }
+
+  _frame_pass_count[frame] = 0;
+
+  if (_timestamp_pool != VK_NULL_HANDLE)
+  {
+    vkCmdResetQueryPool(command_buffer, _timestamp_pool, frame * kMaxPasses * 2, kMaxPasses * 2);
+  }
+
+  if (_occlusion_pool != VK_NULL_HANDLE)
+  {
+    vkCmdResetQueryPool(command_buffer, _occlusion_pool, frame * kMaxPasses, kMaxPasses);
+  }
+
+  if (_statistics_pool != VK_NULL_HANDLE)
+  {
+    vkCmdResetQueryPool(command_buffer, _statistics_pool, frame * kMaxPasses, kMaxPasses);
+  }
+}
+
+uint32_t GpuProfiler::beginPass(VkCommandBuffer command_buffer, uint32_t frame, const char* name)
+{
+  if (frame >= kMaxFrames || _frame_pass_count[frame] >= kMaxPasses)
+  {
+    LOG_WARNING("GpuProfiler", "Out of profiler queries for pass %s", name);
+    return UINT32_MAX;
+  }
+
+  uint32_t pass = _frame_pass_count[frame]++;
+  uint32_t query = frame * kMaxPasses + pass;
+  _frame_pass_names[frame][pass] = name;
+
+  if (_timestamp_pool != VK_NULL_HANDLE)
+  {
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _timestamp_pool, query * 2);
+  }
+
+  if (_occlusion_pool != VK_NULL_HANDLE)
+  {
+    vkCmdBeginQuery(command_buffer, _occlusion_pool, query, 0);
+  }
+
+  if (_statistics_pool != VK_NULL_HANDLE)
+  {
+    vkCmdBeginQuery(command_buffer, _statistics_pool, query, 0);
+  }
+
+  return pass;
+}
+
+void GpuProfiler::endPass(VkCommandBuffer command_buffer, uint32_t frame, uint32_t pass)
+{
+  if (frame >= kMaxFrames || pass >= kMaxPasses)
+  {
+    return;
+  }
+
+  uint32_t query = frame * kMaxPasses + pass;
+
+  if (_statistics_pool != VK_NULL_HANDLE)
+  {
+    vkCmdEndQuery(command_buffer, _statistics_pool, query);
+  }
+
+  if (_occlusion_pool != VK_NULL_HANDLE)
+  {
+    vkCmdEndQuery(command_buffer, _occlusion_pool, query);
+  }
+
+  if (_timestamp_pool != VK_NULL_HANDLE)
+  {
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _timestamp_pool, query * 2 + 1);
+  }
+}
+
+void GpuProfiler::collect(uint32_t frame)
+{
+  if (frame >= kMaxFrames || _frame_pass_count[frame] == 0)
+  {
+    return;
+  }
+
+  uint32_t pass_count = _frame_pass_count[frame];
+  uint32_t first = frame * kMaxPasses;
+  VkQueryResultFlags flags = VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT;
+
+  // Every query is followed by its availability word
+  uint64_t timestamps[kMaxPasses * 2][2] = {};
+  uint64_t occlusion[kMaxPasses][2] = {};
+  uint64_t statistics[kMaxPasses][kStatisticCount + 1] = {};
+
+  if (_timestamp_pool != VK_NULL_HANDLE)
+  {
+    vkGetQueryPoolResults(_device, _timestamp_pool, first * 2, pass_count * 2,
+      sizeof(timestamps), timestamps, sizeof(timestamps[0]), flags);
+  }
+
+  if (_occlusion_pool != VK_NULL_HANDLE)
+  {
+    vkGetQueryPoolResults(_device, _occlusion_pool, first, pass_count,
+      sizeof(occlusion), occlusion, sizeof(occlusion[0]), flags);
+  }
+
+  if (_statistics_pool != VK_NULL_HANDLE)
+  {
+    vkGetQueryPoolResults(_device, _statistics_pool, first, pass_count,
+      sizeof(statistics), statistics, sizeof(statistics[0]), flags);
+  }
+
+  _passes.resize(pass_count);
+  for (uint32_t i = 0; i < pass_count; i++)
+  {
+    GpuPassStats& stats = _passes[i];
+    stats.name = _frame_pass_names[frame][i];
+
+    if (timestamps[i * 2][1] != 0 && timestamps[i * 2 + 1][1] != 0)
+    {
+      uint64_t ticks = (timestamps[i * 2 + 1][0] - timestamps[i * 2][0]) & _timestamp_mask;
+      stats.time_ms = (double) ticks * _timestamp_period / 1000000.0;
+    }
+
+    if (occlusion[i][1] != 0)
+    {
+      stats.samples_passed = occlusion[i][0];
+    }
+
+    stats.has_statistics = statistics[i][kStatisticCount] != 0;
+    if (stats.has_statistics)
+    {
+      stats.input_vertices = statistics[i][0];
+      stats.input_primitives = statistics[i][1];
+      stats.vertex_invocations = statistics[i][2];
+      stats.clipping_invocations = statistics[i][3];
+      stats.clipping_primitives = statistics[i][4];
+      stats.fragment_invocations = statistics[i][5];
+    }
+  }
+}
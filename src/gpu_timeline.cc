@@ -0,0 +1,151 @@
+#include "gpu_timeline.h"
+
+#include "logger.h"
+
+GpuTimeline::GpuTimeline()
+{
+  _completed = 0;
+}
+
+int GpuTimeline::init(VkDevice device)
+{
+  _device = device;
+
+  VkSemaphoreTypeCreateInfo type_info = {};
+  type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+  type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  type_info.initialValue = 0;
+
+  VkSemaphoreCreateInfo create_info = {};
+  create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  create_info.pNext = &type_info;
+
+  VkResult result = vkCreateSemaphore(_device, &create_info, nullptr, &_semaphore);
+  if (result != VK_SUCCESS)
+  {
+    LOG_ERROR("Timeline", "Failed creating timeline semaphore");
+    return 0;
+  }
+
+  _submitted = 0;
+  _completed = 0;
+  return 1;
+}
+
+void GpuTimeline::release()
+{
+  if (_device == VK_NULL_HANDLE)
+  {
+    return;
+  }
+
+  vkDestroySemaphore(_device, _semaphore, nullptr);
+  _semaphore = VK_NULL_HANDLE;
+  _device = VK_NULL_HANDLE;
+}
+
+int GpuTimeline::submit(VkQueue queue, const VkSubmitInfo& submit_info, uint64_t* value)
+{
+  if (submit_info.signalSemaphoreCount >= kMaxSignalSemaphores)
+  {
+    LOG_ERROR("Timeline", "Too many signal semaphores in a submit");
+    return 0;
+  }
+
+  // Binary semaphores ignore their value
+  VkSemaphore signal_semaphores[kMaxSignalSemaphores];
+  uint64_t signal_values[kMaxSignalSemaphores] = {};
+  for (uint32_t i = 0; i < submit_info.signalSemaphoreCount; i++)
+  {
+    signal_semaphores[i] = submit_info.pSignalSemaphores[i];
+  }
+
+  uint32_t signal_count = submit_info.signalSemaphoreCount;
+  signal_semaphores[signal_count] = _semaphore;
+  signal_values[signal_count] = _submitted + 1;
+  signal_count++;
+
+  VkTimelineSemaphoreSubmitInfo timeline_info = {};
+  timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  timeline_info.pNext = submit_info.pNext;
+  timeline_info.signalSemaphoreValueCount = signal_count;
+  timeline_info.pSignalSemaphoreValues = signal_values;
+
+  VkSubmitInfo info = submit_info;
+  info.pNext = &timeline_info;
+  info.signalSemaphoreCount = signal_count;
+  info.pSignalSemaphores = signal_semaphores;
+
+  VkResult result = vkQueueSubmit(queue, 1, &info, VK_NULL_HANDLE);
+  if (result != VK_SUCCESS)
+  {
+    LOG_ERROR("Timeline", "Failed submitting to queue");
+    return 0;
+  }
+
+  _submitted++;
+  if (value != nullptr)
+  {
+    *value = _submitted;
+  }
+
+  return 1;
+}
+
+uint64_t GpuTimeline::completedValue()
+{
+  uint64_t value = 0;
+  if (vkGetSemaphoreCounterValue(_device, _semaphore, &value) == VK_SUCCESS)
+  {
+    advance(value);
+  }
+
+  return _completed;
+}
+
+bool GpuTimeline::isComplete(uint64_t value)
+{
+  if (value <= _completed)
+  {
+    return true;
+  }
+
+  return value <= completedValue();
+}
+
+int GpuTimeline::wait(uint64_t value, uint64_t timeout)
+{
+  if (isComplete(value))
+  {
+    return 1;
+  }
+
+  VkSemaphoreWaitInfo wait_info = {};
+  wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+  wait_info.semaphoreCount = 1;
+  wait_info.pSemaphores = &_semaphore;
+  wait_info.pValues = &value;
+
+  VkResult result = vkWaitSemaphores(_device, &wait_info, timeout);
+  if (result == VK_TIMEOUT)
+  {
+    return 0;
+  }
+  else if (result != VK_SUCCESS)
+  {
+    LOG_ERROR("Timeline", "Failed waiting for timeline value %llu", (unsigned long long) value);
+    return 0;
+  }
+
+  advance(value);
+  return 1;
+}
+
+void GpuTimeline::advance(uint64_t value)
+{
+  // Other threads may poll too, never move the cache backwards
+  uint64_t completed = _completed.load();
+  while (value > completed && !_completed.compare_exchange_weak(completed, value))
+  {
+  }
+}
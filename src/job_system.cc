@@ -0,0 +1,508 @@
+#include "job_system.h"
+
+#include <deque>
+#include <memory>
+#include <thread>
+#include <condition_variable>
+
+#include "logger.h"
+
+struct Job
+{
+  JobFunction function;
+  void* data;
+  JobCounter* counter;
+  // Set by the allocating thread, cleared by whichever thread ran the job
+  std::atomic<bool> active;
+};
+
+// Jobs are recycled from a per thread ring. A slot is only reused once its
+// job has run, a thread with kJobPoolSize jobs in flight helps running
+// jobs until one of its slots is released.
+static const uint32_t kJobPoolSize = 4096;
+static const uint32_t kDequeCapacity = 4096;
+
+struct JobPool
+{
+  Job jobs[kJobPoolSize];
+  uint32_t next = 0;
+
+  JobPool()
+  {
+    for (uint32_t i = 0; i < kJobPoolSize; i++)
+    {
+      jobs[i].active = false;
+    }
+  }
+
+  // nullptr when every slot is still in flight
+  Job* allocate()
+  {
+    for (uint32_t i = 0; i < kJobPoolSize; i++)
+    {
+      Job* job = &jobs[next++ & (kJobPoolSize - 1)];
+      if (!job->active.load(std::memory_order_acquire))
+      {
+        job->active.store(true, std::memory_order_relaxed);
+        return job;
+      }
+    }
+    return nullptr;
+  }
+};
+
+// Chase-Lev deque with a fixed capacity
+class WorkStealingDeque
+{
+public:
+  WorkStealingDeque()
+  {
+    _top = 0;
+    _bottom = 0;
+    for (uint32_t i = 0; i < kDequeCapacity; i++)
+    {
+      _buffer[i] = nullptr;
+    }
+  }
+
+  // Owner only
+  bool push(Job* job)
+  {
+    int64_t bottom = _bottom.load(std::memory_order_relaxed);
+    int64_t top = _top.load(std::memory_order_acquire);
+    if (bottom - top >= (int64_t) kDequeCapacity)
+    {
+      return false;
+    }
+
+    _buffer[bottom & (kDequeCapacity - 1)].store(job, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    _bottom.store(bottom + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // Owner only
+  Job* pop()
+  {
+    int64_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+    _bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = _top.load(std::memory_order_relaxed);
+
+    if (top > bottom)
+    {
+      _bottom.store(bottom + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+
+    Job* job = _buffer[bottom & (kDequeCapacity - 1)].load(std::memory_order_relaxed);
+    if (top == bottom)
+    {
+      // Last element, race against thieves
+      if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+      {
+        job = nullptr;
+      }
+      _bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    return job;
+  }
+
+  // Any thread
+  Job* steal()
+  {
+    int64_t top = _top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = _bottom.load(std::memory_order_acquire);
+
+    if (top >= bottom)
+    {
+      return nullptr;
+    }
+
+    Job* job = _buffer[top & (kDequeCapacity - 1)].load(std::memory_order_relaxed);
+    if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+    {
+      return nullptr;
+    }
+
+    return job;
+  }
+
+private:
+  std::atomic<int64_t> _top;
+  std::atomic<int64_t> _bottom;
+  std::atomic<Job*> _buffer[kDequeCapacity];
+};
+
+struct Worker
+{
+  WorkStealingDeque deque;
+  std::thread thread;
+};
+
+static std::vector<Worker*> workers;
+static std::atomic<bool> running(false);
+
+// Submissions from threads that are not workers
+static std::mutex shared_mutex;
+static std::deque<Job*> shared_queue;
+static std::atomic<int32_t> shared_count(0);
+
+// Idle workers sleep until something is queued
+static std::atomic<int32_t> pending_jobs(0);
+static std::atomic<int32_t> sleeping_workers(0);
+static std::mutex sleep_mutex;
+static std::condition_variable sleep_condition;
+
+static thread_local uint32_t worker_index = UINT32_MAX;
+static thread_local uint32_t random_state = 0x9E3779B9u;
+static thread_local std::unique_ptr<JobPool> job_pool;
+
+static uint32_t nextRandom()
+{
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return random_state;
+}
+
+JobCounter::JobCounter()
+{
+  _value = 0;
+  _busy = 0;
+}
+
+int JobSystem::init(uint32_t worker_count)
+{
+  if (!workers.empty())
+  {
+    LOG_WARNING("JobSystem", "Job system already initialized");
+    return 1;
+  }
+
+  if (worker_count == 0)
+  {
+    worker_count = std::thread::hardware_concurrency();
+  }
+  if (worker_count == 0)
+  {
+    worker_count = 1;
+  }
+
+  workers.resize(worker_count);
+  for (uint32_t i = 0; i < worker_count; i++)
+  {
+    workers[i] = new Worker();
+  }
+
+  running = true;
+  worker_index = 0;
+  for (uint32_t i = 1; i < worker_count; i++)
+  {
+    workers[i]->thread = std::thread(&JobSystem::workerLoop, i);
+  }
+
+  LOG_DEBUG("JobSystem", "Running with %d workers", worker_count);
+  return 1;
+}
+
+void JobSystem::shutdown()
+{
+  if (workers.empty())
+  {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    running = false;
+  }
+  sleep_condition.notify_all();
+
+  for (size_t i = 1; i < workers.size(); i++)
+  {
+    workers[i]->thread.join();
+  }
+
+  for (size_t i = 0; i < workers.size(); i++)
+  {
+    delete workers[i];
+  }
+  workers.clear();
+  worker_index = UINT32_MAX;
+}
+
+uint32_t JobSystem::workerCount()
+{
+  return (uint32_t) workers.size();
+}
+
+uint32_t JobSystem::workerIndex()
+{
+  return worker_index;
+}
+
+void JobSystem::run(JobFunction function, void* data, JobCounter* counter, JobCounter* dependency)
+{
+  if (workers.empty())
+  {
+    // Not initialized, behave as a plain call
+    function(data);
+    return;
+  }
+
+  if (!job_pool)
+  {
+    job_pool.reset(new JobPool());
+  }
+
+  Job* job = job_pool->allocate();
+  while (job == nullptr)
+  {
+    // Every slot is in flight, run jobs until one of them is done
+    Job* pending = findJob(worker_index);
+    if (pending != nullptr)
+    {
+      execute(pending);
+    }
+    else
+    {
+      std::this_thread::yield();
+    }
+    job = job_pool->allocate();
+  }
+
+  job->function = function;
+  job->data = data;
+  job->counter = counter;
+
+  if (counter != nullptr)
+  {
+    counter->_value.fetch_add(1, std::memory_order_acq_rel);
+  }
+
+  if (dependency != nullptr)
+  {
+    std::lock_guard<std::mutex> lock(dependency->_mutex);
+    if (dependency->_value.load(std::memory_order_acquire) > 0)
+    {
+      dependency->_waiters.push_back(job);
+      return;
+    }
+  }
+
+  submit(job);
+}
+
+void JobSystem::submit(Job* job)
+{
+  uint32_t index = worker_index;
+  if (index < workers.size())
+  {
+    if (!workers[index]->deque.push(job))
+    {
+      // Deque full, run it right away rather than failing
+      execute(job);
+      return;
+    }
+  }
+  else
+  {
+    std::lock_guard<std::mutex> lock(shared_mutex);
+    shared_queue.push_back(job);
+    shared_count.fetch_add(1);
+  }
+
+  pending_jobs.fetch_add(1);
+  if (sleeping_workers.load() > 0)
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    sleep_condition.notify_one();
+  }
+}
+
+void JobSystem::execute(Job* job)
+{
+  JobCounter* counter = job->counter;
+  job->function(job->data);
+
+  // The slot may be handed out again right after this
+  job->active.store(false, std::memory_order_release);
+
+  if (counter != nullptr)
+  {
+    finish(counter);
+  }
+}
+
+void JobSystem::finish(JobCounter* counter)
+{
+  // Waiters may destroy the counter as soon as it reads zero, _busy keeps
+  // them around until this is the last access
+  counter->_busy.fetch_add(1, std::memory_order_acq_rel);
+
+  std::vector<Job*> ready;
+  if (counter->_value.fetch_sub(1, std::memory_order_acq_rel) == 1)
+  {
+    std::lock_guard<std::mutex> lock(counter->_mutex);
+    ready.swap(counter->_waiters);
+  }
+
+  counter->_busy.fetch_sub(1, std::memory_order_acq_rel);
+
+  for (size_t i = 0; i < ready.size(); i++)
+  {
+    submit(ready[i]);
+  }
+}
+
+Job* JobSystem::findJob(uint32_t index)
+{
+  Job* job = nullptr;
+  uint32_t count = (uint32_t) workers.size();
+
+  if (index < count)
+  {
+    job = workers[index]->deque.pop();
+  }
+
+  if (job == nullptr && shared_count.load(std::memory_order_relaxed) > 0)
+  {
+    std::lock_guard<std::mutex> lock(shared_mutex);
+    if (!shared_queue.empty())
+    {
+      job = shared_queue.front();
+      shared_queue.pop_front();
+      shared_count.fetch_sub(1);
+    }
+  }
+
+  if (job == nullptr && count > 1)
+  {
+    uint32_t start = nextRandom() % count;
+    for (uint32_t i = 0; i < count && job == nullptr; i++)
+    {
+      uint32_t victim = (start + i) % count;
+      if (victim != index)
+      {
+        job = workers[victim]->deque.steal();
+      }
+    }
+  }
+
+  if (job != nullptr)
+  {
+    pending_jobs.fetch_sub(1);
+  }
+
+  return job;
+}
+
+void JobSystem::workerLoop(uint32_t index)
+{
+  worker_index = index;
+  random_state = 0x9E3779B9u * (index + 1);
+
+  uint32_t idle_spins = 0;
+  while (running.load(std::memory_order_relaxed))
+  {
+    Job* job = findJob(index);
+    if (job != nullptr)
+    {
+      execute(job);
+      idle_spins = 0;
+      continue;
+    }
+
+    // Spin a little before going to sleep, jobs tend to come in bursts
+    if (++idle_spins < 64)
+    {
+      std::this_thread::yield();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleep_mutex);
+    sleeping_workers.fetch_add(1);
+    sleep_condition.wait(lock, []() { return pending_jobs.load() > 0 || !running.load(); });
+    sleeping_workers.fetch_sub(1);
+    idle_spins = 0;
+  }
+}
+
+void JobSystem::wait(JobCounter* counter)
+{
+  // Help running jobs until the counter drains
+  while (counter->value() > 0)
+  {
+    Job* job = findJob(worker_index);
+    if (job != nullptr)
+    {
+      execute(job);
+    }
+    else
+    {
+      std::this_thread::yield();
+    }
+  }
+
+  while (counter->_busy.load(std::memory_order_acquire) > 0)
+  {
+    std::this_thread::yield();
+  }
+}
+
+struct ParallelForBatch
+{
+  ParallelForFunction function;
+  void* data;
+  uint32_t begin;
+  uint32_t end;
+};
+
+static void runParallelForBatch(void* data)
+{
+  ParallelForBatch* batch = (ParallelForBatch*) data;
+  batch->function(batch->begin, batch->end, batch->data);
+}
+
+void JobSystem::parallelFor(uint32_t count, uint32_t batch_size, ParallelForFunction function, void* data)
+{
+  if (count == 0)
+  {
+    return;
+  }
+
+  if (batch_size == 0)
+  {
+    batch_size = 1;
+  }
+
+  uint32_t batch_count = (count + batch_size - 1) / batch_size;
+  if (batch_count == 1 || workers.size() <= 1)
+  {
+    function(0, count, data);
+    return;
+  }
+
+  std::vector<ParallelForBatch> batches(batch_count);
+  JobCounter counter;
+
+  // The last batch runs on the calling thread
+  for (uint32_t i = 0; i < batch_count; i++)
+  {
+    batches[i].function = function;
+    batches[i].data = data;
+    batches[i].begin = i * batch_size;
+    batches[i].end = i + 1 == batch_count ? count : (i + 1) * batch_size;
+
+    if (i + 1 < batch_count)
+    {
+      run(runParallelForBatch, &batches[i], &counter);
+    }
+  }
+
+  runParallelForBatch(&batches[batch_count - 1]);
+  wait(&counter);
+}
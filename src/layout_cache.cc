@@ -0,0 +1,191 @@
+#include "layout_cache.h"
+
+#include <algorithm>
+
+#include "logger.h"
+
+// FNV-1a, over the fields only so padding never changes the hash
+static uint64_t hashWord(uint64_t hash, uint64_t word)
+{
+  for (uint32_t i = 0; i < 8; i++)
+  {
+    hash ^= (word >> (i * 8)) & 0xFF;
+    hash *= 0x100000001B3ull;
+  }
+
+  return hash;
+}
+
+static const uint64_t kHashSeed = 0xCBF29CE484222325ull;
+
+static bool sameBinding(const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b)
+{
+  return a.binding == b.binding && a.descriptorType == b.descriptorType &&
+    a.descriptorCount == b.descriptorCount && a.stageFlags == b.stageFlags;
+}
+
+static bool samePushConstants(const VkPushConstantRange& a, const VkPushConstantRange& b)
+{
+  return a.stageFlags == b.stageFlags && a.offset == b.offset && a.size == b.size;
+}
+
+void LayoutCache::init(VkDevice device)
+{
+  _device = device;
+}
+
+void LayoutCache::release()
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  for (auto it = _pipeline_layouts.begin(); it != _pipeline_layouts.end(); ++it)
+  {
+    vkDestroyPipelineLayout(_device, it->second.layout, nullptr);
+  }
+  for (auto it = _set_layouts.begin(); it != _set_layouts.end(); ++it)
+  {
+    vkDestroyDescriptorSetLayout(_device, it->second.layout, nullptr);
+  }
+
+  _pipeline_layouts.clear();
+  _set_layouts.clear();
+}
+
+VkDescriptorSetLayout LayoutCache::descriptorSetLayout(const VkDescriptorSetLayoutBinding* bindings, uint32_t count)
+{
+  std::vector<VkDescriptorSetLayoutBinding> sorted(bindings, bindings + count);
+  std::sort(sorted.begin(), sorted.end(),
+    [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) { return a.binding < b.binding; });
+
+  uint64_t hash = hashWord(kHashSeed, count);
+  for (uint32_t i = 0; i < count; i++)
+  {
+    if (sorted[i].pImmutableSamplers != nullptr)
+    {
+      LOG_ERROR("Layouts", "Immutable samplers are not supported");
+      return VK_NULL_HANDLE;
+    }
+
+    hash = hashWord(hash, ((uint64_t) sorted[i].binding << 32) | sorted[i].descriptorType);
+    hash = hashWord(hash, ((uint64_t) sorted[i].descriptorCount << 32) | sorted[i].stageFlags);
+  }
+
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  auto range = _set_layouts.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it)
+  {
+    const std::vector<VkDescriptorSetLayoutBinding>& cached = it->second.bindings;
+    if (cached.size() == sorted.size() && std::equal(cached.begin(), cached.end(), sorted.begin(), sameBinding))
+    {
+      return it->second.layout;
+    }
+  }
+
+  VkDescriptorSetLayoutCreateInfo create_info = {};
+  create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  create_info.bindingCount = count;
+  create_info.pBindings = sorted.data();
+
+  SetLayoutEntry entry;
+  VkResult result = vkCreateDescriptorSetLayout(_device, &create_info, nullptr, &entry.layout);
+  if (result != VK_SUCCESS)
+  {
+    LOG_ERROR("Layouts", "Failed creating descriptor set layout");
+    return VK_NULL_HANDLE;
+  }
+
+  entry.bindings.swap(sorted);
+  _set_layouts.insert(std::make_pair(hash, entry));
+
+  LOG_DEBUG("Layouts", "Created descriptor set layout with %d bindings", count);
+  return entry.layout;
+}
+
+VkPipelineLayout LayoutCache::pipelineLayout(const VkDescriptorSetLayout* set_layouts, uint32_t set_count,
+  const VkPushConstantRange* push_constants, uint32_t push_constant_count)
+{
+  uint64_t hash = hashWord(kHashSeed, ((uint64_t) set_count << 32) | push_constant_count);
+  for (uint32_t i = 0; i < set_count; i++)
+  {
+    hash = hashWord(hash, (uint64_t) set_layouts[i]);
+  }
+  for (uint32_t i = 0; i < push_constant_count; i++)
+  {
+    hash = hashWord(hash, ((uint64_t) push_constants[i].stageFlags << 32) | push_constants[i].offset);
+    hash = hashWord(hash, push_constants[i].size);
+  }
+
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  auto range = _pipeline_layouts.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it)
+  {
+    const PipelineLayoutEntry& cached = it->second;
+    if (cached.set_layouts.size() == set_count && cached.push_constants.size() == push_constant_count &&
+        std::equal(cached.set_layouts.begin(), cached.set_layouts.end(), set_layouts) &&
+        std::equal(cached.push_constants.begin(), cached.push_constants.end(), push_constants, samePushConstants))
+    {
+      return cached.layout;
+    }
+  }
+
+  VkPipelineLayoutCreateInfo create_info = {};
+  create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  create_info.setLayoutCount = set_count;
+  create_info.pSetLayouts = set_layouts;
+  create_info.pushConstantRangeCount = push_constant_count;
+  create_info.pPushConstantRanges = push_constants;
+
+  PipelineLayoutEntry entry;
+  VkResult result = vkCreatePipelineLayout(_device, &create_info, nullptr, &entry.layout);
+  if (result != VK_SUCCESS)
+  {
+    LOG_ERROR("Layouts", "Failed creating pipeline layout");
+    return VK_NULL_HANDLE;
+  }
+
+  entry.set_layouts.assign(set_layouts, set_layouts + set_count);
+  entry.push_constants.assign(push_constants, push_constants + push_constant_count);
+  _pipeline_layouts.insert(std::make_pair(hash, entry));
+
+  LOG_DEBUG("Layouts", "Created pipeline layout with %d sets", set_count);
+  return entry.layout;
+}
+
+VkPipelineLayout LayoutCache::pipelineLayout(const ShaderReflection& reflection,
+  std::vector<VkDescriptorSetLayout>* set_layouts)
+{
+  const std::vector<ShaderBinding>& bindings = reflection.bindings();
+  std::vector<VkDescriptorSetLayout> layouts(reflection.setCount());
+
+  size_t first = 0;
+  for (uint32_t set = 0; set < layouts.size(); set++)
+  {
+    std::vector<VkDescriptorSetLayoutBinding> set_bindings;
+    while (first < bindings.size() && bindings[first].set == set)
+    {
+      VkDescriptorSetLayoutBinding binding = {};
+      binding.binding = bindings[first].binding;
+      binding.descriptorType = bindings[first].type;
+      binding.descriptorCount = bindings[first].count;
+      binding.stageFlags = bindings[first].stages;
+      set_bindings.push_back(binding);
+      first++;
+    }
+
+    layouts[set] = descriptorSetLayout(set_bindings.data(), (uint32_t) set_bindings.size());
+    if (layouts[set] == VK_NULL_HANDLE)
+    {
+      return VK_NULL_HANDLE;
+    }
+  }
+
+  if (set_layouts != nullptr)
+  {
+    *set_layouts = layouts;
+  }
+
+  return pipelineLayout(layouts.data(), (uint32_t) layouts.size(),
+    &reflection.pushConstants(), reflection.hasPushConstants() ? 1 : 0);
+}
@@ -0,0 +1,85 @@
+#include "lod.h"
+
+#include <math.h>
+
+#include "scene.h"
+
+// Objects closer than this are treated as this close, the camera can be
+// inside the bounds
+static const float kMinDistance = 1e-3f;
+static const float kBudgetStep = 1.25f;
+static const float kMaxErrorScale = 64.0f;
+// Fraction of the budget under which the threshold relaxes again
+static const float kBudgetRelax = 0.8f;
+
+void LodSelector::select(const Scene& scene, const glm::vec3& eye, float projection_scale,
+  const LodChain* chains, uint32_t chain_count, const uint32_t* objects, uint32_t count, uint32_t* levels)
+{
+  if (scene.layoutVersion() != _layout_version || scene.count() != _levels.size())
+  {
+    _levels.assign(scene.count(), 0);
+    _layout_version = scene.layoutVersion();
+  }
+
+  const glm::mat4* matrices = scene.worldMatrices();
+  const glm::vec3* bounds_min = scene.worldBoundsMin();
+  const glm::vec3* bounds_max = scene.worldBoundsMax();
+  const uint32_t* mesh_ids = scene.meshIds();
+
+  float threshold = _pixel_error * _error_scale;
+  float refine = threshold * (1.0f + _hysteresis);
+  float coarsen = threshold * (1.0f - _hysteresis);
+
+  _stats = LodStats();
+  _stats.objects = count;
+  _stats.error_scale = _error_scale;
+
+  for (uint32_t i = 0; i < count; i++)
+  {
+    uint32_t object = objects[i];
+    uint32_t mesh = mesh_ids[object];
+    if (mesh >= chain_count || chains[mesh].count == 0)
+    {
+      levels[i] = 0;
+      continue;
+    }
+
+    const LodChain& chain = chains[mesh];
+    const glm::mat4& matrix = matrices[object];
+    float scale = sqrtf(glm::max(glm::max(glm::dot(glm::vec3(matrix[0]), glm::vec3(matrix[0])),
+      glm::dot(glm::vec3(matrix[1]), glm::vec3(matrix[1]))), glm::dot(glm::vec3(matrix[2]), glm::vec3(matrix[2]))));
+
+    // Nearest point of the bounding sphere
+    glm::vec3 center = (bounds_min[object] + bounds_max[object]) * 0.5f;
+    float radius = glm::length(bounds_max[object] - center);
+    float distance = glm::max(glm::length(center - eye) - radius, kMinDistance);
+    float pixels_per_unit = scale * projection_scale / distance;
+
+    uint32_t level = _levels[object] < chain.count ? _levels[object] : chain.count - 1;
+    while (level > 0 && chain.lods[level].error * pixels_per_unit > refine)
+    {
+      level--;
+    }
+    while (level + 1 < chain.count && chain.lods[level + 1].error * pixels_per_unit < coarsen)
+    {
+      level++;
+    }
+
+    _levels[object] = (uint8_t) level;
+    levels[i] = level;
+    _stats.triangles += chain.lods[level].index_count / 3;
+    _stats.level_counts[level]++;
+  }
+
+  if (_triangle_budget > 0)
+  {
+    if (_stats.triangles > _triangle_budget)
+    {
+      _error_scale = glm::min(_error_scale * kBudgetStep, kMaxErrorScale);
+    }
+    else if (_stats.triangles < _triangle_budget * kBudgetRelax)
+    {
+      _error_scale = glm::max(_error_scale / kBudgetStep, 1.0f);
+    }
+  }
+}
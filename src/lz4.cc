@@ -0,0 +1,215 @@
+#include "lz4.h"
+
+#include <string.h>
+
+static const uint32_t kMinMatch = 4;
+// The format requires the last 5 bytes to be literals and the last match
+// to start at least 12 bytes before the end
+static const size_t kLastLiterals = 5;
+static const size_t kMatchLimit = 12;
+static const uint32_t kMaxOffset = 65535;
+static const uint32_t kHashBits = 12;
+
+static uint32_t read32(const uint8_t* data)
+{
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+static uint32_t hash(uint32_t value)
+{
+  return (value * 2654435761u) >> (32 - kHashBits);
+}
+
+static uint8_t* writeLength(uint8_t* output, size_t length)
+{
+  while (length >= 255)
+  {
+    *output++ = 255;
+    length -= 255;
+  }
+  *output++ = (uint8_t) length;
+  return output;
+}
+
+size_t Lz4::compress(const uint8_t* source, size_t source_size, uint8_t* destination, size_t capacity)
+{
+  if (capacity < compressBound(source_size))
+  {
+    return 0;
+  }
+
+  uint32_t table[1 << kHashBits];
+  memset(table, 0, sizeof(table));
+
+  const uint8_t* input = source;
+  const uint8_t* input_end = source + source_size;
+  const uint8_t* anchor = source;
+  uint8_t* output = destination;
+
+  if (source_size > kMatchLimit)
+  {
+    const uint8_t* match_limit = input_end - kMatchLimit;
+    // Position 0 is also the empty marker, so offsets start at 1
+    input++;
+
+    while (input < match_limit)
+    {
+      uint32_t sequence = read32(input);
+      uint32_t slot = hash(sequence);
+      const uint8_t* candidate = source + table[slot];
+      table[slot] = (uint32_t) (input - source);
+
+      if (candidate >= input || input - candidate > kMaxOffset || read32(candidate) != sequence)
+      {
+        input++;
+        continue;
+      }
+
+      // Extend backwards over pending literals
+      while (input > anchor && candidate > source && input[-1] == candidate[-1])
+      {
+        input--;
+        candidate--;
+      }
+
+      const uint8_t* match_end = input + kMinMatch;
+      const uint8_t* reference = candidate + kMinMatch;
+      while (match_end < input_end - kLastLiterals && *match_end == *reference)
+      {
+        match_end++;
+        reference++;
+      }
+
+      size_t literal_length = (size_t) (input - anchor);
+      size_t match_length = (size_t) (match_end - input) - kMinMatch;
+
+      uint8_t* token = output++;
+      *token = (uint8_t) ((literal_length >= 15 ? 15 : literal_length) << 4);
+      if (literal_length >= 15)
+      {
+        output = writeLength(output, literal_length - 15);
+      }
+      memcpy(output, anchor, literal_length);
+      output += literal_length;
+
+      uint16_t offset = (uint16_t) (input - candidate);
+      *output++ = (uint8_t) (offset & 0xFF);
+      *output++ = (uint8_t) (offset >> 8);
+
+      *token |= (uint8_t) (match_length >= 15 ? 15 : match_length);
+      if (match_length >= 15)
+      {
+        output = writeLength(output, match_length - 15);
+      }
+
+      input = match_end;
+      anchor = input;
+    }
+  }
+
+  // Trailing literals
+  size_t literal_length = (size_t) (input_end - anchor);
+  *output++ = (uint8_t) ((literal_length >= 15 ? 15 : literal_length) << 4);
+  if (literal_length >= 15)
+  {
+    output = writeLength(output, literal_length - 15);
+  }
+  memcpy(output, anchor, literal_length);
+  output += literal_length;
+
+  return (size_t) (output - destination);
+}
+
+int Lz4::decompress(const uint8_t* source, size_t source_size, uint8_t* destination, size_t destination_size)
+{
+  const uint8_t* input = source;
+  const uint8_t* input_end = source + source_size;
+  uint8_t* output = destination;
+  uint8_t* output_end = destination + destination_size;
+
+  while (input < input_end)
+  {
+    uint8_t token = *input++;
+
+    size_t literal_length = token >> 4;
+    if (literal_length == 15)
+    {
+      uint8_t value;
+      do
+      {
+        if (input >= input_end)
+        {
+          return 0;
+        }
+        value = *input++;
+        literal_length += value;
+      } while (value == 255);
+    }
+
+    if (literal_length > (size_t) (input_end - input) || literal_length > (size_t) (output_end - output))
+    {
+      return 0;
+    }
+    memcpy(output, input, literal_length);
+    input += literal_length;
+    output += literal_length;
+
+    // The last sequence has no match
+    if (input == input_end)
+    {
+      break;
+    }
+
+    if (input_end - input < 2)
+    {
+      return 0;
+    }
+    size_t offset = input[0] | (input[1] << 8);
+    input += 2;
+
+    if (offset == 0 || offset > (size_t) (output - destination))
+    {
+      return 0;
+    }
+
+    size_t match_length = token & 15;
+    if (match_length == 15)
+    {
+      uint8_t value;
+      do
+      {
+        if (input >= input_end)
+        {
+          return 0;
+        }
+        value = *input++;
+        match_length += value;
+      } while (value == 255);
+    }
+    match_length += kMinMatch;
+
+    if (match_length > (size_t) (output_end - output))
+    {
+      return 0;
+    }
+
+    // Overlapping copies repeat the pattern, so go byte by byte when close
+    const uint8_t* match = output - offset;
+    if (offset >= match_length)
+    {
+      memcpy(output, match, match_length);
+      output += match_length;
+    }
+    else
+    {
+      for (size_t i = 0; i < match_length; i++)
+      {
+        *output++ = *match++;
+      }
+    }
+  }
+
+  return output == output_end ? 1 : 0;
+}
@@ -1,4 +1,12 @@
 #include "render.h"
+#include "render_thread.h"
+#include "clock.h"
+#include "job_system.h"
+#include "assets.h"
+#include "async_io.h"
+#include "logger.h"
+
+#include <string.h>
 
 bool running = true;
 
@@ -9,8 +17,12 @@ LRESULT CALLBACK WindowProc(HWND window, UINT message, WPARAM wParam, LPARAM lPa
   {
   // WINDOW RESIZED
   case WM_SIZE: {
-    Render* render = (Render*) GetWindowLongPtr(window, GWLP_USERDATA);
-    //render->_resize = true;
+    RenderThread* render_thread = (RenderThread*) GetWindowLongPtr(window, GWLP_USERDATA);
+    if (render_thread != nullptr)
+    {
+      RenderEvent event = { kRenderEventType_Resize, LOWORD(lParam), HIWORD(lParam) };
+      render_thread->postEvent(event);
+    }
     break;
   }
   // WINDOW CLOSED
@@ -26,6 +38,135 @@ LRESULT CALLBACK WindowProc(HWND window, UINT message, WPARAM wParam, LPARAM lPa
   return result;
 }
 
+// Owns the renderer, so it is destroyed before the systems its pipeline
+// builder thread uses are shut down
+static int run(HWND window, HINSTANCE instance, int argc, char** argv)
+{
+  // --fixed-step <fps or fraction> | --replay <file> | --record <file>
+  // --capture-ppm <prefix> | --capture-png <prefix>
+  // --capture-raw <file, pipe or -> | --capture-y4m <file, pipe or ->
+  Clock clock;
+  Render render;
+  for (int i = 1; i + 1 < argc; i += 2)
+  {
+    if (strcmp(argv[i], "--fixed-step") == 0)
+    {
+      uint32_t rate_numerator;
+      uint32_t rate_denominator;
+      if (!Clock::parseRate(argv[i + 1], &rate_numerator, &rate_denominator))
+      {
+        LOG_ERROR("Clock", "Invalid --fixed-step rate %s, expected e.g. 60, 29.97 or 30000/1001", argv[i + 1]);
+        return 0;
+      }
+
+      clock.initFixedStep((double) rate_denominator / rate_numerator);
+      render.capture().setFrameRate(rate_numerator, rate_denominator);
+    }
+    else if (strcmp(argv[i], "--replay") == 0)
+    {
+      if (!clock.initReplay(argv[i + 1]))
+      {
+        return 0;
+      }
+    }
+    else if (strcmp(argv[i], "--record") == 0)
+    {
+      clock.startRecording(argv[i + 1]);
+    }
+    else if (strcmp(argv[i], "--capture-ppm") == 0)
+    {
+      render.capture().configure(kCaptureFormat_PPM, argv[i + 1]);
+    }
+    else if (strcmp(argv[i], "--capture-png") == 0)
+    {
+      render.capture().configure(kCaptureFormat_PNG, argv[i + 1]);
+    }
+    else if (strcmp(argv[i], "--capture-raw") == 0)
+    {
+      render.capture().configure(kCaptureFormat_Raw, argv[i + 1]);
+    }
+    else if (strcmp(argv[i], "--capture-y4m") == 0)
+    {
+      render.capture().configure(kCaptureFormat_Y4M, argv[i + 1]);
+    }
+  }
+
+  if (!render.init(window, instance)) {
+    return 0;
+  };
+
+  RenderThread render_thread;
+  SetWindowLongPtr(window, GWLP_USERDATA, (LONG_PTR) &render_thread);
+
+  ShowWindow(window, 1);
+
+  if (!render_thread.start(&render))
+  {
+    return 0;
+  }
+
+  HANDLE consumed_event = render_thread.consumedEvent();
+  while (running)
+  {
+    MSG message;
+    while (PeekMessage(&message, window, 0, 0, PM_REMOVE))
+    {
+      TranslateMessage(&message);
+      DispatchMessage(&message);
+    }
+
+    // Only simulate once the render thread took the previous state
+    if (render_thread.canPublish())
+    {
+      clock.tick();
+
+      FrameState& state = render_thread.state();
+      state.time = clock.time();
+      state.frame = clock.frame();
+      render_thread.publish();
+    }
+
+    MsgWaitForMultipleObjects(1, &consumed_event, FALSE, INFINITE, QS_ALLINPUT);
+  }
+
+  render_thread.stop();
+  SetWindowLongPtr(window, GWLP_USERDATA, 0);
+
+  vkDeviceWaitIdle(render._device);
+
+  render.telemetry().report();
+
+  const BvhStats& cull_stats = render.cullStats();
+  LOG_DEBUG("Render", "Last frame culling: %u nodes, %u leaves, %u visible, %u culled",
+    cull_stats.nodes_visited, cull_stats.leaves_visited, cull_stats.objects_visible, cull_stats.objects_culled);
+  const DrawStateStats& unsorted = render.unsortedDrawStats();
+  const DrawStateStats& sorted = render.sortedDrawStats();
+  LOG_DEBUG("Render", "Last frame draws: %u draws, %u -> %u pipeline, %u -> %u descriptor, %u -> %u vertex, "
+    "%u -> %u index binds", sorted.draws, unsorted.pipeline_binds, sorted.pipeline_binds, unsorted.descriptor_binds,
+    sorted.descriptor_binds, unsorted.vertex_binds, sorted.vertex_binds, unsorted.index_binds, sorted.index_binds);
+
+  const LodStats& lod_stats = render.lodStats();
+  LOG_DEBUG("Render", "Last frame levels of detail: %u objects, %u triangles, error scale %.2f",
+    lod_stats.objects, lod_stats.triangles, lod_stats.error_scale);
+
+  const OcclusionStats& occlusion_stats = render.occlusionStats();
+  if (occlusion_stats.triangles > 0)
+  {
+    LOG_DEBUG("Render", "Last frame occlusion: %u triangles, %u tested, %u occluded",
+      occlusion_stats.triangles, occlusion_stats.objects_tested, occlusion_stats.objects_occluded);
+  }
+
+  const ClusterStats& cluster_stats = render.clusterStats();
+  if (cluster_stats.objects > 0)
+  {
+    LOG_DEBUG("Render", "Last frame clusters: %u objects, %u of %u clusters visible, %llu triangles instead of %llu",
+      cluster_stats.objects, cluster_stats.clusters_visible, cluster_stats.clusters,
+      (unsigned long long) cluster_stats.triangles, (unsigned long long) cluster_stats.whole_triangles);
+  }
+
+  return 1;
+}
+
 int main(int argc, char** argv)
 {
   // For fully win32 inmersive experience see: WinMain.
@@ -58,28 +199,17 @@ int main(int argc, char** argv)
     NULL
   );
 
-  Render render;
-  if (!render.init(window, instance)) {
-    return 0;
-  };
+  JobSystem::init();
+  AsyncIo::init();
 
-  SetWindowLongPtr(window, GWLP_USERDATA, (LONG_PTR) &render);
+  // Optional, loose files are used when there is no pack
+  Assets::mount("../../assets.pak");
 
-  ShowWindow(window, 1);
+  int result = run(window, instance, argc, argv);
 
-  while (running)
-  {
-    MSG message;
-    while (PeekMessage(&message, window, 0, 0, PM_REMOVE))
-    {
-      TranslateMessage(&message);
-      DispatchMessage(&message);
-    }
-
-    render.drawFrame();
-  }
+  Assets::unmount();
+  AsyncIo::shutdown();
+  JobSystem::shutdown();
 
-  vkDeviceWaitIdle(render._device);
-
-  return 1;
-}
\ No newline at end of file
+  return result;
+}
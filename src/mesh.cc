@@ -0,0 +1,159 @@
+#include "mesh.h"
+
+#include "logger.h"
+
+int MeshFile::open(const std::string& name)
+{
+  if (!Assets::load(name, &_asset))
+  {
+    return 0;
+  }
+
+  if (!validate(name))
+  {
+    close();
+    return 0;
+  }
+
+  return 1;
+}
+
+const void* MeshFile::section(MeshSection section) const
+{
+  return _asset.data() + header().sections[section].offset;
+}
+
+uint64_t MeshFile::sectionSize(MeshSection section) const
+{
+  return header().sections[section].size;
+}
+
+int MeshFile::validate(const std::string& file_name)
+{
+  const MeshHeader* header = (const MeshHeader*) _asset.data();
+  uint64_t size = _asset.size();
+
+  if (size < sizeof(MeshHeader) || header->magic != kMeshMagic)
+  {
+    LOG_ERROR("Mesh", "Not a mesh file: %s", file_name.c_str());
+    return 0;
+  }
+
+  if (header->version != kMeshVersion)
+  {
+    LOG_ERROR("Mesh", "%s has version %d, expected %d, run meshconv again",
+      file_name.c_str(), header->version, kMeshVersion);
+    return 0;
+  }
+
+  if (header->index_size != 2 && header->index_size != 4)
+  {
+    LOG_ERROR("Mesh", "Invalid index size in %s", file_name.c_str());
+    return 0;
+  }
+
+  if (header->index_size == 2 && header->vertex_count > 0xFFFF)
+  {
+    LOG_ERROR("Mesh", "%s has %u vertices, too many for 16 bit indices", file_name.c_str(), header->vertex_count);
+    return 0;
+  }
+
+  if (header->lod_count == 0 || header->lod_count > kMeshMaxLods)
+  {
+    LOG_ERROR("Mesh", "Invalid level of detail count in %s", file_name.c_str());
+    return 0;
+  }
+
+  for (uint32_t stream = 0; stream < kVertexStream_Count; stream++)
+  {
+    if (header->encodings[stream] >= kVertexEncoding_Count ||
+        !_layout.setEncoding((VertexStream) stream, (VertexEncoding) header->encodings[stream]))
+    {
+      LOG_ERROR("Mesh", "Invalid encoding for vertex stream %d in %s", stream, file_name.c_str());
+      return 0;
+    }
+  }
+
+  uint64_t expected_sizes[kMeshSection_Count] = {};
+  for (uint32_t stream = 0; stream < kVertexStream_Count; stream++)
+  {
+    expected_sizes[stream] = (uint64_t) header->vertex_count * _layout.stride((VertexStream) stream);
+  }
+  expected_sizes[kMeshSection_Indices] = (uint64_t) header->index_count * header->index_size;
+  expected_sizes[kMeshSection_Lods] = (uint64_t) header->lod_count * sizeof(MeshLod);
+  expected_sizes[kMeshSection_Clusters] = (uint64_t) header->cluster_count * sizeof(MeshCluster);
+  expected_sizes[kMeshSection_ClusterVertices] = (uint64_t) header->cluster_vertex_count * sizeof(uint32_t);
+  expected_sizes[kMeshSection_ClusterTriangles] = (uint64_t) header->cluster_triangle_count * 3;
+
+  for (uint32_t i = 0; i < kMeshSection_Count; i++)
+  {
+    const MeshSectionEntry& entry = header->sections[i];
+    if (entry.size != expected_sizes[i] || entry.offset % kMeshSectionAlignment != 0 ||
+        entry.offset > size || entry.size > size - entry.offset)
+    {
+      LOG_ERROR("Mesh", "Corrupt section %d in %s", i, file_name.c_str());
+      return 0;
+    }
+  }
+
+  const MeshLod* lods = (const MeshLod*) (_asset.data() + header->sections[kMeshSection_Lods].offset);
+  for (uint32_t i = 0; i < header->lod_count; i++)
+  {
+    if (lods[i].index_count == 0 || lods[i].index_count % 3 != 0 ||
+        lods[i].index_offset > header->index_count || lods[i].index_count > header->index_count - lods[i].index_offset)
+    {
+      LOG_ERROR("Mesh", "Corrupt level of detail %d in %s", i, file_name.c_str());
+      return 0;
+    }
+  }
+
+  // Indices are copied into the shared arena, where an out of range one
+  // would read the vertices of another mesh
+  const uint8_t* indices = _asset.data() + header->sections[kMeshSection_Indices].offset;
+  for (uint32_t i = 0; i < header->index_count; i++)
+  {
+    uint32_t index = header->index_size == 2 ? ((const uint16_t*) indices)[i] : ((const uint32_t*) indices)[i];
+    if (index >= header->vertex_count)
+    {
+      LOG_ERROR("Mesh", "Index %u out of range in %s", i, file_name.c_str());
+      return 0;
+    }
+  }
+
+  // Clusters are read on the GPU, so every index is checked here
+  const MeshCluster* clusters = (const MeshCluster*) (_asset.data() + header->sections[kMeshSection_Clusters].offset);
+  const uint8_t* cluster_triangles = _asset.data() + header->sections[kMeshSection_ClusterTriangles].offset;
+  for (uint32_t i = 0; i < header->cluster_count; i++)
+  {
+    const MeshCluster& cluster = clusters[i];
+    bool valid = cluster.vertex_count <= kMeshClusterMaxVertices && cluster.triangle_count <= kMeshClusterMaxTriangles &&
+      cluster.vertex_offset <= header->cluster_vertex_count &&
+      cluster.vertex_count <= header->cluster_vertex_count - cluster.vertex_offset &&
+      cluster.triangle_offset <= header->cluster_triangle_count &&
+      cluster.triangle_count <= header->cluster_triangle_count - cluster.triangle_offset;
+
+    for (uint32_t k = 0; valid && k < cluster.triangle_count * 3; k++)
+    {
+      valid = cluster_triangles[cluster.triangle_offset * 3 + k] < cluster.vertex_count;
+    }
+
+    if (!valid)
+    {
+      LOG_ERROR("Mesh", "Corrupt cluster %d in %s", i, file_name.c_str());
+      return 0;
+    }
+  }
+
+  const uint32_t* cluster_vertices =
+    (const uint32_t*) (_asset.data() + header->sections[kMeshSection_ClusterVertices].offset);
+  for (uint32_t i = 0; i < header->cluster_vertex_count; i++)
+  {
+    if (cluster_vertices[i] >= header->vertex_count)
+    {
+      LOG_ERROR("Mesh", "Cluster vertex %d out of range in %s", i, file_name.c_str());
+      return 0;
+    }
+  }
+
+  return 1;
+}
@@ -0,0 +1,470 @@
+#include "occlusion.h"
+
+#include <float.h>
+#include <math.h>
+
+#include <algorithm>
+
+#include "simd.h"
+
+const float OcclusionBuffer::kNearW = 1e-3f;
+
+static inline uint32_t rowMask(uint32_t first, uint32_t last)
+{
+  uint32_t from_first = first >= 32 ? 0 : ~0u >> first;
+  uint32_t from_last = last >= 32 ? 0 : ~0u >> last;
+  return from_first & ~from_last;
+}
+
+int OcclusionBuffer::init(uint32_t width, uint32_t height)
+{
+  if (width == 0 || height == 0)
+  {
+    return 0;
+  }
+
+  _tiles_x = (width + kTileWidth - 1) / kTileWidth;
+  _tiles_y = (height + kTileHeight - 1) / kTileHeight;
+  _width = _tiles_x * kTileWidth;
+  _height = _tiles_y * kTileHeight;
+  _tiles.resize(_tiles_x * _tiles_y);
+
+  clear(_view_projection);
+  return 1;
+}
+
+void OcclusionBuffer::clear(const glm::mat4& view_projection)
+{
+  _view_projection = view_projection;
+  _stats = OcclusionStats();
+
+  for (Tile& tile : _tiles)
+  {
+    std::fill(tile.mask, tile.mask + kTileHeight, 0);
+    tile.z0 = 0.0f;
+    tile.z1 = 0.0f;
+  }
+}
+
+void OcclusionBuffer::renderOccluder(const glm::mat4& model, const glm::vec3* positions, uint32_t vertex_count,
+  const uint32_t* indices, uint32_t index_count)
+{
+  glm::mat4 matrix = _view_projection * model;
+
+  _clip.resize(vertex_count);
+  for (uint32_t i = 0; i < vertex_count; i++)
+  {
+    _clip[i] = matrix * glm::vec4(positions[i], 1.0f);
+  }
+
+  for (uint32_t i = 0; i + 2 < index_count; i += 3)
+  {
+    glm::vec4 triangle[3] = { _clip[indices[i]], _clip[indices[i + 1]], _clip[indices[i + 2]] };
+    rasterize(triangle);
+  }
+}
+
+void OcclusionBuffer::rasterize(const glm::vec4* clip)
+{
+  // Clipped against the near w, a triangle becomes at most a quad
+  glm::vec4 polygon[4];
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < 3; i++)
+  {
+    const glm::vec4& a = clip[i];
+    const glm::vec4& b = clip[(i + 1) % 3];
+    float distance_a = a.w - kNearW;
+    float distance_b = b.w - kNearW;
+
+    if (distance_a >= 0.0f)
+    {
+      polygon[count++] = a;
+    }
+    if ((distance_a >= 0.0f) != (distance_b >= 0.0f))
+    {
+      polygon[count++] = a + (b - a) * (distance_a / (distance_a - distance_b));
+    }
+  }
+
+  bool avx2 = Simd::level() == kSimdLevel_AVX2;
+  for (uint32_t i = 1; i + 1 < count; i++)
+  {
+    glm::vec4 fan[3] = { polygon[0], polygon[i], polygon[i + 1] };
+
+    Triangle triangle;
+    if (!setupTriangle(fan, &triangle))
+    {
+      continue;
+    }
+
+    _stats.triangles++;
+    if (avx2)
+    {
+      rasterizeAVX2(triangle);
+    }
+    else
+    {
+      rasterizeScalar(triangle);
+    }
+  }
+}
+
+int OcclusionBuffer::setupTriangle(const glm::vec4* clip, Triangle* triangle) const
+{
+  glm::vec2 screen[3];
+  float depth[3];
+  for (uint32_t i = 0; i < 3; i++)
+  {
+    float inverse_w = 1.0f / clip[i].w;
+    screen[i].x = (clip[i].x * inverse_w * 0.5f + 0.5f) * _width;
+    screen[i].y = (clip[i].y * inverse_w * 0.5f + 0.5f) * _height;
+    depth[i] = inverse_w;
+  }
+
+  glm::vec2 bounds_min = glm::min(screen[0], glm::min(screen[1], screen[2]));
+  glm::vec2 bounds_max = glm::max(screen[0], glm::max(screen[1], screen[2]));
+  if (bounds_max.x < 0.0f || bounds_max.y < 0.0f || bounds_min.x > _width || bounds_min.y > _height)
+  {
+    return 0;
+  }
+
+  glm::vec2 edge_1 = screen[1] - screen[0];
+  glm::vec2 edge_2 = screen[2] - screen[0];
+  float area = edge_1.x * edge_2.y - edge_2.x * edge_1.y;
+  if (fabsf(area) < 1e-6f)
+  {
+    return 0;
+  }
+
+  // Edge functions are positive inside, horizontal edges need no test as
+  // the rows are already limited to the vertical extent
+  uint32_t left_count = 0, right_count = 0;
+  for (uint32_t i = 0; i < 3; i++)
+  {
+    const glm::vec2& from = screen[i];
+    const glm::vec2& to = screen[(i + 1) % 3];
+
+    float a = from.y - to.y;
+    float b = to.x - from.x;
+    float c = from.x * to.y - to.x * from.y;
+    if (area < 0.0f)
+    {
+      a = -a;
+      b = -b;
+      c = -c;
+    }
+
+    if (a == 0.0f)
+    {
+      continue;
+    }
+
+    // Row y is inside where x >= slope * y + offset for a > 0, and <= otherwise
+    float slope = -b / a;
+    float offset = -c / a;
+    if (a > 0.0f && left_count < 2)
+    {
+      triangle->left_slope[left_count] = slope;
+      triangle->left_offset[left_count++] = offset;
+    }
+    else if (a < 0.0f && right_count < 2)
+    {
+      triangle->right_slope[right_count] = slope;
+      triangle->right_offset[right_count++] = offset;
+    }
+  }
+
+  for (; left_count < 2; left_count++)
+  {
+    triangle->left_slope[left_count] = 0.0f;
+    triangle->left_offset[left_count] = -FLT_MAX;
+  }
+  for (; right_count < 2; right_count++)
+  {
+    triangle->right_slope[right_count] = 0.0f;
+    triangle->right_offset[right_count] = FLT_MAX;
+  }
+
+  triangle->y_min = bounds_min.y;
+  triangle->y_max = bounds_max.y;
+
+  // 1 / w is linear in screen space, so depth is a plane
+  float depth_1 = depth[1] - depth[0];
+  float depth_2 = depth[2] - depth[0];
+  triangle->depth_a = (depth_1 * edge_2.y - depth_2 * edge_1.y) / area;
+  triangle->depth_b = (depth_2 * edge_1.x - depth_1 * edge_2.x) / area;
+  triangle->depth_c = depth[0] - triangle->depth_a * screen[0].x - triangle->depth_b * screen[0].y;
+  triangle->depth_min = std::min(depth[0], std::min(depth[1], depth[2]));
+
+  // Clamped as floats first, the bounds can be far off screen
+  triangle->tile_x0 = (uint32_t) (std::max(bounds_min.x, 0.0f) / kTileWidth);
+  triangle->tile_y0 = (uint32_t) (std::max(bounds_min.y, 0.0f) / kTileHeight);
+  triangle->tile_x1 = std::min((uint32_t) (std::min(bounds_max.x, (float) _width) / kTileWidth) + 1, _tiles_x);
+  triangle->tile_y1 = std::min((uint32_t) (std::min(bounds_max.y, (float) _height) / kTileHeight) + 1, _tiles_y);
+
+  return 1;
+}
+
+float OcclusionBuffer::tileDepth(const Triangle& triangle, uint32_t tile_x, uint32_t tile_y) const
+{
+  // The plane is smallest at one of the tile corners
+  float x = (float) (tile_x * kTileWidth + (triangle.depth_a > 0.0f ? 0 : kTileWidth));
+  float y = (float) (tile_y * kTileHeight + (triangle.depth_b > 0.0f ? 0 : kTileHeight));
+  float depth = triangle.depth_a * x + triangle.depth_b * y + triangle.depth_c;
+
+  // Past the triangle the plane keeps going, not its depth
+  return std::max(depth, triangle.depth_min);
+}
+
+void OcclusionBuffer::rasterizeScalar(const Triangle& triangle)
+{
+  for (uint32_t tile_y = triangle.tile_y0; tile_y < triangle.tile_y1; tile_y++)
+  {
+    // Span of every row in pixels, the same for the whole row of tiles
+    float left[kTileHeight], right[kTileHeight];
+    bool valid[kTileHeight];
+    for (uint32_t row = 0; row < kTileHeight; row++)
+    {
+      float y = (float) (tile_y * kTileHeight) + (row + 0.5f);
+      left[row] = std::max(triangle.left_slope[0] * y + triangle.left_offset[0],
+        triangle.left_slope[1] * y + triangle.left_offset[1]) - 0.5f;
+      right[row] = std::min(triangle.right_slope[0] * y + triangle.right_offset[0],
+        triangle.right_slope[1] * y + triangle.right_offset[1]) - 0.5f;
+      valid[row] = y >= triangle.y_min && y <= triangle.y_max;
+    }
+
+    for (uint32_t tile_x = triangle.tile_x0; tile_x < triangle.tile_x1; tile_x++)
+    {
+      Tile* tile = &_tiles[tile_y * _tiles_x + tile_x];
+      float depth = tileDepth(triangle, tile_x, tile_y);
+      if (depth <= tile->z0)
+      {
+        continue;
+      }
+
+      float base = (float) (tile_x * kTileWidth);
+      uint32_t coverage[kTileHeight];
+      for (uint32_t row = 0; row < kTileHeight; row++)
+      {
+        float first = std::min(std::max(ceilf(left[row] - base), 0.0f), 32.0f);
+        float last = std::min(std::max(floorf(right[row] - base) + 1.0f, 0.0f), 32.0f);
+        coverage[row] = valid[row] ? rowMask((uint32_t) first, (uint32_t) last) : 0;
+      }
+
+      mergeTile(tile, coverage, depth);
+    }
+  }
+}
+
+void OcclusionBuffer::mergeTile(Tile* tile, const uint32_t* coverage, float depth)
+{
+  uint32_t any = 0;
+  for (uint32_t row = 0; row < kTileHeight; row++)
+  {
+    any |= coverage[row];
+  }
+  if (!any || depth <= tile->z0)
+  {
+    return;
+  }
+
+  uint32_t covered = 0;
+  for (uint32_t row = 0; row < kTileHeight; row++)
+  {
+    covered |= tile->mask[row];
+  }
+
+  // Merging pulls the working layer back to the farthest of both. When
+  // the triangle is closer to the tile depth than to the working layer,
+  // starting over from the triangle keeps more of the occlusion.
+  if (!covered || tile->z1 - depth > depth - tile->z0)
+  {
+    std::copy(coverage, coverage + kTileHeight, tile->mask);
+    tile->z1 = depth;
+  }
+  else
+  {
+    for (uint32_t row = 0; row < kTileHeight; row++)
+    {
+      tile->mask[row] |= coverage[row];
+    }
+    tile->z1 = std::min(tile->z1, depth);
+  }
+
+  uint32_t full = ~0u;
+  for (uint32_t row = 0; row < kTileHeight; row++)
+  {
+    full &= tile->mask[row];
+  }
+
+  if (full == ~0u)
+  {
+    tile->z0 = tile->z1;
+    std::fill(tile->mask, tile->mask + kTileHeight, 0);
+  }
+}
+
+bool OcclusionBuffer::testBox(const glm::vec3& bounds_min, const glm::vec3& bounds_max)
+{
+  BoxRect rect;
+  projectBoxes(&bounds_min, &bounds_max, 1, &rect);
+  return testRect(rect);
+}
+
+void OcclusionBuffer::projectBoxes(const glm::vec3* bounds_min, const glm::vec3* bounds_max, uint32_t count,
+  BoxRect* rects) const
+{
+  if (Simd::level() == kSimdLevel_AVX2)
+  {
+    projectBoxesAVX2(bounds_min, bounds_max, count, rects);
+  }
+  else
+  {
+    projectBoxesScalar(bounds_min, bounds_max, count, rects);
+  }
+}
+
+void OcclusionBuffer::projectBoxesScalar(const glm::vec3* bounds_min, const glm::vec3* bounds_max, uint32_t count,
+  BoxRect* rects) const
+{
+  const glm::mat4& matrix = _view_projection;
+  for (uint32_t box = 0; box < count; box++)
+  {
+    BoxRect* rect = &rects[box];
+
+    // One corner and the three edges, the other corners are sums of
+    // them. Spelled out so the AVX2 path can add in the same order.
+    glm::vec3 extent = bounds_max[box] - bounds_min[box];
+    glm::vec4 origin = matrix[3] + matrix[0] * bounds_min[box].x + matrix[1] * bounds_min[box].y +
+      matrix[2] * bounds_min[box].z;
+    glm::vec4 edge_x = matrix[0] * extent.x;
+    glm::vec4 edge_y = matrix[1] * extent.y;
+    glm::vec4 edge_z = matrix[2] * extent.z;
+
+    glm::vec4 corners[8];
+    corners[0] = origin;
+    corners[1] = origin + edge_x;
+    corners[2] = corners[0] + edge_y;
+    corners[3] = corners[1] + edge_y;
+    for (uint32_t i = 0; i < 4; i++)
+    {
+      corners[i + 4] = corners[i] + edge_z;
+    }
+
+    glm::vec2 screen_min(FLT_MAX), screen_max(-FLT_MAX);
+    float depth = 0.0f;
+    rect->clipped = false;
+    for (uint32_t i = 0; i < 8; i++)
+    {
+      const glm::vec4& clip = corners[i];
+      if (clip.w < kNearW)
+      {
+        rect->clipped = true;
+        break;
+      }
+
+      float inverse_w = 1.0f / clip.w;
+      glm::vec2 screen((clip.x * inverse_w * 0.5f + 0.5f) * _width, (clip.y * inverse_w * 0.5f + 0.5f) * _height);
+      screen_min = glm::min(screen_min, screen);
+      screen_max = glm::max(screen_max, screen);
+      depth = std::max(depth, inverse_w);
+    }
+
+    // Every pixel the rectangle touches, not only the covered centers
+    rect->x0 = (uint32_t) std::min(std::max(floorf(screen_min.x), 0.0f), (float) _width);
+    rect->y0 = (uint32_t) std::min(std::max(floorf(screen_min.y), 0.0f), (float) _height);
+    rect->x1 = (uint32_t) std::min(std::max(ceilf(screen_max.x), 0.0f), (float) _width);
+    rect->y1 = (uint32_t) std::min(std::max(ceilf(screen_max.y), 0.0f), (float) _height);
+    rect->depth = depth;
+  }
+}
+
+bool OcclusionBuffer::testRect(const BoxRect& rect)
+{
+  _stats.objects_tested++;
+
+  bool visible = rect.clipped || (rect.x0 < rect.x1 && rect.y0 < rect.y1 &&
+    (Simd::level() == kSimdLevel_AVX2 ? testTilesAVX2(rect.x0, rect.x1, rect.y0, rect.y1, rect.depth) :
+      testTilesScalar(rect.x0, rect.x1, rect.y0, rect.y1, rect.depth)));
+  if (!visible)
+  {
+    _stats.objects_occluded++;
+  }
+  return visible;
+}
+
+bool OcclusionBuffer::testTilesScalar(uint32_t x0, uint32_t x1, uint32_t y0, uint32_t y1, float depth) const
+{
+  for (uint32_t tile_y = y0 / kTileHeight; tile_y <= (y1 - 1) / kTileHeight; tile_y++)
+  {
+    for (uint32_t tile_x = x0 / kTileWidth; tile_x <= (x1 - 1) / kTileWidth; tile_x++)
+    {
+      const Tile& tile = _tiles[tile_y * _tiles_x + tile_x];
+      if (depth < tile.z0)
+      {
+        continue;
+      }
+
+      uint32_t covered = 0;
+      for (uint32_t row = 0; row < kTileHeight; row++)
+      {
+        covered |= tile.mask[row];
+      }
+      if (!covered || depth >= tile.z1)
+      {
+        return true;
+      }
+
+      // Between both depths, only the pixels outside the working layer show
+      uint32_t base = tile_x * kTileWidth;
+      uint32_t columns = rowMask(x0 > base ? x0 - base : 0, std::min(x1 - base, kTileWidth));
+      for (uint32_t row = 0; row < kTileHeight; row++)
+      {
+        uint32_t y = tile_y * kTileHeight + row;
+        if (y >= y0 && y < y1 && (columns & ~tile.mask[row]))
+        {
+          return true;
+        }
+      }
+    }
+  }
+
+  return false;
+}
+
+void OcclusionBuffer::tileDepths(float* depths) const
+{
+  for (size_t i = 0; i < _tiles.size(); i++)
+  {
+    depths[i] = _tiles[i].z0;
+  }
+}
+
+void OcclusionBuffer::filter(const glm::vec3* bounds_min, const glm::vec3* bounds_max, std::vector<uint32_t>* objects)
+{
+  size_t kept = 0;
+  for (size_t first = 0; first < objects->size(); first += kBoxBatch)
+  {
+    uint32_t count = (uint32_t) std::min(objects->size() - first, (size_t) kBoxBatch);
+
+    glm::vec3 batch_min[kBoxBatch], batch_max[kBoxBatch];
+    for (uint32_t i = 0; i < count; i++)
+    {
+      uint32_t object = (*objects)[first + i];
+      batch_min[i] = bounds_min[object];
+      batch_max[i] = bounds_max[object];
+    }
+
+    BoxRect rects[kBoxBatch];
+    projectBoxes(batch_min, batch_max, count, rects);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+      if (testRect(rects[i]))
+      {
+        (*objects)[kept++] = (*objects)[first + i];
+      }
+    }
+  }
+  objects->resize(kept);
+}
@@ -0,0 +1,240 @@
+// AVX2 rasterizer and tests, one tile row per lane. Only called when Simd
+// picked the AVX2 kernels, see simd_avx2.cc for the target options.
+#include "occlusion.h"
+
+#include <float.h>
+
+#include <algorithm>
+
+#include "simd.h"
+
+#ifdef SIMD_X86
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2,fma"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#endif
+
+#include <immintrin.h>
+
+// Same operations in the same order as the scalar path, so both produce
+// the same masks
+void OcclusionBuffer::rasterizeAVX2(const Triangle& triangle)
+{
+  __m256 row_centers = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+  __m256 half = _mm256_set1_ps(0.5f);
+  __m256 zero = _mm256_setzero_ps();
+  __m256 width = _mm256_set1_ps(32.0f);
+  __m256 one = _mm256_set1_ps(1.0f);
+  __m256i ones = _mm256_set1_epi32(-1);
+
+  for (uint32_t tile_y = triangle.tile_y0; tile_y < triangle.tile_y1; tile_y++)
+  {
+    __m256 y = _mm256_add_ps(_mm256_set1_ps((float) (tile_y * kTileHeight)), row_centers);
+
+    __m256 left = _mm256_max_ps(
+      _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(triangle.left_slope[0]), y), _mm256_set1_ps(triangle.left_offset[0])),
+      _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(triangle.left_slope[1]), y), _mm256_set1_ps(triangle.left_offset[1])));
+    __m256 right = _mm256_min_ps(
+      _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(triangle.right_slope[0]), y), _mm256_set1_ps(triangle.right_offset[0])),
+      _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(triangle.right_slope[1]), y), _mm256_set1_ps(triangle.right_offset[1])));
+    left = _mm256_sub_ps(left, half);
+    right = _mm256_sub_ps(right, half);
+
+    __m256i valid = _mm256_castps_si256(_mm256_and_ps(
+      _mm256_cmp_ps(y, _mm256_set1_ps(triangle.y_min), _CMP_GE_OQ),
+      _mm256_cmp_ps(y, _mm256_set1_ps(triangle.y_max), _CMP_LE_OQ)));
+
+    for (uint32_t tile_x = triangle.tile_x0; tile_x < triangle.tile_x1; tile_x++)
+    {
+      Tile* tile = &_tiles[tile_y * _tiles_x + tile_x];
+      float depth = tileDepth(triangle, tile_x, tile_y);
+      if (depth <= tile->z0)
+      {
+        continue;
+      }
+
+      __m256 base = _mm256_set1_ps((float) (tile_x * kTileWidth));
+      __m256 first = _mm256_min_ps(_mm256_max_ps(_mm256_ceil_ps(_mm256_sub_ps(left, base)), zero), width);
+      __m256 last = _mm256_min_ps(_mm256_max_ps(_mm256_add_ps(_mm256_floor_ps(_mm256_sub_ps(right, base)), one), zero), width);
+
+      // Variable shifts by 32 give 0, so full and empty rows need no care
+      __m256i from_first = _mm256_srlv_epi32(ones, _mm256_cvttps_epi32(first));
+      __m256i from_last = _mm256_srlv_epi32(ones, _mm256_cvttps_epi32(last));
+      __m256i coverage = _mm256_and_si256(_mm256_andnot_si256(from_last, from_first), valid);
+
+      uint32_t masks[kTileHeight];
+      _mm256_storeu_si256((__m256i*) masks, coverage);
+      mergeTile(tile, masks, depth);
+    }
+  }
+}
+
+// One box per lane, the corners in turn. Adds and multiplies follow the
+// scalar path one for one, so both find the same rectangles.
+void OcclusionBuffer::projectBoxesAVX2(const glm::vec3* bounds_min, const glm::vec3* bounds_max, uint32_t count,
+  BoxRect* rects) const
+{
+  // Missing boxes are empty boxes at the origin, their lanes are dropped
+  float min_x[kBoxBatch] = {}, min_y[kBoxBatch] = {}, min_z[kBoxBatch] = {};
+  float extent_x[kBoxBatch] = {}, extent_y[kBoxBatch] = {}, extent_z[kBoxBatch] = {};
+  for (uint32_t box = 0; box < count; box++)
+  {
+    glm::vec3 extent = bounds_max[box] - bounds_min[box];
+    min_x[box] = bounds_min[box].x;
+    min_y[box] = bounds_min[box].y;
+    min_z[box] = bounds_min[box].z;
+    extent_x[box] = extent.x;
+    extent_y[box] = extent.y;
+    extent_z[box] = extent.z;
+  }
+
+  __m256 corner_x = _mm256_loadu_ps(min_x);
+  __m256 corner_y = _mm256_loadu_ps(min_y);
+  __m256 corner_z = _mm256_loadu_ps(min_z);
+  __m256 size_x = _mm256_loadu_ps(extent_x);
+  __m256 size_y = _mm256_loadu_ps(extent_y);
+  __m256 size_z = _mm256_loadu_ps(extent_z);
+
+  // Only x, y and w of the clip positions are needed
+  const glm::mat4& matrix = _view_projection;
+  __m256 origin[3], edge_x[3], edge_y[3], edge_z[3];
+  for (uint32_t i = 0; i < 3; i++)
+  {
+    uint32_t component = i == 2 ? 3 : i;
+    origin[i] = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_set1_ps(matrix[3][component]),
+      _mm256_mul_ps(_mm256_set1_ps(matrix[0][component]), corner_x)),
+      _mm256_mul_ps(_mm256_set1_ps(matrix[1][component]), corner_y)),
+      _mm256_mul_ps(_mm256_set1_ps(matrix[2][component]), corner_z));
+    edge_x[i] = _mm256_mul_ps(_mm256_set1_ps(matrix[0][component]), size_x);
+    edge_y[i] = _mm256_mul_ps(_mm256_set1_ps(matrix[1][component]), size_y);
+    edge_z[i] = _mm256_mul_ps(_mm256_set1_ps(matrix[2][component]), size_z);
+  }
+
+  __m256 corners[8][3];
+  for (uint32_t i = 0; i < 3; i++)
+  {
+    corners[0][i] = origin[i];
+    corners[1][i] = _mm256_add_ps(origin[i], edge_x[i]);
+    corners[2][i] = _mm256_add_ps(corners[0][i], edge_y[i]);
+    corners[3][i] = _mm256_add_ps(corners[1][i], edge_y[i]);
+    for (uint32_t corner = 0; corner < 4; corner++)
+    {
+      corners[corner + 4][i] = _mm256_add_ps(corners[corner][i], edge_z[i]);
+    }
+  }
+
+  __m256 one = _mm256_set1_ps(1.0f);
+  __m256 half = _mm256_set1_ps(0.5f);
+  __m256 near_w = _mm256_set1_ps(kNearW);
+  __m256 width = _mm256_set1_ps((float) _width);
+  __m256 height = _mm256_set1_ps((float) _height);
+  __m256 min_x_screen = _mm256_set1_ps(FLT_MAX), min_y_screen = _mm256_set1_ps(FLT_MAX);
+  __m256 max_x_screen = _mm256_set1_ps(-FLT_MAX), max_y_screen = _mm256_set1_ps(-FLT_MAX);
+  __m256 depth = _mm256_setzero_ps();
+  __m256 clipped = _mm256_setzero_ps();
+  for (uint32_t corner = 0; corner < 8; corner++)
+  {
+    const __m256* clip = corners[corner];
+    clipped = _mm256_or_ps(clipped, _mm256_cmp_ps(clip[2], near_w, _CMP_LT_OQ));
+
+    __m256 inverse_w = _mm256_div_ps(one, clip[2]);
+    __m256 x = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(clip[0], inverse_w), half), half), width);
+    __m256 y = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(clip[1], inverse_w), half), half), height);
+    min_x_screen = _mm256_min_ps(min_x_screen, x);
+    min_y_screen = _mm256_min_ps(min_y_screen, y);
+    max_x_screen = _mm256_max_ps(max_x_screen, x);
+    max_y_screen = _mm256_max_ps(max_y_screen, y);
+    depth = _mm256_max_ps(depth, inverse_w);
+  }
+
+  __m256 zero = _mm256_setzero_ps();
+  uint32_t x0[kBoxBatch], x1[kBoxBatch], y0[kBoxBatch], y1[kBoxBatch];
+  float depths[kBoxBatch];
+  _mm256_storeu_si256((__m256i*) x0, _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_floor_ps(min_x_screen), zero), width)));
+  _mm256_storeu_si256((__m256i*) y0, _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_floor_ps(min_y_screen), zero), height)));
+  _mm256_storeu_si256((__m256i*) x1, _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_ceil_ps(max_x_screen), zero), width)));
+  _mm256_storeu_si256((__m256i*) y1, _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_ceil_ps(max_y_screen), zero), height)));
+  _mm256_storeu_ps(depths, depth);
+  uint32_t clipped_mask = (uint32_t) _mm256_movemask_ps(clipped);
+
+  for (uint32_t box = 0; box < count; box++)
+  {
+    rects[box].x0 = x0[box];
+    rects[box].x1 = x1[box];
+    rects[box].y0 = y0[box];
+    rects[box].y1 = y1[box];
+    rects[box].depth = depths[box];
+    rects[box].clipped = (clipped_mask >> box) & 1;
+  }
+}
+
+bool OcclusionBuffer::testTilesAVX2(uint32_t x0, uint32_t x1, uint32_t y0, uint32_t y1, float depth) const
+{
+  __m256i rows = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+  for (uint32_t tile_y = y0 / kTileHeight; tile_y <= (y1 - 1) / kTileHeight; tile_y++)
+  {
+    // Rows of the rectangle in this tile row, compared as signed
+    __m256i y = _mm256_add_epi32(_mm256_set1_epi32((int32_t) (tile_y * kTileHeight)), rows);
+    __m256i inside = _mm256_andnot_si256(
+      _mm256_cmpgt_epi32(_mm256_set1_epi32((int32_t) y0), y),
+      _mm256_cmpgt_epi32(_mm256_set1_epi32((int32_t) y1), y));
+
+    for (uint32_t tile_x = x0 / kTileWidth; tile_x <= (x1 - 1) / kTileWidth; tile_x++)
+    {
+      const Tile& tile = _tiles[tile_y * _tiles_x + tile_x];
+      if (depth < tile.z0)
+      {
+        continue;
+      }
+
+      __m256i mask = _mm256_loadu_si256((const __m256i*) tile.mask);
+      if (_mm256_testz_si256(mask, mask) || depth >= tile.z1)
+      {
+        return true;
+      }
+
+      uint32_t base = tile_x * kTileWidth;
+      uint32_t first = x0 > base ? x0 - base : 0;
+      uint32_t last = std::min(x1 - base, kTileWidth);
+      uint32_t columns = (first >= 32 ? 0 : ~0u >> first) & ~(last >= 32 ? 0 : ~0u >> last);
+
+      // Visible when the rectangle has a pixel outside the working layer
+      __m256i rectangle = _mm256_and_si256(_mm256_set1_epi32((int32_t) columns), inside);
+      if (!_mm256_testc_si256(mask, rectangle))
+      {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+#else
+
+void OcclusionBuffer::rasterizeAVX2(const Triangle& triangle)
+{
+  rasterizeScalar(triangle);
+}
+
+void OcclusionBuffer::projectBoxesAVX2(const glm::vec3* bounds_min, const glm::vec3* bounds_max, uint32_t count,
+  BoxRect* rects) const
+{
+  projectBoxesScalar(bounds_min, bounds_max, count, rects);
+}
+
+bool OcclusionBuffer::testTilesAVX2(uint32_t x0, uint32_t x1, uint32_t y0, uint32_t y1, float depth) const
+{
+  return testTilesScalar(x0, x1, y0, y1, depth);
+}
+
+#endif // SIMD_X86
@@ -0,0 +1,220 @@
+#include "pack_file.h"
+
+#include <string.h>
+
+#include <vector>
+
+#include "job_system.h"
+#include "logger.h"
+#include "lz4.h"
+
+int PackFile::open(const std::string& file_name)
+{
+  close();
+
+  // Always map, the pack is read in place
+  if (!_file.open(file_name, false))
+  {
+    return 0;
+  }
+
+  if (!validate(file_name))
+  {
+    close();
+    return 0;
+  }
+
+  _header = (const PackHeader*) _file.data();
+  _table = (const PackEntry*) (_file.data() + _header->table_offset);
+  _names = (const char*) (_file.data() + _header->names_offset);
+
+  LOG_DEBUG("Pack", "Mounted %s, %d entries", file_name.c_str(), _header->entry_count);
+  return 1;
+}
+
+void PackFile::close()
+{
+  _file.close();
+  _header = nullptr;
+  _table = nullptr;
+  _names = nullptr;
+}
+
+int PackFile::validate(const std::string& file_name) const
+{
+  const PackHeader* header = (const PackHeader*) _file.data();
+  uint64_t size = _file.size();
+
+  if (size < sizeof(PackHeader) || header->magic != kPackMagic)
+  {
+    LOG_ERROR("Pack", "Not a pack file: %s", file_name.c_str());
+    return 0;
+  }
+
+  if (header->version != kPackVersion)
+  {
+    LOG_ERROR("Pack", "%s has version %d, expected %d, run the packer again",
+      file_name.c_str(), header->version, kPackVersion);
+    return 0;
+  }
+
+  uint64_t table_size = (uint64_t) header->table_size * sizeof(PackEntry);
+  if (header->table_size == 0 || (header->table_size & (header->table_size - 1)) != 0 ||
+      header->table_offset > size || table_size > size - header->table_offset ||
+      header->names_offset > size || header->names_size > size - header->names_offset)
+  {
+    LOG_ERROR("Pack", "Corrupt table of contents in %s", file_name.c_str());
+    return 0;
+  }
+
+  const PackEntry* table = (const PackEntry*) (_file.data() + header->table_offset);
+  for (uint32_t i = 0; i < header->table_size; i++)
+  {
+    const PackEntry& entry = table[i];
+    if (entry.hash == 0)
+    {
+      continue;
+    }
+
+    bool valid = entry.offset <= size && entry.stored_size <= size - entry.offset &&
+      (uint64_t) entry.name_offset + entry.name_length <= header->names_size;
+
+    if (entry.compression == kPackCompression_None)
+    {
+      valid = valid && entry.stored_size == entry.size;
+    }
+    else if (entry.compression == kPackCompression_Lz4)
+    {
+      uint64_t blocks = (entry.size + kPackBlockSize - 1) / kPackBlockSize;
+      valid = valid && entry.block_count == blocks && entry.stored_size >= blocks * sizeof(uint32_t);
+    }
+    else
+    {
+      valid = false;
+    }
+
+    if (!valid)
+    {
+      LOG_ERROR("Pack", "Corrupt entry %d in %s", i, file_name.c_str());
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+const PackEntry* PackFile::find(const std::string& name) const
+{
+  if (_header == nullptr)
+  {
+    return nullptr;
+  }
+
+  uint64_t hash = packHash(name.c_str(), (uint32_t) name.size());
+  uint32_t mask = _header->table_size - 1;
+
+  for (uint32_t i = 0; i < _header->table_size; i++)
+  {
+    const PackEntry& entry = _table[(hash + i) & mask];
+    if (entry.hash == 0)
+    {
+      return nullptr;
+    }
+
+    if (entry.hash == hash && entry.name_length == name.size() &&
+        memcmp(_names + entry.name_offset, name.c_str(), name.size()) == 0)
+    {
+      return &entry;
+    }
+  }
+
+  return nullptr;
+}
+
+std::string PackFile::entryName(const PackEntry& entry) const
+{
+  return std::string(_names + entry.name_offset, entry.name_length);
+}
+
+struct DecompressJob
+{
+  const uint8_t* blocks;
+  std::vector<uint64_t> offsets;
+  const PackEntry* entry;
+  uint8_t* destination;
+  std::atomic<int> failed;
+};
+
+static int decompressBlock(const DecompressJob& job, uint32_t block)
+{
+  const uint32_t* sizes = (const uint32_t*) job.blocks;
+  uint32_t stored_size = sizes[block] & ~kPackBlockRaw;
+  const uint8_t* source = job.blocks + job.offsets[block];
+
+  uint64_t begin = (uint64_t) block * kPackBlockSize;
+  uint64_t size = job.entry->size - begin < kPackBlockSize ? job.entry->size - begin : kPackBlockSize;
+
+  if ((sizes[block] & kPackBlockRaw) != 0)
+  {
+    if (stored_size != size)
+    {
+      return 0;
+    }
+
+    memcpy(job.destination + begin, source, (size_t) size);
+    return 1;
+  }
+
+  return Lz4::decompress(source, stored_size, job.destination + begin, (size_t) size);
+}
+
+int PackFile::decompress(const PackEntry& entry, uint8_t* destination) const
+{
+  const uint8_t* data = entryData(entry);
+
+  if (entry.compression == kPackCompression_None)
+  {
+    memcpy(destination, data, (size_t) entry.size);
+    return 1;
+  }
+
+  DecompressJob job;
+  job.blocks = data;
+  job.entry = &entry;
+  job.destination = destination;
+  job.failed = 0;
+
+  // Blocks follow the size table back to back
+  const uint32_t* sizes = (const uint32_t*) data;
+  uint64_t offset = (uint64_t) entry.block_count * sizeof(uint32_t);
+  job.offsets.resize(entry.block_count);
+  for (uint32_t i = 0; i < entry.block_count; i++)
+  {
+    job.offsets[i] = offset;
+    offset += sizes[i] & ~kPackBlockRaw;
+  }
+
+  if (offset > entry.stored_size)
+  {
+    LOG_ERROR("Pack", "Corrupt block table in %s", entryName(entry).c_str());
+    return 0;
+  }
+
+  JobSystem::parallelFor(entry.block_count, 1, [&job](uint32_t begin, uint32_t end) {
+    for (uint32_t i = begin; i < end; i++)
+    {
+      if (!decompressBlock(job, i))
+      {
+        job.failed = 1;
+      }
+    }
+  });
+
+  if (job.failed)
+  {
+    LOG_ERROR("Pack", "Failed decompressing %s", entryName(entry).c_str());
+    return 0;
+  }
+
+  return 1;
+}
@@ -1,12 +1,37 @@
 #include "render.h"
 
+#include <math.h>
+
+#include <chrono>
+
 #include "logger.h"
 #include "utils.h"
+#include "mesh.h"
+#include "assets.h"
+#include "shader_reflection.h"
 
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 
-#include "chrono"
+static const uint32_t kShaderCount = 2;
+static const char* const kShaderNames[kShaderCount] = { "shaders/vert.spv", "shaders/frag.spv" };
+static const uint32_t kOcclusionWidth = 320;
+static const float kNearPlane = 0.1f;
+static const float kFarPlane = 10.0f;
+static const float kFieldOfView = 45.0f;
+static const uint32_t kTriangleBudget = 1000000;
+// Shared by every mesh, 16 bit indices take half of the index bytes
+static const uint32_t kGeometryVertexCapacity = 1 << 20;
+static const uint64_t kGeometryIndexCapacity = 16 << 20;
+static const uint32_t kGeometryClusterCapacity = 1 << 16;
+
+// Index buffers a draw reads, see DrawPacket::index_binding
+enum IndexBinding
+{
+  kIndexBinding_Arena16 = 0,
+  kIndexBinding_Arena32,
+  kIndexBinding_Clusters,
+};
 
 static struct UniformBufferObject {
   glm::mat4 model;
@@ -23,7 +48,12 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
 Render::Render() { }
 
 Render::~Render() {
+  _shader_watcher.stop();
+  cancelPipelineBuild();
+
   cleanup();
+  _deletion_queue.destroySwapchain(_swapchain, _timeline.submittedValue());
+  _deletion_queue.flush();
 
 #ifdef DEBUG
   auto vkDestroyDebugUtilsMessengerEXT = (PFN_vkDestroyDebugUtilsMessengerEXT)
@@ -37,21 +67,20 @@ Render::~Render() {
 
  vkDestroySemaphore(_device, _image_ready_semaphore, nullptr);
  vkDestroySemaphore(_device, _render_finished_semaphore, nullptr);
- vkDestroyFence(_device, _frame_fence, nullptr);
+ _timeline.release();
 
-  vkDestroyDescriptorSetLayout(_device, _uniform_descriptor_layout, nullptr);
+  _layout_cache.release();
 
-  vkDestroyBuffer(_device, _positions_vertex_buffer, nullptr);
-  vkFreeMemory(_device, _positions_buffer_memory, nullptr);
-  vkDestroyBuffer(_device, _colors_vertex_buffer, nullptr);
-  vkFreeMemory(_device, _colors_buffer_memory, nullptr);
-  vkDestroyBuffer(_device, _indices_buffer, nullptr);
-  vkFreeMemory(_device, _indices_buffer_memory, nullptr);
+  _clusters.release();
+  _geometry.release();
   vkDestroyBuffer(_device, _uniform_buffer, nullptr);
   vkFreeMemory(_device, _uniform_buffer_memory, nullptr);
 
   vkDestroyCommandPool(_device, _command_pool, nullptr);
   vkDestroyDescriptorPool(_device, _descriptor_pool, nullptr);
+
+  _profiler.release();
+  _capture.release();
   
   vkDestroyDevice(_device, nullptr);
   vkDestroySurfaceKHR(_instance, _surface, nullptr);
@@ -143,6 +172,23 @@ int Render::init(HWND window, HINSTANCE instance)
     return 0;
   }
 
+  _layout_cache.init(_device);
+
+  if (!createSyncObjects())
+  {
+    return 0;
+  }
+
+  if (!_profiler.init(_physical_device, _device, _queue_indices.graphics_family, _statistics_supported))
+  {
+    return 0;
+  }
+
+  if (!_capture.init(_physical_device, _device, _layout_cache))
+  {
+    return 0;
+  }
+
   RECT rect;
   GetClientRect(window, &rect);
   if (!createSwapChain(rect.right - rect.left, rect.bottom - rect.top))
@@ -155,12 +201,17 @@ int Render::init(HWND window, HINSTANCE instance)
     return 0;
   }
 
+  if (!createGeometry())
+  {
+    return 0;
+  }
+
   if (!createGraphicsPipeline())
   {
     return 0;
   }
 
-  if (!createVertexBuffers())
+  if (!createDescriptors())
   {
     return 0;
   }
@@ -170,13 +221,31 @@ int Render::init(HWND window, HINSTANCE instance)
     return 0;
   }
 
+  // Optional, without it shaders are only picked up on restart
+  _shader_watcher.start(Assets::root() + "shaders");
+
   return 1;
 }
 
-void Render::drawFrame()
+void Render::drawFrame(const FrameState& state)
 {
-  vkWaitForFences(_device, 1, &_frame_fence, VK_TRUE, UINT64_MAX);
-  vkResetFences(_device, 1, &_frame_fence);
+  _telemetry.beginFrame();
+
+  // One frame in flight, the previous frame owns the uniform buffer
+  _timeline.wait(_frame_value);
+  _telemetry.mark(kFramePhase_GpuWait);
+
+  _deletion_queue.collect();
+  _geometry.collect();
+
+  // The previous submission is done, so its queries are ready
+  if (_last_image_index != UINT32_MAX)
+  {
+    _profiler.collect(_last_image_index);
+  }
+  _capture.retire(_timeline.completedValue());
+
+  reloadShaders();
 
   uint32_t image_index = 0;
   VkResult result = vkAcquireNextImageKHR(
@@ -184,10 +253,12 @@ void Render::drawFrame()
     UINT64_MAX, _image_ready_semaphore, 
     VK_NULL_HANDLE, &image_index
   );
+  _telemetry.mark(kFramePhase_Acquire);
 
   if (result == VK_ERROR_OUT_OF_DATE_KHR)
   {
     recreateSwapChain();
+    _telemetry.endFrame();
     return;
   }
   else if (result == VK_SUBOPTIMAL_KHR)
@@ -197,9 +268,24 @@ void Render::drawFrame()
   else if (result != VK_SUCCESS)
   {
     LOG_ERROR("Render", "Failed to get image from swapchain");
+    _telemetry.endFrame();
     return;
   }
 
+  update(state.time);
+  _telemetry.mark(kFramePhase_Update);
+
+  cull();
+  _telemetry.mark(kFramePhase_Cull);
+
+  sortDraws();
+  if (!recordCommandBuffer(image_index, state))
+  {
+    _telemetry.endFrame();
+    return;
+  }
+  _telemetry.mark(kFramePhase_Record);
+
   VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT };
   VkSubmitInfo submit_info = {};
   submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -211,15 +297,17 @@ void Render::drawFrame()
   submit_info.signalSemaphoreCount = 1;
   submit_info.pSignalSemaphores = &_render_finished_semaphore;
 
-  update();
-
-  result = vkQueueSubmit(_graphics_queue, 1, &submit_info, _frame_fence);
-  if (result != VK_SUCCESS)
+  int submitted = _timeline.submit(_graphics_queue, submit_info, &_frame_value);
+  _telemetry.mark(kFramePhase_Submit);
+  if (!submitted)
   {
     LOG_ERROR("Render", "Failed submiting command buffer");
+    _telemetry.endFrame();
     return;
   }
 
+  _last_image_index = image_index;
+
   VkPresentInfoKHR present_info = {};
   present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
   present_info.waitSemaphoreCount = 1;
@@ -230,6 +318,9 @@ void Render::drawFrame()
   present_info.pResults = nullptr;
 
   result = vkQueuePresentKHR(_present_queue, &present_info);
+  _telemetry.mark(kFramePhase_Present);
+  _telemetry.endFrame();
+
   if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || _resize) {
     _resize = false;
     recreateSwapChain();
@@ -345,11 +436,24 @@ int Render::createLogicalDevice(const std::vector<char*>& device_extensions)
     queue_create_infos.push_back(queue_create_info);
   }
 
+  VkPhysicalDeviceFeatures supported_features;
+  vkGetPhysicalDeviceFeatures(_physical_device, &supported_features);
+
   // Any mandatory features required
   VkPhysicalDeviceFeatures device_features = {};
 
+  // Timeline semaphores are core in 1.2, pickPhysicalDevice checked them
+  VkPhysicalDeviceVulkan12Features vulkan12_features = {};
+  vulkan12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  vulkan12_features.timelineSemaphore = VK_TRUE;
+
+  // Optional features
+  device_features.pipelineStatisticsQuery = supported_features.pipelineStatisticsQuery;
+  _statistics_supported = supported_features.pipelineStatisticsQuery == VK_TRUE;
+
   VkDeviceCreateInfo create_info = {};
   create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+  create_info.pNext = &vulkan12_features;
   create_info.queueCreateInfoCount = (uint32_t) queue_create_infos.size();
   create_info.pQueueCreateInfos = queue_create_infos.data();
   create_info.pEnabledFeatures = &device_features;
@@ -438,6 +542,19 @@ int Render::createSwapChain(int width, int height)
   VkSwapchainCreateInfoKHR create_info = {};
   create_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
   create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  if (_capture.enabled())
+  {
+    if (capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT)
+    {
+      create_info.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    }
+    else
+    {
+      LOG_WARNING("Render", "Swapchain images can not be copied, capture disabled");
+      _capture.release();
+      _capture.configure(kCaptureFormat_None, "");
+    }
+  }
   create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
   create_info.preTransform = capabilities.currentTransform;
   create_info.surface = _surface;
@@ -448,7 +565,7 @@ int Render::createSwapChain(int width, int height)
   create_info.presentMode = surface_present_mode;
   create_info.imageArrayLayers = 1;
   create_info.clipped = VK_TRUE;
-  create_info.oldSwapchain = VK_NULL_HANDLE;
+  create_info.oldSwapchain = _swapchain;
   
   uint32_t queue_family_indices[] = { _queue_indices.graphics_family, _queue_indices.present_family };
   if (_queue_indices.graphics_family != _queue_indices.present_family)
@@ -465,6 +582,7 @@ int Render::createSwapChain(int width, int height)
     create_info.pQueueFamilyIndices = nullptr;
   }
 
+  VkSwapchainKHR old_swapchain = _swapchain;
   VkResult result = vkCreateSwapchainKHR(_device, &create_info, nullptr, &_swapchain);
   if (result != VK_SUCCESS)
   {
@@ -472,6 +590,9 @@ int Render::createSwapChain(int width, int height)
     return 0;
   }
 
+  // Its images may still be in use by the last frame
+  _deletion_queue.destroySwapchain(old_swapchain, _timeline.submittedValue());
+
   vkGetSwapchainImagesKHR(_device, _swapchain, &image_count, nullptr);
   _swapchain_images.resize(image_count);
   vkGetSwapchainImagesKHR(_device, _swapchain, &image_count, _swapchain_images.data());
@@ -505,6 +626,11 @@ int Render::createSwapChain(int width, int height)
     }
   }
 
+  if (!_capture.resize(_swapchain_extent, _swapchain_format))
+  {
+    return 0;
+  }
+
   LOG_DEBUG("Render", "Swapchain created succesfully");
   return 1;
 }
@@ -574,18 +700,159 @@ int Render::createGraphicsPipeline()
 {
   std::cout << "\n";
   LOG_DEBUG("Render", "Creating ghrapic pipeline");
-  
-  std::vector<char> vertex_shader_code = Utils::readFile("../../shaders/vert.spv");
-  std::vector<char> fragment_shader_code = Utils::readFile("../../shaders/frag.spv");
 
-  if (vertex_shader_code.size() == 0 || fragment_shader_code.size() == 0)
+  PipelineBuild build = {};
+  if (!buildGraphicsPipeline(_render_pass, _swapchain_extent, &build))
+  {
+    return 0;
+  }
+
+  // The descriptor set is allocated once, shaders can not change its layout
+  if (_descriptor_set != VK_NULL_HANDLE && build.uniform_layout != _uniform_descriptor_layout)
+  {
+    LOG_ERROR("Render", "Shaders changed the uniform layout, restart to apply them");
+    vkDestroyPipeline(_device, build.pipeline, nullptr);
+    return 0;
+  }
+
+  _graphics_pipeline = build.pipeline;
+  _pipeline_layout = build.layout;
+  _uniform_descriptor_layout = build.uniform_layout;
+
+  LOG_DEBUG("Render", "Ghrapic pipeline created succesfully");
+  return 1;
+}
+
+void Render::reloadShaders()
+{
+  std::vector<std::string> changed;
+  _shader_watcher.poll(&changed);
+
+  for (size_t i = 0; i < changed.size(); i++)
+  {
+    std::string name = "shaders/" + changed[i];
+    if (name.size() < 4 || name.compare(name.size() - 4, 4, ".spv") != 0)
+    {
+      continue;
+    }
+
+    Assets::markChanged(name);
+    for (uint32_t j = 0; j < kShaderCount; j++)
+    {
+      _shaders_changed |= name == kShaderNames[j];
+    }
+  }
+
+  // Swapped between frames, the previous pipeline goes once the last
+  // submission that bound it retires
+  if (_pipeline_built)
+  {
+    _pipeline_builder.join();
+    _pipeline_built = false;
+
+    if (_pipeline_build_result && _pipeline_build.uniform_layout != _uniform_descriptor_layout)
+    {
+      LOG_ERROR("Render", "Shaders changed the uniform layout, restart to apply them");
+      vkDestroyPipeline(_device, _pipeline_build.pipeline, nullptr);
+    }
+    else if (_pipeline_build_result)
+    {
+      _deletion_queue.destroyPipeline(_graphics_pipeline, _timeline.submittedValue());
+      _graphics_pipeline = _pipeline_build.pipeline;
+      _pipeline_layout = _pipeline_build.layout;
+      LOG_DEBUG("Render", "Reloaded shaders");
+    }
+  }
+
+  if (_shaders_changed && !_pipeline_builder.joinable())
+  {
+    _shaders_changed = false;
+
+    VkRenderPass render_pass = _render_pass;
+    VkExtent2D extent = _swapchain_extent;
+    _pipeline_builder = std::thread([this, render_pass, extent]() {
+      _pipeline_build = {};
+      _pipeline_build_result = buildGraphicsPipeline(render_pass, extent, &_pipeline_build);
+      _pipeline_built = true;
+    });
+  }
+}
+
+void Render::cancelPipelineBuild()
+{
+  if (!_pipeline_builder.joinable())
+  {
+    return;
+  }
+
+  _pipeline_builder.join();
+  _pipeline_built = false;
+
+  // Never bound, so it can go right away
+  if (_pipeline_build_result)
+  {
+    vkDestroyPipeline(_device, _pipeline_build.pipeline, nullptr);
+  }
+}
+
+// Called from the pipeline builder thread too, so it only reads state that
+// stays put while a build runs
+int Render::buildGraphicsPipeline(VkRenderPass render_pass, VkExtent2D extent, PipelineBuild* build)
+{
+  Asset shader_code[kShaderCount];
+
+  if (!Assets::loadMany(kShaderNames, kShaderCount, shader_code))
   {
     LOG_ERROR("Render", "Failed opening shader files");
     return 0;
   }
 
-  VkShaderModule vertex_shader_module = createShaderModule(vertex_shader_code);
-  VkShaderModule fragment_shader_module = createShaderModule(fragment_shader_code);
+  // Layouts and vertex input come from the shaders themselves
+  ShaderReflection reflection;
+  ShaderReflection fragment_reflection;
+  if (!reflection.parse(shader_code[0].data(), shader_code[0].size()) ||
+      !fragment_reflection.parse(shader_code[1].data(), shader_code[1].size()) ||
+      !reflection.merge(fragment_reflection))
+  {
+    LOG_ERROR("Render", "Failed reflecting shaders");
+    return 0;
+  }
+
+  // Every input has to read one of the mesh streams, in its encoding
+  std::vector<VkVertexInputBindingDescription> bindings;
+  std::vector<VkVertexInputAttributeDescription> attributes;
+  if (!reflection.vertexInput(_geometry.layout(), &bindings, &attributes))
+  {
+    LOG_ERROR("Render", "Shader vertex inputs do not match the mesh streams");
+    return 0;
+  }
+
+  VkPipelineVertexInputStateCreateInfo vertex_input_info{};
+  vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  vertex_input_info.vertexBindingDescriptionCount = (uint32_t) bindings.size();
+  vertex_input_info.pVertexBindingDescriptions = bindings.data();
+  vertex_input_info.vertexAttributeDescriptionCount = (uint32_t) attributes.size();
+  vertex_input_info.pVertexAttributeDescriptions = attributes.data();
+
+  const ShaderBinding* uniform_binding = reflection.findBinding(0, 0);
+  if (uniform_binding == nullptr || uniform_binding->type != VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER ||
+      uniform_binding->size != sizeof(UniformBufferObject))
+  {
+    LOG_ERROR("Render", "Shaders do not declare the uniform buffer at set 0 binding 0");
+    return 0;
+  }
+
+  // Cached, rebuilding the pipeline gets the same layouts back
+  std::vector<VkDescriptorSetLayout> set_layouts;
+  build->layout = _layout_cache.pipelineLayout(reflection, &set_layouts);
+  if (build->layout == VK_NULL_HANDLE)
+  {
+    return 0;
+  }
+  build->uniform_layout = set_layouts[0];
+
+  VkShaderModule vertex_shader_module = createShaderModule(shader_code[0].data(), shader_code[0].size());
+  VkShaderModule fragment_shader_module = createShaderModule(shader_code[1].data(), shader_code[1].size());
 
   VkPipelineShaderStageCreateInfo vertex_stage_create_info = {};
   vertex_stage_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -601,38 +868,6 @@ int Render::createGraphicsPipeline()
 
   VkPipelineShaderStageCreateInfo shader_stages[] = { vertex_stage_create_info, fragment_stage_create_info };
 
-  VkVertexInputBindingDescription positions_binding_description = {};
-  positions_binding_description.binding = 0;
-  positions_binding_description.stride = sizeof(glm::vec3);
-  positions_binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-  VkVertexInputBindingDescription colors_binding_description = {};
-  colors_binding_description.binding = 1;
-  colors_binding_description.stride = sizeof(glm::vec3);
-  colors_binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-  VkVertexInputAttributeDescription positions_attribute_description = {};
-  positions_attribute_description.binding = 0;
-  positions_attribute_description.location = 0;
-  positions_attribute_description.offset = 0;
-  positions_attribute_description.format = VK_FORMAT_R32G32B32_SFLOAT;
-
-  VkVertexInputAttributeDescription colors_attribute_description = {};
-  colors_attribute_description.binding = 1;
-  colors_attribute_description.location = 1;
-  colors_attribute_description.offset = 0;
-  colors_attribute_description.format = VK_FORMAT_R32G32B32_SFLOAT;
-
-  VkVertexInputBindingDescription bindings[] = { positions_binding_description, colors_binding_description };
-  VkVertexInputAttributeDescription attributes[] = { positions_attribute_description, colors_attribute_description };
-
-  VkPipelineVertexInputStateCreateInfo vertex_input_info{};
-  vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-  vertex_input_info.vertexBindingDescriptionCount = sizeof(bindings) / sizeof(VkVertexInputBindingDescription);
-  vertex_input_info.pVertexBindingDescriptions = bindings;
-  vertex_input_info.vertexAttributeDescriptionCount = sizeof(attributes) / sizeof(VkVertexInputAttributeDescription);;
-  vertex_input_info.pVertexAttributeDescriptions = attributes;
-
   VkPipelineInputAssemblyStateCreateInfo input_assembly = {};
   input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
   input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
@@ -641,14 +876,14 @@ int Render::createGraphicsPipeline()
   VkViewport viewport = {};
   viewport.x = 0.0f;
   viewport.y = 0.0f;
-  viewport.width = _swapchain_extent.width;
-  viewport.height = _swapchain_extent.height;
+  viewport.width = extent.width;
+  viewport.height = extent.height;
   viewport.minDepth = 0.0f;
   viewport.maxDepth = 1.0f;
 
   VkRect2D scissor = {};
   scissor.offset = { 0, 0 };
-  scissor.extent = _swapchain_extent;
+  scissor.extent = extent;
 
   VkPipelineViewportStateCreateInfo viewport_info = {};
   viewport_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
@@ -689,36 +924,6 @@ int Render::createGraphicsPipeline()
   color_blending.attachmentCount = 1;
   color_blending.pAttachments = &color_blend_attachment;
 
-  VkDescriptorSetLayoutBinding uniform_layour_binding = {};
-  uniform_layour_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  uniform_layour_binding.binding = 0;
-  uniform_layour_binding.descriptorCount = 1;
-  uniform_layour_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-
-  VkDescriptorSetLayoutCreateInfo uniform_layout_create_info = {};
-  uniform_layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-  uniform_layout_create_info.bindingCount = 1;
-  uniform_layout_create_info.pBindings = &uniform_layour_binding;
-
-  VkResult result = vkCreateDescriptorSetLayout(_device, &uniform_layout_create_info, nullptr, &_uniform_descriptor_layout);
-  if (result != VK_SUCCESS)
-  {
-    LOG_ERROR("Render", "Failed creating uniform descriptor layuout");
-    return 0;
-  }
-
-  VkPipelineLayoutCreateInfo pipeline_layout_create_info = {};
-  pipeline_layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-  pipeline_layout_create_info.setLayoutCount = 1;
-  pipeline_layout_create_info.pSetLayouts = &_uniform_descriptor_layout;
-
-  result = vkCreatePipelineLayout(_device, &pipeline_layout_create_info, nullptr, &_pipeline_layout);
-  if (result != VK_SUCCESS)
-  {
-    LOG_ERROR("Render", "Failed creating pipeline layout");
-    return 0;
-  }
-
   VkGraphicsPipelineCreateInfo pipeline_info = {};
   pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
   pipeline_info.stageCount = 2;
@@ -729,170 +934,114 @@ int Render::createGraphicsPipeline()
   pipeline_info.pRasterizationState = &rasterizer;
   pipeline_info.pMultisampleState = &multisampler;
   pipeline_info.pColorBlendState = &color_blending;
-  pipeline_info.layout = _pipeline_layout;
-  pipeline_info.renderPass = _render_pass;
+  pipeline_info.layout = build->layout;
+  pipeline_info.renderPass = render_pass;
   pipeline_info.subpass = 0;
 
-  result = vkCreateGraphicsPipelines(_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &_graphics_pipeline);
+  VkResult result = vkCreateGraphicsPipelines(_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &build->pipeline);
+
+  vkDestroyShaderModule(_device, vertex_shader_module, nullptr);
+  vkDestroyShaderModule(_device, fragment_shader_module, nullptr);
+
   if (result != VK_SUCCESS)
   {
     LOG_ERROR("Render", "Failed creating graphics pipeline");
     return 0;
   }
 
-  vkDestroyShaderModule(_device, vertex_shader_module, nullptr);
-  vkDestroyShaderModule(_device, fragment_shader_module, nullptr);
-
-  LOG_DEBUG("Render", "Ghrapic pipeline created succesfully");
   return 1;
 }
 
-int Render::createVertexBuffers()
+
+int Render::createGeometry()
 {
   std::cout << "\n";
-  LOG_DEBUG("Render", "Creating vertex buffer");
-
-  void* buffer_memory;
-  glm::vec3 positions[] = {
-    {-0.5f, -0.5f, -0.5f}, 
-    { 0.5f, -0.5f, -0.5f}, 
-    { 0.5f,  0.5f, -0.5f}, 
-    {-0.5f,  0.5f, -0.5f},
-    {-0.5f, -0.5f,  0.5f},
-    { 0.5f, -0.5f,  0.5f},
-    { 0.5f,  0.5f,  0.5f},
-    {-0.5f,  0.5f,  0.5f},
-  };
-
-  glm::vec3 colors[] = {
-    {0.0f, 0.0f, 1.0f},
-    {1.0f, 0.0f, 0.0f},
-    {0.0f, 0.0f, 1.0f},
-    {1.0f, 0.0f, 0.0f},
-    {0.0f, 0.0f, 1.0f},
-    {1.0f, 0.0f, 0.0f},
-    {0.0f, 0.0f, 1.0f},
-    {1.0f, 0.0f, 0.0f},
-  };
-
-  uint16_t indices[] = {
-    0, 1, 3, 3, 1, 2,
-    1, 5, 2, 2, 5, 6,
-    5, 4, 6, 6, 4, 7,
-    4, 0, 7, 7, 0, 3,
-    3, 2, 7, 7, 2, 6,
-    4, 5, 0, 0, 5, 1
-  };
-
-  //////////////////
-  // POSITIONS
-  VkBufferCreateInfo create_info = {};
-  create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-  create_info.size = sizeof(positions);
-  create_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-  create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  LOG_DEBUG("Render", "Creating geometry");
 
-  VkResult result = vkCreateBuffer(_device, &create_info, nullptr, &_positions_vertex_buffer);
-  if (result != VK_SUCCESS) 
+  uint32_t mesh_id = 0;
+  if (!loadMesh("data/cube.mesh", &mesh_id))
   {
-    LOG_ERROR("Render", "Failed creating vertex buffer");
     return 0;
   }
 
-  VkMemoryRequirements memory_requirements;
-  vkGetBufferMemoryRequirements(_device, _positions_vertex_buffer, &memory_requirements);
-
-  VkMemoryAllocateInfo allocate_info{};
-  allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocate_info.allocationSize = memory_requirements.size;
-  allocate_info.memoryTypeIndex = findMemoryType(memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  const RenderMesh& mesh = _meshes[mesh_id];
+  _cube = _scene.create(SceneHandle(), mesh_id);
+  _scene.setBounds(_cube, mesh.bounds_min, mesh.bounds_max);
+  _lod_selector.setTriangleBudget(kTriangleBudget);
 
-  result = vkAllocateMemory(_device, &allocate_info, nullptr, &_positions_buffer_memory);
-  if (result != VK_SUCCESS) {
-    LOG_ERROR("Render", "Failed to allocate vertex buffer memory!");
+  // Reads the cluster buffers of the arena, which exists now
+  if (!_clusters.init(_physical_device, _device, _layout_cache, _geometry))
+  {
     return 0;
   }
 
-  vkBindBufferMemory(_device, _positions_vertex_buffer, _positions_buffer_memory, 0);
+  return 1;
+}
 
-  vkMapMemory(_device, _positions_buffer_memory, 0, create_info.size, 0, &buffer_memory);
-  memcpy(buffer_memory, positions, (size_t) create_info.size);
-  vkUnmapMemory(_device, _positions_buffer_memory);
+int Render::loadMesh(const std::string& name, uint32_t* mesh_id)
+{
+  std::chrono::steady_clock::time_point load_start = std::chrono::steady_clock::now();
 
-  //////////////////
-  // COLORS
-  create_info.size = sizeof(colors);
-  result = vkCreateBuffer(_device, &create_info, nullptr, &_colors_vertex_buffer);
-  if (result != VK_SUCCESS)
+  MeshFile file;
+  if (!file.open(name))
   {
-    LOG_ERROR("Render", "Failed creating vertex buffer");
     return 0;
   }
 
-  vkGetBufferMemoryRequirements(_device, _colors_vertex_buffer, &memory_requirements);
-  allocate_info.allocationSize = memory_requirements.size;
-
-  result = vkAllocateMemory(_device, &allocate_info, nullptr, &_colors_buffer_memory);
-  if (result != VK_SUCCESS) {
-    LOG_ERROR("Render", "Failed to allocate vertex buffer memory!");
+  // The first mesh decides the layout of the arena
+  if (!_geometry.valid() && !_geometry.init(_physical_device, _device, &_timeline, file.vertexLayout(),
+        kGeometryVertexCapacity, kGeometryIndexCapacity, kGeometryClusterCapacity))
+  {
     return 0;
   }
 
-  vkBindBufferMemory(_device, _colors_vertex_buffer, _colors_buffer_memory, 0);
-
-  vkMapMemory(_device, _colors_buffer_memory, 0, create_info.size, 0, &buffer_memory);
-  memcpy(buffer_memory, colors, (size_t) create_info.size);
-  vkUnmapMemory(_device, _colors_buffer_memory);
-
-  // --------------------------------
-  // INDICES
-  create_info.size = sizeof(indices);
-  create_info.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
-  result = vkCreateBuffer(_device, &create_info, nullptr, &_indices_buffer);
-  if (result != VK_SUCCESS)
+  RenderMesh mesh;
+  if (!_geometry.add(file, &mesh.geometry))
   {
-    LOG_ERROR("Render", "Failed creating indices buffer");
+    LOG_ERROR("Render", "Failed adding %s to the geometry arena", name.c_str());
     return 0;
   }
 
-  vkGetBufferMemoryRequirements(_device, _indices_buffer, &memory_requirements);
-  allocate_info.allocationSize = memory_requirements.size;
+  const MeshHeader& header = file.header();
+  mesh.lods.assign(file.lods(), file.lods() + file.lodCount());
+  mesh.bounds_min = glm::vec3(header.bounds_min[0], header.bounds_min[1], header.bounds_min[2]);
+  mesh.bounds_max = glm::vec3(header.bounds_max[0], header.bounds_max[1], header.bounds_max[2]);
+  mesh.dequantize = glm::scale(
+    glm::translate(glm::mat4(1.0f), glm::vec3(header.position_offset[0], header.position_offset[1], header.position_offset[2])),
+    glm::vec3(header.position_scale[0], header.position_scale[1], header.position_scale[2]));
 
-  result = vkAllocateMemory(_device, &allocate_info, nullptr, &_indices_buffer_memory);
-  if (result != VK_SUCCESS) {
-    LOG_ERROR("Render", "Failed to allocate indices buffer memory!");
-    return 0;
+  *mesh_id = (uint32_t) _meshes.size();
+  _meshes.push_back(std::move(mesh));
+
+  // The vectors of earlier meshes may have moved
+  _lod_chains.resize(_meshes.size());
+  for (size_t i = 0; i < _meshes.size(); i++)
+  {
+    _lod_chains[i].lods = _meshes[i].lods.data();
+    _lod_chains[i].count = (uint32_t) _meshes[i].lods.size();
   }
 
-  vkBindBufferMemory(_device, _indices_buffer, _indices_buffer_memory, 0);
+  const GeometryRange& range = _meshes[*mesh_id].geometry;
+  double load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - load_start).count();
+  double load_mb = file.fileSize() / (1024.0 * 1024.0);
+  LOG_DEBUG("Render", "Loaded %s, %.3f MB in %.3f ms (%.1f MB/s), %u vertices at %d, %u %s bit indices at %u",
+    name.c_str(), load_mb, load_ms, load_ms > 0.0 ? load_mb * 1000.0 / load_ms : 0.0, range.vertex_count,
+    range.vertex_offset, range.index_count, range.index_type == VK_INDEX_TYPE_UINT16 ? "16" : "32",
+    range.first_index);
 
-  vkMapMemory(_device, _indices_buffer_memory, 0, create_info.size, 0, &buffer_memory);
-  memcpy(buffer_memory, indices, (size_t) create_info.size);
-  vkUnmapMemory(_device, _indices_buffer_memory);
-  
+  return 1;
+}
+
+int Render::createDescriptors()
+{
   ////////////////////
   // UNIFORM BUFFER
-  create_info.size = sizeof(UniformBufferObject);
-  create_info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-
-  result = vkCreateBuffer(_device, &create_info, nullptr, &_uniform_buffer);
-  if (result != VK_SUCCESS)
+  if (!createHostBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, nullptr, sizeof(UniformBufferObject),
+        &_uniform_buffer, &_uniform_buffer_memory))
   {
-    LOG_ERROR("Render", "Failed creating unifrom buffer");
-    return 0;
-  }
-
-  vkGetBufferMemoryRequirements(_device, _uniform_buffer, &memory_requirements);
-  allocate_info.allocationSize = memory_requirements.size;
-
-  result = vkAllocateMemory(_device, &allocate_info, nullptr, &_uniform_buffer_memory);
-  if (result != VK_SUCCESS) {
-    LOG_ERROR("Render", "Failed to allocate uniform buffer memory!");
     return 0;
   }
 
-  vkBindBufferMemory(_device, _uniform_buffer, _uniform_buffer_memory, 0);
-
   ////////////////////
   // DESCRIPTORS
   VkDescriptorPoolSize pool_size = {};
@@ -905,7 +1054,7 @@ int Render::createVertexBuffers()
   pool_create_info.pPoolSizes = &pool_size;
   pool_create_info.maxSets = 1;
 
-  result = vkCreateDescriptorPool(_device, &pool_create_info, nullptr, &_descriptor_pool);
+  VkResult result = vkCreateDescriptorPool(_device, &pool_create_info, nullptr, &_descriptor_pool);
   if (result != VK_SUCCESS) {
     LOG_ERROR("Render", "Failed to create descriptor pool!");
     return 0;
@@ -940,7 +1089,50 @@ int Render::createVertexBuffers()
 
   vkUpdateDescriptorSets(_device, 1, &descriptor_write, 0, nullptr);  
 
-  LOG_DEBUG("Render", "Vertex buffers created succesfully");
+  LOG_DEBUG("Render", "Descriptors created succesfully");
+  return 1;
+}
+
+int Render::createHostBuffer(VkBufferUsageFlags usage, const void* data, VkDeviceSize size,
+  VkBuffer* buffer, VkDeviceMemory* memory)
+{
+  VkBufferCreateInfo create_info = {};
+  create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  create_info.size = size;
+  create_info.usage = usage;
+  create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  VkResult result = vkCreateBuffer(_device, &create_info, nullptr, buffer);
+  if (result != VK_SUCCESS)
+  {
+    LOG_ERROR("Render", "Failed creating buffer");
+    return 0;
+  }
+
+  VkMemoryRequirements memory_requirements;
+  vkGetBufferMemoryRequirements(_device, *buffer, &memory_requirements);
+
+  VkMemoryAllocateInfo allocate_info = {};
+  allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocate_info.allocationSize = memory_requirements.size;
+  allocate_info.memoryTypeIndex = findMemoryType(memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+  result = vkAllocateMemory(_device, &allocate_info, nullptr, memory);
+  if (result != VK_SUCCESS) {
+    LOG_ERROR("Render", "Failed to allocate buffer memory!");
+    return 0;
+  }
+
+  vkBindBufferMemory(_device, *buffer, *memory, 0);
+
+  if (data != nullptr)
+  {
+    void* buffer_memory;
+    vkMapMemory(_device, *memory, 0, size, 0, &buffer_memory);
+    memcpy(buffer_memory, data, (size_t) size);
+    vkUnmapMemory(_device, *memory);
+  }
+
   return 1;
 }
 
@@ -952,9 +1144,14 @@ int Render::createCommandBuffer()
   VkCommandPoolCreateInfo pool_info = {};
   pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
   pool_info.queueFamilyIndex = _queue_indices.graphics_family;
-  pool_info.flags = 0;
+  pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
-  VkResult result = vkCreateCommandPool(_device, &pool_info, nullptr, &_command_pool);
+  // The pool outlives swapchain recreation, only the buffers are replaced
+  VkResult result = VK_SUCCESS;
+  if (_command_pool == VK_NULL_HANDLE)
+  {
+    result = vkCreateCommandPool(_device, &pool_info, nullptr, &_command_pool);
+  }
   if (result != VK_SUCCESS)
   {
     LOG_ERROR("Render", "Failed creating command pool");
@@ -976,65 +1173,136 @@ int Render::createCommandBuffer()
     return 0;
   }
 
-  for (size_t i = 0; i < _command_buffers.size(); i++)
+  LOG_DEBUG("Render", "Command buffer created succesfully");
+  return 1;
+}
+
+int Render::createSyncObjects()
+{
+  std::cout << "\n";
+  LOG_DEBUG("Render", "Creating sync objects");
+
+  // Acquire and present only take binary semaphores, everything else is
+  // tracked with timeline values. Created once, swapchain recreation
+  // keeps them.
+  VkSemaphoreCreateInfo semaphore_info = {};
+  semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+  if (vkCreateSemaphore(_device, &semaphore_info, nullptr, &_image_ready_semaphore) != VK_SUCCESS ||
+      vkCreateSemaphore(_device, &semaphore_info, nullptr, &_render_finished_semaphore) != VK_SUCCESS)
   {
-    VkCommandBufferBeginInfo begin_info = {};
-    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    LOG_ERROR("Render", "Failed creating semaphore");
+    return 0;
+  }
 
-    result = vkBeginCommandBuffer(_command_buffers[i], &begin_info);
-    if (result != VK_SUCCESS)
+  if (!_timeline.init(_device))
+  {
+    return 0;
+  }
+
+  _deletion_queue.init(_device, &_timeline);
+
+  LOG_DEBUG("Render", "Sync objects created succesfully");
+  return 1;
+}
+
+int Render::recordCommandBuffer(uint32_t image_index, const FrameState& state)
+{
+  VkCommandBuffer command_buffer = _command_buffers[image_index];
+
+  VkCommandBufferBeginInfo begin_info = {};
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  VkResult result = vkBeginCommandBuffer(command_buffer, &begin_info);
+  if (result != VK_SUCCESS)
+  {
+    LOG_ERROR("Render", "Failed to begin recording command buffer %d", image_index);
+    return 0;
+  }
+
+  _profiler.resetFrame(command_buffer, image_index);
+  uint32_t main_pass = _profiler.beginPass(command_buffer, image_index, "main");
+
+  VkClearValue clear_color = {{{ 0.06f, 0.06f, 0.06f, 1.0f }}};
+  VkRenderPassBeginInfo render_pass_info = {};
+  render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+  render_pass_info.renderPass = _render_pass;
+  render_pass_info.framebuffer = _swapchain_framebuffers[image_index];
+  render_pass_info.renderArea.offset = { 0, 0 };
+  render_pass_info.renderArea.extent = _swapchain_extent;
+  render_pass_info.clearValueCount = 1;
+  render_pass_info.pClearValues = &clear_color;
+
+  // Writes the indices of the visible clusters the draws below read
+  _clusters.record(command_buffer);
+
+  vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+
+  // State is only bound when its id differs from the previous packet, the
+  // same rule DrawQueue::countStateChanges counts. There is a single
+  // pipeline and descriptor set so far, which every id maps to. Meshes
+  // share the geometry arena, so switching mesh only changes the draw
+  // arguments, and the index buffer when the index width changes or a draw
+  // switches to the culled cluster indices.
+  _geometry.bindVertexBuffers(command_buffer);
+
+  const DrawPacket* packets = _draw_queue.packets();
+  for (uint32_t i = 0; i < _draw_queue.count(); i++)
+  {
+    uint64_t key = packets[i].key;
+    uint64_t previous = i > 0 ? packets[i - 1].key : 0;
+
+    if (i == 0 || DrawKey::pipeline(key) != DrawKey::pipeline(previous))
     {
-      LOG_ERROR("Render", "Failed to begin recording command buffer %d", i);
-      return 0;
+      vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _graphics_pipeline);
     }
 
-    VkClearValue clear_color = {{{ 0.06f, 0.06f, 0.06f, 1.0f }}};
-    VkRenderPassBeginInfo render_pass_info = {};
-    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    render_pass_info.renderPass = _render_pass;
-    render_pass_info.framebuffer = _swapchain_framebuffers[i];
-    render_pass_info.renderArea.offset = { 0, 0 };
-    render_pass_info.renderArea.extent = _swapchain_extent;
-    render_pass_info.clearValueCount = 1;
-    render_pass_info.pClearValues = &clear_color;
-
-    vkCmdBeginRenderPass(_command_buffers[i], &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
-    vkCmdBindPipeline(_command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, _graphics_pipeline);
-
-    VkBuffer vertex_buffers[] = { _positions_vertex_buffer, _colors_vertex_buffer };
-    VkDeviceSize offsets[] = { 0, 0 };
-    vkCmdBindVertexBuffers(_command_buffers[i], 0, 2, vertex_buffers, offsets);
-    vkCmdBindDescriptorSets(_command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, _pipeline_layout, 0, 1, &_descriptor_set, 0, nullptr);
-    vkCmdBindIndexBuffer(_command_buffers[i], _indices_buffer, 0, VK_INDEX_TYPE_UINT16);
-
-    // HARDCODED INDEX COUNT
-    vkCmdDrawIndexed(_command_buffers[i], 36, 1, 0, 0, 0);
-    vkCmdEndRenderPass(_command_buffers[i]);
-
-    result = vkEndCommandBuffer(_command_buffers[i]);
-    if (result != VK_SUCCESS)
+    if (i == 0 || DrawKey::material(key) != DrawKey::material(previous))
     {
-      LOG_ERROR("Render", "Failed to record command buffer");
-      return 0;
+      vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipeline_layout, 0, 1, &_descriptor_set, 0, nullptr);
+    }
+
+    // Culled clusters append 32 bit indices to a buffer of their own
+    uint32_t index_binding = packets[i].index_binding;
+    if (i == 0 || index_binding != packets[i - 1].index_binding)
+    {
+      VkBuffer index_buffer = index_binding == kIndexBinding_Clusters ? _clusters.indexBuffer() :
+        _geometry.indexBuffer();
+      VkIndexType index_type = index_binding == kIndexBinding_Arena16 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+      vkCmdBindIndexBuffer(command_buffer, index_buffer, 0, index_type);
+    }
+
+    // The uniform buffer only holds the cube matrix
+    const RenderMesh& mesh = _meshes[DrawKey::mesh(key)];
+    if (index_binding == kIndexBinding_Clusters)
+    {
+      _clusters.draw(command_buffer, _cluster_draws[packets[i].object]);
+    }
+    else
+    {
+      const MeshLod& lod = mesh.lods[packets[i].lod];
+      vkCmdDrawIndexed(command_buffer, lod.index_count, 1, mesh.geometry.first_index + lod.index_offset,
+        mesh.geometry.vertex_offset, 0);
     }
   }
+  vkCmdEndRenderPass(command_buffer);
 
-  VkSemaphoreCreateInfo semaphore_info = {};
-  semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  _profiler.endPass(command_buffer, image_index, main_pass);
 
-  VkFenceCreateInfo fence_info = {};
-  fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-  fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+  if (state.frame != _last_frame)
+  {
+    _capture.recordCopy(command_buffer, _swapchain_images[image_index], state.frame, _timeline.pendingValue());
+    _last_frame = state.frame;
+  }
 
-  if (vkCreateSemaphore(_device, &semaphore_info, nullptr, &_image_ready_semaphore) != VK_SUCCESS ||
-      vkCreateSemaphore(_device, &semaphore_info, nullptr, &_render_finished_semaphore) != VK_SUCCESS ||
-      vkCreateFence(_device, &fence_info, nullptr, &_frame_fence) != VK_SUCCESS)
+  result = vkEndCommandBuffer(command_buffer);
+  if (result != VK_SUCCESS)
   {
-    LOG_ERROR("Render", "Failed creating semaphore");
+    LOG_ERROR("Render", "Failed to record command buffer");
     return 0;
   }
 
-  LOG_DEBUG("Render", "Command buffer created succesfully");
   return 1;
 }
 
@@ -1043,7 +1311,16 @@ int Render::recreateSwapChain()
   std::cout << "\n";
   LOG_DEBUG("Render", "Recreating swapchain");
 
-  vkDeviceWaitIdle(_device);
+  // Nothing is destroyed here, the old objects go to the deletion queue.
+  // Capture slots are resized in place, so only they wait for the last frame.
+  if (_capture.enabled())
+  {
+    _timeline.wait(_frame_value);
+  }
+
+  // A build in flight targets the old render pass and extent, the pipeline
+  // is rebuilt below from the current shaders anyway
+  cancelPipelineBuild();
 
   cleanup();
 
@@ -1073,19 +1350,23 @@ int Render::recreateSwapChain()
   return 1;
 }
 
-void Render::update()
+void Render::update(double time)
 {
-  static std::chrono::steady_clock::time_point start_time = std::chrono::high_resolution_clock::now();
+  // Wrap in double precision so long runs keep a stable angle
+  float angle = (float) fmod(time * 90.0, 360.0);
 
-  std::chrono::steady_clock::time_point current_time = std::chrono::high_resolution_clock::now();
-  float time = std::chrono::duration<float, std::chrono::seconds::period>(current_time - start_time).count();
+  _scene.setRotation(_cube, glm::angleAxis(glm::radians(angle), glm::vec3(0.0f, 0.0f, 1.0f)));
+  _scene.updateTransforms();
+  _bvh.update(_scene);
 
   UniformBufferObject uniform = {};
-  uniform.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-  uniform.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-  uniform.projection = glm::perspective(glm::radians(45.0f), _swapchain_extent.width / (float) _swapchain_extent.height, 0.1f, 10.0f);
+  uniform.model = _scene.worldMatrix(_cube) * _meshes[_scene.meshIds()[_scene.index(_cube)]].dequantize;
+  _view_position = glm::vec3(2.0f, 2.0f, 2.0f);
+  uniform.view = glm::lookAt(_view_position, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+  uniform.projection = glm::perspective(glm::radians(kFieldOfView), _swapchain_extent.width / (float) _swapchain_extent.height, kNearPlane, kFarPlane);
 
   uniform.projection[1][1] *= -1;
+  _view_projection = uniform.projection * uniform.view;
 
   void* data;
   vkMapMemory(_device, _uniform_buffer_memory, 0, sizeof(uniform), 0, &data);
@@ -1093,6 +1374,95 @@ void Render::update()
   vkUnmapMemory(_device, _uniform_buffer_memory);
 }
 
+void Render::cull()
+{
+  Frustum frustum;
+  frustum.setMatrix(_view_projection);
+  _bvh.cull(frustum, &_visible);
+
+  if (_occluders.empty() || _visible.empty())
+  {
+    return;
+  }
+
+  // Fixed width, the height follows the aspect of the swapchain
+  uint32_t width = kOcclusionWidth;
+  uint32_t height = _swapchain_extent.width > 0 ? width * _swapchain_extent.height / _swapchain_extent.width : width;
+  height = (height + 7) & ~7u;
+  if (_occlusion.width() != width || _occlusion.height() != height)
+  {
+    _occlusion.init(width, height);
+  }
+
+  _occlusion.clear(_view_projection);
+  for (const Occluder& occluder : _occluders)
+  {
+    if (_scene.valid(occluder.object))
+    {
+      _occlusion.renderOccluder(_scene.worldMatrix(occluder.object), occluder.positions.data(),
+        (uint32_t) occluder.positions.size(), occluder.indices.data(), (uint32_t) occluder.indices.size());
+    }
+  }
+  _occlusion.filter(_scene.worldBoundsMin(), _scene.worldBoundsMax(), &_visible);
+}
+
+void Render::sortDraws()
+{
+  const glm::vec3* bounds_min = _scene.worldBoundsMin();
+  const glm::vec3* bounds_max = _scene.worldBoundsMax();
+  const uint32_t* mesh_ids = _scene.meshIds();
+  const uint32_t* material_ids = _scene.materialIds();
+
+  uint32_t count = (uint32_t) _visible.size();
+  float projection_scale = _swapchain_extent.height / (2.0f * tanf(glm::radians(kFieldOfView) * 0.5f));
+  _draw_levels.resize(count);
+  _lod_selector.select(_scene, _view_position, projection_scale, _lod_chains.data(), (uint32_t) _lod_chains.size(),
+    _visible.data(), count, _draw_levels.data());
+
+  // The finest level of meshes with clusters is culled per cluster on the
+  // GPU, coarser levels are cheap enough to draw whole
+  _clusters.begin(_view_projection, _view_position);
+  if (!_occluders.empty())
+  {
+    _clusters.setOcclusion(_occlusion);
+  }
+
+  const glm::mat4* world_matrices = _scene.worldMatrices();
+  _cluster_draws.resize(_scene.count());
+  _draw_queue.clear();
+  for (uint32_t i = 0; i < count; i++)
+  {
+    uint32_t object = _visible[i];
+    const RenderMesh& mesh = _meshes[mesh_ids[object]];
+    _cluster_draws[object] = _draw_levels[i] == 0 ? _clusters.add(world_matrices[object], mesh.geometry,
+      mesh.lods[0].index_count / 3) : UINT32_MAX;
+
+    uint32_t index_binding = mesh.geometry.index_type == VK_INDEX_TYPE_UINT16 ? kIndexBinding_Arena16 :
+      kIndexBinding_Arena32;
+    if (_cluster_draws[object] != UINT32_MAX)
+    {
+      index_binding = kIndexBinding_Clusters;
+    }
+
+    // Clip w is the view depth of the bounds center
+    glm::vec3 center = (bounds_min[object] + bounds_max[object]) * 0.5f;
+    float depth = (_view_projection * glm::vec4(center, 1.0f)).w / kFarPlane;
+    _draw_queue.add(DrawKey::make(kDrawPass_Opaque, 0, material_ids[object], mesh_ids[object], depth), object,
+      _draw_levels[i], index_binding);
+  }
+  _draw_queue.sort();
+}
+
+void Render::addOccluder(SceneHandle object, const glm::vec3* positions, uint32_t vertex_count,
+  const uint32_t* indices, uint32_t index_count)
+{
+  Occluder occluder;
+  occluder.object = object;
+  occluder.positions.assign(positions, positions + vertex_count);
+  occluder.indices.assign(indices, indices + index_count);
+  _occluders.push_back(std::move(occluder));
+}
+
 int Render::pickPhysicalDevice(const std::vector<char*>& device_extensions)
 {
   std::cout << "\n";
@@ -1119,8 +1489,23 @@ int Render::pickPhysicalDevice(const std::vector<char*>& device_extensions)
     VkPhysicalDeviceProperties properties;
     vkGetPhysicalDeviceProperties(devices[i], &properties);
 
+    // Synchronization is built on timeline semaphores
+    VkPhysicalDeviceVulkan12Features vulkan12_features = {};
+    vulkan12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+    VkPhysicalDeviceFeatures2 features = {};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &vulkan12_features;
+
+    bool timeline_support = false;
+    if (properties.apiVersion >= VK_API_VERSION_1_2)
+    {
+      vkGetPhysicalDeviceFeatures2(devices[i], &features);
+      timeline_support = vulkan12_features.timelineSemaphore == VK_TRUE;
+    }
+
     // We just want dedicated GPUs
-    if (properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
+    if (properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU && timeline_support)
     {
 
       uint32_t count;
@@ -1184,12 +1569,12 @@ uint32_t Render::findMemoryType(uint32_t filter, VkMemoryPropertyFlags propertie
   return UINT32_MAX;
 }
 
-VkShaderModule Render::createShaderModule(const std::vector<char>& code) const
+VkShaderModule Render::createShaderModule(const void* code, size_t size) const
 {
   VkShaderModuleCreateInfo create_info = {};
   create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-  create_info.codeSize = code.size();
-  create_info.pCode = reinterpret_cast<const uint32_t*>(code.data());
+  create_info.codeSize = size;
+  create_info.pCode = reinterpret_cast<const uint32_t*>(code);
 
   VkShaderModule shader_module = {};
   VkResult result = vkCreateShaderModule(_device, &create_info, nullptr, &shader_module);
@@ -1204,17 +1589,19 @@ VkShaderModule Render::createShaderModule(const std::vector<char>& code) const
 
 void Render::cleanup()
 {
+  // The last submitted frame may still use any of these. The swapchain is
+  // kept so it can be handed to its replacement as oldSwapchain.
+  uint64_t value = _timeline.submittedValue();
+
   for (size_t i = 0; i < _swapchain_image_views.size(); i++)
   {
-    vkDestroyImageView(_device, _swapchain_image_views[i], nullptr);
-    vkDestroyFramebuffer(_device, _swapchain_framebuffers[i], nullptr);
+    _deletion_queue.destroyImageView(_swapchain_image_views[i], value);
+    _deletion_queue.destroyFramebuffer(_swapchain_framebuffers[i], value);
   }
 
-  vkFreeCommandBuffers(_device, _command_pool, static_cast<uint32_t>(_command_buffers.size()), _command_buffers.data());
-
-  vkDestroyPipeline(_device, _graphics_pipeline, nullptr);
-  vkDestroyPipelineLayout(_device, _pipeline_layout, nullptr);
-  vkDestroyRenderPass(_device, _render_pass, nullptr);
+  _deletion_queue.freeCommandBuffers(_command_pool, _command_buffers, value);
+  _command_buffers.clear();
 
-  vkDestroySwapchainKHR(_device, _swapchain, nullptr);
+  _deletion_queue.destroyPipeline(_graphics_pipeline, value);
+  _deletion_queue.destroyRenderPass(_render_pass, value);
 }
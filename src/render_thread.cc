@@ -0,0 +1,117 @@
+#include "render_thread.h"
+
+#include "logger.h"
+
+RenderThread::RenderThread()
+{
+  _running = false;
+  _wake_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+  _consumed_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+}
+
+RenderThread::~RenderThread()
+{
+  stop();
+
+  CloseHandle(_wake_event);
+  CloseHandle(_consumed_event);
+}
+
+int RenderThread::start(Render* render)
+{
+  if (_running)
+  {
+    LOG_WARNING("RenderThread", "Render thread already running");
+    return 1;
+  }
+
+  if (_wake_event == NULL || _consumed_event == NULL)
+  {
+    LOG_ERROR("RenderThread", "Failed creating render thread events");
+    return 0;
+  }
+
+  _render = render;
+  _running = true;
+  _thread = std::thread(&RenderThread::loop, this);
+
+  LOG_DEBUG("RenderThread", "Render thread started");
+  return 1;
+}
+
+void RenderThread::stop()
+{
+  if (!_running)
+  {
+    return;
+  }
+
+  _running = false;
+  SetEvent(_wake_event);
+  _thread.join();
+
+  LOG_DEBUG("RenderThread", "Render thread stopped");
+}
+
+void RenderThread::publish()
+{
+  _states.publish();
+  SetEvent(_wake_event);
+}
+
+void RenderThread::postEvent(const RenderEvent& event)
+{
+  if (!_events.push(event))
+  {
+    LOG_WARNING("RenderThread", "Render event queue full, dropping event");
+    return;
+  }
+
+  SetEvent(_wake_event);
+}
+
+void RenderThread::loop()
+{
+  bool minimized = false;
+  bool has_state = false;
+
+  while (_running.load())
+  {
+    RenderEvent event;
+    while (_events.pop(&event))
+    {
+      switch (event.type)
+      {
+      case kRenderEventType_Resize: {
+        minimized = event.width == 0 || event.height == 0;
+        _render->_resize = true;
+        break;
+      }
+      }
+    }
+
+    // A zero sized swapchain can not be created, leave states unconsumed
+    // so the simulation pauses too
+    if (minimized)
+    {
+      WaitForSingleObject(_wake_event, INFINITE);
+      continue;
+    }
+
+    if (!_states.pending())
+    {
+      WaitForSingleObject(_wake_event, kStaleRedrawMs);
+    }
+
+    if (_states.consume())
+    {
+      has_state = true;
+      SetEvent(_consumed_event);
+    }
+
+    if (has_state && _running.load())
+    {
+      _render->drawFrame(_states.front());
+    }
+  }
+}
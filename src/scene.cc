@@ -0,0 +1,284 @@
+#include "scene.h"
+
+#include <algorithm>
+
+#include "job_system.h"
+#include "simd.h"
+
+// Objects per job, a batch of matrices is a few pages of each array
+static const uint32_t kTransformBatch = 4096;
+
+// Moves every element to its new position, order[new] = old
+template<typename T>
+static void gather(std::vector<T>* values, const std::vector<uint32_t>& order)
+{
+  std::vector<T> gathered(order.size());
+  for (size_t i = 0; i < order.size(); i++)
+  {
+    gathered[i] = (*values)[order[i]];
+  }
+  values->swap(gathered);
+}
+
+SceneHandle Scene::create(SceneHandle parent, uint32_t mesh_id, uint32_t material_id)
+{
+  uint32_t parent_index = valid(parent) ? index(parent) : kNoParent;
+  uint32_t dense = count();
+
+  SceneHandle handle;
+  if (_free_slot != UINT32_MAX)
+  {
+    handle.slot = _free_slot;
+    _free_slot = _slots[_free_slot].index;
+  }
+  else
+  {
+    handle.slot = (uint32_t) _slots.size();
+    _slots.push_back(Slot());
+    _slots.back().generation = 0;
+  }
+  _slots[handle.slot].index = dense;
+  handle.generation = _slots[handle.slot].generation;
+
+  // Parents always exist already, so they precede the new object. Depth
+  // order only holds while objects are added level by level.
+  uint32_t depth = parent_index == kNoParent ? 0 : _depths[parent_index] + 1;
+  if (dense == 0)
+  {
+    _levels.assign(1, 0);
+    _levels.push_back(1);
+  }
+  else if (depth == _depths[dense - 1])
+  {
+    _levels.back() = dense + 1;
+  }
+  else if (depth == _depths[dense - 1] + 1)
+  {
+    _levels.push_back(dense + 1);
+  }
+  else
+  {
+    _sorted = false;
+  }
+
+  _handles.push_back(handle.slot);
+  _parents.push_back(parent_index);
+  _depths.push_back(depth);
+  _positions.push_back(glm::vec3(0.0f));
+  _rotations.push_back(glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+  _scales.push_back(glm::vec3(1.0f));
+  _world_matrices.push_back(glm::mat4(1.0f));
+  _bounds_min.push_back(glm::vec3(0.0f));
+  _bounds_max.push_back(glm::vec3(0.0f));
+  _world_bounds_min.push_back(glm::vec3(0.0f));
+  _world_bounds_max.push_back(glm::vec3(0.0f));
+  _mesh_ids.push_back(mesh_id);
+  _material_ids.push_back(material_id);
+  _layout_version++;
+
+  return handle;
+}
+
+void Scene::destroy(SceneHandle handle)
+{
+  if (!valid(handle))
+  {
+    return;
+  }
+
+  // Children follow their parents, so one pass finds the whole subtree
+  if (!_sorted)
+  {
+    sortByDepth();
+  }
+
+  uint32_t object_count = count();
+  std::vector<uint8_t> removed(object_count, 0);
+  removed[index(handle)] = 1;
+
+  std::vector<uint32_t> order;
+  order.reserve(object_count);
+
+  for (uint32_t i = 0; i < object_count; i++)
+  {
+    if (removed[i] || (_parents[i] != kNoParent && removed[_parents[i]]))
+    {
+      removed[i] = 1;
+
+      Slot& slot = _slots[_handles[i]];
+      slot.generation++;
+      slot.index = _free_slot;
+      _free_slot = _handles[i];
+    }
+    else
+    {
+      order.push_back(i);
+    }
+  }
+
+  // A stable compaction keeps the depth order, only the levels move
+  reorder(order);
+  _sorted = false;
+}
+
+bool Scene::valid(SceneHandle handle) const
+{
+  return handle.slot < _slots.size() && _slots[handle.slot].generation == handle.generation;
+}
+
+int Scene::setParent(SceneHandle handle, SceneHandle parent)
+{
+  if (!valid(handle))
+  {
+    return 0;
+  }
+
+  uint32_t object = index(handle);
+  uint32_t parent_index = valid(parent) ? index(parent) : kNoParent;
+
+  for (uint32_t ancestor = parent_index; ancestor != kNoParent; ancestor = _parents[ancestor])
+  {
+    if (ancestor == object)
+    {
+      return 0;
+    }
+  }
+
+  _parents[object] = parent_index;
+  _sorted = false;
+  return 1;
+}
+
+void Scene::setBounds(SceneHandle handle, const glm::vec3& bounds_min, const glm::vec3& bounds_max)
+{
+  uint32_t object = index(handle);
+  _bounds_min[object] = bounds_min;
+  _bounds_max[object] = bounds_max;
+}
+
+void Scene::updateTransforms()
+{
+  if (!_sorted)
+  {
+    sortByDepth();
+  }
+
+  for (size_t level = 0; level + 1 < _levels.size(); level++)
+  {
+    uint32_t begin = _levels[level];
+    uint32_t end = _levels[level + 1];
+
+    JobSystem::parallelFor(end - begin, kTransformBatch, [this, begin](uint32_t first, uint32_t last) {
+      updateRange(begin + first, begin + last);
+    });
+  }
+}
+
+void Scene::updateRange(uint32_t begin, uint32_t end)
+{
+  // Local matrices of the whole range first, several objects per instruction
+  Simd::composeTransforms(&_positions[begin], &_rotations[begin], &_scales[begin], end - begin, &_world_matrices[begin]);
+
+  for (uint32_t i = begin; i < end; i++)
+  {
+    uint32_t parent = _parents[i];
+    if (parent != kNoParent)
+    {
+      _world_matrices[i] = _world_matrices[parent] * _world_matrices[i];
+    }
+    const glm::mat4& world = _world_matrices[i];
+
+    // Box of the transformed box, from its center and half extents
+    glm::vec3 center = (_bounds_min[i] + _bounds_max[i]) * 0.5f;
+    glm::vec3 extent = (_bounds_max[i] - _bounds_min[i]) * 0.5f;
+
+    glm::vec3 world_center = glm::vec3(world * glm::vec4(center, 1.0f));
+    glm::vec3 world_extent =
+      glm::abs(glm::vec3(world[0])) * extent.x +
+      glm::abs(glm::vec3(world[1])) * extent.y +
+      glm::abs(glm::vec3(world[2])) * extent.z;
+
+    _world_bounds_min[i] = world_center - world_extent;
+    _world_bounds_max[i] = world_center + world_extent;
+  }
+}
+
+void Scene::sortByDepth()
+{
+  uint32_t object_count = count();
+
+  // Walks up to the first ancestor with a known depth, then fills the chain
+  std::vector<uint32_t> chain;
+  std::fill(_depths.begin(), _depths.end(), UINT32_MAX);
+
+  uint32_t max_depth = 0;
+  for (uint32_t i = 0; i < object_count; i++)
+  {
+    uint32_t ancestor = i;
+    while (ancestor != kNoParent && _depths[ancestor] == UINT32_MAX)
+    {
+      chain.push_back(ancestor);
+      ancestor = _parents[ancestor];
+    }
+
+    uint32_t depth = ancestor == kNoParent ? 0 : _depths[ancestor] + 1;
+    for (size_t j = chain.size(); j-- > 0;)
+    {
+      _depths[chain[j]] = depth++;
+    }
+    chain.clear();
+
+    max_depth = _depths[i] > max_depth ? _depths[i] : max_depth;
+  }
+
+  // Stable counting sort, the level starts are the prefix sums
+  _levels.assign(max_depth + 2, 0);
+  for (uint32_t i = 0; i < object_count; i++)
+  {
+    _levels[_depths[i] + 1]++;
+  }
+  for (size_t level = 1; level < _levels.size(); level++)
+  {
+    _levels[level] += _levels[level - 1];
+  }
+
+  std::vector<uint32_t> order(object_count);
+  std::vector<uint32_t> next(_levels.begin(), _levels.end() - 1);
+  for (uint32_t i = 0; i < object_count; i++)
+  {
+    order[next[_depths[i]]++] = i;
+  }
+
+  reorder(order);
+  _sorted = true;
+}
+
+void Scene::reorder(const std::vector<uint32_t>& order)
+{
+  std::vector<uint32_t> new_index(count(), (uint32_t) kNoParent);
+  for (uint32_t i = 0; i < order.size(); i++)
+  {
+    new_index[order[i]] = i;
+  }
+
+  gather(&_handles, order);
+  gather(&_parents, order);
+  gather(&_depths, order);
+  gather(&_positions, order);
+  gather(&_rotations, order);
+  gather(&_scales, order);
+  gather(&_world_matrices, order);
+  gather(&_bounds_min, order);
+  gather(&_bounds_max, order);
+  gather(&_world_bounds_min, order);
+  gather(&_world_bounds_max, order);
+  gather(&_mesh_ids, order);
+  gather(&_material_ids, order);
+
+  for (uint32_t i = 0; i < order.size(); i++)
+  {
+    _parents[i] = _parents[i] == kNoParent ? kNoParent : new_index[_parents[i]];
+    _slots[_handles[i]].index = i;
+  }
+  _layout_version++;
+}
@@ -0,0 +1,714 @@
+#include "shader_reflection.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "spirv-headers/spirv.h"
+
+#include "logger.h"
+
+static const uint32_t kNone = UINT32_MAX;
+
+// What the parser keeps about every result id
+struct SpirvId
+{
+  // Defining instruction, 0 for ids that are only decorated. Scan checks
+  // the word count against the operands read for every opcode kept.
+  uint32_t opcode = 0;
+  uint32_t word = 0;
+
+  uint32_t location = kNone;
+  uint32_t binding = kNone;
+  uint32_t set = kNone;
+  uint32_t array_stride = 0;
+  bool built_in = false;
+  bool block = false;
+  bool buffer_block = false;
+  // Value of integer constants
+  uint32_t constant = 0;
+};
+
+class SpirvModule
+{
+public:
+  SpirvModule(const uint32_t* words, size_t count) : _words(words), _count(count) { }
+
+  int scan();
+  int reflect(VkShaderStageFlags* stages, std::vector<ShaderInput>* inputs,
+    std::vector<ShaderBinding>* bindings, VkPushConstantRange* push_constants);
+
+private:
+  // 0 for ids out of bounds or without a defining instruction
+  uint32_t opcodeOf(uint32_t id) const { return id < _ids.size() ? _ids[id].opcode : 0; }
+  // Only for ids whose opcode was checked
+  const uint32_t* instruction(uint32_t id) const { return _words + _ids[id].word; }
+  int define(uint32_t id, uint32_t opcode, size_t word);
+  uint32_t memberDecoration(uint32_t id, uint32_t member, SpvDecoration decoration) const;
+
+  uint32_t typeSize(uint32_t type, uint32_t matrix_stride) const;
+  VkFormat inputFormat(uint32_t type) const;
+  int descriptorType(uint32_t type, SpvStorageClass storage, VkDescriptorType* descriptor_type) const;
+
+  const uint32_t* _words;
+  size_t _count;
+  std::vector<SpirvId> _ids;
+  std::vector<uint32_t> _variables;
+  std::unordered_map<uint64_t, uint32_t> _member_decorations;
+  VkShaderStageFlags _stages = 0;
+};
+
+static uint64_t memberKey(uint32_t id, uint32_t member, uint32_t decoration)
+{
+  return ((uint64_t) id << 32) | ((uint64_t) member << 8) | (decoration & 0xFF);
+}
+
+static VkShaderStageFlags stageFlag(uint32_t execution_model)
+{
+  switch (execution_model)
+  {
+  case SpvExecutionModelVertex: return VK_SHADER_STAGE_VERTEX_BIT;
+  case SpvExecutionModelTessellationControl: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+  case SpvExecutionModelTessellationEvaluation: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+  case SpvExecutionModelGeometry: return VK_SHADER_STAGE_GEOMETRY_BIT;
+  case SpvExecutionModelFragment: return VK_SHADER_STAGE_FRAGMENT_BIT;
+  case SpvExecutionModelGLCompute: return VK_SHADER_STAGE_COMPUTE_BIT;
+  default: return 0;
+  }
+}
+
+// Least word count of the type declarations kept, so every operand read
+// later is inside the instruction
+static uint32_t typeLength(uint32_t opcode)
+{
+  switch (opcode)
+  {
+  case SpvOpTypeFloat: return 3;
+  case SpvOpTypeInt: return 4;
+  case SpvOpTypeVector: return 4;
+  case SpvOpTypeMatrix: return 4;
+  case SpvOpTypeImage: return 9;
+  case SpvOpTypeSampledImage: return 3;
+  case SpvOpTypeArray: return 4;
+  case SpvOpTypeRuntimeArray: return 3;
+  case SpvOpTypePointer: return 4;
+  default: return 2;
+  }
+}
+
+int SpirvModule::define(uint32_t id, uint32_t opcode, size_t word)
+{
+  if (id >= _ids.size() || _ids[id].opcode != 0)
+  {
+    LOG_ERROR("Reflection", "Invalid or repeated result id %d", id);
+    return 0;
+  }
+
+  _ids[id].opcode = opcode;
+  _ids[id].word = (uint32_t) word;
+  return 1;
+}
+
+int SpirvModule::scan()
+{
+  if (_count < 5 || _words[0] != SpvMagicNumber)
+  {
+    LOG_ERROR("Reflection", "Not a SPIR-V module");
+    return 0;
+  }
+
+  // Every id is defined by an instruction of at least one word, a larger
+  // bound is corrupt
+  uint32_t bound = _words[3];
+  if (bound > _count)
+  {
+    LOG_ERROR("Reflection", "Id bound %d is larger than the module", bound);
+    return 0;
+  }
+  _ids.resize(bound);
+
+  size_t word = 5;
+  while (word < _count)
+  {
+    const uint32_t* op = _words + word;
+    uint32_t opcode = op[0] & SpvOpCodeMask;
+    uint32_t length = op[0] >> SpvWordCountShift;
+
+    if (length == 0 || word + length > _count)
+    {
+      LOG_ERROR("Reflection", "Truncated instruction at word %d", (uint32_t) word);
+      return 0;
+    }
+
+    switch (opcode)
+    {
+    case SpvOpEntryPoint:
+      if (length < 2)
+      {
+        LOG_ERROR("Reflection", "Invalid entry point");
+        return 0;
+      }
+      _stages |= stageFlag(op[1]);
+      break;
+
+    case SpvOpDecorate:
+    {
+      if (length < 3 || op[1] >= bound)
+      {
+        break;
+      }
+
+      SpirvId& target = _ids[op[1]];
+      uint32_t value = length > 3 ? op[3] : 0;
+      switch (op[2])
+      {
+      case SpvDecorationLocation: target.location = value; break;
+      case SpvDecorationBinding: target.binding = value; break;
+      case SpvDecorationDescriptorSet: target.set = value; break;
+      case SpvDecorationArrayStride: target.array_stride = value; break;
+      case SpvDecorationBuiltIn: target.built_in = true; break;
+      case SpvDecorationBlock: target.block = true; break;
+      case SpvDecorationBufferBlock: target.buffer_block = true; break;
+      default: break;
+      }
+      break;
+    }
+
+    case SpvOpMemberDecorate:
+    {
+      if (length < 4 || op[1] >= bound)
+      {
+        break;
+      }
+
+      // A struct with built-in members is gl_PerVertex
+      if (op[3] == SpvDecorationBuiltIn)
+      {
+        _ids[op[1]].built_in = true;
+      }
+      else if (op[3] == SpvDecorationOffset || op[3] == SpvDecorationMatrixStride)
+      {
+        _member_decorations[memberKey(op[1], op[2], op[3])] = length > 4 ? op[4] : 0;
+      }
+      break;
+    }
+
+    case SpvOpTypeVoid:
+    case SpvOpTypeBool:
+    case SpvOpTypeInt:
+    case SpvOpTypeFloat:
+    case SpvOpTypeVector:
+    case SpvOpTypeMatrix:
+    case SpvOpTypeImage:
+    case SpvOpTypeSampler:
+    case SpvOpTypeSampledImage:
+    case SpvOpTypeArray:
+    case SpvOpTypeRuntimeArray:
+    case SpvOpTypeStruct:
+    case SpvOpTypePointer:
+    case SpvOpTypeAccelerationStructureKHR:
+    {
+      if (length < typeLength(opcode))
+      {
+        LOG_ERROR("Reflection", "Invalid type declaration at word %d", (uint32_t) word);
+        return 0;
+      }
+
+      // Types are declared after the types they use, which keeps the type
+      // graph free of cycles. Pointers may point at later structs.
+      uint32_t first = opcode == SpvOpTypeStruct ? 2 : 0;
+      uint32_t last = opcode == SpvOpTypeStruct ? length : 0;
+      if (opcode == SpvOpTypeVector || opcode == SpvOpTypeMatrix || opcode == SpvOpTypeSampledImage ||
+        opcode == SpvOpTypeArray || opcode == SpvOpTypeRuntimeArray)
+      {
+        first = 2;
+        last = 3;
+      }
+      for (uint32_t i = first; i < last; i++)
+      {
+        if (opcodeOf(op[i]) == 0)
+        {
+          LOG_ERROR("Reflection", "Type %d uses undeclared type %d", op[1], op[i]);
+          return 0;
+        }
+      }
+
+      if (!define(op[1], opcode, word))
+      {
+        return 0;
+      }
+      break;
+    }
+
+    case SpvOpConstant:
+      if (length < 4 || !define(op[2], opcode, word))
+      {
+        LOG_ERROR("Reflection", "Invalid constant at word %d", (uint32_t) word);
+        return 0;
+      }
+      _ids[op[2]].constant = op[3];
+      break;
+
+    case SpvOpVariable:
+      if (length < 4 || !define(op[2], opcode, word))
+      {
+        LOG_ERROR("Reflection", "Invalid variable at word %d", (uint32_t) word);
+        return 0;
+      }
+      // Function locals come after the globals and are of no interest
+      if (op[3] != SpvStorageClassFunction)
+      {
+        _variables.push_back(op[2]);
+      }
+      break;
+
+    default:
+      break;
+    }
+
+    word += length;
+  }
+
+  if (_stages == 0)
+  {
+    LOG_ERROR("Reflection", "Module has no supported entry point");
+    return 0;
+  }
+
+  return 1;
+}
+
+uint32_t SpirvModule::memberDecoration(uint32_t id, uint32_t member, SpvDecoration decoration) const
+{
+  auto found = _member_decorations.find(memberKey(id, member, decoration));
+  return found != _member_decorations.end() ? found->second : kNone;
+}
+
+// Size of a type laid out with its explicit offsets and strides
+uint32_t SpirvModule::typeSize(uint32_t type, uint32_t matrix_stride) const
+{
+  if (opcodeOf(type) == 0)
+  {
+    return 0;
+  }
+
+  const uint32_t* op = instruction(type);
+  switch (_ids[type].opcode)
+  {
+  case SpvOpTypeBool:
+    return 4;
+
+  case SpvOpTypeInt:
+  case SpvOpTypeFloat:
+    return op[2] / 8;
+
+  case SpvOpTypeVector:
+    return typeSize(op[2], 0) * op[3];
+
+  case SpvOpTypeMatrix:
+    return (matrix_stride != kNone && matrix_stride != 0 ? matrix_stride : typeSize(op[2], 0)) * op[3];
+
+  case SpvOpTypeArray:
+  {
+    uint32_t length = opcodeOf(op[3]) == SpvOpConstant ? _ids[op[3]].constant : 0;
+    uint32_t stride = _ids[type].array_stride != 0 ? _ids[type].array_stride : typeSize(op[2], matrix_stride);
+    return stride * length;
+  }
+
+  case SpvOpTypeStruct:
+  {
+    uint32_t member_count = (op[0] >> SpvWordCountShift) - 2;
+    uint32_t size = 0;
+
+    for (uint32_t i = 0; i < member_count; i++)
+    {
+      uint32_t offset = memberDecoration(type, i, SpvDecorationOffset);
+      uint32_t end = (offset != kNone ? offset : size) +
+        typeSize(op[2 + i], memberDecoration(type, i, SpvDecorationMatrixStride));
+      size = end > size ? end : size;
+    }
+
+    return size;
+  }
+
+  // Runtime arrays are sized by the buffer bound to them
+  default:
+    return 0;
+  }
+}
+
+VkFormat SpirvModule::inputFormat(uint32_t type) const
+{
+  uint32_t components = 1;
+  if (opcodeOf(type) == SpvOpTypeVector)
+  {
+    components = instruction(type)[3];
+    type = instruction(type)[2];
+  }
+
+  if (opcodeOf(type) != SpvOpTypeFloat && opcodeOf(type) != SpvOpTypeInt)
+  {
+    return VK_FORMAT_UNDEFINED;
+  }
+
+  const uint32_t* op = instruction(type);
+  if (op[2] != 32 || components < 1 || components > 4)
+  {
+    return VK_FORMAT_UNDEFINED;
+  }
+
+  static const VkFormat float_formats[] = {
+    VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT
+  };
+  static const VkFormat int_formats[] = {
+    VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT
+  };
+  static const VkFormat uint_formats[] = {
+    VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT
+  };
+
+  switch (_ids[type].opcode)
+  {
+  case SpvOpTypeFloat: return float_formats[components - 1];
+  case SpvOpTypeInt: return op[3] ? int_formats[components - 1] : uint_formats[components - 1];
+  default: return VK_FORMAT_UNDEFINED;
+  }
+}
+
+int SpirvModule::descriptorType(uint32_t type, SpvStorageClass storage, VkDescriptorType* descriptor_type) const
+{
+  if (opcodeOf(type) == 0)
+  {
+    return 0;
+  }
+
+  const uint32_t* op = instruction(type);
+  switch (_ids[type].opcode)
+  {
+  case SpvOpTypeStruct:
+    if (storage == SpvStorageClassStorageBuffer || _ids[type].buffer_block)
+    {
+      *descriptor_type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      return 1;
+    }
+    if (storage == SpvStorageClassUniform && _ids[type].block)
+    {
+      *descriptor_type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+      return 1;
+    }
+    return 0;
+
+  case SpvOpTypeSampler:
+    *descriptor_type = VK_DESCRIPTOR_TYPE_SAMPLER;
+    return 1;
+
+  case SpvOpTypeSampledImage:
+  {
+    // Sampled buffer images are uniform texel buffers
+    if (opcodeOf(op[2]) != SpvOpTypeImage)
+    {
+      return 0;
+    }
+    const uint32_t* image = instruction(op[2]);
+    *descriptor_type = image[3] == SpvDimBuffer ?
+      VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    return 1;
+  }
+
+  case SpvOpTypeImage:
+  {
+    // Dim, then sampled is 1 for sampled and 2 for storage images
+    uint32_t dim = op[3];
+    bool storage_image = op[7] == 2;
+
+    if (dim == SpvDimSubpassData)
+    {
+      *descriptor_type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+    }
+    else if (dim == SpvDimBuffer)
+    {
+      *descriptor_type = storage_image ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+    }
+    else
+    {
+      *descriptor_type = storage_image ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    }
+    return 1;
+  }
+
+  case SpvOpTypeAccelerationStructureKHR:
+    *descriptor_type = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+    return 1;
+
+  default:
+    return 0;
+  }
+}
+
+int SpirvModule::reflect(VkShaderStageFlags* stages, std::vector<ShaderInput>* inputs,
+  std::vector<ShaderBinding>* bindings, VkPushConstantRange* push_constants)
+{
+  *stages = _stages;
+
+  for (size_t i = 0; i < _variables.size(); i++)
+  {
+    uint32_t id = _variables[i];
+    const SpirvId& variable = _ids[id];
+    const uint32_t* op = instruction(id);
+    SpvStorageClass storage = (SpvStorageClass) op[3];
+
+    uint32_t pointer = op[1];
+    if (opcodeOf(pointer) != SpvOpTypePointer)
+    {
+      LOG_ERROR("Reflection", "Variable %d is not a pointer", id);
+      return 0;
+    }
+    uint32_t type = instruction(pointer)[3];
+    if (opcodeOf(type) == 0)
+    {
+      LOG_ERROR("Reflection", "Variable %d has an invalid type", id);
+      return 0;
+    }
+
+    if (storage == SpvStorageClassInput)
+    {
+      if (!(_stages & VK_SHADER_STAGE_VERTEX_BIT) || variable.built_in || _ids[type].built_in)
+      {
+        continue;
+      }
+
+      ShaderInput input = {};
+      input.location = variable.location;
+      input.format = _ids[type].opcode == SpvOpTypeVector || _ids[type].opcode == SpvOpTypeInt ||
+        _ids[type].opcode == SpvOpTypeFloat ? inputFormat(type) : VK_FORMAT_UNDEFINED;
+
+      if (input.location == kNone || input.format == VK_FORMAT_UNDEFINED)
+      {
+        LOG_ERROR("Reflection", "Unsupported vertex input %d, only located 32 bit scalars and vectors are", id);
+        return 0;
+      }
+
+      inputs->push_back(input);
+    }
+    else if (storage == SpvStorageClassPushConstant)
+    {
+      push_constants->stageFlags = _stages;
+      push_constants->offset = 0;
+      push_constants->size = typeSize(type, kNone);
+    }
+    else if (storage == SpvStorageClassUniform || storage == SpvStorageClassUniformConstant ||
+      storage == SpvStorageClassStorageBuffer)
+    {
+      ShaderBinding binding = {};
+      binding.set = variable.set != kNone ? variable.set : 0;
+      binding.binding = variable.binding;
+      binding.count = 1;
+      binding.stages = _stages;
+
+      // Arrays of descriptors, possibly nested
+      while (_ids[type].opcode == SpvOpTypeArray || _ids[type].opcode == SpvOpTypeRuntimeArray)
+      {
+        if (_ids[type].opcode == SpvOpTypeRuntimeArray)
+        {
+          LOG_ERROR("Reflection", "Unsized descriptor array %d is not supported", id);
+          return 0;
+        }
+
+        uint32_t length = instruction(type)[3];
+        if (opcodeOf(length) != SpvOpConstant)
+        {
+          LOG_ERROR("Reflection", "Descriptor array %d has no constant length", id);
+          return 0;
+        }
+        binding.count *= _ids[length].constant;
+        type = instruction(type)[2];
+      }
+
+      if (binding.binding == kNone || !descriptorType(type, storage, &binding.type))
+      {
+        LOG_ERROR("Reflection", "Unsupported resource %d", id);
+        return 0;
+      }
+
+      if (binding.type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER || binding.type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      {
+        binding.size = typeSize(type, kNone);
+      }
+
+      bindings->push_back(binding);
+    }
+  }
+
+  return 1;
+}
+
+int ShaderReflection::parse(const void* code, size_t size)
+{
+  *this = ShaderReflection();
+
+  if (size % sizeof(uint32_t) != 0)
+  {
+    LOG_ERROR("Reflection", "SPIR-V size is not a multiple of 4");
+    return 0;
+  }
+
+  SpirvModule module((const uint32_t*) code, size / sizeof(uint32_t));
+  std::vector<ShaderBinding> bindings;
+
+  if (!module.scan() || !module.reflect(&_stages, &_inputs, &bindings, &_push_constants))
+  {
+    *this = ShaderReflection();
+    return 0;
+  }
+
+  for (size_t i = 0; i < bindings.size(); i++)
+  {
+    addBinding(bindings[i]);
+  }
+
+  std::sort(_inputs.begin(), _inputs.end(),
+    [](const ShaderInput& a, const ShaderInput& b) { return a.location < b.location; });
+
+  return 1;
+}
+
+void ShaderReflection::addBinding(const ShaderBinding& binding)
+{
+  auto position = std::lower_bound(_bindings.begin(), _bindings.end(), binding,
+    [](const ShaderBinding& a, const ShaderBinding& b) { return a.set < b.set || (a.set == b.set && a.binding < b.binding); });
+  _bindings.insert(position, binding);
+}
+
+int ShaderReflection::merge(const ShaderReflection& other)
+{
+  for (size_t i = 0; i < other._bindings.size(); i++)
+  {
+    const ShaderBinding& binding = other._bindings[i];
+    ShaderBinding* existing = nullptr;
+    for (size_t j = 0; j < _bindings.size() && existing == nullptr; j++)
+    {
+      if (_bindings[j].set == binding.set && _bindings[j].binding == binding.binding)
+      {
+        existing = &_bindings[j];
+      }
+    }
+
+    if (existing == nullptr)
+    {
+      addBinding(binding);
+      continue;
+    }
+
+    if (existing->type != binding.type || existing->count != binding.count)
+    {
+      LOG_ERROR("Reflection", "Stages disagree on set %d binding %d", binding.set, binding.binding);
+      return 0;
+    }
+
+    existing->stages |= binding.stages;
+    existing->size = existing->size > binding.size ? existing->size : binding.size;
+  }
+
+  // A single range visible to every stage that declares push constants
+  if (other.hasPushConstants())
+  {
+    _push_constants.stageFlags |= other._push_constants.stageFlags;
+    _push_constants.size = _push_constants.size > other._push_constants.size ? _push_constants.size : other._push_constants.size;
+  }
+
+  if (other._stages & VK_SHADER_STAGE_VERTEX_BIT)
+  {
+    _inputs = other._inputs;
+  }
+
+  _stages |= other._stages;
+  return 1;
+}
+
+const ShaderBinding* ShaderReflection::findBinding(uint32_t set, uint32_t binding) const
+{
+  for (size_t i = 0; i < _bindings.size(); i++)
+  {
+    if (_bindings[i].set == set && _bindings[i].binding == binding)
+    {
+      return &_bindings[i];
+    }
+  }
+
+  return nullptr;
+}
+
+uint32_t ShaderReflection::setCount() const
+{
+  return _bindings.empty() ? 0 : _bindings.back().set + 1;
+}
+
+int ShaderReflection::vertexInput(const VertexLayout& layout, std::vector<VkVertexInputBindingDescription>* bindings,
+  std::vector<VkVertexInputAttributeDescription>* attributes) const
+{
+  bindings->clear();
+  attributes->clear();
+
+  for (size_t i = 0; i < _inputs.size(); i++)
+  {
+    uint32_t location = _inputs[i].location;
+    VertexEncoding encoding = location < kVertexStream_Count ? layout.encoding((VertexStream) location) :
+      kVertexEncoding_None;
+    if (encoding == kVertexEncoding_None)
+    {
+      LOG_ERROR("Reflection", "Vertex input at location %d has no vertex stream", location);
+      return 0;
+    }
+
+    // Every encoding reads as floats, octahedral ones as two components
+    uint32_t components = encoding == kVertexEncoding_Octahedral16 ? 2 : 3;
+    VkFormat format = _inputs[i].format;
+    bool floats = format == VK_FORMAT_R32_SFLOAT || format == VK_FORMAT_R32G32_SFLOAT ||
+      format == VK_FORMAT_R32G32B32_SFLOAT || format == VK_FORMAT_R32G32B32A32_SFLOAT;
+    if (!floats || formatSize(format) / 4 > components)
+    {
+      LOG_ERROR("Reflection", "Vertex input at location %d cannot read the %s stream", location,
+        VertexLayout::encodingName(encoding));
+      return 0;
+    }
+
+    VkVertexInputBindingDescription binding = {};
+    binding.binding = location;
+    binding.stride = VertexLayout::encodingSize(encoding);
+    binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    bindings->push_back(binding);
+
+    VkVertexInputAttributeDescription attribute = {};
+    attribute.binding = location;
+    attribute.location = location;
+    attribute.offset = 0;
+    attribute.format = encodingFormat(encoding);
+    attributes->push_back(attribute);
+  }
+
+  return 1;
+}
+
+uint32_t ShaderReflection::formatSize(VkFormat format)
+{
+  switch (format)
+  {
+  case VK_FORMAT_R32_SFLOAT: case VK_FORMAT_R32_SINT: case VK_FORMAT_R32_UINT: return 4;
+  case VK_FORMAT_R32G32_SFLOAT: case VK_FORMAT_R32G32_SINT: case VK_FORMAT_R32G32_UINT: return 8;
+  case VK_FORMAT_R32G32B32_SFLOAT: case VK_FORMAT_R32G32B32_SINT: case VK_FORMAT_R32G32B32_UINT: return 12;
+  case VK_FORMAT_R32G32B32A32_SFLOAT: case VK_FORMAT_R32G32B32A32_SINT: case VK_FORMAT_R32G32B32A32_UINT: return 16;
+  default: return 0;
+  }
+}
+
+VkFormat ShaderReflection::encodingFormat(VertexEncoding encoding)
+{
+  switch (encoding)
+  {
+  case kVertexEncoding_Float3: return VK_FORMAT_R32G32B32_SFLOAT;
+  case kVertexEncoding_Half4: return VK_FORMAT_R16G16B16A16_SFLOAT;
+  case kVertexEncoding_Snorm16x4: return VK_FORMAT_R16G16B16A16_SNORM;
+  case kVertexEncoding_Unorm8x4: return VK_FORMAT_R8G8B8A8_UNORM;
+  case kVertexEncoding_Octahedral16: return VK_FORMAT_R16G16_SNORM;
+  default: return VK_FORMAT_UNDEFINED;
+  }
+}
@@ -0,0 +1,522 @@
+#include "simd.h"
+
+#include <math.h>
+
+#include <chrono>
+#include <vector>
+
+#include "simd_lanes.h"
+
+#if defined(SIMD_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(SIMD_X86)
+#include <cpuid.h>
+#endif
+
+#ifdef GLM_FORCE_QUAT_DATA_WXYZ
+#error "Kernels expect quaternions stored as x, y, z, w"
+#endif
+
+struct SimdKernels
+{
+  void (*compose)(const glm::vec3*, const glm::quat*, const glm::vec3*, uint32_t, glm::mat4*);
+  void (*multiply)(const glm::mat4&, const glm::mat4*, uint32_t, glm::mat4*);
+  void (*spheres)(const glm::mat4*, const glm::vec4*, uint32_t, glm::vec4*);
+  void (*boxes)(const glm::vec4*, uint32_t, const BoxLanes*, uint32_t, uint32_t*);
+};
+
+////////////////////
+// SCALAR
+
+// Plain glm, one object at a time
+void composeTransformsScalar(const glm::vec3* positions, const glm::quat* rotations, const glm::vec3* scales,
+  uint32_t count, glm::mat4* matrices)
+{
+  for (uint32_t i = 0; i < count; i++)
+  {
+    glm::mat3 rotation = glm::mat3_cast(rotations[i]);
+    matrices[i] = glm::mat4(
+      glm::vec4(rotation[0] * scales[i].x, 0.0f),
+      glm::vec4(rotation[1] * scales[i].y, 0.0f),
+      glm::vec4(rotation[2] * scales[i].z, 0.0f),
+      glm::vec4(positions[i], 1.0f));
+  }
+}
+
+void multiplyMatricesScalar(const glm::mat4& left, const glm::mat4* right, uint32_t count, glm::mat4* result)
+{
+  glm::mat4 matrix = left;
+  for (uint32_t i = 0; i < count; i++)
+  {
+    result[i] = matrix * right[i];
+  }
+}
+
+void transformSpheresScalar(const glm::mat4* matrices, const glm::vec4* spheres, uint32_t count, glm::vec4* result)
+{
+  for (uint32_t i = 0; i < count; i++)
+  {
+    const glm::mat4& matrix = matrices[i];
+    glm::vec3 x(matrix[0]), y(matrix[1]), z(matrix[2]);
+    float scale = glm::max(glm::dot(x, x), glm::max(glm::dot(y, y), glm::dot(z, z)));
+
+    glm::vec3 center = glm::vec3(matrix * glm::vec4(glm::vec3(spheres[i]), 1.0f));
+    result[i] = glm::vec4(center, spheres[i].w * sqrtf(scale));
+  }
+}
+
+void classifyBoxesScalar(const glm::vec4* planes, uint32_t plane_count, const BoxLanes* boxes, uint32_t count,
+  uint32_t* masks)
+{
+  for (uint32_t i = 0; i < count; i++)
+  {
+    const BoxLanes& box = boxes[i];
+    uint32_t mask = 0;
+
+    for (uint32_t lane = 0; lane < 4; lane++)
+    {
+      glm::vec3 min(box.min_x[lane], box.min_y[lane], box.min_z[lane]);
+      glm::vec3 max(box.max_x[lane], box.max_y[lane], box.max_z[lane]);
+
+      bool outside = false;
+      bool inside = true;
+      for (uint32_t p = 0; p < plane_count; p++)
+      {
+        glm::vec3 normal(planes[p]);
+        glm::vec3 far_corner = glm::mix(min, max, glm::greaterThan(normal, glm::vec3(0.0f)));
+        glm::vec3 near_corner = glm::mix(max, min, glm::greaterThan(normal, glm::vec3(0.0f)));
+
+        outside |= glm::dot(normal, far_corner) + planes[p].w < 0.0f;
+        inside &= glm::dot(normal, near_corner) + planes[p].w >= 0.0f;
+      }
+
+      mask |= (outside ? 1u : 0u) << lane;
+      mask |= (inside ? 0x10u : 0u) << lane;
+    }
+
+    masks[i] = mask;
+  }
+}
+
+static const SimdKernels scalar_kernels = {
+  composeTransformsScalar, multiplyMatricesScalar, transformSpheresScalar, classifyBoxesScalar
+};
+
+#ifdef SIMD_X86
+////////////////////
+// SSE2
+
+struct LaneSSE
+{
+  __m128 v;
+
+  static LaneSSE splat(float value) { LaneSSE lane = { _mm_set1_ps(value) }; return lane; }
+  static LaneSSE sqrt(LaneSSE a) { LaneSSE lane = { _mm_sqrt_ps(a.v) }; return lane; }
+  static LaneSSE min(LaneSSE a, LaneSSE b) { LaneSSE lane = { _mm_min_ps(a.v, b.v) }; return lane; }
+  static LaneSSE max(LaneSSE a, LaneSSE b) { LaneSSE lane = { _mm_max_ps(a.v, b.v) }; return lane; }
+};
+
+static inline LaneSSE operator+(LaneSSE a, LaneSSE b) { LaneSSE lane = { _mm_add_ps(a.v, b.v) }; return lane; }
+static inline LaneSSE operator-(LaneSSE a, LaneSSE b) { LaneSSE lane = { _mm_sub_ps(a.v, b.v) }; return lane; }
+static inline LaneSSE operator*(LaneSSE a, LaneSSE b) { LaneSSE lane = { _mm_mul_ps(a.v, b.v) }; return lane; }
+
+static void composeTransformsSSE(const glm::vec3* positions, const glm::quat* rotations, const glm::vec3* scales,
+  uint32_t count, glm::mat4* matrices)
+{
+  uint32_t i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    __m128 position[3], rotation[4], scale[3];
+    loadVec3x4(positions + i, position);
+    loadVec4x4(&rotations[i].x, 4, rotation);
+    loadVec3x4(scales + i, scale);
+
+    LaneSSE p[3] = { { position[0] }, { position[1] }, { position[2] } };
+    LaneSSE q[4] = { { rotation[0] }, { rotation[1] }, { rotation[2] }, { rotation[3] } };
+    LaneSSE s[3] = { { scale[0] }, { scale[1] }, { scale[2] } };
+
+    LaneSSE m[16];
+    composeLanes(p, q, s, m);
+
+    for (uint32_t column = 0; column < 4; column++)
+    {
+      storeVec4x4(&matrices[i][column][0], 16,
+        m[column * 4].v, m[column * 4 + 1].v, m[column * 4 + 2].v, m[column * 4 + 3].v);
+    }
+  }
+
+  composeTransformsScalar(positions + i, rotations + i, scales + i, count - i, matrices + i);
+}
+
+// Column by column, every column is a linear combination of the left ones
+static void multiplyMatricesSSE(const glm::mat4& left, const glm::mat4* right, uint32_t count, glm::mat4* result)
+{
+  __m128 l0 = _mm_loadu_ps(&left[0][0]);
+  __m128 l1 = _mm_loadu_ps(&left[1][0]);
+  __m128 l2 = _mm_loadu_ps(&left[2][0]);
+  __m128 l3 = _mm_loadu_ps(&left[3][0]);
+
+  for (uint32_t i = 0; i < count; i++)
+  {
+    for (uint32_t column = 0; column < 4; column++)
+    {
+      __m128 r = _mm_loadu_ps(&right[i][column][0]);
+      __m128 value = _mm_mul_ps(l0, _mm_shuffle_ps(r, r, _MM_SHUFFLE(0, 0, 0, 0)));
+      value = _mm_add_ps(value, _mm_mul_ps(l1, _mm_shuffle_ps(r, r, _MM_SHUFFLE(1, 1, 1, 1))));
+      value = _mm_add_ps(value, _mm_mul_ps(l2, _mm_shuffle_ps(r, r, _MM_SHUFFLE(2, 2, 2, 2))));
+      value = _mm_add_ps(value, _mm_mul_ps(l3, _mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 3))));
+      _mm_storeu_ps(&result[i][column][0], value);
+    }
+  }
+}
+
+static void transformSpheresSSE(const glm::mat4* matrices, const glm::vec4* spheres, uint32_t count, glm::vec4* result)
+{
+  uint32_t i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    __m128 columns[16], sphere[4];
+    for (uint32_t column = 0; column < 4; column++)
+    {
+      loadVec4x4(&matrices[i][column][0], 16, columns + column * 4);
+    }
+    loadVec4x4(&spheres[i].x, 4, sphere);
+
+    LaneSSE m[16];
+    for (uint32_t j = 0; j < 16; j++)
+    {
+      m[j].v = columns[j];
+    }
+    LaneSSE s[4] = { { sphere[0] }, { sphere[1] }, { sphere[2] }, { sphere[3] } };
+
+    LaneSSE transformed[4];
+    sphereLanes(m, s, transformed);
+    storeVec4x4(&result[i].x, 4, transformed[0].v, transformed[1].v, transformed[2].v, transformed[3].v);
+  }
+
+  transformSpheresScalar(matrices + i, spheres + i, count - i, result + i);
+}
+
+static void classifyBoxesSSE(const glm::vec4* planes, uint32_t plane_count, const BoxLanes* boxes, uint32_t count,
+  uint32_t* masks)
+{
+  __m128 zero = _mm_setzero_ps();
+  for (uint32_t i = 0; i < count; i++)
+  {
+    const BoxLanes& box = boxes[i];
+    LaneSSE min[3] = { { _mm_loadu_ps(box.min_x) }, { _mm_loadu_ps(box.min_y) }, { _mm_loadu_ps(box.min_z) } };
+    LaneSSE max[3] = { { _mm_loadu_ps(box.max_x) }, { _mm_loadu_ps(box.max_y) }, { _mm_loadu_ps(box.max_z) } };
+
+    LaneSSE far_distance = { zero }, near_distance = { zero };
+    boxLanes(planes, plane_count, min, max, &far_distance, &near_distance);
+
+    masks[i] = (uint32_t) _mm_movemask_ps(_mm_cmplt_ps(far_distance.v, zero)) |
+      ((uint32_t) _mm_movemask_ps(_mm_cmpge_ps(near_distance.v, zero)) << 4);
+  }
+}
+
+static const SimdKernels sse_kernels = {
+  composeTransformsSSE, multiplyMatricesSSE, transformSpheresSSE, classifyBoxesSSE
+};
+
+static const SimdKernels avx2_kernels = {
+  composeTransformsAVX2, multiplyMatricesAVX2, transformSpheresAVX2, classifyBoxesAVX2
+};
+
+static bool cpuSupportsAVX2()
+{
+  uint32_t registers[4] = {};
+
+#ifdef _MSC_VER
+  __cpuid((int*) registers, 0);
+  if (registers[0] < 7)
+  {
+    return false;
+  }
+
+  __cpuid((int*) registers, 1);
+  bool os_saves_avx = (registers[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+  bool fma = (registers[2] & (1 << 12)) != 0;
+
+  __cpuidex((int*) registers, 7, 0);
+#else
+  if (__get_cpuid_max(0, nullptr) < 7)
+  {
+    return false;
+  }
+
+  __get_cpuid(1, &registers[0], &registers[1], &registers[2], &registers[3]);
+  bool os_saves_avx = false;
+  if (registers[2] & (1 << 27))
+  {
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    os_saves_avx = (eax & 6) == 6;
+  }
+  bool fma = (registers[2] & (1 << 12)) != 0;
+
+  __get_cpuid_count(7, 0, &registers[0], &registers[1], &registers[2], &registers[3]);
+#endif
+
+  bool avx2 = (registers[1] & (1 << 5)) != 0;
+  return os_saves_avx && fma && avx2;
+}
+#endif // SIMD_X86
+
+
+////////////////////
+// DISPATCH
+
+static const SimdKernels* kernelsFor(SimdLevel level)
+{
+  switch (level)
+  {
+#ifdef SIMD_X86
+  case kSimdLevel_SSE2: return &sse_kernels;
+  case kSimdLevel_AVX2: return &avx2_kernels;
+#endif
+  default: return &scalar_kernels;
+  }
+}
+
+static SimdLevel detectLevel()
+{
+#if defined(SIMD_X86)
+  return cpuSupportsAVX2() ? kSimdLevel_AVX2 : kSimdLevel_SSE2;
+#else
+  return kSimdLevel_Scalar;
+#endif
+}
+
+// Objects per measured call, few enough to stay in cache and to keep the
+// measurement well under a millisecond
+static const uint32_t kMeasureCount = 512;
+static const int kMeasureRuns = 5;
+
+struct SimdMeasureData
+{
+  std::vector<glm::vec3> positions;
+  std::vector<glm::quat> rotations;
+  std::vector<glm::vec3> scales;
+  std::vector<glm::mat4> matrices;
+  std::vector<glm::mat4> results;
+  std::vector<glm::vec4> spheres;
+  std::vector<glm::vec4> sphere_results;
+  std::vector<BoxLanes> boxes;
+  std::vector<uint32_t> masks;
+  glm::vec4 planes[6];
+};
+
+static double measureKernel(const SimdKernels& candidate, SimdKernel kernel, SimdMeasureData* data)
+{
+  double best = 1e30;
+  for (int run = 0; run < kMeasureRuns; run++)
+  {
+    auto start = std::chrono::steady_clock::now();
+    switch (kernel)
+    {
+    case kSimdKernel_Compose:
+      candidate.compose(data->positions.data(), data->rotations.data(), data->scales.data(), kMeasureCount,
+        data->results.data());
+      break;
+    case kSimdKernel_Multiply:
+      candidate.multiply(data->matrices[0], data->matrices.data(), kMeasureCount, data->results.data());
+      break;
+    case kSimdKernel_Spheres:
+      candidate.spheres(data->matrices.data(), data->spheres.data(), kMeasureCount, data->sphere_results.data());
+      break;
+    default:
+      candidate.boxes(data->planes, 6, data->boxes.data(), kMeasureCount / 4, data->masks.data());
+      break;
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    best = elapsed < best ? elapsed : best;
+  }
+  return best;
+}
+
+// Wider is not faster for every kernel on every CPU, e.g. when loads and
+// shuffles dominate or the compiler mixes encodings, so every supported
+// level is timed once per kernel and the fastest one kept
+static void measureKernels(SimdLevel detected, SimdKernels* fastest, SimdLevel* levels)
+{
+  SimdMeasureData data;
+  data.positions.assign(kMeasureCount, glm::vec3(1.0f, 2.0f, 3.0f));
+  data.rotations.assign(kMeasureCount, glm::angleAxis(0.5f, glm::vec3(0.0f, 0.6f, 0.8f)));
+  data.scales.assign(kMeasureCount, glm::vec3(1.0f, 2.0f, 0.5f));
+  data.matrices.assign(kMeasureCount, glm::mat4(1.0f));
+  data.results.resize(kMeasureCount);
+  data.spheres.assign(kMeasureCount, glm::vec4(0.5f, 0.5f, 0.5f, 1.0f));
+  data.sphere_results.resize(kMeasureCount);
+  data.masks.resize(kMeasureCount / 4);
+
+  BoxLanes box = {};
+  for (uint32_t lane = 0; lane < 4; lane++)
+  {
+    box.min_x[lane] = box.min_y[lane] = box.min_z[lane] = -1.0f - lane;
+    box.max_x[lane] = box.max_y[lane] = box.max_z[lane] = 1.0f + lane;
+  }
+  data.boxes.assign(kMeasureCount / 4, box);
+  for (uint32_t i = 0; i < 6; i++)
+  {
+    glm::vec3 normal(0.0f);
+    normal[i % 3] = i < 3 ? 1.0f : -1.0f;
+    data.planes[i] = glm::vec4(normal, 2.0f);
+  }
+
+  const SimdLevel candidates[] = { kSimdLevel_Scalar, kSimdLevel_SSE2, kSimdLevel_AVX2 };
+  double best[kSimdKernel_Count];
+  for (uint32_t kernel = 0; kernel < kSimdKernel_Count; kernel++)
+  {
+    levels[kernel] = kSimdLevel_Scalar;
+    best[kernel] = 1e30;
+  }
+
+  for (SimdLevel level : candidates)
+  {
+    bool supported = level == kSimdLevel_Scalar || level == detected ||
+      (level == kSimdLevel_SSE2 && detected == kSimdLevel_AVX2);
+    if (!supported)
+    {
+      continue;
+    }
+
+    // The first call of each kernel also warms up the caches and the
+    // upper register halves, only the best run counts
+    const SimdKernels* candidate = kernelsFor(level);
+    for (uint32_t kernel = 0; kernel < kSimdKernel_Count; kernel++)
+    {
+      double time = measureKernel(*candidate, (SimdKernel) kernel, &data);
+      if (time < best[kernel])
+      {
+        best[kernel] = time;
+        levels[kernel] = level;
+      }
+    }
+  }
+
+  const SimdKernels* selected[kSimdKernel_Count];
+  for (uint32_t kernel = 0; kernel < kSimdKernel_Count; kernel++)
+  {
+    selected[kernel] = kernelsFor(levels[kernel]);
+  }
+  fastest->compose = selected[kSimdKernel_Compose]->compose;
+  fastest->multiply = selected[kSimdKernel_Multiply]->multiply;
+  fastest->spheres = selected[kSimdKernel_Spheres]->spheres;
+  fastest->boxes = selected[kSimdKernel_Boxes]->boxes;
+}
+
+struct SimdDispatch
+{
+  SimdLevel detected_level;
+  SimdLevel current_level;
+  SimdKernels fastest;
+  SimdLevel fastest_levels[kSimdKernel_Count];
+  SimdKernels kernels;
+  SimdLevel kernel_levels[kSimdKernel_Count];
+
+  SimdDispatch()
+  {
+    detected_level = detectLevel();
+    current_level = detected_level;
+    measureKernels(detected_level, &fastest, fastest_levels);
+    useFastest();
+  }
+
+  void useFastest()
+  {
+    current_level = detected_level;
+    kernels = fastest;
+    for (uint32_t kernel = 0; kernel < kSimdKernel_Count; kernel++)
+    {
+      kernel_levels[kernel] = fastest_levels[kernel];
+    }
+  }
+};
+
+static SimdDispatch dispatch;
+
+SimdLevel Simd::level()
+{
+  return dispatch.current_level;
+}
+
+bool Simd::supported(SimdLevel level)
+{
+  switch (level)
+  {
+  case kSimdLevel_Scalar: return true;
+  case kSimdLevel_SSE2: return dispatch.detected_level == kSimdLevel_SSE2 || dispatch.detected_level == kSimdLevel_AVX2;
+  default: return level == dispatch.detected_level;
+  }
+}
+
+int Simd::setLevel(SimdLevel level)
+{
+  if (!supported(level))
+  {
+    return 0;
+  }
+
+  dispatch.current_level = level;
+  dispatch.kernels = *kernelsFor(level);
+  for (uint32_t kernel = 0; kernel < kSimdKernel_Count; kernel++)
+  {
+    dispatch.kernel_levels[kernel] = level;
+  }
+  return 1;
+}
+
+void Simd::setFastest()
+{
+  dispatch.useFastest();
+}
+
+SimdLevel Simd::kernelLevel(SimdKernel kernel)
+{
+  return kernel < kSimdKernel_Count ? dispatch.kernel_levels[kernel] : kSimdLevel_Scalar;
+}
+
+const char* Simd::levelName(SimdLevel level)
+{
+  switch (level)
+  {
+  case kSimdLevel_SSE2: return "SSE2";
+  case kSimdLevel_AVX2: return "AVX2";
+  default: return "Scalar";
+  }
+}
+
+const char* Simd::kernelName(SimdKernel kernel)
+{
+  switch (kernel)
+  {
+  case kSimdKernel_Compose: return "compose";
+  case kSimdKernel_Multiply: return "multiply";
+  case kSimdKernel_Spheres: return "spheres";
+  default: return "boxes";
+  }
+}
+
+void Simd::composeTransforms(const glm::vec3* positions, const glm::quat* rotations, const glm::vec3* scales,
+  uint32_t count, glm::mat4* matrices)
+{
+  dispatch.kernels.compose(positions, rotations, scales, count, matrices);
+}
+
+void Simd::multiplyMatrices(const glm::mat4& left, const glm::mat4* right, uint32_t count, glm::mat4* result)
+{
+  dispatch.kernels.multiply(left, right, count, result);
+}
+
+void Simd::transformSpheres(const glm::mat4* matrices, const glm::vec4* spheres, uint32_t count, glm::vec4* result)
+{
+  dispatch.kernels.spheres(matrices, spheres, count, result);
+}
+
+void Simd::classifyBoxes(const glm::vec4* planes, uint32_t plane_count, const BoxLanes* boxes, uint32_t count,
+  uint32_t* masks)
+{
+  dispatch.kernels.boxes(planes, plane_count, boxes, count, masks);
+}
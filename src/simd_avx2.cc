@@ -0,0 +1,263 @@
+// AVX2 kernels, in their own file so the rest of the build keeps the base
+// instruction set. Only called after the CPU check in simd.cc passed.
+#include "simd.h"
+
+#ifdef SIMD_X86
+// After glm, so its inline functions are not emitted with AVX encodings
+// the linker could then pick for the other translation units
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2,fma"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#endif
+
+#include <immintrin.h>
+
+#include "simd_lanes.h"
+
+struct LaneAVX2
+{
+  __m256 v;
+
+  static LaneAVX2 splat(float value) { LaneAVX2 lane = { _mm256_set1_ps(value) }; return lane; }
+  static LaneAVX2 sqrt(LaneAVX2 a) { LaneAVX2 lane = { _mm256_sqrt_ps(a.v) }; return lane; }
+  static LaneAVX2 min(LaneAVX2 a, LaneAVX2 b) { LaneAVX2 lane = { _mm256_min_ps(a.v, b.v) }; return lane; }
+  static LaneAVX2 max(LaneAVX2 a, LaneAVX2 b) { LaneAVX2 lane = { _mm256_max_ps(a.v, b.v) }; return lane; }
+};
+
+static inline LaneAVX2 operator+(LaneAVX2 a, LaneAVX2 b) { LaneAVX2 lane = { _mm256_add_ps(a.v, b.v) }; return lane; }
+static inline LaneAVX2 operator-(LaneAVX2 a, LaneAVX2 b) { LaneAVX2 lane = { _mm256_sub_ps(a.v, b.v) }; return lane; }
+static inline LaneAVX2 operator*(LaneAVX2 a, LaneAVX2 b) { LaneAVX2 lane = { _mm256_mul_ps(a.v, b.v) }; return lane; }
+
+// Every load and store below is a full 256-bit one or a 128-bit broadcast.
+// Both are VEX encoded whatever the compiler flags of this file, while the
+// _mm_ load and store intrinsics are legacy SSE without /arch:AVX and pay
+// a transition with the upper halves in use.
+
+// Objects 0-3 in the low halves and 4-7 in the high halves, so the in-lane
+// shuffles of the SSE version deinterleave both groups at once
+static inline void loadVec3x8(const glm::vec3* source, LaneAVX2* lanes)
+{
+  const float* data = (const float*) source;
+  __m256 l0 = _mm256_loadu_ps(data);
+  __m256 l1 = _mm256_loadu_ps(data + 8);
+  __m256 l2 = _mm256_loadu_ps(data + 16);
+
+  // Floats 0-3 and 12-15, 4-7 and 16-19, 8-11 and 20-23
+  __m256 a = _mm256_blend_ps(l0, l1, 0xf0);
+  __m256 b = _mm256_permute2f128_ps(l0, l2, 0x21);
+  __m256 c = _mm256_blend_ps(l1, l2, 0xf0);
+
+  __m256 x_high = _mm256_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2));
+  __m256 y_low = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1));
+  __m256 y_high = _mm256_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3));
+  __m256 z_low = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2));
+
+  lanes[0].v = _mm256_shuffle_ps(a, x_high, _MM_SHUFFLE(2, 0, 3, 0));
+  lanes[1].v = _mm256_shuffle_ps(y_low, y_high, _MM_SHUFFLE(2, 0, 2, 0));
+  lanes[2].v = _mm256_shuffle_ps(z_low, c, _MM_SHUFFLE(3, 0, 2, 0));
+}
+
+// Transposes within each 128-bit half, so one pass handles two groups of four
+static inline void transposeHalves(__m256* lanes)
+{
+  __m256 t0 = _mm256_unpacklo_ps(lanes[0], lanes[1]);
+  __m256 t1 = _mm256_unpacklo_ps(lanes[2], lanes[3]);
+  __m256 t2 = _mm256_unpackhi_ps(lanes[0], lanes[1]);
+  __m256 t3 = _mm256_unpackhi_ps(lanes[2], lanes[3]);
+
+  lanes[0] = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+  lanes[1] = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+  lanes[2] = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+  lanes[3] = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+// Eight packed vec4 into x, y, z and w lanes, and back. Register j holds
+// object j in its low half and object j + 4 in its high half.
+static inline void loadVec4x8(const float* source, LaneAVX2* lanes)
+{
+  __m256 pair01 = _mm256_loadu_ps(source);
+  __m256 pair23 = _mm256_loadu_ps(source + 8);
+  __m256 pair45 = _mm256_loadu_ps(source + 16);
+  __m256 pair67 = _mm256_loadu_ps(source + 24);
+
+  __m256 rows[4] = {
+    _mm256_permute2f128_ps(pair01, pair45, 0x20), _mm256_permute2f128_ps(pair01, pair45, 0x31),
+    _mm256_permute2f128_ps(pair23, pair67, 0x20), _mm256_permute2f128_ps(pair23, pair67, 0x31)
+  };
+  transposeHalves(rows);
+
+  for (uint32_t j = 0; j < 4; j++)
+  {
+    lanes[j].v = rows[j];
+  }
+}
+
+static inline void storeVec4x8(float* destination, const LaneAVX2* lanes)
+{
+  __m256 rows[4] = { lanes[0].v, lanes[1].v, lanes[2].v, lanes[3].v };
+  transposeHalves(rows);
+
+  _mm256_storeu_ps(destination, _mm256_permute2f128_ps(rows[0], rows[1], 0x20));
+  _mm256_storeu_ps(destination + 8, _mm256_permute2f128_ps(rows[2], rows[3], 0x20));
+  _mm256_storeu_ps(destination + 16, _mm256_permute2f128_ps(rows[0], rows[1], 0x31));
+  _mm256_storeu_ps(destination + 24, _mm256_permute2f128_ps(rows[2], rows[3], 0x31));
+}
+
+// Eight matrices into sixteen lanes, m[column * 4 + row], and back. Columns
+// are moved in pairs, one 256-bit access per object and pair.
+static inline void loadMatrix8(const glm::mat4* matrices, LaneAVX2* m)
+{
+  for (uint32_t column = 0; column < 4; column += 2)
+  {
+    __m256 first[4], second[4];
+    for (uint32_t j = 0; j < 4; j++)
+    {
+      __m256 low = _mm256_loadu_ps(&matrices[j][column][0]);
+      __m256 high = _mm256_loadu_ps(&matrices[j + 4][column][0]);
+      first[j] = _mm256_permute2f128_ps(low, high, 0x20);
+      second[j] = _mm256_permute2f128_ps(low, high, 0x31);
+    }
+
+    transposeHalves(first);
+    transposeHalves(second);
+    for (uint32_t j = 0; j < 4; j++)
+    {
+      m[column * 4 + j].v = first[j];
+      m[column * 4 + 4 + j].v = second[j];
+    }
+  }
+}
+
+static inline void storeMatrix8(const LaneAVX2* m, glm::mat4* matrices)
+{
+  for (uint32_t column = 0; column < 4; column += 2)
+  {
+    __m256 first[4], second[4];
+    for (uint32_t j = 0; j < 4; j++)
+    {
+      first[j] = m[column * 4 + j].v;
+      second[j] = m[column * 4 + 4 + j].v;
+    }
+
+    transposeHalves(first);
+    transposeHalves(second);
+    for (uint32_t j = 0; j < 4; j++)
+    {
+      _mm256_storeu_ps(&matrices[j][column][0], _mm256_permute2f128_ps(first[j], second[j], 0x20));
+      _mm256_storeu_ps(&matrices[j + 4][column][0], _mm256_permute2f128_ps(first[j], second[j], 0x31));
+    }
+  }
+}
+
+void composeTransformsAVX2(const glm::vec3* positions, const glm::quat* rotations, const glm::vec3* scales,
+  uint32_t count, glm::mat4* matrices)
+{
+  uint32_t i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    LaneAVX2 position[3], rotation[4], scale[3];
+    loadVec3x8(positions + i, position);
+    loadVec4x8(&rotations[i].x, rotation);
+    loadVec3x8(scales + i, scale);
+
+    LaneAVX2 m[16];
+    composeLanes(position, rotation, scale, m);
+    storeMatrix8(m, matrices + i);
+  }
+
+  // The tail is plain glm, which may be legacy SSE
+  _mm256_zeroupper();
+  composeTransformsScalar(positions + i, rotations + i, scales + i, count - i, matrices + i);
+}
+
+// Two result columns per register, the left matrix is duplicated in both
+// halves and every right element is broadcast within its half
+void multiplyMatricesAVX2(const glm::mat4& left, const glm::mat4* right, uint32_t count, glm::mat4* result)
+{
+  __m256 l0 = _mm256_broadcast_ps((const __m128*) &left[0][0]);
+  __m256 l1 = _mm256_broadcast_ps((const __m128*) &left[1][0]);
+  __m256 l2 = _mm256_broadcast_ps((const __m128*) &left[2][0]);
+  __m256 l3 = _mm256_broadcast_ps((const __m128*) &left[3][0]);
+
+  for (uint32_t i = 0; i < count; i++)
+  {
+    for (uint32_t column = 0; column < 4; column += 2)
+    {
+      __m256 r = _mm256_loadu_ps(&right[i][column][0]);
+      __m256 value = _mm256_mul_ps(l0, _mm256_shuffle_ps(r, r, _MM_SHUFFLE(0, 0, 0, 0)));
+      value = _mm256_fmadd_ps(l1, _mm256_shuffle_ps(r, r, _MM_SHUFFLE(1, 1, 1, 1)), value);
+      value = _mm256_fmadd_ps(l2, _mm256_shuffle_ps(r, r, _MM_SHUFFLE(2, 2, 2, 2)), value);
+      value = _mm256_fmadd_ps(l3, _mm256_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 3)), value);
+      _mm256_storeu_ps(&result[i][column][0], value);
+    }
+  }
+}
+
+void transformSpheresAVX2(const glm::mat4* matrices, const glm::vec4* spheres, uint32_t count, glm::vec4* result)
+{
+  uint32_t i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    LaneAVX2 m[16], sphere[4];
+    loadMatrix8(matrices + i, m);
+    loadVec4x8(&spheres[i].x, sphere);
+
+    LaneAVX2 transformed[4];
+    sphereLanes(m, sphere, transformed);
+    storeVec4x8(&result[i].x, transformed);
+  }
+
+  _mm256_zeroupper();
+  transformSpheresScalar(matrices + i, spheres + i, count - i, result + i);
+}
+
+static inline LaneAVX2 combine(const float* low, const float* high)
+{
+  LaneAVX2 lane = {
+    _mm256_blend_ps(_mm256_broadcast_ps((const __m128*) low), _mm256_broadcast_ps((const __m128*) high), 0xf0)
+  };
+  return lane;
+}
+
+// Two groups per iteration, one in each half
+void classifyBoxesAVX2(const glm::vec4* planes, uint32_t plane_count, const BoxLanes* boxes, uint32_t count,
+  uint32_t* masks)
+{
+  __m256 zero = _mm256_setzero_ps();
+
+  for (uint32_t i = 0; i < count; i += 2)
+  {
+    // A last odd group is tested twice
+    const BoxLanes& low = boxes[i];
+    const BoxLanes& high = boxes[i + 1 < count ? i + 1 : i];
+
+    LaneAVX2 min[3], max[3];
+    min[0] = combine(low.min_x, high.min_x);
+    min[1] = combine(low.min_y, high.min_y);
+    min[2] = combine(low.min_z, high.min_z);
+    max[0] = combine(low.max_x, high.max_x);
+    max[1] = combine(low.max_y, high.max_y);
+    max[2] = combine(low.max_z, high.max_z);
+
+    LaneAVX2 far_distance = { zero }, near_distance = { zero };
+    boxLanes(planes, plane_count, min, max, &far_distance, &near_distance);
+
+    uint32_t outside = (uint32_t) _mm256_movemask_ps(_mm256_cmp_ps(far_distance.v, zero, _CMP_LT_OQ));
+    uint32_t inside = (uint32_t) _mm256_movemask_ps(_mm256_cmp_ps(near_distance.v, zero, _CMP_GE_OQ));
+
+    masks[i] = (outside & 0xf) | ((inside & 0xf) << 4);
+    if (i + 1 < count)
+    {
+      masks[i + 1] = (outside >> 4) | (inside & 0xf0);
+    }
+  }
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+#endif // SIMD_X86
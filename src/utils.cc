@@ -1,24 +1,182 @@
 #include "utils.h"
 
-#include <fstream>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 #include "logger.h"
 
-std::vector<char> Utils::readFile(const std::string& file_name)
+MappedFile::MappedFile() { }
+
+MappedFile::~MappedFile()
+{
+  close();
+}
+
+MappedFile::MappedFile(MappedFile&& other)
+{
+  *this = static_cast<MappedFile&&>(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other)
+{
+  if (this != &other)
+  {
+    close();
+
+    _data = other._data;
+    _size = other._size;
+    _mapped = other._mapped;
+    _buffer.swap(other._buffer);
+    _file = other._file;
+    _mapping = other._mapping;
+
+    other._data = nullptr;
+    other._size = 0;
+    other._mapped = false;
+    other._file = nullptr;
+    other._mapping = nullptr;
+  }
+
+  return *this;
+}
+
+int MappedFile::open(const std::string& file_name, bool small_file_read)
 {
-  std::ifstream file(file_name, std::ios::ate | std::ios::binary);
+  close();
 
-  if (!file.is_open()) {
+#ifdef _WIN32
+  HANDLE file = CreateFile(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+    OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+  {
     LOG_WARNING("Utils", "Failed opening file: %s", file_name.c_str());
-    return std::vector<char>();
+    return 0;
   }
 
-  size_t file_size = (size_t) file.tellg();
-  std::vector<char> buffer(file_size);
+  LARGE_INTEGER size;
+  GetFileSizeEx(file, &size);
+  _size = (size_t) size.QuadPart;
 
-  file.seekg(0);
-  file.read(buffer.data(), file_size);
-  file.close();
+  if (_size == 0)
+  {
+    // Nothing to map, still a valid empty view
+    _buffer.resize(1);
+    _data = (const uint8_t*) _buffer.data();
+  }
+  else if (small_file_read && _size <= kSmallFileSize)
+  {
+    DWORD read = 0;
+    _buffer.resize((_size + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+    if (ReadFile(file, _buffer.data(), (DWORD) _size, &read, NULL) && read == _size)
+    {
+      _data = (const uint8_t*) _buffer.data();
+    }
+  }
+  else
+  {
+    HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping != NULL)
+    {
+      _data = (const uint8_t*) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+      _mapping = mapping;
+      _mapped = _data != nullptr;
+    }
+  }
 
-  return buffer;
+  // The view keeps the file alive, the handle is only needed while mapped
+  if (_mapped)
+  {
+    _file = file;
+  }
+  else
+  {
+    CloseHandle(file);
+  }
+#else
+  int file = ::open(file_name.c_str(), O_RDONLY);
+  if (file < 0)
+  {
+    LOG_WARNING("Utils", "Failed opening file: %s", file_name.c_str());
+    return 0;
+  }
+
+  struct stat info;
+  fstat(file, &info);
+  _size = (size_t) info.st_size;
+
+  if (_size == 0)
+  {
+    _buffer.resize(1);
+    _data = (const uint8_t*) _buffer.data();
+  }
+  else if (small_file_read && _size <= kSmallFileSize)
+  {
+    _buffer.resize((_size + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+    if (read(file, _buffer.data(), _size) == (ssize_t) _size)
+    {
+      _data = (const uint8_t*) _buffer.data();
+    }
+  }
+  else
+  {
+    void* data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, file, 0);
+    if (data != MAP_FAILED)
+    {
+      _data = (const uint8_t*) data;
+      _mapped = true;
+    }
+  }
+
+  ::close(file);
+#endif
+
+  if (_data == nullptr)
+  {
+    LOG_WARNING("Utils", "Failed reading file: %s", file_name.c_str());
+    close();
+    return 0;
+  }
+
+  return 1;
+}
+
+void MappedFile::close()
+{
+  if (_mapped)
+  {
+#ifdef _WIN32
+    UnmapViewOfFile(_data);
+    CloseHandle((HANDLE) _mapping);
+    CloseHandle((HANDLE) _file);
+#else
+    munmap((void*) _data, _size);
+#endif
+  }
+#ifdef _WIN32
+  else if (_mapping != nullptr)
+  {
+    CloseHandle((HANDLE) _mapping);
+  }
+#endif
+
+  _data = nullptr;
+  _size = 0;
+  _mapped = false;
+  _buffer.clear();
+  _buffer.shrink_to_fit();
+  _file = nullptr;
+  _mapping = nullptr;
+}
+
+MappedFile Utils::mapFile(const std::string& file_name)
+{
+  MappedFile file;
+  file.open(file_name);
+  return file;
 }
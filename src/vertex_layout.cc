@@ -0,0 +1,285 @@
+#include "vertex_layout.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char* const kStreamNames[kVertexStream_Count] = { "position", "color", "normal" };
+
+static const char* const kEncodingNames[kVertexEncoding_Count] = {
+  "none", "float", "half", "snorm16", "unorm8", "oct16"
+};
+
+// Round to nearest even, out of range values become infinity
+static uint16_t floatToHalf(float value)
+{
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  uint32_t sign = (bits >> 16) & 0x8000;
+  uint32_t float_exponent = (bits >> 23) & 0xff;
+  uint32_t mantissa = bits & 0x7fffff;
+  int32_t exponent = (int32_t) float_exponent - 127 + 15;
+
+  if (float_exponent == 0xff)
+  {
+    return (uint16_t) (sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0));
+  }
+  if (exponent >= 31)
+  {
+    return (uint16_t) (sign | 0x7c00);
+  }
+
+  // Denormal halves keep the implicit bit in the mantissa
+  uint32_t shift = 13;
+  uint32_t half = 0;
+  if (exponent <= 0)
+  {
+    if (exponent < -10)
+    {
+      return (uint16_t) sign;
+    }
+    mantissa |= 0x800000;
+    shift = (uint32_t) (14 - exponent);
+  }
+  else
+  {
+    half = (uint32_t) exponent << 10;
+  }
+
+  uint32_t rest = mantissa & ((1u << shift) - 1);
+  uint32_t halfway = 1u << (shift - 1);
+  half |= mantissa >> shift;
+  // A carry out of the mantissa correctly bumps the exponent
+  if (rest > halfway || (rest == halfway && (half & 1)))
+  {
+    half++;
+  }
+
+  return (uint16_t) (sign | half);
+}
+
+static int16_t floatToSnorm16(float value)
+{
+  value = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+  return (int16_t) lrintf(value * 32767.0f);
+}
+
+static uint8_t floatToUnorm8(float value)
+{
+  value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+  return (uint8_t) lrintf(value * 255.0f);
+}
+
+int VertexLayout::setEncoding(VertexStream stream, VertexEncoding encoding)
+{
+  bool valid = false;
+  switch (stream)
+  {
+  case kVertexStream_Position:
+    valid = encoding == kVertexEncoding_Float3 || encoding == kVertexEncoding_Half4 ||
+      encoding == kVertexEncoding_Snorm16x4;
+    break;
+  case kVertexStream_Color:
+    valid = encoding == kVertexEncoding_None || encoding == kVertexEncoding_Float3 ||
+      encoding == kVertexEncoding_Half4 || encoding == kVertexEncoding_Unorm8x4;
+    break;
+  case kVertexStream_Normal:
+    valid = encoding == kVertexEncoding_None || encoding == kVertexEncoding_Float3 ||
+      encoding == kVertexEncoding_Snorm16x4 || encoding == kVertexEncoding_Octahedral16;
+    break;
+  default:
+    break;
+  }
+
+  if (!valid)
+  {
+    return 0;
+  }
+
+  _encodings[stream] = encoding;
+  return 1;
+}
+
+uint32_t VertexLayout::vertexSize() const
+{
+  uint32_t size = 0;
+  for (uint32_t stream = 0; stream < kVertexStream_Count; stream++)
+  {
+    size += encodingSize(_encodings[stream]);
+  }
+  return size;
+}
+
+void VertexLayout::positionQuantization(const float* bounds_min, const float* bounds_max, float* offset,
+  float* scale) const
+{
+  VertexEncoding encoding = _encodings[kVertexStream_Position];
+  for (uint32_t axis = 0; axis < 3; axis++)
+  {
+    float center = (bounds_min[axis] + bounds_max[axis]) * 0.5f;
+    float extent = (bounds_max[axis] - bounds_min[axis]) * 0.5f;
+
+    // Halves are most precise near zero, so they are centered too
+    offset[axis] = encoding == kVertexEncoding_Float3 ? 0.0f : center;
+    scale[axis] = encoding == kVertexEncoding_Snorm16x4 && extent > 0.0f ? extent : 1.0f;
+  }
+}
+
+void VertexLayout::encode(VertexStream stream, const float* values, uint32_t count, const float* offset,
+  const float* scale, void* result) const
+{
+  VertexEncoding encoding = _encodings[stream];
+  uint8_t* output = (uint8_t*) result;
+
+  for (uint32_t i = 0; i < count; i++, output += encodingSize(encoding))
+  {
+    float value[3] = { values[i * 3], values[i * 3 + 1], values[i * 3 + 2] };
+    if (stream == kVertexStream_Position)
+    {
+      for (uint32_t axis = 0; axis < 3; axis++)
+      {
+        value[axis] = (value[axis] - offset[axis]) / scale[axis];
+      }
+    }
+    else if (stream == kVertexStream_Normal)
+    {
+      float length = sqrtf(value[0] * value[0] + value[1] * value[1] + value[2] * value[2]);
+      for (uint32_t axis = 0; axis < 3; axis++)
+      {
+        value[axis] = length > 0.0f ? value[axis] / length : (axis == 2 ? 1.0f : 0.0f);
+      }
+    }
+
+    switch (encoding)
+    {
+    case kVertexEncoding_Float3:
+      memcpy(output, value, sizeof(value));
+      break;
+    case kVertexEncoding_Half4:
+    {
+      uint16_t half[4] = { floatToHalf(value[0]), floatToHalf(value[1]), floatToHalf(value[2]), 0x3c00 };
+      memcpy(output, half, sizeof(half));
+      break;
+    }
+    case kVertexEncoding_Snorm16x4:
+    {
+      int16_t snorm[4] = { floatToSnorm16(value[0]), floatToSnorm16(value[1]), floatToSnorm16(value[2]), 0 };
+      memcpy(output, snorm, sizeof(snorm));
+      break;
+    }
+    case kVertexEncoding_Unorm8x4:
+    {
+      uint8_t unorm[4] = { floatToUnorm8(value[0]), floatToUnorm8(value[1]), floatToUnorm8(value[2]), 255 };
+      memcpy(output, unorm, sizeof(unorm));
+      break;
+    }
+    case kVertexEncoding_Octahedral16:
+    {
+      // Project onto the octahedron, the lower half folds over the diagonals
+      float sum = fabsf(value[0]) + fabsf(value[1]) + fabsf(value[2]);
+      float x = value[0] / sum;
+      float y = value[1] / sum;
+      if (value[2] < 0.0f)
+      {
+        float folded_x = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float folded_y = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = folded_x;
+        y = folded_y;
+      }
+
+      int16_t snorm[2] = { floatToSnorm16(x), floatToSnorm16(y) };
+      memcpy(output, snorm, sizeof(snorm));
+      break;
+    }
+    default:
+      break;
+    }
+  }
+}
+
+std::string VertexLayout::glsl() const
+{
+  char line[256];
+  std::string result = "// Generated by meshconv for the vertex layout:";
+  for (uint32_t stream = 0; stream < kVertexStream_Count; stream++)
+  {
+    snprintf(line, sizeof(line), " %s %s", kStreamNames[stream], encodingName(_encodings[stream]));
+    result += line;
+  }
+  result += "\n\n";
+
+  for (uint32_t stream = 0; stream < kVertexStream_Count; stream++)
+  {
+    VertexEncoding encoding = _encodings[stream];
+    if (encoding != kVertexEncoding_None)
+    {
+      // Normalized and half formats read as floats, the extra components
+      // of four component formats are left unread
+      snprintf(line, sizeof(line), "layout(location = %u) in %s %s;\n", stream,
+        encoding == kVertexEncoding_Octahedral16 ? "vec2" : "vec3", kStreamNames[stream]);
+      result += line;
+    }
+  }
+
+  result += "\n// Object space once multiplied by the model matrix, which holds the dequantization\n";
+  result += "vec3 decodePosition() { return position; }\n";
+
+  if (_encodings[kVertexStream_Color] != kVertexEncoding_None)
+  {
+    result += "vec3 decodeColor() { return color; }\n";
+  }
+
+  switch (_encodings[kVertexStream_Normal])
+  {
+  case kVertexEncoding_Octahedral16:
+    result +=
+      "vec3 decodeNormal()\n"
+      "{\n"
+      "  vec3 n = vec3(normal, 1.0 - abs(normal.x) - abs(normal.y));\n"
+      "  float t = max(-n.z, 0.0);\n"
+      "  n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);\n"
+      "  return normalize(n);\n"
+      "}\n";
+    break;
+  case kVertexEncoding_Float3:
+  case kVertexEncoding_Snorm16x4:
+    result += "vec3 decodeNormal() { return normalize(normal); }\n";
+    break;
+  default:
+    break;
+  }
+
+  return result;
+}
+
+uint32_t VertexLayout::encodingSize(VertexEncoding encoding)
+{
+  switch (encoding)
+  {
+  case kVertexEncoding_Float3: return 12;
+  case kVertexEncoding_Half4: return 8;
+  case kVertexEncoding_Snorm16x4: return 8;
+  case kVertexEncoding_Unorm8x4: return 4;
+  case kVertexEncoding_Octahedral16: return 4;
+  default: return 0;
+  }
+}
+
+const char* VertexLayout::encodingName(VertexEncoding encoding)
+{
+  return encoding < kVertexEncoding_Count ? kEncodingNames[encoding] : "unknown";
+}
+
+int VertexLayout::parseEncoding(const char* name, VertexEncoding* encoding)
+{
+  for (uint32_t i = 0; i < kVertexEncoding_Count; i++)
+  {
+    if (strcmp(name, kEncodingNames[i]) == 0)
+    {
+      *encoding = (VertexEncoding) i;
+      return 1;
+    }
+  }
+  return 0;
+}
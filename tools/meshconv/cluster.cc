@@ -0,0 +1,143 @@
+#include "cluster.h"
+
+#include <math.h>
+
+// Cones wider than this, as the cosine of their half angle, would cull
+// almost nothing from where triangles are visible at all
+static const float kMinConeSpread = 0.1f;
+
+static void computeBounds(const float* positions, const uint32_t* vertices, const uint8_t* triangles,
+  MeshCluster* cluster)
+{
+  float bounds_min[3] = { INFINITY, INFINITY, INFINITY };
+  float bounds_max[3] = { -INFINITY, -INFINITY, -INFINITY };
+  for (uint32_t i = 0; i < cluster->vertex_count; i++)
+  {
+    const float* position = &positions[vertices[i] * 3];
+    for (uint32_t axis = 0; axis < 3; axis++)
+    {
+      bounds_min[axis] = fminf(bounds_min[axis], position[axis]);
+      bounds_max[axis] = fmaxf(bounds_max[axis], position[axis]);
+    }
+  }
+
+  float radius = 0.0f;
+  for (uint32_t axis = 0; axis < 3; axis++)
+  {
+    cluster->center[axis] = (bounds_min[axis] + bounds_max[axis]) * 0.5f;
+  }
+  for (uint32_t i = 0; i < cluster->vertex_count; i++)
+  {
+    const float* position = &positions[vertices[i] * 3];
+    float dx = position[0] - cluster->center[0];
+    float dy = position[1] - cluster->center[1];
+    float dz = position[2] - cluster->center[2];
+    radius = fmaxf(radius, sqrtf(dx * dx + dy * dy + dz * dz));
+  }
+  cluster->radius = radius;
+
+  // Front facing normals are clockwise, so the cross product is reversed
+  float normals[kMeshClusterMaxTriangles][3];
+  uint32_t normal_count = 0;
+  float axis[3] = {};
+  for (uint32_t i = 0; i < cluster->triangle_count; i++)
+  {
+    const float* p0 = &positions[vertices[triangles[i * 3]] * 3];
+    const float* p1 = &positions[vertices[triangles[i * 3 + 1]] * 3];
+    const float* p2 = &positions[vertices[triangles[i * 3 + 2]] * 3];
+    float e1[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+    float e2[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    float normal[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+    float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+
+    // Degenerate triangles are never rasterized, they do not widen the cone
+    if (length > 0.0f)
+    {
+      for (uint32_t k = 0; k < 3; k++)
+      {
+        normals[normal_count][k] = normal[k] / length;
+        axis[k] += normals[normal_count][k];
+      }
+      normal_count++;
+    }
+  }
+
+  float axis_length = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+  float min_dot = 1.0f;
+  for (uint32_t i = 0; i < normal_count && axis_length > 0.0f; i++)
+  {
+    float dot = (normals[i][0] * axis[0] + normals[i][1] * axis[1] + normals[i][2] * axis[2]) / axis_length;
+    min_dot = fminf(min_dot, dot);
+  }
+
+  if (axis_length == 0.0f || min_dot <= kMinConeSpread)
+  {
+    cluster->cone_axis[0] = 0.0f;
+    cluster->cone_axis[1] = 0.0f;
+    cluster->cone_axis[2] = 1.0f;
+    cluster->cone_cutoff = 1.0f;
+    return;
+  }
+
+  // Stored as the sine of the widest angle to a normal, see MeshCluster
+  for (uint32_t k = 0; k < 3; k++)
+  {
+    cluster->cone_axis[k] = axis[k] / axis_length;
+  }
+  cluster->cone_cutoff = sqrtf(1.0f - min_dot * min_dot);
+}
+
+void buildClusters(const uint32_t* indices, size_t index_count, const float* positions, uint32_t vertex_count,
+  ClusterData* result)
+{
+  result->clusters.clear();
+  result->vertices.clear();
+  result->triangles.clear();
+
+  // Local index of every vertex in the open cluster, 0xff when not in it
+  std::vector<uint8_t> local(vertex_count, 0xff);
+  MeshCluster cluster = {};
+
+  for (size_t i = 0; i + 2 < index_count; i += 3)
+  {
+    uint32_t added = 0;
+    for (uint32_t k = 0; k < 3; k++)
+    {
+      added += local[indices[i + k]] == 0xff ? 1 : 0;
+    }
+
+    if (cluster.vertex_count + added > kMeshClusterMaxVertices || cluster.triangle_count == kMeshClusterMaxTriangles)
+    {
+      computeBounds(positions, &result->vertices[cluster.vertex_offset],
+        &result->triangles[cluster.triangle_offset * 3], &cluster);
+      result->clusters.push_back(cluster);
+
+      for (uint32_t k = 0; k < cluster.vertex_count; k++)
+      {
+        local[result->vertices[cluster.vertex_offset + k]] = 0xff;
+      }
+      cluster = MeshCluster();
+      cluster.vertex_offset = (uint32_t) result->vertices.size();
+      cluster.triangle_offset = (uint32_t) (result->triangles.size() / 3);
+    }
+
+    for (uint32_t k = 0; k < 3; k++)
+    {
+      uint32_t vertex = indices[i + k];
+      if (local[vertex] == 0xff)
+      {
+        local[vertex] = (uint8_t) cluster.vertex_count++;
+        result->vertices.push_back(vertex);
+      }
+      result->triangles.push_back(local[vertex]);
+    }
+    cluster.triangle_count++;
+  }
+
+  if (cluster.triangle_count > 0)
+  {
+    computeBounds(positions, &result->vertices[cluster.vertex_offset], &result->triangles[cluster.triangle_offset * 3],
+      &cluster);
+    result->clusters.push_back(cluster);
+  }
+}
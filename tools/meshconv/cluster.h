@@ -0,0 +1,30 @@
+#ifndef __CLUSTER_H__
+#define __CLUSTER_H__ 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "mesh_format.h"
+
+struct ClusterData
+{
+  std::vector<MeshCluster> clusters;
+  // Vertex indices of every cluster, back to back
+  std::vector<uint32_t> vertices;
+  // Three local indices per triangle, back to back
+  std::vector<uint8_t> triangles;
+};
+
+// Splits a triangle list into clusters of at most kMeshClusterMaxVertices
+// and kMeshClusterMaxTriangles, in list order. The list should already be
+// ordered for the vertex cache, which keeps neighbouring triangles
+// together, so each cluster is spatially compact.
+//
+// Cones are built from front facing normals, triangles are front facing
+// when clockwise like the demo pipeline expects.
+void buildClusters(const uint32_t* indices, size_t index_count, const float* positions, uint32_t vertex_count,
+  ClusterData* result);
+
+#endif // __CLUSTER_H__
@@ -0,0 +1,502 @@
+// meshconv [options] <input.obj> <output.mesh>
+//
+//   --positions float|half|snorm16   default snorm16
+//   --colors none|float|half|unorm8  default unorm8
+//   --normals none|float|snorm16|oct16  default none
+//   --glsl <file>  writes the shader inputs of the layout
+//
+// Converts Wavefront OBJ into the binary mesh format (see mesh_format.h).
+// Vertex colors use the common "v x y z r g b" extension, vertices without
+// them are white. Faces with more than three vertices are fanned, texture
+// coordinates and normals are ignored, normals are computed from the faces
+// when the layout has them.
+//
+// Levels of detail are generated by halving the triangle count of the full
+// mesh until the simplifier stalls or kMeshMaxLods is reached. Every level
+// is then ordered for the vertex cache and for overdraw, and the vertices
+// are renumbered in order of first use. The finest level is finally split
+// into clusters of at most 64 vertices and 124 triangles, with bounding
+// spheres and normal cones the renderer culls them with.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "mesh_format.h"
+#include "cluster.h"
+#include "optimize.h"
+#include "simplify.h"
+
+// A level that removes less than this fraction of the previous one is
+// not worth its indices
+static const float kMinLodReduction = 0.15f;
+static const uint32_t kMinLodTriangles = 8;
+// Cache size ACMR and ATVR are reported for, a common hardware FIFO
+static const uint32_t kReportCacheSize = 16;
+// Overdraw ordering may give up this much ACMR
+static const float kOverdrawThreshold = 1.05f;
+
+struct ObjMesh
+{
+  std::vector<float> positions;
+  std::vector<float> colors;
+  std::vector<uint32_t> indices;
+};
+
+// Resolves a 1 based, possibly negative, OBJ index
+static bool resolveIndex(long index, size_t count, uint32_t* result)
+{
+  long resolved = index > 0 ? index - 1 : (long) count + index;
+  if (index == 0 || resolved < 0 || resolved >= (long) count)
+  {
+    return false;
+  }
+
+  *result = (uint32_t) resolved;
+  return true;
+}
+
+static bool loadObj(const char* file_name, ObjMesh* mesh)
+{
+  FILE* file = fopen(file_name, "r");
+  if (file == nullptr)
+  {
+    fprintf(stderr, "Failed opening %s\n", file_name);
+    return false;
+  }
+
+  char line[1024];
+  uint32_t line_number = 0;
+  bool valid = true;
+
+  while (valid && fgets(line, sizeof(line), file) != nullptr)
+  {
+    line_number++;
+
+    if (line[0] == 'v' && line[1] == ' ')
+    {
+      float values[6] = { 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f };
+      int count = sscanf(line + 2, "%f %f %f %f %f %f",
+        &values[0], &values[1], &values[2], &values[3], &values[4], &values[5]);
+
+      if (count < 3)
+      {
+        fprintf(stderr, "%s:%u: invalid vertex\n", file_name, line_number);
+        valid = false;
+        break;
+      }
+
+      // x y z w has no color
+      if (count < 6)
+      {
+        values[3] = values[4] = values[5] = 1.0f;
+      }
+
+      mesh->positions.insert(mesh->positions.end(), values, values + 3);
+      mesh->colors.insert(mesh->colors.end(), values + 3, values + 6);
+    }
+    else if (line[0] == 'f' && line[1] == ' ')
+    {
+      size_t vertex_count = mesh->positions.size() / 3;
+      std::vector<uint32_t> face;
+
+      char* cursor = line + 2;
+      while (true)
+      {
+        char* end = nullptr;
+        long index = strtol(cursor, &end, 10);
+        if (end == cursor)
+        {
+          break;
+        }
+
+        uint32_t resolved;
+        if (!resolveIndex(index, vertex_count, &resolved))
+        {
+          fprintf(stderr, "%s:%u: vertex index out of range\n", file_name, line_number);
+          valid = false;
+          break;
+        }
+        face.push_back(resolved);
+
+        // Skip the /vt/vn part
+        cursor = end;
+        while (*cursor != '\0' && *cursor != ' ' && *cursor != '\t' && *cursor != '\n' && *cursor != '\r')
+        {
+          cursor++;
+        }
+      }
+
+      if (valid && face.size() < 3)
+      {
+        fprintf(stderr, "%s:%u: face with less than 3 vertices\n", file_name, line_number);
+        valid = false;
+      }
+
+      for (size_t i = 2; valid && i < face.size(); i++)
+      {
+        mesh->indices.push_back(face[0]);
+        mesh->indices.push_back(face[i - 1]);
+        mesh->indices.push_back(face[i]);
+      }
+    }
+  }
+
+  fclose(file);
+
+  if (valid && mesh->indices.empty())
+  {
+    fprintf(stderr, "%s has no faces\n", file_name);
+    valid = false;
+  }
+
+  return valid;
+}
+
+static void buildLods(const ObjMesh& mesh, std::vector<uint32_t>* indices, std::vector<MeshLod>* lods)
+{
+  MeshLod full = {};
+  full.index_count = (uint32_t) mesh.indices.size();
+  lods->push_back(full);
+  *indices = mesh.indices;
+
+  // Every level is simplified from the full mesh, so its error is measured
+  // against the original surface
+  while (lods->size() < kMeshMaxLods)
+  {
+    const MeshLod& previous = lods->back();
+    size_t target = (previous.index_count / 3 / 2) * 3;
+    if (target < kMinLodTriangles * 3)
+    {
+      break;
+    }
+
+    float error = 0.0f;
+    std::vector<uint32_t> simplified = simplifyMesh(mesh.positions, mesh.indices, target, &error);
+    if (simplified.size() > previous.index_count * (1.0f - kMinLodReduction))
+    {
+      break;
+    }
+
+    MeshLod lod = {};
+    lod.index_offset = (uint32_t) indices->size();
+    lod.index_count = (uint32_t) simplified.size();
+    lod.error = error > previous.error ? error : previous.error;
+    lods->push_back(lod);
+    indices->insert(indices->end(), simplified.begin(), simplified.end());
+  }
+}
+
+static void optimizeMesh(ObjMesh* mesh, std::vector<uint32_t>* indices, const std::vector<MeshLod>& lods)
+{
+  uint32_t vertex_count = (uint32_t) (mesh->positions.size() / 3);
+
+  for (size_t i = 0; i < lods.size(); i++)
+  {
+    uint32_t* lod_indices = indices->data() + lods[i].index_offset;
+    VertexCacheStats before = analyzeVertexCache(lod_indices, lods[i].index_count, vertex_count, kReportCacheSize);
+
+    optimizeVertexCache(lod_indices, lods[i].index_count, vertex_count);
+    optimizeOverdraw(lod_indices, lods[i].index_count, mesh->positions.data(), vertex_count, kOverdrawThreshold);
+
+    VertexCacheStats after = analyzeVertexCache(lod_indices, lods[i].index_count, vertex_count, kReportCacheSize);
+    printf("  lod %u: %u triangles, error %g, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", (uint32_t) i,
+      lods[i].index_count / 3, lods[i].error, before.acmr, after.acmr, before.atvr, after.atvr);
+  }
+
+  // The finest level comes first, so its vertices are the ones in order
+  std::vector<uint32_t> remap = optimizeVertexFetch(indices->data(), indices->size(), vertex_count);
+  std::vector<float> positions(mesh->positions.size());
+  std::vector<float> colors(mesh->colors.size());
+  for (uint32_t vertex = 0; vertex < vertex_count; vertex++)
+  {
+    for (uint32_t axis = 0; axis < 3; axis++)
+    {
+      positions[remap[vertex] * 3 + axis] = mesh->positions[vertex * 3 + axis];
+      colors[remap[vertex] * 3 + axis] = mesh->colors[vertex * 3 + axis];
+    }
+  }
+  mesh->positions.swap(positions);
+  mesh->colors.swap(colors);
+}
+
+static uint64_t alignSection(uint64_t offset)
+{
+  return (offset + kMeshSectionAlignment - 1) & ~((uint64_t) kMeshSectionAlignment - 1);
+}
+
+// Area weighted face normals of the finest level
+static std::vector<float> computeNormals(const ObjMesh& mesh, const std::vector<uint32_t>& indices, const MeshLod& lod)
+{
+  std::vector<float> normals(mesh.positions.size(), 0.0f);
+  for (uint32_t i = lod.index_offset; i < lod.index_offset + lod.index_count; i += 3)
+  {
+    const float* p0 = &mesh.positions[indices[i] * 3];
+    const float* p1 = &mesh.positions[indices[i + 1] * 3];
+    const float* p2 = &mesh.positions[indices[i + 2] * 3];
+    float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+    float normal[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+
+    for (uint32_t k = 0; k < 3; k++)
+    {
+      for (uint32_t axis = 0; axis < 3; axis++)
+      {
+        normals[indices[i + k] * 3 + axis] += normal[axis];
+      }
+    }
+  }
+
+  // Encoding normalizes them
+  return normals;
+}
+
+static bool writeMesh(const char* file_name, const ObjMesh& mesh, const std::vector<uint32_t>& lod_indices,
+  const std::vector<MeshLod>& lods, const ClusterData& clusters, const VertexLayout& layout)
+{
+  MeshHeader header = {};
+  header.magic = kMeshMagic;
+  header.version = kMeshVersion;
+  header.vertex_count = (uint32_t) (mesh.positions.size() / 3);
+  header.index_size = header.vertex_count <= 0xFFFF ? 2 : 4;
+  header.index_count = (uint32_t) lod_indices.size();
+  header.lod_count = (uint32_t) lods.size();
+  header.cluster_count = (uint32_t) clusters.clusters.size();
+  header.cluster_vertex_count = (uint32_t) clusters.vertices.size();
+  header.cluster_triangle_count = (uint32_t) (clusters.triangles.size() / 3);
+
+  for (uint32_t axis = 0; axis < 3; axis++)
+  {
+    header.bounds_min[axis] = mesh.positions[axis];
+    header.bounds_max[axis] = mesh.positions[axis];
+  }
+  for (size_t i = 0; i < mesh.positions.size(); i++)
+  {
+    uint32_t axis = i % 3;
+    header.bounds_min[axis] = mesh.positions[i] < header.bounds_min[axis] ? mesh.positions[i] : header.bounds_min[axis];
+    header.bounds_max[axis] = mesh.positions[i] > header.bounds_max[axis] ? mesh.positions[i] : header.bounds_max[axis];
+  }
+
+  for (uint32_t stream = 0; stream < kVertexStream_Count; stream++)
+  {
+    header.encodings[stream] = (uint8_t) layout.encoding((VertexStream) stream);
+  }
+  layout.positionQuantization(header.bounds_min, header.bounds_max, header.position_offset, header.position_scale);
+
+  std::vector<float> normals;
+  if (layout.encoding(kVertexStream_Normal) != kVertexEncoding_None)
+  {
+    normals = computeNormals(mesh, lod_indices, lods[0]);
+  }
+
+  const float* stream_values[kVertexStream_Count] = { mesh.positions.data(), mesh.colors.data(), normals.data() };
+  std::vector<uint8_t> streams[kVertexStream_Count];
+  for (uint32_t stream = 0; stream < kVertexStream_Count; stream++)
+  {
+    streams[stream].resize(header.vertex_count * layout.stride((VertexStream) stream));
+    if (!streams[stream].empty())
+    {
+      layout.encode((VertexStream) stream, stream_values[stream], header.vertex_count, header.position_offset,
+        header.position_scale, streams[stream].data());
+    }
+  }
+
+  std::vector<uint8_t> indices(lod_indices.size() * header.index_size);
+  for (size_t i = 0; i < lod_indices.size(); i++)
+  {
+    if (header.index_size == 2)
+    {
+      ((uint16_t*) indices.data())[i] = (uint16_t) lod_indices[i];
+    }
+    else
+    {
+      ((uint32_t*) indices.data())[i] = lod_indices[i];
+    }
+  }
+
+  const void* section_data[kMeshSection_Count] = {
+    streams[kVertexStream_Position].data(), streams[kVertexStream_Color].data(), streams[kVertexStream_Normal].data(),
+    indices.data(), lods.data(), clusters.clusters.data(), clusters.vertices.data(), clusters.triangles.data()
+  };
+  uint64_t section_sizes[kMeshSection_Count] = {
+    streams[kVertexStream_Position].size(),
+    streams[kVertexStream_Color].size(),
+    streams[kVertexStream_Normal].size(),
+    indices.size(),
+    lods.size() * sizeof(MeshLod),
+    clusters.clusters.size() * sizeof(MeshCluster),
+    clusters.vertices.size() * sizeof(uint32_t),
+    clusters.triangles.size()
+  };
+
+  uint64_t offset = alignSection(sizeof(MeshHeader));
+  for (uint32_t i = 0; i < kMeshSection_Count; i++)
+  {
+    header.sections[i].offset = offset;
+    header.sections[i].size = section_sizes[i];
+    offset = alignSection(offset + section_sizes[i]);
+  }
+
+  FILE* file = fopen(file_name, "wb");
+  if (file == nullptr)
+  {
+    fprintf(stderr, "Failed creating %s\n", file_name);
+    return false;
+  }
+
+  std::vector<uint8_t> contents(offset, 0);
+  memcpy(contents.data(), &header, sizeof(header));
+  for (uint32_t i = 0; i < kMeshSection_Count; i++)
+  {
+    if (section_sizes[i] > 0)
+    {
+      memcpy(contents.data() + header.sections[i].offset, section_data[i], (size_t) section_sizes[i]);
+    }
+  }
+
+  bool written = fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+  fclose(file);
+
+  if (!written)
+  {
+    fprintf(stderr, "Failed writing %s\n", file_name);
+    return false;
+  }
+
+  printf("%s: %u vertices, %u indices (%u bit), %llu bytes\n", file_name,
+    header.vertex_count, header.index_count, header.index_size * 8, (unsigned long long) contents.size());
+
+  uint32_t float_size = 0;
+  for (uint32_t stream = 0; stream < kVertexStream_Count; stream++)
+  {
+    float_size += layout.encoding((VertexStream) stream) != kVertexEncoding_None ? sizeof(float) * 3 : 0;
+  }
+  printf("  vertex: position %s, color %s, normal %s, %u bytes instead of %u\n",
+    VertexLayout::encodingName(layout.encoding(kVertexStream_Position)),
+    VertexLayout::encodingName(layout.encoding(kVertexStream_Color)),
+    VertexLayout::encodingName(layout.encoding(kVertexStream_Normal)), layout.vertexSize(), float_size);
+  return true;
+}
+
+static void reportClusters(const ClusterData& data)
+{
+  uint32_t cones = 0;
+  for (const MeshCluster& cluster : data.clusters)
+  {
+    cones += cluster.cone_cutoff < 1.0f ? 1 : 0;
+  }
+
+  uint32_t count = (uint32_t) data.clusters.size();
+  printf("  clusters: %u, %.1f vertices and %.1f triangles each, %u with a backface cone\n", count,
+    count > 0 ? data.vertices.size() / (float) count : 0.0f,
+    count > 0 ? data.triangles.size() / 3.0f / count : 0.0f, cones);
+}
+
+static bool writeGlsl(const char* file_name, const VertexLayout& layout)
+{
+  FILE* file = fopen(file_name, "w");
+  if (file == nullptr)
+  {
+    fprintf(stderr, "Failed creating %s\n", file_name);
+    return false;
+  }
+
+  std::string glsl = layout.glsl();
+  bool written = fwrite(glsl.data(), 1, glsl.size(), file) == glsl.size();
+  fclose(file);
+
+  if (!written)
+  {
+    fprintf(stderr, "Failed writing %s\n", file_name);
+  }
+  return written;
+}
+
+int main(int argc, char** argv)
+{
+  static const char* const kStreamOptions[kVertexStream_Count] = { "--positions", "--colors", "--normals" };
+
+  VertexLayout layout;
+  layout.setEncoding(kVertexStream_Position, kVertexEncoding_Snorm16x4);
+  layout.setEncoding(kVertexStream_Color, kVertexEncoding_Unorm8x4);
+  const char* glsl_file = nullptr;
+
+  int first = 1;
+  while (first + 1 < argc && strncmp(argv[first], "--", 2) == 0)
+  {
+    bool known = strcmp(argv[first], "--glsl") == 0;
+    if (known)
+    {
+      glsl_file = argv[first + 1];
+    }
+
+    for (uint32_t stream = 0; stream < kVertexStream_Count; stream++)
+    {
+      if (strcmp(argv[first], kStreamOptions[stream]) == 0)
+      {
+        VertexEncoding encoding;
+        if (!VertexLayout::parseEncoding(argv[first + 1], &encoding) ||
+            !layout.setEncoding((VertexStream) stream, encoding))
+        {
+          fprintf(stderr, "%s cannot be %s\n", kStreamOptions[stream] + 2, argv[first + 1]);
+          return 1;
+        }
+        known = true;
+      }
+    }
+
+    if (!known)
+    {
+      fprintf(stderr, "Unknown option %s\n", argv[first]);
+      return 1;
+    }
+    first += 2;
+  }
+
+  if (argc - first != 2)
+  {
+    fprintf(stderr, "usage: meshconv [--positions float|half|snorm16] [--colors none|float|half|unorm8]\n"
+      "  [--normals none|float|snorm16|oct16] [--glsl <file>] <input.obj> <output.mesh>\n");
+    return 1;
+  }
+
+  const char* input = argv[first];
+  const char* output = argv[first + 1];
+  const char* extension = strrchr(input, '.');
+  if (extension == nullptr || strcmp(extension, ".obj") != 0)
+  {
+    fprintf(stderr, "Only .obj input is supported\n");
+    return 1;
+  }
+
+  ObjMesh mesh;
+  if (!loadObj(input, &mesh))
+  {
+    return 1;
+  }
+
+  std::vector<uint32_t> indices;
+  std::vector<MeshLod> lods;
+  buildLods(mesh, &indices, &lods);
+  optimizeMesh(&mesh, &indices, lods);
+
+  ClusterData clusters;
+  buildClusters(indices.data() + lods[0].index_offset, lods[0].index_count, mesh.positions.data(),
+    (uint32_t) (mesh.positions.size() / 3), &clusters);
+
+  if (!writeMesh(output, mesh, indices, lods, clusters, layout))
+  {
+    return 1;
+  }
+  reportClusters(clusters);
+
+  if (glsl_file != nullptr && !writeGlsl(glsl_file, layout))
+  {
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,355 @@
+#include "optimize.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <numeric>
+
+// Forsyth's tuning, for an LRU cache of kCacheSize entries
+static const uint32_t kCacheSize = 32;
+static const float kCacheDecayPower = 1.5f;
+static const float kLastTriangleScore = 0.75f;
+static const float kValenceBoostScale = 2.0f;
+static const float kValenceBoostPower = 0.5f;
+
+// Cache used to find where a cluster can end without losing hits
+static const uint32_t kClusterCacheSize = 16;
+
+static float vertexScore(int cache_position, uint32_t remaining)
+{
+  // No triangles left, the vertex is done
+  if (remaining == 0)
+  {
+    return -1.0f;
+  }
+
+  float score = 0.0f;
+  if (cache_position >= 0)
+  {
+    // The last triangle's vertices score lower on purpose, so the next
+    // triangle does not just reuse the same edge
+    if (cache_position < 3)
+    {
+      score = kLastTriangleScore;
+    }
+    else
+    {
+      score = powf(1.0f - (cache_position - 3) / (float) (kCacheSize - 3), kCacheDecayPower);
+    }
+  }
+
+  // Vertices with few triangles left are finished first
+  return score + kValenceBoostScale * powf((float) remaining, -kValenceBoostPower);
+}
+
+VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t index_count, uint32_t vertex_count,
+  uint32_t cache_size)
+{
+  VertexCacheStats stats = {};
+
+  // A vertex is cached while fewer than cache_size misses happened since
+  // its own, which is a FIFO without storing the queue
+  std::vector<uint32_t> timestamps(vertex_count, 0);
+  std::vector<uint8_t> used(vertex_count, 0);
+  uint32_t time = cache_size + 1;
+  uint32_t unique = 0;
+
+  for (size_t i = 0; i < index_count; i++)
+  {
+    uint32_t vertex = indices[i];
+    if (time - timestamps[vertex] > cache_size)
+    {
+      timestamps[vertex] = time++;
+      stats.transforms++;
+    }
+
+    unique += used[vertex] ? 0 : 1;
+    used[vertex] = 1;
+  }
+
+  stats.acmr = index_count > 0 ? stats.transforms / (float) (index_count / 3) : 0.0f;
+  stats.atvr = unique > 0 ? stats.transforms / (float) unique : 0.0f;
+  return stats;
+}
+
+void optimizeVertexCache(uint32_t* indices, size_t index_count, uint32_t vertex_count)
+{
+  uint32_t triangle_count = (uint32_t) (index_count / 3);
+  if (triangle_count == 0)
+  {
+    return;
+  }
+
+  // Triangles of every vertex, the first remaining[v] are not emitted yet
+  std::vector<uint32_t> offsets(vertex_count + 1, 0);
+  for (size_t i = 0; i < index_count; i++)
+  {
+    offsets[indices[i] + 1]++;
+  }
+  std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+  std::vector<uint32_t> remaining(vertex_count, 0);
+  std::vector<uint32_t> adjacency(index_count);
+  for (size_t i = 0; i < index_count; i++)
+  {
+    uint32_t vertex = indices[i];
+    adjacency[offsets[vertex] + remaining[vertex]++] = (uint32_t) (i / 3);
+  }
+
+  std::vector<int> cache_positions(vertex_count, -1);
+  std::vector<float> vertex_scores(vertex_count);
+  for (uint32_t vertex = 0; vertex < vertex_count; vertex++)
+  {
+    vertex_scores[vertex] = vertexScore(-1, remaining[vertex]);
+  }
+
+  std::vector<uint8_t> emitted(triangle_count, 0);
+  uint32_t best = 0;
+  float best_score = -1.0f;
+  for (uint32_t triangle = 0; triangle < triangle_count; triangle++)
+  {
+    const uint32_t* corners = &indices[triangle * 3];
+    float score = vertex_scores[corners[0]] + vertex_scores[corners[1]] + vertex_scores[corners[2]];
+    if (score > best_score)
+    {
+      best = triangle;
+      best_score = score;
+    }
+  }
+
+  std::vector<uint32_t> result;
+  result.reserve(index_count);
+  uint32_t cache[kCacheSize + 3];
+  uint32_t cache_count = 0;
+  uint32_t cursor = 0;
+
+  while (result.size() < index_count)
+  {
+    // Nothing in the cache has triangles left, take the next one in order
+    if (best_score < 0.0f)
+    {
+      while (emitted[cursor])
+      {
+        cursor++;
+      }
+      best = cursor;
+    }
+
+    uint32_t corners[3] = { indices[best * 3], indices[best * 3 + 1], indices[best * 3 + 2] };
+    result.insert(result.end(), corners, corners + 3);
+    emitted[best] = 1;
+
+    for (uint32_t corner : corners)
+    {
+      uint32_t* triangles = &adjacency[offsets[corner]];
+      for (uint32_t i = 0; i < remaining[corner]; i++)
+      {
+        if (triangles[i] == best)
+        {
+          triangles[i] = triangles[--remaining[corner]];
+          break;
+        }
+      }
+    }
+
+    // The triangle's vertices move to the front, the rest shifts back
+    uint32_t next_cache[kCacheSize + 3];
+    uint32_t next_count = 0;
+    for (uint32_t corner : corners)
+    {
+      if (std::find(next_cache, next_cache + next_count, corner) == next_cache + next_count)
+      {
+        next_cache[next_count++] = corner;
+      }
+    }
+    for (uint32_t i = 0; i < cache_count; i++)
+    {
+      if (std::find(next_cache, next_cache + next_count, cache[i]) == next_cache + next_count)
+      {
+        next_cache[next_count++] = cache[i];
+      }
+    }
+
+    for (uint32_t i = 0; i < next_count; i++)
+    {
+      uint32_t vertex = next_cache[i];
+      cache_positions[vertex] = i < kCacheSize ? (int) i : -1;
+      vertex_scores[vertex] = vertexScore(cache_positions[vertex], remaining[vertex]);
+    }
+
+    // Only triangles around the cache changed score
+    best_score = -1.0f;
+    for (uint32_t i = 0; i < next_count; i++)
+    {
+      uint32_t vertex = next_cache[i];
+      const uint32_t* triangles = &adjacency[offsets[vertex]];
+      for (uint32_t k = 0; k < remaining[vertex]; k++)
+      {
+        const uint32_t* triangle = &indices[triangles[k] * 3];
+        float score = vertex_scores[triangle[0]] + vertex_scores[triangle[1]] + vertex_scores[triangle[2]];
+        if (score > best_score)
+        {
+          best = triangles[k];
+          best_score = score;
+        }
+      }
+    }
+
+    cache_count = std::min(next_count, kCacheSize);
+    std::copy(next_cache, next_cache + cache_count, cache);
+  }
+
+  std::copy(result.begin(), result.end(), indices);
+}
+
+void optimizeOverdraw(uint32_t* indices, size_t index_count, const float* positions, uint32_t vertex_count,
+  float threshold)
+{
+  uint32_t triangle_count = (uint32_t) (index_count / 3);
+  if (triangle_count == 0)
+  {
+    return;
+  }
+
+  float acmr = analyzeVertexCache(indices, index_count, vertex_count, kClusterCacheSize).acmr;
+
+  // Cluster starts, cut where the cache restarts anyway or where the
+  // cluster so far, from a cold cache, is cheap enough
+  std::vector<uint32_t> clusters;
+  std::vector<uint32_t> timestamps(vertex_count, 0);
+  uint32_t time = kClusterCacheSize + 1;
+  uint32_t cluster_misses = 0;
+  uint32_t cluster_start = 0;
+
+  for (uint32_t triangle = 0; triangle < triangle_count; triangle++)
+  {
+    uint32_t misses = 0;
+    for (uint32_t k = 0; k < 3; k++)
+    {
+      uint32_t vertex = indices[triangle * 3 + k];
+      if (time - timestamps[vertex] > kClusterCacheSize)
+      {
+        timestamps[vertex] = time++;
+        misses++;
+      }
+    }
+
+    uint32_t cluster_triangles = triangle - cluster_start;
+    bool restart = misses == 3;
+    bool cheap = cluster_triangles > 0 && cluster_misses <= threshold * acmr * cluster_triangles;
+    if (triangle == 0 || restart || cheap)
+    {
+      clusters.push_back(triangle);
+      cluster_start = triangle;
+      cluster_misses = 0;
+
+      // Later triangles of the cluster start from a cold cache
+      time += kClusterCacheSize + 1;
+      misses = 0;
+      for (uint32_t k = 0; k < 3; k++)
+      {
+        uint32_t vertex = indices[triangle * 3 + k];
+        if (time - timestamps[vertex] > kClusterCacheSize)
+        {
+          timestamps[vertex] = time++;
+          misses++;
+        }
+      }
+    }
+
+    cluster_misses += misses;
+  }
+
+  // Area weighted centroid and normal of every cluster
+  uint32_t cluster_count = (uint32_t) clusters.size();
+  clusters.push_back(triangle_count);
+  std::vector<double> centroids(cluster_count * 3, 0.0);
+  std::vector<double> normals(cluster_count * 3, 0.0);
+  std::vector<double> areas(cluster_count, 0.0);
+  double mesh_centroid[3] = {};
+  double mesh_area = 0.0;
+
+  for (uint32_t cluster = 0; cluster < cluster_count; cluster++)
+  {
+    for (uint32_t triangle = clusters[cluster]; triangle < clusters[cluster + 1]; triangle++)
+    {
+      const float* p0 = &positions[indices[triangle * 3] * 3];
+      const float* p1 = &positions[indices[triangle * 3 + 1] * 3];
+      const float* p2 = &positions[indices[triangle * 3 + 2] * 3];
+      double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+      double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+      double normal[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+      double area = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+
+      for (uint32_t axis = 0; axis < 3; axis++)
+      {
+        double center = (p0[axis] + p1[axis] + p2[axis]) / 3.0;
+        centroids[cluster * 3 + axis] += center * area;
+        normals[cluster * 3 + axis] += normal[axis];
+        mesh_centroid[axis] += center * area;
+      }
+      areas[cluster] += area;
+      mesh_area += area;
+    }
+  }
+
+  for (uint32_t axis = 0; axis < 3; axis++)
+  {
+    mesh_centroid[axis] /= mesh_area > 0.0 ? mesh_area : 1.0;
+  }
+
+  std::vector<double> keys(cluster_count, 0.0);
+  for (uint32_t cluster = 0; cluster < cluster_count; cluster++)
+  {
+    const double* normal = &normals[cluster * 3];
+    double length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+    if (areas[cluster] == 0.0 || length == 0.0)
+    {
+      continue;
+    }
+
+    for (uint32_t axis = 0; axis < 3; axis++)
+    {
+      double offset = centroids[cluster * 3 + axis] / areas[cluster] - mesh_centroid[axis];
+      keys[cluster] += offset * normal[axis] / length;
+    }
+  }
+
+  std::vector<uint32_t> order(cluster_count);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return keys[a] > keys[b]; });
+
+  std::vector<uint32_t> result;
+  result.reserve(index_count);
+  for (uint32_t cluster : order)
+  {
+    result.insert(result.end(), indices + clusters[cluster] * 3, indices + clusters[cluster + 1] * 3);
+  }
+  std::copy(result.begin(), result.end(), indices);
+}
+
+std::vector<uint32_t> optimizeVertexFetch(uint32_t* indices, size_t index_count, uint32_t vertex_count)
+{
+  std::vector<uint32_t> remap(vertex_count, UINT32_MAX);
+  uint32_t next = 0;
+
+  for (size_t i = 0; i < index_count; i++)
+  {
+    uint32_t& target = remap[indices[i]];
+    if (target == UINT32_MAX)
+    {
+      target = next++;
+    }
+    indices[i] = target;
+  }
+
+  for (uint32_t vertex = 0; vertex < vertex_count; vertex++)
+  {
+    if (remap[vertex] == UINT32_MAX)
+    {
+      remap[vertex] = next++;
+    }
+  }
+
+  return remap;
+}
@@ -0,0 +1,39 @@
+#ifndef __OPTIMIZE_H__
+#define __OPTIMIZE_H__ 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// Post transform cache of a triangle list, simulated as a FIFO
+struct VertexCacheStats
+{
+  uint32_t transforms;
+  // Transforms per triangle, 0.5 is the limit for large regular meshes
+  float acmr;
+  // Transforms per referenced vertex, 1 is optimal
+  float atvr;
+};
+
+VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t index_count, uint32_t vertex_count,
+  uint32_t cache_size);
+
+// Reorders triangles for the post transform cache with Tom Forsyth's
+// linear speed algorithm: greedily emits the triangle whose vertices score
+// best on an LRU cache position and on how few triangles they have left.
+void optimizeVertexCache(uint32_t* indices, size_t index_count, uint32_t vertex_count);
+
+// Splits a cache optimized list in clusters, at cache restarts and where
+// the cluster ACMR is within threshold of the whole list, then draws the
+// clusters facing away from the mesh center first (Sander, Nehab and
+// Barczak). Those tend to occlude the rest, and the ACMR grows by at most
+// the threshold.
+void optimizeOverdraw(uint32_t* indices, size_t index_count, const float* positions, uint32_t vertex_count,
+  float threshold);
+
+// Renumbers vertices in order of first use so fetches walk memory
+// forward. Returns the old to new vertex map, unused vertices go last.
+std::vector<uint32_t> optimizeVertexFetch(uint32_t* indices, size_t index_count, uint32_t vertex_count);
+
+#endif // __OPTIMIZE_H__
@@ -0,0 +1,349 @@
+#include "simplify.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <iterator>
+#include <numeric>
+
+// Collapses whose moved triangles turn by more than about 75 degrees are
+// rejected, which also catches triangles that become degenerate
+static const double kMinNormalCosine = 0.25;
+
+// Symmetric 4x4 matrix of the summed plane equations, weighted by area
+struct Quadric
+{
+  double a00, a01, a02, a03;
+  double a11, a12, a13;
+  double a22, a23;
+  double a33;
+  double weight;
+};
+
+struct Collapse
+{
+  uint32_t from;
+  uint32_t to;
+  double error;
+};
+
+static void addPlane(Quadric* q, double a, double b, double c, double d, double weight)
+{
+  q->a00 += weight * a * a; q->a01 += weight * a * b; q->a02 += weight * a * c; q->a03 += weight * a * d;
+  q->a11 += weight * b * b; q->a12 += weight * b * c; q->a13 += weight * b * d;
+  q->a22 += weight * c * c; q->a23 += weight * c * d;
+  q->a33 += weight * d * d;
+  q->weight += weight;
+}
+
+static void addQuadric(Quadric* q, const Quadric& other)
+{
+  q->a00 += other.a00; q->a01 += other.a01; q->a02 += other.a02; q->a03 += other.a03;
+  q->a11 += other.a11; q->a12 += other.a12; q->a13 += other.a13;
+  q->a22 += other.a22; q->a23 += other.a23;
+  q->a33 += other.a33;
+  q->weight += other.weight;
+}
+
+// Mean squared distance from the point to the planes of the quadric
+static double evaluate(const Quadric& q, const float* p)
+{
+  double x = p[0], y = p[1], z = p[2];
+  double error =
+    q.a00 * x * x + 2.0 * q.a01 * x * y + 2.0 * q.a02 * x * z + 2.0 * q.a03 * x +
+    q.a11 * y * y + 2.0 * q.a12 * y * z + 2.0 * q.a13 * y +
+    q.a22 * z * z + 2.0 * q.a23 * z +
+    q.a33;
+  return q.weight > 0.0 ? std::max(error, 0.0) / q.weight : 0.0;
+}
+
+static void triangleNormal(const float* p0, const float* p1, const float* p2, double* normal)
+{
+  double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+  double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+  normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+  normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+  normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+// Working state of one simplification, vertices are canonical ids: the
+// first vertex of every group of vertices sharing a position
+struct Simplifier
+{
+  const float* positions;
+  std::vector<uint32_t> canonical;
+  std::vector<uint8_t> locked;
+  std::vector<Quadric> quadrics;
+
+  // Triangles around every vertex of the current index buffer
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> adjacency;
+
+  const float* position(uint32_t vertex) const { return positions + vertex * 3; }
+  void buildAdjacency(const std::vector<uint32_t>& indices);
+  bool canCollapse(const std::vector<uint32_t>& indices, uint32_t from, uint32_t to) const;
+};
+
+void Simplifier::buildAdjacency(const std::vector<uint32_t>& indices)
+{
+  offsets.assign(canonical.size() + 1, 0);
+  for (uint32_t index : indices)
+  {
+    offsets[canonical[index] + 1]++;
+  }
+  std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+  std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+  adjacency.resize(indices.size());
+  for (size_t i = 0; i < indices.size(); i++)
+  {
+    adjacency[cursor[canonical[indices[i]]]++] = (uint32_t) (i / 3);
+  }
+}
+
+bool Simplifier::canCollapse(const std::vector<uint32_t>& indices, uint32_t from, uint32_t to) const
+{
+  // Vertices connected to both ends must be exactly the third vertices of
+  // the triangles on the edge, anything else pinches the surface
+  std::vector<uint32_t> from_neighbours, to_neighbours;
+  uint32_t shared_triangles = 0;
+
+  for (uint32_t i = offsets[from]; i < offsets[from + 1]; i++)
+  {
+    const uint32_t* triangle = &indices[adjacency[i] * 3];
+    uint32_t corners[3] = { canonical[triangle[0]], canonical[triangle[1]], canonical[triangle[2]] };
+    bool has_to = corners[0] == to || corners[1] == to || corners[2] == to;
+    shared_triangles += has_to ? 1 : 0;
+
+    for (uint32_t corner : corners)
+    {
+      if (corner != from)
+      {
+        from_neighbours.push_back(corner);
+      }
+    }
+
+    // Triangles on the edge disappear, the others must keep their facing
+    if (!has_to)
+    {
+      const float* points[3];
+      for (uint32_t k = 0; k < 3; k++)
+      {
+        points[k] = position(corners[k] == from ? to : corners[k]);
+      }
+
+      double before[3], after[3];
+      triangleNormal(position(corners[0]), position(corners[1]), position(corners[2]), before);
+      triangleNormal(points[0], points[1], points[2], after);
+
+      double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+      double lengths = sqrt(before[0] * before[0] + before[1] * before[1] + before[2] * before[2]) *
+        sqrt(after[0] * after[0] + after[1] * after[1] + after[2] * after[2]);
+      if (lengths == 0.0 || dot < kMinNormalCosine * lengths)
+      {
+        return false;
+      }
+    }
+  }
+
+  for (uint32_t i = offsets[to]; i < offsets[to + 1]; i++)
+  {
+    const uint32_t* triangle = &indices[adjacency[i] * 3];
+    for (uint32_t k = 0; k < 3; k++)
+    {
+      uint32_t corner = canonical[triangle[k]];
+      if (corner != to)
+      {
+        to_neighbours.push_back(corner);
+      }
+    }
+  }
+
+  std::sort(from_neighbours.begin(), from_neighbours.end());
+  from_neighbours.erase(std::unique(from_neighbours.begin(), from_neighbours.end()), from_neighbours.end());
+  std::sort(to_neighbours.begin(), to_neighbours.end());
+  to_neighbours.erase(std::unique(to_neighbours.begin(), to_neighbours.end()), to_neighbours.end());
+
+  std::vector<uint32_t> common;
+  std::set_intersection(from_neighbours.begin(), from_neighbours.end(), to_neighbours.begin(), to_neighbours.end(),
+    std::back_inserter(common));
+  return common.size() == shared_triangles;
+}
+
+std::vector<uint32_t> simplifyMesh(const std::vector<float>& positions, const std::vector<uint32_t>& indices,
+  size_t target_index_count, float* error)
+{
+  uint32_t vertex_count = (uint32_t) (positions.size() / 3);
+  std::vector<uint32_t> result = indices;
+  double max_error = 0.0;
+
+  Simplifier simplifier;
+  simplifier.positions = positions.data();
+  simplifier.canonical.resize(vertex_count);
+  simplifier.locked.assign(vertex_count, 0);
+  simplifier.quadrics.assign(vertex_count, Quadric());
+
+  // Group vertices by position, seams are locked
+  std::vector<uint32_t> order(vertex_count);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    const float* pa = &positions[a * 3];
+    const float* pb = &positions[b * 3];
+    return pa[0] != pb[0] ? pa[0] < pb[0] : (pa[1] != pb[1] ? pa[1] < pb[1] : pa[2] < pb[2]);
+  });
+  for (uint32_t begin = 0, end = 0; begin < vertex_count; begin = end)
+  {
+    const float* first = &positions[order[begin] * 3];
+    for (end = begin + 1; end < vertex_count; end++)
+    {
+      const float* other = &positions[order[end] * 3];
+      if (other[0] != first[0] || other[1] != first[1] || other[2] != first[2])
+      {
+        break;
+      }
+    }
+
+    uint32_t group_first = *std::min_element(order.begin() + begin, order.begin() + end);
+    for (uint32_t i = begin; i < end; i++)
+    {
+      simplifier.canonical[order[i]] = group_first;
+      simplifier.locked[order[i]] = end - begin > 1 ? 1 : 0;
+    }
+  }
+
+  // Edges without a twin in the opposite direction are on a border
+  std::vector<uint64_t> edges;
+  edges.reserve(result.size());
+  for (size_t i = 0; i < result.size(); i++)
+  {
+    size_t next = i % 3 == 2 ? i - 2 : i + 1;
+    uint32_t a = simplifier.canonical[result[i]];
+    uint32_t b = simplifier.canonical[result[next]];
+    edges.push_back(((uint64_t) a << 32) | b);
+  }
+  std::sort(edges.begin(), edges.end());
+  for (uint64_t edge : edges)
+  {
+    uint64_t twin = (edge << 32) | (edge >> 32);
+    if (!std::binary_search(edges.begin(), edges.end(), twin))
+    {
+      simplifier.locked[(uint32_t) (edge >> 32)] = 1;
+      simplifier.locked[(uint32_t) edge] = 1;
+    }
+  }
+
+  for (size_t i = 0; i < result.size(); i += 3)
+  {
+    uint32_t corners[3] = {
+      simplifier.canonical[result[i]], simplifier.canonical[result[i + 1]], simplifier.canonical[result[i + 2]]
+    };
+    double normal[3];
+    triangleNormal(simplifier.position(corners[0]), simplifier.position(corners[1]), simplifier.position(corners[2]),
+      normal);
+    double length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+    if (length == 0.0)
+    {
+      continue;
+    }
+
+    double a = normal[0] / length, b = normal[1] / length, c = normal[2] / length;
+    const float* p = simplifier.position(corners[0]);
+    double d = -(a * p[0] + b * p[1] + c * p[2]);
+    for (uint32_t corner : corners)
+    {
+      addPlane(&simplifier.quadrics[corner], a, b, c, d, length * 0.5);
+    }
+  }
+
+  // Every pass collapses the cheapest edges that do not touch each other,
+  // about two triangles per collapse
+  std::vector<uint32_t> remap(vertex_count);
+  std::vector<uint8_t> touched(vertex_count);
+  std::vector<Collapse> collapses;
+
+  while (result.size() > target_index_count)
+  {
+    simplifier.buildAdjacency(result);
+
+    collapses.clear();
+    for (size_t i = 0; i < result.size(); i++)
+    {
+      size_t next = i % 3 == 2 ? i - 2 : i + 1;
+      uint32_t a = simplifier.canonical[result[i]];
+      uint32_t b = simplifier.canonical[result[next]];
+      // Interior edges show up once in each direction, take one of them
+      if (a >= b)
+      {
+        continue;
+      }
+
+      Quadric quadric = simplifier.quadrics[a];
+      addQuadric(&quadric, simplifier.quadrics[b]);
+      if (!simplifier.locked[a])
+      {
+        Collapse collapse = { a, b, evaluate(quadric, simplifier.position(b)) };
+        collapses.push_back(collapse);
+      }
+      if (!simplifier.locked[b])
+      {
+        Collapse collapse = { b, a, evaluate(quadric, simplifier.position(a)) };
+        collapses.push_back(collapse);
+      }
+    }
+    std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+      return a.error < b.error;
+    });
+
+    size_t wanted = std::max<size_t>((result.size() - target_index_count) / 6, 1);
+    size_t applied = 0;
+    std::iota(remap.begin(), remap.end(), 0);
+    std::fill(touched.begin(), touched.end(), 0);
+
+    for (size_t i = 0; i < collapses.size() && applied < wanted; i++)
+    {
+      const Collapse& collapse = collapses[i];
+      if (touched[collapse.from] || touched[collapse.to] || !simplifier.canCollapse(result, collapse.from, collapse.to))
+      {
+        continue;
+      }
+
+      // Neighbouring triangles change shape, their vertices wait a pass
+      for (uint32_t k = simplifier.offsets[collapse.from]; k < simplifier.offsets[collapse.from + 1]; k++)
+      {
+        const uint32_t* triangle = &result[simplifier.adjacency[k] * 3];
+        touched[simplifier.canonical[triangle[0]]] = 1;
+        touched[simplifier.canonical[triangle[1]]] = 1;
+        touched[simplifier.canonical[triangle[2]]] = 1;
+      }
+
+      remap[collapse.from] = collapse.to;
+      addQuadric(&simplifier.quadrics[collapse.to], simplifier.quadrics[collapse.from]);
+      max_error = std::max(max_error, collapse.error);
+      applied++;
+    }
+
+    if (applied == 0)
+    {
+      break;
+    }
+
+    // Unlocked vertices are alone in their group, so remapping the vertex
+    // is the same as remapping its position
+    size_t write = 0;
+    for (size_t i = 0; i < result.size(); i += 3)
+    {
+      uint32_t a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+      uint32_t ca = simplifier.canonical[a], cb = simplifier.canonical[b], cc = simplifier.canonical[c];
+      if (ca != cb && cb != cc && ca != cc)
+      {
+        result[write++] = a;
+        result[write++] = b;
+        result[write++] = c;
+      }
+    }
+    result.resize(write);
+  }
+
+  *error = (float) sqrt(max_error);
+  return result;
+}
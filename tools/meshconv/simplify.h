@@ -0,0 +1,23 @@
+#ifndef __SIMPLIFY_H__
+#define __SIMPLIFY_H__ 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// Quadric error metric simplification (Garland and Heckbert) by half edge
+// collapses: a vertex only ever moves onto one of its neighbours, so every
+// level of detail indexes the same vertex buffer.
+//
+// Vertices on open borders or on attribute seams (one position, several
+// vertices) are never moved, and collapses that flip or degenerate a
+// triangle are rejected, so the result can stop above the target.
+//
+// positions are float3, indices a triangle list. Returns the indices of
+// the simplified mesh, error receives the largest collapse error as a
+// distance in object space.
+std::vector<uint32_t> simplifyMesh(const std::vector<float>& positions, const std::vector<uint32_t>& indices,
+  size_t target_index_count, float* error);
+
+#endif // __SIMPLIFY_H__
@@ -0,0 +1,319 @@
+// packer <output.pak> <directory>...
+//
+// Packs every file under the given directories into a single asset pack
+// (see pack_format.h). Entry names are the paths as walked, with forward
+// slashes, so run it from the folder the demo resolves assets against:
+//   packer assets.pak shaders data
+// Entries are LZ4 compressed in independent blocks when that saves at
+// least an eighth of their size, otherwise they are stored as is.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "pack_format.h"
+#include "lz4.h"
+
+struct InputFile
+{
+  std::string name;
+  std::vector<uint8_t> data;
+};
+
+static bool readFile(const std::string& path, std::vector<uint8_t>* data)
+{
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr)
+  {
+    return false;
+  }
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  data->resize((size_t) size);
+  bool read = size == 0 || fread(data->data(), 1, (size_t) size, file) == (size_t) size;
+  fclose(file);
+  return read;
+}
+
+static void listFiles(const std::string& directory, std::vector<std::string>* files)
+{
+#ifdef _WIN32
+  WIN32_FIND_DATA find_data;
+  HANDLE find = FindFirstFile((directory + "/*").c_str(), &find_data);
+  if (find == INVALID_HANDLE_VALUE)
+  {
+    return;
+  }
+
+  do
+  {
+    std::string name = find_data.cFileName;
+    if (name == "." || name == "..")
+    {
+      continue;
+    }
+
+    std::string path = directory + "/" + name;
+    if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+    {
+      listFiles(path, files);
+    }
+    else
+    {
+      files->push_back(path);
+    }
+  } while (FindNextFile(find, &find_data));
+
+  FindClose(find);
+#else
+  DIR* dir = opendir(directory.c_str());
+  if (dir == nullptr)
+  {
+    return;
+  }
+
+  while (dirent* item = readdir(dir))
+  {
+    std::string name = item->d_name;
+    if (name == "." || name == "..")
+    {
+      continue;
+    }
+
+    std::string path = directory + "/" + name;
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+    {
+      continue;
+    }
+
+    if (S_ISDIR(info.st_mode))
+    {
+      listFiles(path, files);
+    }
+    else
+    {
+      files->push_back(path);
+    }
+  }
+
+  closedir(dir);
+#endif
+}
+
+static std::string normalizeName(std::string name)
+{
+  for (size_t i = 0; i < name.size(); i++)
+  {
+    if (name[i] == '\\')
+    {
+      name[i] = '/';
+    }
+  }
+
+  while (name.compare(0, 2, "./") == 0)
+  {
+    name.erase(0, 2);
+  }
+
+  return name;
+}
+
+// Block size table followed by the blocks
+static std::vector<uint8_t> compressEntry(const std::vector<uint8_t>& data, uint32_t* block_count)
+{
+  *block_count = (uint32_t) ((data.size() + kPackBlockSize - 1) / kPackBlockSize);
+
+  std::vector<uint8_t> output(*block_count * sizeof(uint32_t));
+  std::vector<uint8_t> block(Lz4::compressBound(kPackBlockSize));
+
+  for (uint32_t i = 0; i < *block_count; i++)
+  {
+    size_t begin = (size_t) i * kPackBlockSize;
+    size_t size = data.size() - begin < kPackBlockSize ? data.size() - begin : kPackBlockSize;
+
+    size_t compressed = Lz4::compress(data.data() + begin, size, block.data(), block.size());
+    uint32_t stored_size = (uint32_t) compressed;
+    const uint8_t* stored = block.data();
+
+    if (compressed == 0 || compressed >= size)
+    {
+      stored_size = (uint32_t) size | kPackBlockRaw;
+      stored = data.data() + begin;
+    }
+
+    memcpy(output.data() + i * sizeof(uint32_t), &stored_size, sizeof(stored_size));
+    output.insert(output.end(), stored, stored + (stored_size & ~kPackBlockRaw));
+  }
+
+  return output;
+}
+
+static uint64_t align(uint64_t offset)
+{
+  return (offset + kPackAlignment - 1) & ~((uint64_t) kPackAlignment - 1);
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 3)
+  {
+    fprintf(stderr, "usage: packer <output.pak> <directory>...\n");
+    return 1;
+  }
+
+  std::vector<std::string> paths;
+  for (int i = 2; i < argc; i++)
+  {
+    listFiles(argv[i], &paths);
+  }
+
+  std::vector<InputFile> inputs;
+  for (size_t i = 0; i < paths.size(); i++)
+  {
+    InputFile input;
+    input.name = normalizeName(paths[i]);
+
+    size_t length = input.name.size();
+    if (length > 4 && input.name.compare(length - 4, 4, ".pak") == 0)
+    {
+      continue;
+    }
+
+    if (!readFile(paths[i], &input.data))
+    {
+      fprintf(stderr, "Failed reading %s\n", paths[i].c_str());
+      return 1;
+    }
+
+    inputs.push_back(input);
+  }
+
+  if (inputs.empty())
+  {
+    fprintf(stderr, "Nothing to pack\n");
+    return 1;
+  }
+
+  // Half full at most, keeps probes short
+  uint32_t table_size = 1;
+  while (table_size < inputs.size() * 2)
+  {
+    table_size *= 2;
+  }
+
+  PackHeader header = {};
+  header.magic = kPackMagic;
+  header.version = kPackVersion;
+  header.entry_count = (uint32_t) inputs.size();
+  header.table_size = table_size;
+  header.table_offset = sizeof(PackHeader);
+  header.names_offset = header.table_offset + table_size * sizeof(PackEntry);
+
+  std::vector<PackEntry> table(table_size);
+  memset(table.data(), 0, table.size() * sizeof(PackEntry));
+
+  std::string names;
+  std::vector<std::vector<uint8_t> > payloads(inputs.size());
+  std::vector<PackEntry> entries(inputs.size());
+
+  for (size_t i = 0; i < inputs.size(); i++)
+  {
+    const InputFile& input = inputs[i];
+    PackEntry& entry = entries[i];
+    memset(&entry, 0, sizeof(entry));
+
+    entry.hash = packHash(input.name.c_str(), (uint32_t) input.name.size());
+    entry.size = input.data.size();
+    entry.name_offset = (uint32_t) names.size();
+    entry.name_length = (uint32_t) input.name.size();
+    names += input.name;
+
+    uint32_t block_count = 0;
+    std::vector<uint8_t> compressed = compressEntry(input.data, &block_count);
+    if (compressed.size() + compressed.size() / 7 < input.data.size())
+    {
+      entry.compression = kPackCompression_Lz4;
+      entry.block_count = block_count;
+      payloads[i].swap(compressed);
+    }
+    else
+    {
+      entry.compression = kPackCompression_None;
+      payloads[i] = input.data;
+    }
+    entry.stored_size = payloads[i].size();
+  }
+
+  header.names_size = names.size();
+
+  uint64_t offset = align(header.names_offset + header.names_size);
+  for (size_t i = 0; i < entries.size(); i++)
+  {
+    entries[i].offset = offset;
+    offset = align(offset + entries[i].stored_size);
+
+    uint32_t slot = (uint32_t) (entries[i].hash & (table_size - 1));
+    while (table[slot].hash != 0)
+    {
+      if (table[slot].name_length == entries[i].name_length &&
+          names.compare(table[slot].name_offset, table[slot].name_length, inputs[i].name) == 0)
+      {
+        fprintf(stderr, "Duplicated entry %s\n", inputs[i].name.c_str());
+        return 1;
+      }
+      slot = (slot + 1) & (table_size - 1);
+    }
+    table[slot] = entries[i];
+  }
+
+  FILE* file = fopen(argv[1], "wb");
+  if (file == nullptr)
+  {
+    fprintf(stderr, "Failed creating %s\n", argv[1]);
+    return 1;
+  }
+
+  std::vector<uint8_t> contents((size_t) offset, 0);
+  memcpy(contents.data(), &header, sizeof(header));
+  memcpy(contents.data() + header.table_offset, table.data(), table.size() * sizeof(PackEntry));
+  memcpy(contents.data() + header.names_offset, names.data(), names.size());
+
+  uint64_t original_size = 0;
+  for (size_t i = 0; i < entries.size(); i++)
+  {
+    if (!payloads[i].empty())
+    {
+      memcpy(contents.data() + entries[i].offset, payloads[i].data(), payloads[i].size());
+    }
+    original_size += entries[i].size;
+
+    printf("  %-32s %10llu -> %10llu %s\n", inputs[i].name.c_str(), (unsigned long long) entries[i].size,
+      (unsigned long long) entries[i].stored_size, entries[i].compression == kPackCompression_Lz4 ? "lz4" : "stored");
+  }
+
+  bool written = fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+  fclose(file);
+
+  if (!written)
+  {
+    fprintf(stderr, "Failed writing %s\n", argv[1]);
+    return 1;
+  }
+
+  printf("%s: %u entries, %llu bytes from %llu\n", argv[1], header.entry_count,
+    (unsigned long long) contents.size(), (unsigned long long) original_size);
+  return 0;
+}